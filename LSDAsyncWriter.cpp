@@ -0,0 +1,289 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// LSDAsyncWriter.cpp
+// Land Surface Dynamics AsyncWriter
+//
+// An object within the University
+//  of Edinburgh Land Surface Dynamics group topographic toolbox
+//  for writing rasters and csv files on background threads so that
+//  computation can carry on while the disk catches up.
+//
+// Developed by:
+//  Simon M. Mudd
+//  Martin D. Hurst
+//  David T. Milodowski
+//  Stuart W.D. Grieve
+//  Declan A. Valters
+//  Fiona Clubb
+//
+// Copyright (C) 2026 Simon M. Mudd 2026
+//
+// Developer can be contacted by simon.m.mudd _at_ ed.ac.uk
+//
+//    Simon Mudd
+//    University of Edinburgh
+//    School of GeoSciences
+//    Drummond Street
+//    Edinburgh, EH8 9XP
+//    Scotland
+//    United Kingdom
+//
+// This program is free software;
+// you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation;
+// either version 2 of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY;
+// without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU General Public License for more details.
+//
+// You should have received a copy of the
+// GNU General Public License along with this program;
+// if not, write to:
+// Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301
+// USA
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+#ifndef LSDAsyncWriter_CPP
+#define LSDAsyncWriter_CPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <list>
+#include "LSDRaster.hpp"
+#include "LSDIndexRaster.hpp"
+#include "LSDFlowInfo.hpp"
+#include "LSDJunctionNetwork.hpp"
+#include "LSDSpatialCSVReader.hpp"
+#include "LSDAsyncWriter.hpp"
+using namespace std;
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The jobs. Each holds everything it needs to write its output.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+class LSDRasterWriteJob : public LSDWriteJob
+{
+  public:
+    LSDRasterWriteJob(LSDRaster& R, string fname, string ext)
+      : Raster(R), Filename(fname), Extension(ext) {}
+    void write()   { Raster.write_raster(Filename, Extension); }
+
+  private:
+    LSDRaster Raster;
+    string Filename;
+    string Extension;
+};
+
+class LSDIndexRasterWriteJob : public LSDWriteJob
+{
+  public:
+    LSDIndexRasterWriteJob(LSDIndexRaster& R, string fname, string ext)
+      : Raster(R), Filename(fname), Extension(ext) {}
+    void write()   { Raster.write_raster(Filename, Extension); }
+
+  private:
+    LSDIndexRaster Raster;
+    string Filename;
+    string Extension;
+};
+
+class LSDChannelNetworkWriteJob : public LSDWriteJob
+{
+  public:
+    LSDChannelNetworkWriteJob(LSDJunctionNetwork& JN, LSDFlowInfo& FI, string prefix,
+                              bool geojson)
+      : JunctionNetwork(JN), FlowInfo(&FI), Prefix(prefix), ConvertToGeojson(geojson) {}
+    void write()
+    {
+      JunctionNetwork.PrintChannelNetworkToCSV(*FlowInfo, Prefix);
+      if (ConvertToGeojson)
+      {
+        LSDSpatialCSVReader thiscsv(Prefix+".csv");
+        thiscsv.print_data_to_geojson(Prefix+".geojson");
+      }
+    }
+
+  private:
+    LSDJunctionNetwork JunctionNetwork;
+    LSDFlowInfo* FlowInfo;
+    string Prefix;
+    bool ConvertToGeojson;
+};
+
+class LSDNodeIndicesWriteJob : public LSDWriteJob
+{
+  public:
+    LSDNodeIndicesWriteJob(LSDFlowInfo& FI, vector<int>& nodes, string csv_fname,
+                           string geojson_fname)
+      : FlowInfo(&FI), NodeIndices(nodes), CSVName(csv_fname), GeojsonName(geojson_fname) {}
+    void write()
+    {
+      FlowInfo->print_vector_of_nodeindices_to_csv_file_with_latlong(NodeIndices, CSVName);
+      if (GeojsonName != "NULL")
+      {
+        LSDSpatialCSVReader thiscsv(CSVName);
+        thiscsv.print_data_to_geojson(GeojsonName);
+      }
+    }
+
+  private:
+    LSDFlowInfo* FlowInfo;
+    vector<int> NodeIndices;
+    string CSVName;
+    string GeojsonName;
+};
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Starts the worker threads
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDAsyncWriter::create(int n_threads)
+{
+  NActive = 0;
+  ShuttingDown = false;
+  for (int i = 0; i<n_threads; i++)
+  {
+    Workers.push_back(thread(&LSDAsyncWriter::worker_loop, this));
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Writes everything that is left and joins the threads
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+LSDAsyncWriter::~LSDAsyncWriter()
+{
+  flush();
+  {
+    unique_lock<mutex> lock(QueueMutex);
+    ShuttingDown = true;
+  }
+  WorkAvailable.notify_all();
+  for (int i = 0; i<int(Workers.size()); i++)
+  {
+    Workers[i].join();
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Each worker takes jobs off the front of the queue until it is told to stop
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDAsyncWriter::worker_loop()
+{
+  while (true)
+  {
+    LSDWriteJob* Job;
+    {
+      unique_lock<mutex> lock(QueueMutex);
+      while (Pending.empty() && not ShuttingDown)
+      {
+        WorkAvailable.wait(lock);
+      }
+      if (Pending.empty())
+      {
+        return;
+      }
+      Job = Pending.front();
+      Pending.pop_front();
+      NActive++;
+    }
+
+    Job->write();
+
+    {
+      unique_lock<mutex> lock(QueueMutex);
+      Finished.push_back(Job);
+      NActive--;
+      if (Pending.empty() && NActive == 0)
+      {
+        AllDone.notify_all();
+      }
+    }
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Adds a job to the queue. With no workers the job is written straight away.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDAsyncWriter::enqueue(LSDWriteJob* Job)
+{
+  release_finished_jobs();
+  if (Workers.empty())
+  {
+    Job->write();
+    delete Job;
+    return;
+  }
+  {
+    unique_lock<mutex> lock(QueueMutex);
+    Pending.push_back(Job);
+  }
+  WorkAvailable.notify_one();
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Deletes the jobs that are done. The jobs are deleted here, on the owning
+// thread, because the TNT reference counts are not thread safe.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDAsyncWriter::release_finished_jobs()
+{
+  list<LSDWriteJob*> done;
+  {
+    unique_lock<mutex> lock(QueueMutex);
+    done.swap(Finished);
+  }
+  for (list<LSDWriteJob*>::iterator it = done.begin(); it != done.end(); ++it)
+  {
+    delete *it;
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Waits until the queue is empty and nothing is being written
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDAsyncWriter::flush()
+{
+  {
+    unique_lock<mutex> lock(QueueMutex);
+    while (not Pending.empty() || NActive > 0)
+    {
+      AllDone.wait(lock);
+    }
+  }
+  release_finished_jobs();
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The wrappers for the different kinds of output
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDAsyncWriter::write_raster(LSDRaster& Raster, string filename, string extension)
+{
+  enqueue(new LSDRasterWriteJob(Raster, filename, extension));
+}
+
+void LSDAsyncWriter::write_raster(LSDIndexRaster& Raster, string filename, string extension)
+{
+  enqueue(new LSDIndexRasterWriteJob(Raster, filename, extension));
+}
+
+void LSDAsyncWriter::write_channel_network_csv(LSDJunctionNetwork& JunctionNetwork,
+                                               LSDFlowInfo& FlowInfo, string fname_prefix,
+                                               bool convert_to_geojson)
+{
+  enqueue(new LSDChannelNetworkWriteJob(JunctionNetwork, FlowInfo, fname_prefix,
+                                        convert_to_geojson));
+}
+
+void LSDAsyncWriter::write_nodeindices_csv(LSDFlowInfo& FlowInfo, vector<int>& nodeindex_vec,
+                                           string csv_fname, string geojson_fname)
+{
+  enqueue(new LSDNodeIndicesWriteJob(FlowInfo, nodeindex_vec, csv_fname, geojson_fname));
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+#endif
@@ -0,0 +1,188 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// LSDAsyncWriter.hpp
+// Land Surface Dynamics AsyncWriter
+//
+// An object within the University
+//  of Edinburgh Land Surface Dynamics group topographic toolbox
+//  for writing rasters and csv files on background threads so that
+//  computation can carry on while the disk catches up.
+//
+// Developed by:
+//  Simon M. Mudd
+//  Martin D. Hurst
+//  David T. Milodowski
+//  Stuart W.D. Grieve
+//  Declan A. Valters
+//  Fiona Clubb
+//
+// Copyright (C) 2026 Simon M. Mudd 2026
+//
+// Developer can be contacted by simon.m.mudd _at_ ed.ac.uk
+//
+//    Simon Mudd
+//    University of Edinburgh
+//    School of GeoSciences
+//    Drummond Street
+//    Edinburgh, EH8 9XP
+//    Scotland
+//    United Kingdom
+//
+// This program is free software;
+// you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation;
+// either version 2 of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY;
+// without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU General Public License for more details.
+//
+// You should have received a copy of the
+// GNU General Public License along with this program;
+// if not, write to:
+// Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301
+// USA
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+/** @file LSDAsyncWriter.hpp
+
+@brief Write-behind output queue for rasters and csv files.
+@details The driver programs write many outputs in series. Handing them to an
+LSDAsyncWriter lets the next stage of the computation start while the output
+is being written by one or more worker threads.
+
+Jobs hold a copy of the raster (TNT arrays share their storage, so this does
+not duplicate the data) and are released on the calling thread, so the
+reference counts of the TNT arrays are never touched by two threads at once.
+The caller must not change a raster in place after it has been queued.
+Jobs that print channel networks or node lists keep a pointer to the
+LSDFlowInfo object, so flush() must be called before that object goes out of
+scope.
+
+*/
+
+#ifndef LSDAsyncWriter_H
+#define LSDAsyncWriter_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "LSDRaster.hpp"
+#include "LSDIndexRaster.hpp"
+#include "LSDFlowInfo.hpp"
+#include "LSDJunctionNetwork.hpp"
+using namespace std;
+
+///@brief A single output waiting to be written. Subclasses hold the data.
+class LSDWriteJob
+{
+  public:
+    virtual ~LSDWriteJob() {}
+
+    /// @brief Does the writing. Called on a worker thread.
+    virtual void write() = 0;
+};
+
+///@brief Object that owns a pool of writer threads and a queue of outputs.
+class LSDAsyncWriter
+{
+  public:
+    /// @brief Create a writer with a single worker thread. A single thread
+    /// writes the files in the order they were queued.
+    LSDAsyncWriter()                     { create(1); }
+
+    /// @brief Create a writer with a number of worker threads.
+    /// @param n_threads The number of worker threads. If this is 0 the
+    ///  outputs are written immediately on the calling thread.
+    LSDAsyncWriter(int n_threads)        { create(n_threads); }
+
+    /// @brief The destructor waits for all the outputs to be written.
+    ~LSDAsyncWriter();
+
+    /// @brief Queue a raster to be written.
+    /// @param Raster The raster. It must not be changed in place afterwards.
+    /// @param filename a string of the filename _without_ the extension.
+    /// @param extension a string of the extension _without_ the leading dot
+    void write_raster(LSDRaster& Raster, string filename, string extension);
+
+    /// @brief Queue an index raster to be written.
+    /// @param Raster The raster. It must not be changed in place afterwards.
+    /// @param filename a string of the filename _without_ the extension.
+    /// @param extension a string of the extension _without_ the leading dot
+    void write_raster(LSDIndexRaster& Raster, string filename, string extension);
+
+    /// @brief Queue a channel network to be printed with
+    /// LSDJunctionNetwork::PrintChannelNetworkToCSV, optionally followed
+    /// by a conversion of the csv to geojson.
+    /// @param JunctionNetwork The junction network. A copy is queued.
+    /// @param FlowInfo The flow info object. It must outlive the job.
+    /// @param fname_prefix The csv filename without the extension.
+    /// @param convert_to_geojson If true also writes fname_prefix.geojson
+    void write_channel_network_csv(LSDJunctionNetwork& JunctionNetwork, LSDFlowInfo& FlowInfo,
+                                   string fname_prefix, bool convert_to_geojson);
+
+    /// @brief Queue a vector of node indices to be printed with
+    /// LSDFlowInfo::print_vector_of_nodeindices_to_csv_file_with_latlong,
+    /// optionally followed by a conversion of the csv to geojson.
+    /// @param FlowInfo The flow info object. It must outlive the job.
+    /// @param nodeindex_vec The node indices. A copy is queued.
+    /// @param csv_fname The name of the csv file including extension.
+    /// @param geojson_fname The name of the geojson file. Use "NULL" to skip it.
+    void write_nodeindices_csv(LSDFlowInfo& FlowInfo, vector<int>& nodeindex_vec,
+                               string csv_fname, string geojson_fname);
+
+    /// @brief Queue any other job. The writer takes ownership of the pointer.
+    /// @param Job a job allocated with new
+    void enqueue(LSDWriteJob* Job);
+
+    /// @brief Blocks until every queued output has been written and releases
+    /// the finished jobs.
+    void flush();
+
+    /// @return The number of worker threads
+    int get_n_threads() const    { return int(Workers.size()); }
+
+  private:
+    /// @brief The loop run by each worker thread
+    void worker_loop();
+
+    /// @brief Deletes jobs that have been written. Only called on the thread
+    /// that owns the writer.
+    void release_finished_jobs();
+
+    /// The worker threads
+    vector<thread> Workers;
+
+    /// Jobs waiting to be written
+    list<LSDWriteJob*> Pending;
+
+    /// Jobs that have been written but not yet released
+    list<LSDWriteJob*> Finished;
+
+    /// The number of jobs being written right now
+    int NActive;
+
+    /// Set when the workers should exit
+    bool ShuttingDown;
+
+    /// Protects the lists and counters
+    mutex QueueMutex;
+
+    /// Wakes the workers when there is work
+    condition_variable WorkAvailable;
+
+    /// Wakes flush() when the queue is empty
+    condition_variable AllDone;
+
+    void create(int n_threads);
+};
+
+#endif
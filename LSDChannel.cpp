@@ -970,91 +970,186 @@ void LSDChannel::find_best_fit_m_over_n_with_segments(int n_movern, float d_move
 /// hillslope segments. Need to get the best fit m_over_n value first.
 /// Parameters: min_seg_length_for_channel_heads (length used for fitting segments to the chi-
 /// elevation profile, a value of 10 is suggested), A_0, m over n, FlowInfo.
-/// Return value: integer with the node index of the channel head location.
+/// Return value: integer with the node index of the channel head location, which is the
+/// first node of the best fit channel segment. If no segment combination has a positive
+/// test value (or the profile is too short to split) it returns NoDataValue; this used to
+/// be node 0, which is not a channel head. remove_nodes_with_upstream_nodes drops these.
 /// FC 25/09/2013
+///
+/// The regressions are done from running sums of x, y, x^2, y^2 and xy (and of the
+/// squared differences between neighbouring nodes for the Durbin-Watson statistic),
+/// so each combination of segments costs O(1) rather than copying the segments and
+/// fitting them from scratch. The sums are taken in double precision about the mean
+/// of the profile. Only the few combinations that come out within rounding of the
+/// best are fitted again with simple_linear_regression, so the same head is picked
+/// as when every combination was fitted that way.
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 int LSDChannel::calculate_channel_heads(int min_seg_length_for_channel_heads, float A_0,
                                             float m_over_n, LSDFlowInfo& FlowInfo)
 {
     float downslope_chi = 0;
     calculate_chi(downslope_chi, m_over_n, A_0, FlowInfo);
-    vector<float> channel_chi;
-    vector<float> hillslope_chi;
-    vector<float> channel_elev;
-    vector<float> hillslope_elev;
     int end_node = Chi.size();
-    float test_value;
-    float max_test_value = 0;
-    int start_node = 0;
-    int node_index = 0;
-    float elev_intersection = 0;
+    int node_index = NoDataValue;
 
-    vector<float>::iterator vec_iter_start;
-    vector<float>::iterator vec_iter_end;
+    if (end_node == 0)
+    {
+      return node_index;
+    }
 
-    // Looping through the combinations of hillslope and channel segment lengths
-    for (int hill_seg_length = min_seg_length_for_channel_heads; hill_seg_length <= end_node-min_seg_length_for_channel_heads; hill_seg_length++)
+    // centre the data to keep the running sums well conditioned
+    double x_mean = 0;
+    double y_mean = 0;
+    for (int i = 0; i < end_node; i++)
     {
-      int chan_seg_length = end_node - hill_seg_length;
-
-      // assigning the chi values of the hillslope segment
-      hillslope_chi.resize(hill_seg_length);
-      vec_iter_start = Chi.begin()+start_node;
-      vec_iter_end = vec_iter_start+hill_seg_length;
-      hillslope_chi.assign(vec_iter_start,vec_iter_end);
-
-      // assigning the elevation values of the hillslope segment
-      hillslope_elev.resize(hill_seg_length);
-      vec_iter_start = Elevation.begin()+start_node;
-      vec_iter_end = vec_iter_start+hill_seg_length;
-      hillslope_elev.assign(vec_iter_start,vec_iter_end);
-
-      // assigning the chi values of the channel segment
-      channel_chi.resize(chan_seg_length);
-      vec_iter_start = Chi.begin()+start_node+hill_seg_length;
-      vec_iter_end = vec_iter_start+chan_seg_length;
-      channel_chi.assign(vec_iter_start,vec_iter_end);
-
-      // assigning the elevation values of the channel segment
-      channel_elev.resize(chan_seg_length);
-      vec_iter_start = Elevation.begin()+start_node+hill_seg_length;
-      vec_iter_end = vec_iter_start+chan_seg_length;
-      channel_elev.assign(vec_iter_start,vec_iter_end);
-
-      // performing linear regression on the channel segment
-      vector<float> residuals_chan;
-      vector<float> results_chan = simple_linear_regression(channel_chi,channel_elev, residuals_chan);
+      x_mean += Chi[i];
+      y_mean += Elevation[i];
+    }
+    x_mean = x_mean/double(end_node);
+    y_mean = y_mean/double(end_node);
+
+    // running sums: element i holds the sum over nodes 0 to i-1. The difference
+    // sums hold the sum over neighbouring pairs (k-1,k) with k from 1 to i-1.
+    vector<double> Sx(end_node+1,0.0), Sy(end_node+1,0.0), Sxx(end_node+1,0.0);
+    vector<double> Syy(end_node+1,0.0), Sxy(end_node+1,0.0);
+    vector<double> Sdxdx(end_node+1,0.0), Sdydy(end_node+1,0.0), Sdxdy(end_node+1,0.0);
+    for (int i = 0; i < end_node; i++)
+    {
+      double x = Chi[i]-x_mean;
+      double y = Elevation[i]-y_mean;
+      Sx[i+1] = Sx[i]+x;
+      Sy[i+1] = Sy[i]+y;
+      Sxx[i+1] = Sxx[i]+x*x;
+      Syy[i+1] = Syy[i]+y*y;
+      Sxy[i+1] = Sxy[i]+x*y;
+      Sdxdx[i+1] = Sdxdx[i];
+      Sdydy[i+1] = Sdydy[i];
+      Sdxdy[i+1] = Sdxdy[i];
+      if (i > 0)
+      {
+        double dx = double(Chi[i])-double(Chi[i-1]);
+        double dy = double(Elevation[i])-double(Elevation[i-1]);
+        Sdxdx[i+1] += dx*dx;
+        Sdydy[i+1] += dy*dy;
+        Sdxdy[i+1] += dx*dy;
+      }
+    }
 
-      // performing linear regression on the hillslope segment
-      vector<float> residuals_hill;
-      vector<float> results_hill = simple_linear_regression(hillslope_chi, hillslope_elev, residuals_hill);
+    // Looping through the combinations of hillslope and channel segment lengths
+    int first_hill_seg_length = min_seg_length_for_channel_heads;
+    int last_hill_seg_length = end_node-min_seg_length_for_channel_heads;
+    vector<double> test_values;
+    double max_sum_test_value = 0;
+    bool found_test_value = false;
+    for (int hill_seg_length = first_hill_seg_length; hill_seg_length <= last_hill_seg_length; hill_seg_length++)
+    {
+      // the hillslope segment is nodes [0,hill_seg_length) and the channel
+      // segment is nodes [hill_seg_length,end_node)
+      double R2_chan, DW_chan, R2_hill, DW_hill;
+      segment_regression_from_sums(0, hill_seg_length, Sx, Sy, Sxx, Syy, Sxy,
+                                   Sdxdx, Sdydy, Sdxdy, R2_hill, DW_hill);
+      segment_regression_from_sums(hill_seg_length, end_node, Sx, Sy, Sxx, Syy, Sxy,
+                                   Sdxdx, Sdydy, Sdxdy, R2_chan, DW_chan);
 
       // calculating the test value
-      test_value = results_chan[2] - ((results_hill[3] - 2)/2);
-
-      // looping through test values to find the max test value
-
-      if (test_value > max_test_value)
+      double test_value = R2_chan - ((DW_hill - 2)/2);
+      test_values.push_back(test_value);
+      if (test_value > max_sum_test_value || found_test_value == false)
       {
-         max_test_value = test_value;
-         elev_intersection = channel_elev.front();
-         //chi_intersection = channel_chi.front();
+        max_sum_test_value = test_value;
+        found_test_value = true;
       }
-
     }
 
-    //Getting the node index of the channel heads
-    for (unsigned int i = 0; i < Elevation.size(); i++)
+    // The segment fits used to be done in single precision, so combinations
+    // that are within its rounding of the best are fitted again the original
+    // way and the first with the largest test value is kept, as before.
+    double tie_tolerance = 1e-3;
+    float max_test_value = 0;
+    for (int hill_seg_length = first_hill_seg_length; hill_seg_length <= last_hill_seg_length; hill_seg_length++)
     {
-      if (Elevation[i] == elev_intersection)
+      double this_sum_test_value = test_values[hill_seg_length-first_hill_seg_length];
+      if (this_sum_test_value < max_sum_test_value-tie_tolerance || this_sum_test_value < -tie_tolerance)
+      {
+        continue;
+      }
+
+      vector<float> hillslope_chi(Chi.begin(), Chi.begin()+hill_seg_length);
+      vector<float> hillslope_elev(Elevation.begin(), Elevation.begin()+hill_seg_length);
+      vector<float> channel_chi(Chi.begin()+hill_seg_length, Chi.end());
+      vector<float> channel_elev(Elevation.begin()+hill_seg_length, Elevation.end());
+
+      vector<float> residuals_chan;
+      vector<float> results_chan = simple_linear_regression(channel_chi,channel_elev, residuals_chan);
+      vector<float> residuals_hill;
+      vector<float> results_hill = simple_linear_regression(hillslope_chi, hillslope_elev, residuals_hill);
+      float test_value = results_chan[2] - ((results_hill[3] - 2)/2);
+
+      // the channel head is the first node of the channel segment
+      if (test_value > max_test_value)
       {
-        node_index =  NodeSequence[i];
+         max_test_value = test_value;
+         node_index = NodeSequence[hill_seg_length];
       }
     }
 
     return node_index;
 }
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This gets the R^2 and Durbin-Watson statistic of a least squares line through
+// nodes [start,end) of a profile from the running sums built in
+// calculate_channel_heads.
+// The residuals of the fit y = a + b x are e = y - a - b x, so their sum of
+// squares is Syy - Sxy^2/Sxx, and the difference between neighbouring residuals
+// is dy - b dx, so the Durbin-Watson numerator comes from the sums of dx^2,
+// dy^2 and dx dy.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDChannel::segment_regression_from_sums(int start, int end,
+                 vector<double>& Sx, vector<double>& Sy, vector<double>& Sxx,
+                 vector<double>& Syy, vector<double>& Sxy, vector<double>& Sdxdx,
+                 vector<double>& Sdydy, vector<double>& Sdxdy,
+                 double& R2, double& DW)
+{
+  double n = double(end-start);
+  double sum_x = Sx[end]-Sx[start];
+  double sum_y = Sy[end]-Sy[start];
+
+  // sums about the segment mean
+  double SS_xx = (Sxx[end]-Sxx[start]) - sum_x*sum_x/n;
+  double SS_yy = (Syy[end]-Syy[start]) - sum_y*sum_y/n;
+  double SS_xy = (Sxy[end]-Sxy[start]) - sum_x*sum_y/n;
+
+  double slope = 0;
+  double SS_err = SS_yy;
+  if (SS_xx > 0)
+  {
+    slope = SS_xy/SS_xx;
+    SS_err = SS_yy - slope*SS_xy;
+  }
+  if (SS_err < 0)
+  {
+    SS_err = 0;
+  }
+
+  R2 = 1 - SS_err/SS_yy;
+
+  // the neighbouring pairs inside the segment are (k-1,k) for k from start+1 to end-1
+  double top_term = (Sdydy[end]-Sdydy[start+1])
+                    - 2*slope*(Sdxdy[end]-Sdxdy[start+1])
+                    + slope*slope*(Sdxdx[end]-Sdxdx[start+1]);
+  if (top_term < 0)
+  {
+    top_term = 0;
+  }
+  double bottom_term = SS_err;
+  if(bottom_term == 0)
+  {
+    bottom_term = 1e-10;
+  }
+  DW = top_term/bottom_term;
+}
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // This function writes a channel to a CSV file
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
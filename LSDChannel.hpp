@@ -325,11 +325,28 @@ class LSDChannel: public LSDIndexChannel
   /// @param A_0
   /// @param m_over_n
   /// @param FlowInfo
+  /// @return The node index of the channel head, or NoDataValue if no
+  /// combination of segments fits (node 0 was returned before).
   /// @author FC
   /// @date 25/09/13
   int calculate_channel_heads(int min_seg_length_for_channel_heads, float A_0, 
                                             float m_over_n, LSDFlowInfo& FlowInfo);
 
+  /// @brief This gets the R^2 and Durbin-Watson statistic of a least squares
+  /// line through part of a profile from running sums, for calculate_channel_heads.
+  /// @param start the first node of the segment
+  /// @param end one past the last node of the segment
+  /// @param Sx,Sy,Sxx,Syy,Sxy running sums of x, y, x^2, y^2 and xy
+  /// @param Sdxdx,Sdydy,Sdxdy running sums of the squared and cross differences
+  /// between neighbouring nodes
+  /// @param R2 returned with the R^2 of the fit
+  /// @param DW returned with the Durbin-Watson statistic of the residuals
+  void segment_regression_from_sums(int start, int end,
+                 vector<double>& Sx, vector<double>& Sy, vector<double>& Sxx,
+                 vector<double>& Syy, vector<double>& Sxy, vector<double>& Sdxdx,
+                 vector<double>& Sdydy, vector<double>& Sdxdy,
+                 double& R2, double& DW);
+
   /// @brief This function writes the channel to a csv file
   /// @param filename the filename of the channel (whithout the .csv)
   /// @author SMM
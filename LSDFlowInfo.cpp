@@ -87,8 +87,13 @@
 #include <list>
 #include <string>
 #include <cstring>
+#include <cctype>
 #include <algorithm>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include "TNT/tnt.h"
 #include "LSDFlowInfo.hpp"
 #include "LSDIndexRaster.hpp"
@@ -128,6 +133,39 @@ void LSDFlowInfo::create(string fname)
   unpickle(fname);
 }
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Create function that reuses a flow info cache. If cache_filename.FIcache
+// was made from the same DEM and boundary conditions it is loaded, otherwise
+// the flow routing is calculated and the cache is (re)written.
+// If cache_filename is "NULL" no cache is used.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDFlowInfo::create(vector<string>& temp_BoundaryConditions,
+                         LSDRaster& TopoRaster, string cache_filename)
+{
+  if (cache_filename == "NULL")
+  {
+    create(temp_BoundaryConditions, TopoRaster);
+    return;
+  }
+
+  // the flow is routed over TopoRaster as it is, so there are no fill parameters
+  vector<float> NoFillParameters;
+  unsigned long long InputHash = hash_flow_info_inputs(temp_BoundaryConditions, TopoRaster,
+                                                       NoFillParameters);
+  LSDRaster CachedTopography;
+  if (load_cached_flow_info(cache_filename, InputHash, CachedTopography))
+  {
+    cout << "Loaded the flow info from the cache " << cache_filename << ".FIcache" << endl;
+  }
+  else
+  {
+    create(temp_BoundaryConditions, TopoRaster);
+    cache_flow_info(cache_filename, InputHash, TopoRaster);
+  }
+}
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // This defaults to no flux boundary conditions
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -186,14 +224,8 @@ void LSDFlowInfo::create(vector<string>& temp_BoundaryConditions,
 
   // Declare matrices for calculating flow routing
   float one_ov_root2 = 0.707106781;
-  float target_elev;        // a placeholder for the elevation of the potential receiver
-  float slope;
-  float max_slope;        // the maximum slope away from a node
-  int max_slope_index;      // index into the maximum slope
 
   int row, col;            // index for the rows and column
-  int receive_row,receive_col;
-  string::iterator string_iterator;  // used to get characters from string
 
   // we need logic for all of the boundaries.
   // there are 3 kinds of edge boundaries:
@@ -214,12 +246,8 @@ void LSDFlowInfo::create(vector<string>& temp_BoundaryConditions,
   // row NRows-1 is the SOUTH boundary
   // column 0 is the WEST boundary
   // column NCols-1 is the EAST boundary
-  vector<float> slopes(8,NoDataValue);
-  vector<int> row_kernal(8);
-  vector<int> col_kernal(8);
   int ndv = NoDataValue;
   NDataNodes = 0;       // the number of nodes in the raster that have data
-  int one_if_a_baselevel_node;  // this is a switch used to tag baseleve nodes
 
   // the first thing you need to do is construct a topoglogy matrix
   // the donor, receiver, etc lists are as long as the number of nodes.
@@ -271,256 +299,272 @@ void LSDFlowInfo::create(vector<string>& temp_BoundaryConditions,
   NDonorsVector = ndn_vec;
   DonorStackVector = ndn_vec;
   DeltaVector = ndn_plusone_vec;
+  ReceiverVector = ndn_vec;
 
   SVector = ndn_nodata_vec;
   BLBasinVector = ndn_nodata_vec;
 
-  // this vector starts out empty and then base level nodes are added to it
-  for (row = 0; row<NRows; row++)
+  // check for periodic boundary conditions. A periodic boundary needs
+  // the opposite boundary to be periodic as well
+  if (NDataNodes > 0)
     {
-      for (col = 0; col<NCols; col++)
+      if( BoundaryConditions[0].find("P") == 0 || BoundaryConditions[0].find("p") == 0 )
   {
-    // only do calcualtions if there is data
-    if(TopoRaster.RasterData[row][col] != NoDataValue)
+    if( BoundaryConditions[2].find("P") != 0 && BoundaryConditions[2].find("p") != 0 )
       {
-        // calcualte 8 slopes
-        // no slopes mean get NoDataValue entries
-        // the algorithm loops through the neighbors to the cells, collecting
-        // receiver indices. The order is
-        // 7 0 1
-        // 6 - 2
-        // 5 4 3
-        // where the above directions are cardinal directions
-        // do slope 0
-        row_kernal[0] = row-1;
-        row_kernal[1] = row-1;
-        row_kernal[2] = row;
-        row_kernal[3] = row+1;
-        row_kernal[4] = row+1;
-        row_kernal[5] = row+1;
-        row_kernal[6] = row;
-        row_kernal[7] = row-1;
-
-        col_kernal[0] = col;
-        col_kernal[1] = col+1;
-        col_kernal[2] = col+1;
-        col_kernal[3] = col+1;
-        col_kernal[4] = col;
-        col_kernal[5] = col-1;
-        col_kernal[6] = col-1;
-        col_kernal[7] = col-1;
-
-        // check for periodic boundary conditions
-        if( BoundaryConditions[0].find("P") == 0 || BoundaryConditions[0].find("p") == 0 )
-    {
-      if( BoundaryConditions[2].find("P") != 0 && BoundaryConditions[2].find("p") != 0 )
-        {
-          cout << "WARNING!!! North boundary is periodic! Changing South boundary to periodic" << endl;
-          BoundaryConditions[2] = "P";
-        }
+        cout << "WARNING!!! North boundary is periodic! Changing South boundary to periodic" << endl;
+        BoundaryConditions[2] = "P";
+      }
+  }
+      if( BoundaryConditions[1].find("P") == 0 || BoundaryConditions[1].find("p") == 0 )
+  {
+    if( BoundaryConditions[3].find("P") != 0 && BoundaryConditions[3].find("p") != 0 )
+      {
+        cout << "WARNING!!! East boundary is periodic! Changing West boundary to periodic" << endl;
+        BoundaryConditions[3] = "P";
+      }
+  }
+      if( BoundaryConditions[2].find("P") == 0 || BoundaryConditions[2].find("p") == 0 )
+  {
+    if( BoundaryConditions[0].find("P") != 0 && BoundaryConditions[0].find("p") != 0 )
+      {
+        cout << "WARNING!!! South boundary is periodic! Changing North boundary to periodic" << endl;
+        BoundaryConditions[0] = "P";
+      }
+  }
+      if( BoundaryConditions[3].find("P") == 0 || BoundaryConditions[3].find("p") == 0 )
+  {
+    if( BoundaryConditions[1].find("P") != 0 && BoundaryConditions[1].find("p") != 0 )
+      {
+        cout << "WARNING!!! West boundary is periodic! Changing East boundary to periodic" << endl;
+        BoundaryConditions[1] = "P";
+      }
+  }
     }
-        if( BoundaryConditions[1].find("P") == 0 || BoundaryConditions[1].find("p") == 0 )
+
+  // the boundary conditions are read once here rather than for every node.
+  // The order is North, East, South, West
+  vector<int> is_base_level_boundary(4,0);
+  vector<int> is_periodic_boundary(4,0);
+  for (int bc = 0; bc<4; bc++)
     {
-      if( BoundaryConditions[3].find("P") != 0 && BoundaryConditions[3].find("p") != 0 )
-        {
-          cout << "WARNING!!! East boundary is periodic! Changing West boundary to periodic" << endl;
-          BoundaryConditions[3] = "P";
-        }
+      if( BoundaryConditions[bc].find("B") == 0 || BoundaryConditions[bc].find("b") == 0 )
+  {
+    is_base_level_boundary[bc] = 1;
+  }
+      if( BoundaryConditions[bc].find("P") == 0 || BoundaryConditions[bc].find("p") == 0 )
+  {
+    is_periodic_boundary[bc] = 1;
+  }
     }
-        if( BoundaryConditions[2].find("P") == 0 || BoundaryConditions[2].find("p") == 0 )
+
+  // Now calculate the receiver of each node. Each row is independent, so the
+  // rows are shared between threads. Every node writes only its own entries
+  // in ReceiverVector, FlowDirection and FlowLengthCode, so the result does
+  // not depend on the number of threads.
+  #pragma omp parallel for schedule(dynamic,16)
+  for (int this_row = 0; this_row<NRows; this_row++)
     {
-      if( BoundaryConditions[0].find("P") != 0 && BoundaryConditions[0].find("p") != 0 )
-        {
-          cout << "WARNING!!! South boundary is periodic! Changing North boundary to periodic" << endl;
-          BoundaryConditions[0] = "P";
-        }
+      int row_kernal[8];
+      int col_kernal[8];
+      float target_elev;      // a placeholder for the elevation of the potential receiver
+      float slope;
+      float max_slope;        // the maximum slope away from a node
+      int max_slope_index;    // index into the maximum slope
+      int receive_row,receive_col;
+      int one_if_a_baselevel_node;  // this is a switch used to tag baseleve nodes
+      int this_node;
+
+      for (int this_col = 0; this_col<NCols; this_col++)
+  {
+    // only do calcualtions if there is data
+    if(TopoRaster.RasterData[this_row][this_col] == NoDataValue)
+      {
+        continue;
+      }
+    this_node = NodeIndex[this_row][this_col];
+
+    // the algorithm loops through the neighbors to the cells, collecting
+    // receiver indices. The order is
+    // 7 0 1
+    // 6 - 2
+    // 5 4 3
+    // where the above directions are cardinal directions
+    row_kernal[0] = this_row-1;
+    row_kernal[1] = this_row-1;
+    row_kernal[2] = this_row;
+    row_kernal[3] = this_row+1;
+    row_kernal[4] = this_row+1;
+    row_kernal[5] = this_row+1;
+    row_kernal[6] = this_row;
+    row_kernal[7] = this_row-1;
+
+    col_kernal[0] = this_col;
+    col_kernal[1] = this_col+1;
+    col_kernal[2] = this_col+1;
+    col_kernal[3] = this_col+1;
+    col_kernal[4] = this_col;
+    col_kernal[5] = this_col-1;
+    col_kernal[6] = this_col-1;
+    col_kernal[7] = this_col-1;
+
+    // reset baselevel switch for boundaries
+    one_if_a_baselevel_node = 0;
+
+    // NORTH BOUNDARY
+    if (this_row == 0)
+      {
+        if (is_base_level_boundary[0] == 1)
+    {
+      one_if_a_baselevel_node = 1;
     }
-        if( BoundaryConditions[3].find("P") == 0 || BoundaryConditions[3].find("p") == 0 )
+        else if (is_periodic_boundary[0] == 1)
     {
-      if( BoundaryConditions[1].find("P") != 0 && BoundaryConditions[1].find("p") != 0 )
-        {
-          cout << "WARNING!!! West boundary is periodic! Changing East boundary to periodic" << endl;
-          BoundaryConditions[1] = "P";
-        }
+      // if periodic, reflect across to south boundary
+      row_kernal[0] = NRows-1;
+      row_kernal[1] = NRows-1;
+      row_kernal[7] = NRows-1;
     }
-
-        // reset baselevel switch for boundaries
-        one_if_a_baselevel_node = 0;
-
-        // NORTH BOUNDARY
-        if (row == 0)
+        else
     {
-      if( BoundaryConditions[0].find("B") == 0 || BoundaryConditions[0].find("b") == 0 )
-        {
-          one_if_a_baselevel_node = 1;
-        }
-      else
-        {
-          // if periodic, reflect across to south boundary
-          if( BoundaryConditions[0].find("P") == 0 || BoundaryConditions[0].find("p") == 0 )
-      {
-        row_kernal[0] = NRows-1;
-        row_kernal[1] = NRows-1;
-        row_kernal[7] = NRows-1;
+      row_kernal[0] = ndv;
+      row_kernal[1] = ndv;
+      row_kernal[7] = ndv;
+    }
       }
-          else
+    // EAST BOUNDAY
+    if (this_col == NCols-1)
       {
-        row_kernal[0] = ndv;
-        row_kernal[1] = ndv;
-        row_kernal[7] = ndv;
-      }
-        }
+        if (is_base_level_boundary[1] == 1)
+    {
+      one_if_a_baselevel_node = 1;
     }
-        // EAST BOUNDAY
-        if (col == NCols-1)
+        else if (is_periodic_boundary[1] == 1)
     {
-      if( BoundaryConditions[1].find("B") == 0 || BoundaryConditions[1].find("b") == 0 )
-        {
-          one_if_a_baselevel_node = 1;
-        }
-      else
-        {
-          if( BoundaryConditions[1].find("P") == 0 || BoundaryConditions[1].find("p") == 0)
-      {
-        col_kernal[1] = 0;
-        col_kernal[2] = 0;
-        col_kernal[3] = 0;
-      }
-          else
-      {
-        col_kernal[1] = ndv;
-        col_kernal[2] = ndv;
-        col_kernal[3] = ndv;
-      }
-        }
+      col_kernal[1] = 0;
+      col_kernal[2] = 0;
+      col_kernal[3] = 0;
     }
-        // SOUTH BOUNDARY
-        if (row == NRows-1)
+        else
     {
-      if( BoundaryConditions[2].find("B") == 0 || BoundaryConditions[2].find("b") == 0 )
-        {
-          one_if_a_baselevel_node = 1;
-        }
-      else
-        {
-          if( BoundaryConditions[2].find("P") == 0 || BoundaryConditions[2].find("p") == 0)
-      {
-        row_kernal[3] = 0;
-        row_kernal[4] = 0;
-        row_kernal[5] = 0;
+      col_kernal[1] = ndv;
+      col_kernal[2] = ndv;
+      col_kernal[3] = ndv;
+    }
       }
-          else
+    // SOUTH BOUNDARY
+    if (this_row == NRows-1)
       {
-        row_kernal[3] = ndv;
-        row_kernal[4] = ndv;
-        row_kernal[5] = ndv;
-      }
-        }
+        if (is_base_level_boundary[2] == 1)
+    {
+      one_if_a_baselevel_node = 1;
     }
-        // WEST BOUNDARY
-        if (col == 0)
+        else if (is_periodic_boundary[2] == 1)
     {
-      if( BoundaryConditions[3].find("B") == 0 || BoundaryConditions[3].find("b") == 0 )
-        {
-          one_if_a_baselevel_node = 1;
-        }
-      else
-        {
-          if( BoundaryConditions[3].find("P") == 0 || BoundaryConditions[3].find("p") == 0)
-      {
-        col_kernal[5] = NCols-1;
-        col_kernal[6] = NCols-1;
-        col_kernal[7] = NCols-1;
+      row_kernal[3] = 0;
+      row_kernal[4] = 0;
+      row_kernal[5] = 0;
+    }
+        else
+    {
+      row_kernal[3] = ndv;
+      row_kernal[4] = ndv;
+      row_kernal[5] = ndv;
+    }
       }
-          else
+    // WEST BOUNDARY
+    if (this_col == 0)
       {
-        col_kernal[5] = ndv;
-        col_kernal[6] = ndv;
-        col_kernal[7] = ndv;
-      }
-        }
+        if (is_base_level_boundary[3] == 1)
+    {
+      one_if_a_baselevel_node = 1;
     }
-
-        // now loop through the surrounding nodes, calculating the slopes
-        // slopes with NoData get NoData slopes
-        // reminder of ordering:
-        // 7 0 1
-        // 6 - 2
-        // 5 4 3
-        // first logic for baselevel node
-        if (one_if_a_baselevel_node == 1)
+        else if (is_periodic_boundary[3] == 1)
     {
-      // get reciever index
-      FlowDirection[row][col] = -1;
-      ReceiverVector.push_back(NodeIndex[row][col]);
-      FlowLengthCode[row][col] = 0;
+      col_kernal[5] = NCols-1;
+      col_kernal[6] = NCols-1;
+      col_kernal[7] = NCols-1;
     }
-        // now the rest of the nodes
         else
     {
-      FlowLengthCode[row][col] = 0;    // set flow length code to 0, this gets reset
-      // if there is a maximum slope
-      max_slope = 0;
-      max_slope_index = -1;
-      receive_row = row;
-      receive_col = col;
-      for (int slope_iter = 0; slope_iter<8; slope_iter++)
-        {
-          if (row_kernal[slope_iter] == ndv || col_kernal[slope_iter] == ndv)
+      col_kernal[5] = ndv;
+      col_kernal[6] = ndv;
+      col_kernal[7] = ndv;
+    }
+      }
+
+    // now loop through the surrounding nodes, calculating the slopes
+    // slopes with NoData get NoData slopes
+    // first logic for baselevel node
+    if (one_if_a_baselevel_node == 1)
       {
-        slopes[slope_iter] = NoDataValue;
+        // get reciever index
+        FlowDirection[this_row][this_col] = -1;
+        ReceiverVector[this_node] = this_node;
+        FlowLengthCode[this_row][this_col] = 0;
       }
-          else
+    // now the rest of the nodes
+    else
       {
-        target_elev = TopoRaster.RasterData[ row_kernal[slope_iter] ][ col_kernal[slope_iter] ];
-        if(target_elev == NoDataValue)
-          {
-            slopes[slope_iter] = NoDataValue;
-          }
-        else
-          {
-            if(slope_iter%2 == 0)
+        FlowLengthCode[this_row][this_col] = 0;    // set flow length code to 0, this gets reset
+        // if there is a maximum slope
+        max_slope = 0;
+        max_slope_index = -1;
+        receive_row = this_row;
+        receive_col = this_col;
+        for (int slope_iter = 0; slope_iter<8; slope_iter++)
+    {
+      if (row_kernal[slope_iter] == ndv || col_kernal[slope_iter] == ndv)
+        {
+          continue;
+        }
+      target_elev = TopoRaster.RasterData[ row_kernal[slope_iter] ][ col_kernal[slope_iter] ];
+      if(target_elev == NoDataValue)
         {
-          //cout << "LINE 988, cardinal direction, slope iter = " << slope_iter << endl;
-          slope = TopoRaster.RasterData[row][col]-target_elev;
+          continue;
         }
-            else
+      if(slope_iter%2 == 0)
         {
-          slope = one_ov_root2*(TopoRaster.RasterData[row][col]-target_elev);
+          slope = TopoRaster.RasterData[this_row][this_col]-target_elev;
+        }
+      else
+        {
+          slope = one_ov_root2*(TopoRaster.RasterData[this_row][this_col]-target_elev);
         }
 
-            if (slope > max_slope)
+      if (slope > max_slope)
         {
           max_slope_index = slope_iter;
           receive_row = row_kernal[slope_iter];
           receive_col = col_kernal[slope_iter];
           max_slope = slope;
           if(slope_iter%2 == 0)
-            {
-              FlowLengthCode[row][col] = 1;
-            }
+      {
+        FlowLengthCode[this_row][this_col] = 1;
+      }
           else
-            {
-              FlowLengthCode[row][col] = 2;
-            }
-        }
-          }
+      {
+        FlowLengthCode[this_row][this_col] = 2;
       }
         }
-      // get reciever index
-      FlowDirection[row][col] = max_slope_index;
-      ReceiverVector.push_back(NodeIndex[receive_row][receive_col]);
-    }    // end if baselevel boundary  conditional
-
-        // if the node is a base level node, add it to the base level node list
-        if (FlowLengthCode[row][col] == 0)
-    {
-      BaseLevelNodeList.push_back(NodeIndex[row][col]);
     }
-      }      // end if there is data conditional
+        // get reciever index
+        FlowDirection[this_row][this_col] = max_slope_index;
+        ReceiverVector[this_node] = NodeIndex[receive_row][receive_col];
+      }    // end if baselevel boundary  conditional
   }        // end col loop
     }          // end row loop
 
+  // if the node is a base level node, add it to the base level node list.
+  // This is done in node order so the list matches the serial version
+  for (int i = 0; i<NDataNodes; i++)
+    {
+      if (FlowLengthCode[ RowIndex[i] ][ ColIndex[i] ] == 0)
+  {
+    BaseLevelNodeList.push_back(i);
+  }
+    }
+
 
 
   // first create the number of donors vector
@@ -1119,40 +1163,41 @@ float LSDFlowInfo::get_DrainageArea_square_km(int this_node)
 }
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-// recursive add_to_stack routine, from Braun and Willett eq. 12 and 13
+// add_to_stack routine, from Braun and Willett eq. 12 and 13
+//
+// This adds lm_index and everything upstream of it to the stack in the
+// same depth first order as the original recursive version, but uses an
+// explicit stack of nodes so long flow paths cannot overflow the call stack.
+// Donors are pushed in reverse so they come off the stack in the order they
+// appear in the DonorStackVector.
 //
 // SMM 01/06/2012
 //
-//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void LSDFlowInfo::add_to_stack(int lm_index, int& j_index, int bl_node)
 {
-  //cout << "j_index: " << j_index << " and s_vec: " << lm_index << endl;
+  vector<int> node_stack;
+  node_stack.push_back(lm_index);
 
-  SVector[j_index] = lm_index;
-  BLBasinVector[j_index] = bl_node;
-  j_index++;
+  int this_node;
+  while (!node_stack.empty())
+  {
+    this_node = node_stack.back();
+    node_stack.pop_back();
 
+    SVector[j_index] = this_node;
+    BLBasinVector[j_index] = bl_node;
+    j_index++;
 
-  int begin_m,end_m;
-  int l_index;
-  // if donating to itself, need escape hatch
-  if ( lm_index == bl_node)
-    {
-      begin_m = 0;
-      end_m = 0;
-    }
-  else
-    {
-      begin_m = DeltaVector[lm_index];
-      end_m =  DeltaVector[ lm_index+1];
-    }
-  //cout << "lm_index: " << lm_index << " begin_m: " << begin_m << " end m: " << end_m << endl;
-  for( int m_index = begin_m; m_index<end_m; m_index++)
+    // if donating to itself, need escape hatch
+    if (this_node != bl_node)
     {
-      //cout << "recursion, begin_m: " << begin_m << " and end_m: " << end_m << endl;
-      l_index = DonorStackVector[m_index];
-      add_to_stack(l_index, j_index, bl_node);
+      for (int m_index = DeltaVector[this_node+1]-1; m_index>=DeltaVector[this_node]; m_index--)
+      {
+        node_stack.push_back(DonorStackVector[m_index]);
+      }
     }
+  }
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -1471,6 +1516,401 @@ void LSDFlowInfo::unpickle(string filename)
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// FLOW INFO CACHE
+//
+// A single binary file, filename.FIcache, laid out as:
+//   a fixed size header (FlowInfoCacheHeader, no padding)
+//   block 0:  boundary conditions then georeferencing keys and values, each as
+//             an int length followed by the characters
+//   block 1-3:  NodeIndex, FlowDirection, FlowLengthCode (NRows*NCols ints)
+//   block 4-14: RowIndex, ColIndex, BaseLevelNodeList, NDonorsVector,
+//             ReceiverVector, DeltaVector, DonorStackVector, SVector,
+//             BLBasinVector, SVectorIndex, NContributingNodes (ints)
+//   block 15: the filled DEM the flow was routed over (NRows*NCols floats)
+// Every block starts on a 64 byte boundary at the offset given in the header,
+// and the cache is loaded by memory mapping the file. Data is in the byte order
+// of the machine that wrote it. The header holds a hash of the inputs (the
+// unfilled DEM, how it was filled and the boundary conditions), so a matching
+// cache replaces both the fill and the flow routing, and a checksum of all
+// the blocks.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+/// @brief The version of the flow info cache format. Increment this whenever
+/// the layout or the meaning of anything in the cache changes.
+const int FlowInfoCacheVersion = 2;
+
+/// @brief The number of data blocks in the flow info cache.
+const int NFlowInfoCacheBlocks = 16;
+
+/// @brief The header of the flow info cache. The fields are ordered so the
+/// struct has no padding.
+struct FlowInfoCacheHeader
+{
+  /// @brief Always "LSDFLOWI".
+  char Magic[8];
+  /// @brief Hash of the DEM, fill and boundary conditions, see hash_flow_info_inputs.
+  unsigned long long InputHash;
+  /// @brief Hash of the contents of all the blocks.
+  unsigned long long DataChecksum;
+  /// @brief Offset of each block from the start of the file, in bytes.
+  long long BlockOffset[NFlowInfoCacheBlocks];
+  /// @brief The cache format version.
+  int Version;
+  /// @brief The byte order of the data (0 = little endian, 1 = big endian).
+  int ByteOrder;
+  int NRows;
+  int NCols;
+  int NoDataValue;
+  int NDataNodes;
+  int NBaseLevelNodes;
+  int NContributingNodes;
+  /// @brief The number of bytes in block 0.
+  int NTextBytes;
+  /// @brief The number of boundary conditions in block 0.
+  int NBoundaryConditions;
+  /// @brief The number of georeferencing key/value pairs in block 0.
+  int NGeoReferencingStrings;
+  float XMinimum;
+  float YMinimum;
+  float DataResolution;
+};
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This hashes everything the flow info depends on: the georeferencing and data of
+// the DEM, the parameters of the fill applied to it (empty if the flow is routed
+// over the DEM as it is) and the first letter of each boundary condition (which
+// is all that is used to set the boundaries). Hashing the DEM before it is
+// filled lets a cache hit skip the fill as well as the routing.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+unsigned long long LSDFlowInfo::hash_flow_info_inputs(vector<string>& temp_BoundaryConditions,
+                                                      LSDRaster& TopoRaster,
+                                                      vector<float>& FillParameters)
+{
+  int this_NRows = TopoRaster.get_NRows();
+  int this_NCols = TopoRaster.get_NCols();
+  float georef[4];
+  georef[0] = TopoRaster.get_XMinimum();
+  georef[1] = TopoRaster.get_YMinimum();
+  georef[2] = TopoRaster.get_DataResolution();
+  georef[3] = TopoRaster.get_NoDataValue();
+
+  unsigned long long hash = hash_bytes(reinterpret_cast<char*>(&this_NRows),sizeof(int));
+  hash = hash_bytes(reinterpret_cast<char*>(&this_NCols),sizeof(int),hash);
+  hash = hash_bytes(reinterpret_cast<char*>(georef),sizeof(georef),hash);
+  if (this_NRows > 0 && this_NCols > 0)
+  {
+    hash = hash_bytes(reinterpret_cast<char*>(&TopoRaster.RasterData[0][0]),
+                      long(this_NRows)*long(this_NCols)*long(sizeof(float)),hash);
+  }
+  int NFillParameters = FillParameters.size();
+  hash = hash_bytes(reinterpret_cast<char*>(&NFillParameters),sizeof(int),hash);
+  if (NFillParameters > 0)
+  {
+    hash = hash_bytes(reinterpret_cast<char*>(&FillParameters[0]),
+                      long(NFillParameters)*long(sizeof(float)),hash);
+  }
+  int NBCs = temp_BoundaryConditions.size();
+  hash = hash_bytes(reinterpret_cast<char*>(&NBCs),sizeof(int),hash);
+  for (int i = 0; i< NBCs; i++)
+  {
+    char bc = temp_BoundaryConditions[i].empty() ? ' ' :
+                toupper(temp_BoundaryConditions[i][0]);
+    hash = hash_bytes(&bc,1,hash);
+  }
+  return hash;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This writes the flow info cache, along with the filled DEM the flow info was
+// made from. See the description of the format above.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDFlowInfo::cache_flow_info(string filename, unsigned long long InputHash,
+                                  LSDRaster& FilledTopography)
+{
+  string data_fname = filename+".FIcache";
+  if (FilledTopography.get_NRows() != NRows || FilledTopography.get_NCols() != NCols)
+  {
+    cout << "Warning, the filled DEM doesn't match the flow info, so the flow info "
+         << "cache " << data_fname << " was not written" << endl;
+    return;
+  }
+
+  // pack the strings into block 0
+  string text_block;
+  vector<string> text_items;
+  for (int i = 0; i< int(BoundaryConditions.size()); i++)
+  {
+    text_items.push_back(BoundaryConditions[i]);
+  }
+  for (map<string,string>::iterator it = GeoReferencingStrings.begin();
+       it != GeoReferencingStrings.end(); ++it)
+  {
+    text_items.push_back(it->first);
+    text_items.push_back(it->second);
+  }
+  int n_items = text_items.size();
+  for (int i = 0; i<n_items; i++)
+  {
+    int item_length = text_items[i].size();
+    text_block.append(reinterpret_cast<char*>(&item_length),sizeof(int));
+    text_block.append(text_items[i]);
+  }
+
+  // the data blocks, in order
+  long NCells = long(NRows)*long(NCols);
+  const char* block_data[NFlowInfoCacheBlocks];
+  long block_bytes[NFlowInfoCacheBlocks];
+  block_data[0] = text_block.data();
+  block_bytes[0] = text_block.size();
+  block_data[1] = (NCells > 0) ? reinterpret_cast<char*>(&NodeIndex[0][0]) : NULL;
+  block_data[2] = (NCells > 0) ? reinterpret_cast<char*>(&FlowDirection[0][0]) : NULL;
+  block_data[3] = (NCells > 0) ? reinterpret_cast<char*>(&FlowLengthCode[0][0]) : NULL;
+  for (int b = 1; b<=3; b++)
+  {
+    block_bytes[b] = NCells*long(sizeof(int));
+  }
+  vector<int>* node_vectors[11] = {&RowIndex, &ColIndex, &BaseLevelNodeList, &NDonorsVector,
+                                   &ReceiverVector, &DeltaVector, &DonorStackVector, &SVector,
+                                   &BLBasinVector, &SVectorIndex, &NContributingNodes};
+  for (int v = 0; v<11; v++)
+  {
+    block_data[v+4] = node_vectors[v]->empty() ? NULL :
+                        reinterpret_cast<char*>(&(*node_vectors[v])[0]);
+    block_bytes[v+4] = long(node_vectors[v]->size())*long(sizeof(int));
+  }
+  block_data[15] = (NCells > 0) ? reinterpret_cast<char*>(&FilledTopography.RasterData[0][0]) : NULL;
+  block_bytes[15] = NCells*long(sizeof(float));
+
+  // fill in the header
+  FlowInfoCacheHeader header;
+  memset(&header,0,sizeof(header));
+  memcpy(header.Magic,"LSDFLOWI",8);
+  header.InputHash = InputHash;
+  header.Version = FlowInfoCacheVersion;
+  header.ByteOrder = get_host_byte_order();
+  header.NRows = NRows;
+  header.NCols = NCols;
+  header.NoDataValue = NoDataValue;
+  header.NDataNodes = NDataNodes;
+  header.NBaseLevelNodes = BaseLevelNodeList.size();
+  header.NContributingNodes = NContributingNodes.size();
+  header.NTextBytes = text_block.size();
+  header.NBoundaryConditions = BoundaryConditions.size();
+  header.NGeoReferencingStrings = GeoReferencingStrings.size();
+  header.XMinimum = XMinimum;
+  header.YMinimum = YMinimum;
+  header.DataResolution = DataResolution;
+
+  long long offset = sizeof(FlowInfoCacheHeader);
+  unsigned long long checksum = hash_bytes(NULL,0);
+  for (int b = 0; b<NFlowInfoCacheBlocks; b++)
+  {
+    offset = ((offset+63)/64)*64;
+    header.BlockOffset[b] = offset;
+    offset += block_bytes[b];
+    checksum = hash_bytes(block_data[b],block_bytes[b],checksum);
+  }
+  header.DataChecksum = checksum;
+
+  ofstream data_ofs(data_fname.c_str(), ios::out | ios::binary);
+  if (data_ofs.fail())
+  {
+    cout << "Warning, could not write the flow info cache " << data_fname << endl;
+    return;
+  }
+  data_ofs.write(reinterpret_cast<char*>(&header),sizeof(header));
+  long long position = sizeof(FlowInfoCacheHeader);
+  char padding[64];
+  memset(padding,0,64);
+  for (int b = 0; b<NFlowInfoCacheBlocks; b++)
+  {
+    data_ofs.write(padding,header.BlockOffset[b]-position);
+    if (block_bytes[b] > 0)
+    {
+      data_ofs.write(block_data[b],block_bytes[b]);
+    }
+    position = header.BlockOffset[b]+block_bytes[b];
+  }
+  data_ofs.close();
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This loads a flow info cache written by cache_flow_info, and the filled DEM
+// stored with it. The file is memory mapped, so the checksum and the copies
+// into this object read each page straight from the page cache.
+// It returns false, leaving this object and FilledTopography untouched, if the
+// file is missing, was written by a different version or on a machine with a
+// different byte order, was made from different inputs (InputHash does not
+// match) or is truncated or corrupt.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+bool LSDFlowInfo::load_cached_flow_info(string filename, unsigned long long InputHash,
+                                        LSDRaster& FilledTopography)
+{
+  string data_fname = filename+".FIcache";
+  int file_descriptor = open(data_fname.c_str(), O_RDONLY);
+  if (file_descriptor == -1)
+  {
+    return false;
+  }
+  struct stat file_status;
+  if (fstat(file_descriptor,&file_status) != 0 ||
+      file_status.st_size < (off_t)sizeof(FlowInfoCacheHeader))
+  {
+    close(file_descriptor);
+    cout << "The file " << data_fname << " is not a flow info cache." << endl;
+    return false;
+  }
+  long long file_size = file_status.st_size;
+  void* mapped_file = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+  close(file_descriptor);
+  if (mapped_file == MAP_FAILED)
+  {
+    cout << "Could not map the flow info cache " << data_fname << "; it will be rebuilt." << endl;
+    return false;
+  }
+
+  bool loaded = unpack_flow_info_cache(data_fname, static_cast<const char*>(mapped_file),
+                                       file_size, InputHash, FilledTopography);
+  munmap(mapped_file, file_size);
+  return loaded;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This checks and unpacks a flow info cache held in memory (file_data, which is
+// file_size bytes long). See load_cached_flow_info.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+bool LSDFlowInfo::unpack_flow_info_cache(string data_fname, const char* file_data,
+                                         long long file_size, unsigned long long InputHash,
+                                         LSDRaster& FilledTopography)
+{
+  FlowInfoCacheHeader header;
+  memcpy(&header,file_data,sizeof(header));
+  if (memcmp(header.Magic,"LSDFLOWI",8) != 0)
+  {
+    cout << "The file " << data_fname << " is not a flow info cache." << endl;
+    return false;
+  }
+  if (header.Version != FlowInfoCacheVersion || header.ByteOrder != get_host_byte_order())
+  {
+    cout << "The flow info cache " << data_fname << " was written by a different "
+         << "version or on a different machine; it will be rebuilt." << endl;
+    return false;
+  }
+  if (header.InputHash != InputHash)
+  {
+    cout << "The flow info cache " << data_fname << " was made from a different DEM, "
+         << "fill or boundary conditions; it will be rebuilt." << endl;
+    return false;
+  }
+
+  // every block has to lie inside the file
+  long NCells = long(header.NRows)*long(header.NCols);
+  long NNodes = header.NDataNodes;
+  long block_elements[NFlowInfoCacheBlocks] = {header.NTextBytes, NCells, NCells, NCells,
+                                               NNodes, NNodes, header.NBaseLevelNodes,
+                                               NNodes, NNodes, NNodes+1, NNodes, NNodes,
+                                               NNodes, NNodes, header.NContributingNodes,
+                                               NCells};
+  long block_bytes[NFlowInfoCacheBlocks];
+  unsigned long long checksum = hash_bytes(NULL,0);
+  for (int b = 0; b<NFlowInfoCacheBlocks; b++)
+  {
+    block_bytes[b] = (b == 0) ? block_elements[0] : block_elements[b]*long(sizeof(int));
+    if (block_elements[b] < 0 || header.BlockOffset[b] < (long long)sizeof(header) ||
+        header.BlockOffset[b]+block_bytes[b] > file_size)
+    {
+      cout << "The flow info cache " << data_fname << " is truncated; it will be rebuilt." << endl;
+      return false;
+    }
+    checksum = hash_bytes(file_data+header.BlockOffset[b],block_bytes[b],checksum);
+  }
+  if (checksum != header.DataChecksum)
+  {
+    cout << "The flow info cache " << data_fname << " is corrupt; it will be rebuilt." << endl;
+    return false;
+  }
+
+  // unpack the strings. The number of each kind comes from the header, and
+  // every item has to fit in the block
+  int NBCs = header.NBoundaryConditions;
+  int NGRS = header.NGeoReferencingStrings;
+  int n_items = NBCs+2*NGRS;
+  vector<string> text_items;
+  const char* text_block = file_data+header.BlockOffset[0];
+  long position = 0;
+  for (int i = 0; i<n_items && NBCs >= 0 && NGRS >= 0; i++)
+  {
+    int item_length = -1;
+    if (position+long(sizeof(int)) <= block_bytes[0])
+    {
+      memcpy(&item_length,text_block+position,sizeof(int));
+      position += sizeof(int);
+    }
+    if (item_length < 0 || position+item_length > block_bytes[0])
+    {
+      break;
+    }
+    text_items.push_back(string(text_block+position,item_length));
+    position += item_length;
+  }
+  if (NBCs < 0 || NGRS < 0 || int(text_items.size()) != n_items || position != block_bytes[0])
+  {
+    cout << "The flow info cache " << data_fname << " has a bad list of boundary "
+         << "conditions; it will be rebuilt." << endl;
+    return false;
+  }
+  vector<string> temp_BoundaryConditions(text_items.begin(),text_items.begin()+NBCs);
+  map<string,string> temp_GRS;
+  for (int i = NBCs; i<n_items; i+=2)
+  {
+    temp_GRS[text_items[i]] = text_items[i+1];
+  }
+
+  // copy the arrays out of the mapped file
+  Array2D<int> temp_NodeIndex(header.NRows,header.NCols);
+  Array2D<int> temp_FlowDirection(header.NRows,header.NCols);
+  Array2D<int> temp_FlowLengthCode(header.NRows,header.NCols);
+  Array2D<float> temp_FilledZeta(header.NRows,header.NCols);
+  if (NCells > 0)
+  {
+    memcpy(&temp_NodeIndex[0][0],file_data+header.BlockOffset[1],block_bytes[1]);
+    memcpy(&temp_FlowDirection[0][0],file_data+header.BlockOffset[2],block_bytes[2]);
+    memcpy(&temp_FlowLengthCode[0][0],file_data+header.BlockOffset[3],block_bytes[3]);
+    memcpy(&temp_FilledZeta[0][0],file_data+header.BlockOffset[15],block_bytes[15]);
+  }
+  vector<int>* node_vectors[11] = {&RowIndex, &ColIndex, &BaseLevelNodeList, &NDonorsVector,
+                                   &ReceiverVector, &DeltaVector, &DonorStackVector, &SVector,
+                                   &BLBasinVector, &SVectorIndex, &NContributingNodes};
+  for (int v = 0; v<11; v++)
+  {
+    const int* block_start = reinterpret_cast<const int*>(file_data+header.BlockOffset[v+4]);
+    node_vectors[v]->assign(block_start,block_start+block_elements[v+4]);
+  }
+
+  NRows = header.NRows;
+  NCols = header.NCols;
+  XMinimum = header.XMinimum;
+  YMinimum = header.YMinimum;
+  DataResolution = header.DataResolution;
+  NoDataValue = header.NoDataValue;
+  NDataNodes = header.NDataNodes;
+  BoundaryConditions = temp_BoundaryConditions;
+  GeoReferencingStrings = temp_GRS;
+  NodeIndex = temp_NodeIndex;
+  FlowDirection = temp_FlowDirection;
+  FlowLengthCode = temp_FlowLengthCode;
+
+  LSDRaster temp_FilledTopography(NRows,NCols,XMinimum,YMinimum,DataResolution,
+                                  NoDataValue,temp_FilledZeta,GeoReferencingStrings);
+  FilledTopography = temp_FilledTopography;
+  return true;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 //
@@ -1752,19 +2192,11 @@ vector<int> LSDFlowInfo::Ingest_Channel_Heads(string filename, string extension,
         }
       }
       // Test 2 - Need to do some extra checks to load sources correctly.
-      int N_sources_2 = Sources_temp.size();
-      for(int i = 0; i<N_sources_2; ++i)
+      Sources = remove_nodes_with_upstream_nodes(Sources_temp);
+      int N_removed = int(Sources_temp.size())-int(Sources.size());
+      if (N_removed > 0)
       {
-        int test2 = 0;
-        for(int i_test = 0; i_test<int(Sources_temp.size()); ++i_test)
-        {
-          if(i!=i_test)
-          {
-            if(is_node_upstream(Sources_temp[i],Sources_temp[i_test])==true) test2 = 1;
-          }
-        }
-        if(test2 ==0) Sources.push_back(Sources_temp[i]);
-        else cout << "\t\t ! removed node from sources list - other sources upstream" << endl;
+        cout << "\t\t ! removed " << N_removed << " nodes from sources list - other sources upstream or repeated" << endl;
       }
     }
     // Using Node Index directly (default)
@@ -1885,19 +2317,11 @@ vector<int> LSDFlowInfo::Ingest_Channel_Heads(string filename, int input_switch)
       }
     }
     // Test 2 - Need to do some extra checks to load sources correctly.
-    int N_sources_2 = Sources_temp.size();
-    for(int i = 0; i<N_sources_2; ++i)
+    Sources = remove_nodes_with_upstream_nodes(Sources_temp);
+    int N_removed = int(Sources_temp.size())-int(Sources.size());
+    if (N_removed > 0)
     {
-      int test2 = 0;
-      for(int i_test = 0; i_test<int(Sources_temp.size()); ++i_test)
-      {
-        if(i!=i_test)
-        {
-          if(is_node_upstream(Sources_temp[i],Sources_temp[i_test])==true) test2 = 1;
-        }
-      }
-      if(test2 ==0) Sources.push_back(Sources_temp[i]);
-      else cout << "\t\t ! removed node from sources list - other sources upstream" << endl;
+      cout << "\t\t ! removed " << N_removed << " nodes from sources list - other sources upstream or repeated" << endl;
     }
   }
   else
@@ -1982,21 +2406,7 @@ vector<int> LSDFlowInfo::Ingest_Channel_Heads_OS(string csv_filename)
     }
   }
   // Test 2 - Need to do some extra checks to load sources correctly.
-  int N_sources_2 = Sources_temp.size();
-  for(int i = 0; i<N_sources_2; ++i)
-  {
-		cout << flush << "\t Source: " << i << " of " << N_sources_2 << "\r";
-    int test2 = 0;
-    for(int i_test = 0; i_test<int(Sources_temp.size()); ++i_test)
-    {
-			if(i!=i_test)
-      {
-      	if(is_node_upstream(Sources_temp[i],Sources_temp[i_test])==true) test2 = 1;
-      }
-    }
-    if(test2 ==0) Sources.push_back(Sources_temp[i]);
-    //else cout << "\t\t ! removed node from sources list - other sources upstream" << endl;
-  }
+  Sources = remove_nodes_with_upstream_nodes(Sources_temp);
 	cout << "Returning sources..." << endl;
 
   return Sources;
@@ -2302,23 +2712,48 @@ LSDIndexRaster LSDFlowInfo::write_FlowDirection_to_LSDIndexRaster_Arcformat()
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 LSDRaster LSDFlowInfo::write_DrainageArea_to_LSDRaster()
 {
-  // initialise the 2D array
-  int row,col;                // node index
-  float ndv = float(NoDataValue);
-  float this_DA;
-  Array2D<float> DrainageArea_local(NRows,NCols,ndv);
+  // the contributing pixels come from the accumulator engine
+  vector<StackAccumulator> Accumulators(1);
+  Accumulators[0].Operation = StackSum;
+  accumulate_over_stack(Accumulators);
 
-  for(int node = 0; node<NDataNodes; node++)
-    {
-      row = RowIndex[node];
-      col = ColIndex[node];
-      //cout << NContributingNodes[node] << endl;
-      this_DA = float(NContributingNodes[node])*DataResolution*DataResolution;
-      DrainageArea_local[row][col] = this_DA;
-    }
+  LSDRaster DrainageArea = write_drainage_area_accumulator_to_LSDRaster(Accumulators[0]);
+  return DrainageArea;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
-  // create the LSDRaster object
-  LSDRaster DrainageArea(NRows,NCols,XMinimum,YMinimum,DataResolution,ndv,DrainageArea_local,GeoReferencingStrings);
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This gets the D8 drainage area, the contributing pixels and the flow
+// distance from the outlet with a single call to accumulate_over_stack, so
+// the drivers that need all three only set up the stack traversal once.
+// The contributing pixels are copied from NContributingNodes rather than from
+// the float result, which cannot hold counts above 2^24 exactly.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDFlowInfo::get_area_pixels_and_flow_distance(LSDRaster& DrainageArea,
+                                                    LSDIndexRaster& ContributingPixels,
+                                                    LSDRaster& DistanceFromOutlet)
+{
+  vector<StackAccumulator> Accumulators(2);
+  Accumulators[0].Operation = StackSum;
+  Accumulators[1].Operation = StackFlowDistance;
+  accumulate_over_stack(Accumulators);
+
+  DrainageArea = write_drainage_area_accumulator_to_LSDRaster(Accumulators[0]);
+  ContributingPixels = write_NContributingNodes_to_LSDIndexRaster();
+  DistanceFromOutlet = write_accumulator_to_LSDRaster(Accumulators[1]);
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This writes a contributing pixel accumulator to an LSDRaster of drainage area
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+LSDRaster LSDFlowInfo::write_drainage_area_accumulator_to_LSDRaster(StackAccumulator& Accumulator)
+{
+  for(int node = 0; node<int(Accumulator.Result.size()); node++)
+  {
+    Accumulator.Result[node] = Accumulator.Result[node]*DataResolution*DataResolution;
+  }
+  LSDRaster DrainageArea = write_accumulator_to_LSDRaster(Accumulator);
   return DrainageArea;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
@@ -2407,27 +2842,56 @@ void LSDFlowInfo::calculate_upslope_reference_indices()
   vector<int> vectorized_area(NDataNodes,1);
   SVectorIndex = vectorized_area;
 
-  int receiver_node;
-  int donor_node;
-
-  // loop through the s vector, adding pixels to receiver nodes
-  for(int node = NDataNodes-1; node>=0; node--)
+  // each base level basin is a contiguous block of the stack starting at its
+  // base level node, and the basins are independent, so they are done in
+  // parallel, largest first
+  vector<int> BasinStarts;
+  vector<int> BasinSizes;
+  for(int node = 0; node<NDataNodes; node++)
+  {
+    if (ReceiverVector[ SVector[node] ] == SVector[node])
     {
-      donor_node = SVector[node];
-      receiver_node = ReceiverVector[ donor_node ];
-
-      // every node is visited once and only once so we can map the
-      // unique positions of the nodes to the SVector
-      SVectorIndex[donor_node] = node;
-
-      // add the upslope area (note no action is taken
-      // for base level nodes since they donate to themselves and
-      // we must avoid float counting
-      if (donor_node != receiver_node)
+      BasinStarts.push_back(node);
+    }
+  }
+  int n_basins = int(BasinStarts.size());
+  for(int b = 0; b<n_basins; b++)
   {
-    vectorized_area[ receiver_node ] +=  vectorized_area[ donor_node ];
+    int basin_end = (b == n_basins-1) ? NDataNodes : BasinStarts[b+1];
+    BasinSizes.push_back(basin_end-BasinStarts[b]);
   }
+  vector<size_t> index_map;
+  vector<int> sorted_sizes;
+  matlab_int_sort(BasinSizes, sorted_sizes, index_map);
+
+  #pragma omp parallel for schedule(dynamic,1)
+  for(int b = n_basins-1; b>=0; b--)
+  {
+    int basin_start = BasinStarts[ index_map[b] ];
+    int basin_end = basin_start+sorted_sizes[b];
+
+    int receiver_node;
+    int donor_node;
+
+    // loop through the s vector, adding pixels to receiver nodes
+    for(int node = basin_end-1; node>=basin_start; node--)
+      {
+        donor_node = SVector[node];
+        receiver_node = ReceiverVector[ donor_node ];
+
+        // every node is visited once and only once so we can map the
+        // unique positions of the nodes to the SVector
+        SVectorIndex[donor_node] = node;
+
+        // add the upslope area (note no action is taken
+        // for base level nodes since they donate to themselves and
+        // we must avoid float counting
+        if (donor_node != receiver_node)
+    {
+      vectorized_area[ receiver_node ] +=  vectorized_area[ donor_node ];
     }
+      }
+  }
 
   NContributingNodes = vectorized_area;
 }
@@ -2489,140 +2953,461 @@ LSDRaster LSDFlowInfo::get_upslope_node_mask(vector<int> source_nodes)
   {
     this_node = source_nodes[n];
 
-    // check if it is in the DEM
-    if (this_node < NDataNodes)
+    // check if it is in the DEM
+    if (this_node < NDataNodes)
+    {
+      vector<int> upslope_nodes = get_upslope_nodes(this_node);
+
+      int n_us_nodes =  int(upslope_nodes.size());
+      for(int us = 0; us<n_us_nodes; us++)
+      {
+        retrieve_current_row_and_col(upslope_nodes[us],curr_row,curr_col);
+        this_raster[curr_row][curr_col]=is_us;
+      }
+    }
+  }
+
+  // now create the raster
+  LSDRaster temp_us(NRows,NCols,XMinimum,YMinimum,DataResolution,NoDataValue,this_raster,GeoReferencingStrings);
+  return temp_us;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This function takes a list of source nodes and creates a raster where
+// the pixels have a value of upslope_value
+// where there are upslope nodes and NoData otherwise
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+LSDRaster LSDFlowInfo::get_upslope_node_mask(vector<int> source_nodes, vector<float> upslope_values)
+{
+  // initiate the data array
+  Array2D<float> this_raster(NRows,NCols,NoDataValue);
+
+  if (source_nodes.size() == upslope_values.size())
+  {
+    // loop through the nodes, collecting upslope nodes
+    int n_nodes = int(source_nodes.size());
+    int this_node;
+    //int us_node;
+    int curr_row,curr_col;
+
+    // go through all the source nodes, find their upslope nodes
+    // and set the value of these nodes to 1.0 on the data array
+    for (int n = 0; n<n_nodes; n++)
+    {
+      this_node = source_nodes[n];
+
+      // check if it is in the DEM
+      if (this_node < NDataNodes)
+      {
+        vector<int> upslope_nodes = get_upslope_nodes(this_node);
+
+        int n_us_nodes =  int(upslope_nodes.size());
+        for(int us = 0; us<n_us_nodes; us++)
+        {
+          retrieve_current_row_and_col(upslope_nodes[us],curr_row,curr_col);
+          this_raster[curr_row][curr_col]= upslope_values[n];
+        }
+      }
+    }
+  }
+  else
+  {
+    cout << "The uplsope vlaues vector needs to be the same lengths as the sources vector!" << endl;
+    cout << "Returning an nodata raster" << endl;
+  }
+
+  // now create the raster
+  LSDRaster temp_us(NRows,NCols,XMinimum,YMinimum,DataResolution,NoDataValue,this_raster,GeoReferencingStrings);
+  return temp_us;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+//
+//  Accumulate some variable (such a precipitation) from an accumulation raster
+//
+//  Each node gets the sum over itself and all its upslope nodes. This used to sum
+//  the upslope nodes of every node separately; it now uses accumulate_over_stack,
+//  which passes the sums down the stack so every node is visited once.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+LSDRaster LSDFlowInfo::upslope_variable_accumulator(LSDRaster& accum_raster)
+{
+  int raster_NRows, raster_NCols;
+  float raster_XMin, raster_YMin, raster_DataRes;
+
+  // first check to make sure the raster dimensions match that of the
+  // raster upon which LSDFlowInfo is based
+  raster_NRows =  accum_raster.get_NRows();
+  raster_NCols =  accum_raster.get_NCols();
+  raster_XMin  =  accum_raster.get_XMinimum();
+  raster_YMin  =  accum_raster.get_YMinimum();
+  raster_DataRes  =  accum_raster.get_DataResolution();
+
+  if (raster_NRows != NRows || raster_NCols != NCols ||
+      raster_XMin != XMinimum || raster_YMin != YMinimum ||
+      raster_DataRes != DataResolution)
+    {
+      cout << "Warning!!, LSDFlowInfo::upslope_area_accumulator\n"
+     << "Accumulation raster does not match dimensions of original raster" << endl;
+      return accum_raster;
+    }
+  else
+    {
+      // get the value of the variable at each node
+      vector<StackAccumulator> Accumulators(1);
+      Accumulators[0].Operation = StackSum;
+      Accumulators[0].NodeValues.resize(NDataNodes);
+      for(int this_node = 0; this_node <NDataNodes; this_node++)
+      {
+        Accumulators[0].NodeValues[this_node] =
+          accum_raster.get_data_element(RowIndex[this_node], ColIndex[this_node]);
+      }
+
+      // accumulate down the stack and create the raster
+      accumulate_over_stack(Accumulators);
+      LSDRaster accumulated_flow = write_accumulator_to_LSDRaster(Accumulators[0]);
+      return accumulated_flow;
+    }
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This splits the stack into independent pieces of work for the parallel
+// traversals. The upslope nodes of any node occupy a contiguous range of the
+// stack, so every node with no more than MaxTaskSize contributing nodes, whose
+// receiver has more (or which is a base level node), is the root of a task
+// covering its whole range. Small base level basins are therefore a single task
+// and large basins are split into their sub-trees. The nodes that are in no
+// task (the trunks of the large basins) and the task roots are returned in
+// stack order in TopLevelStackNodes, as positions in the stack.
+// The tasks are returned largest first.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDFlowInfo::partition_stack(int MaxTaskSize, vector<int>& TopLevelStackNodes,
+                                  vector<int>& TaskStart, vector<int>& TaskEnd)
+{
+  TopLevelStackNodes.clear();
+  vector<int> Starts;
+  vector<int> Sizes;
+
+  int s_node = 0;
+  while (s_node < NDataNodes)
+  {
+    int this_node = SVector[s_node];
+    TopLevelStackNodes.push_back(s_node);
+    if (NContributingNodes[this_node] > MaxTaskSize)
+    {
+      // a trunk node: its donors follow it in the stack
+      s_node++;
+    }
+    else
+    {
+      // a task root: skip over its upslope nodes
+      Starts.push_back(s_node);
+      Sizes.push_back(NContributingNodes[this_node]);
+      s_node += NContributingNodes[this_node];
+    }
+  }
+
+  // order the tasks largest first so the big ones do not end up last
+  vector<size_t> index_map;
+  vector<int> sorted_sizes;
+  matlab_int_sort(Sizes, sorted_sizes, index_map);
+  int n_tasks = int(Starts.size());
+  TaskStart.resize(n_tasks);
+  TaskEnd.resize(n_tasks);
+  for(int t = 0; t<n_tasks; t++)
+  {
+    int sorted_t = n_tasks-1-t;
+    TaskStart[t] = Starts[ index_map[sorted_t] ];
+    TaskEnd[t] = Starts[ index_map[sorted_t] ]+sorted_sizes[sorted_t];
+  }
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This computes a set of per-node quantities over the stack. The upslope
+// accumulations (sum, max, weighted sum) are done together in one pass from
+// the top of the stack: a node is complete before its receiver is reached, so
+// it is simply combined into its receiver. The downstream integrations (flow
+// distance, chi) are done together in one pass from the base of the stack,
+// where the receiver of a node is always complete before the node itself.
+// Each pass is only made if one of the accumulators needs it.
+//
+// Both passes run in parallel over the tasks from partition_stack, which are
+// handed out to the threads dynamically. In the upslope pass the tasks are done
+// first and then the trunks, and in the downstream pass the other way round.
+// The trunk nodes and task roots are visited in the same order as a serial pass
+// would, so every receiver combines its donors in the same order and the results
+// do not depend on the number of threads.
+//
+// Sums are carried in double precision and rounded to float at the end.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDFlowInfo::accumulate_over_stack(vector<StackAccumulator>& Accumulators)
+{
+  int n_accum = int(Accumulators.size());
+
+  // check the inputs and sort the accumulators by direction
+  vector<int> upslope_accum;
+  vector<int> downstream_accum;
+  for(int a = 0; a<n_accum; a++)
+  {
+    StackAccumulator& this_accum = Accumulators[a];
+    if (this_accum.NodeValues.size() != 0 && int(this_accum.NodeValues.size()) != NDataNodes)
+    {
+      cout << "LSDFlowInfo::accumulate_over_stack, accumulator " << a
+           << " has " << this_accum.NodeValues.size() << " values but there are "
+           << NDataNodes << " nodes" << endl;
+      exit(EXIT_FAILURE);
+    }
+    if (this_accum.Operation == StackWeightedSum && int(this_accum.NodeWeights.size()) != NDataNodes)
+    {
+      cout << "LSDFlowInfo::accumulate_over_stack, accumulator " << a
+           << " is a weighted sum but does not have a weight for every node" << endl;
+      exit(EXIT_FAILURE);
+    }
+
+    if (this_accum.Operation == StackFlowDistance || this_accum.Operation == StackChi)
+    {
+      downstream_accum.push_back(a);
+    }
+    else if (this_accum.Operation == StackSum && this_accum.NodeValues.size() == 0)
+    {
+      // the number of contributing pixels is already known from the stack
+      this_accum.Result.resize(NDataNodes);
+      for(int node = 0; node<NDataNodes; node++)
+      {
+        this_accum.Result[node] = float(NContributingNodes[node]);
+      }
+    }
+    else
+    {
+      upslope_accum.push_back(a);
+    }
+  }
+
+  // split the stack into tasks: a few hundred of them on a large DEM
+  vector<int> TopLevelStackNodes;
+  vector<int> TaskStart;
+  vector<int> TaskEnd;
+  int MaxTaskSize = NDataNodes/256;
+  if (MaxTaskSize < 4096)
+  {
+    MaxTaskSize = 4096;
+  }
+  partition_stack(MaxTaskSize, TopLevelStackNodes, TaskStart, TaskEnd);
+  int n_tasks = int(TaskStart.size());
+  int n_top_level = int(TopLevelStackNodes.size());
+
+  // the upslope accumulations
+  int n_upslope = int(upslope_accum.size());
+  if (n_upslope > 0)
+  {
+    vector<char> is_max(n_upslope,0);
+    for(int u = 0; u<n_upslope; u++)
+    {
+      if (Accumulators[ upslope_accum[u] ].Operation == StackMax)
+      {
+        is_max[u] = 1;
+      }
+    }
+
+    // the running totals, one block of n_upslope values per node
+    vector<double> running(size_t(NDataNodes)*n_upslope);
+    #pragma omp parallel for schedule(static)
+    for(int node = 0; node<NDataNodes; node++)
+    {
+      for(int u = 0; u<n_upslope; u++)
+      {
+        StackAccumulator& this_accum = Accumulators[ upslope_accum[u] ];
+        double this_value = (this_accum.NodeValues.size() == 0) ? 1.0 : this_accum.NodeValues[node];
+        if (this_accum.Operation == StackWeightedSum)
+        {
+          this_value *= this_accum.NodeWeights[node];
+        }
+        running[size_t(node)*n_upslope+u] = this_value;
+      }
+    }
+
+    // go from the top of each task, passing each node on to its receiver.
+    // The task roots are left for the trunk pass since their receivers are
+    // shared between tasks.
+    #pragma omp parallel for schedule(dynamic,1)
+    for(int t = 0; t<n_tasks; t++)
+    {
+      for(int s_node = TaskEnd[t]-1; s_node>TaskStart[t]; s_node--)
+      {
+        int this_node = SVector[s_node];
+        combine_upslope_totals(&running[size_t(this_node)*n_upslope],
+                               &running[size_t(ReceiverVector[this_node])*n_upslope],
+                               is_max);
+      }
+    }
+
+    // then the task roots and the trunks, from the top of the stack
+    for(int tl = n_top_level-1; tl>=0; tl--)
     {
-      vector<int> upslope_nodes = get_upslope_nodes(this_node);
+      int this_node = SVector[ TopLevelStackNodes[tl] ];
+      int receiver_node = ReceiverVector[this_node];
+      if (receiver_node != this_node)
+      {
+        combine_upslope_totals(&running[size_t(this_node)*n_upslope],
+                               &running[size_t(receiver_node)*n_upslope],
+                               is_max);
+      }
+    }
 
-      int n_us_nodes =  int(upslope_nodes.size());
-      for(int us = 0; us<n_us_nodes; us++)
+    for(int u = 0; u<n_upslope; u++)
+    {
+      vector<float>& this_result = Accumulators[ upslope_accum[u] ].Result;
+      this_result.resize(NDataNodes);
+      #pragma omp parallel for schedule(static)
+      for(int node = 0; node<NDataNodes; node++)
       {
-        retrieve_current_row_and_col(upslope_nodes[us],curr_row,curr_col);
-        this_raster[curr_row][curr_col]=is_us;
+        this_result[node] = float(running[size_t(node)*n_upslope+u]);
       }
     }
   }
 
-  // now create the raster
-  LSDRaster temp_us(NRows,NCols,XMinimum,YMinimum,DataResolution,NoDataValue,this_raster,GeoReferencingStrings);
-  return temp_us;
-}
-//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-
-//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-// This function takes a list of source nodes and creates a raster where
-// the pixels have a value of upslope_value
-// where there are upslope nodes and NoData otherwise
-//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-LSDRaster LSDFlowInfo::get_upslope_node_mask(vector<int> source_nodes, vector<float> upslope_values)
-{
-  // initiate the data array
-  Array2D<float> this_raster(NRows,NCols,NoDataValue);
-
-  if (source_nodes.size() == upslope_values.size())
+  // the downstream integrations
+  int n_downstream = int(downstream_accum.size());
+  if (n_downstream > 0)
   {
-    // loop through the nodes, collecting upslope nodes
-    int n_nodes = int(source_nodes.size());
-    int this_node;
-    //int us_node;
-    int curr_row,curr_col;
+    for(int d = 0; d<n_downstream; d++)
+    {
+      Accumulators[ downstream_accum[d] ].Result.assign(NDataNodes,0.0);
+    }
 
-    // go through all the source nodes, find their upslope nodes
-    // and set the value of these nodes to 1.0 on the data array
-    for (int n = 0; n<n_nodes; n++)
+    // first the trunks and task roots from the base of the stack: receivers
+    // are done before their donors
+    for(int tl = 0; tl<n_top_level; tl++)
     {
-      this_node = source_nodes[n];
+      integrate_node_downstream(SVector[ TopLevelStackNodes[tl] ], Accumulators, downstream_accum);
+    }
 
-      // check if it is in the DEM
-      if (this_node < NDataNodes)
+    // then the rest of each task
+    #pragma omp parallel for schedule(dynamic,1)
+    for(int t = 0; t<n_tasks; t++)
+    {
+      for(int s_node = TaskStart[t]+1; s_node<TaskEnd[t]; s_node++)
       {
-        vector<int> upslope_nodes = get_upslope_nodes(this_node);
-
-        int n_us_nodes =  int(upslope_nodes.size());
-        for(int us = 0; us<n_us_nodes; us++)
-        {
-          retrieve_current_row_and_col(upslope_nodes[us],curr_row,curr_col);
-          this_raster[curr_row][curr_col]= upslope_values[n];
-        }
+        integrate_node_downstream(SVector[s_node], Accumulators, downstream_accum);
       }
     }
   }
-  else
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This combines the running upslope totals of a donor into those of its
+// receiver, for accumulate_over_stack
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDFlowInfo::combine_upslope_totals(double* donor, double* receiver, vector<char>& is_max)
+{
+  int n_upslope = int(is_max.size());
+  for(int u = 0; u<n_upslope; u++)
   {
-    cout << "The uplsope vlaues vector needs to be the same lengths as the sources vector!" << endl;
-    cout << "Returning an nodata raster" << endl;
+    if (is_max[u] == 1)
+    {
+      if (donor[u] > receiver[u])
+      {
+        receiver[u] = donor[u];
+      }
+    }
+    else
+    {
+      receiver[u] += donor[u];
+    }
   }
-
-  // now create the raster
-  LSDRaster temp_us(NRows,NCols,XMinimum,YMinimum,DataResolution,NoDataValue,this_raster,GeoReferencingStrings);
-  return temp_us;
 }
-//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-
-
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
-//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-//
-//  Accumulate some variable (such a precipitation) from an accumulation raster
-//
-//  This requires summing all upslope nodes for every node. It seems a bit inefficient
-//  but the other simple alternative is to do a sort() operation initially and then
-//  move from upslope node down. There is probably a more efficient way to do this
-//  and this algorithm should be revisited later to see if we can speed it up.
-//
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This sets the downstream integrations (flow distance, chi) of a node from
+// those of its receiver, for accumulate_over_stack. Base level nodes stay at zero.
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-LSDRaster LSDFlowInfo::upslope_variable_accumulator(LSDRaster& accum_raster)
+void LSDFlowInfo::integrate_node_downstream(int this_node, vector<StackAccumulator>& Accumulators,
+                                            vector<int>& downstream_accum)
 {
-  int raster_NRows, raster_NCols;
-  float raster_XMin, raster_YMin, raster_DataRes;
+  int receiver_node = ReceiverVector[this_node];
+  if (receiver_node == this_node)
+  {
+    return;
+  }
 
-  // first check to make sure the raster dimensions match that of the
-  // raster upon which LSDFlowInfo is based
-  raster_NRows =  accum_raster.get_NRows();
-  raster_NCols =  accum_raster.get_NCols();
-  raster_XMin  =  accum_raster.get_XMinimum();
-  raster_YMin  =  accum_raster.get_YMinimum();
-  raster_DataRes  =  accum_raster.get_DataResolution();
+  float root2 = 1.41421356;
+  float diag_length = root2*DataResolution;
+  float pixel_area = DataResolution*DataResolution;
 
-  if (raster_NRows != NRows || raster_NCols != NCols ||
-      raster_XMin != XMinimum || raster_YMin != YMinimum ||
-      raster_DataRes != DataResolution)
+  int this_FLC = FlowLengthCode[ RowIndex[this_node] ][ ColIndex[this_node] ];
+  int n_downstream = int(downstream_accum.size());
+  for(int d = 0; d<n_downstream; d++)
+  {
+    StackAccumulator& this_accum = Accumulators[ downstream_accum[d] ];
+    vector<float>& this_result = this_accum.Result;
+    if (this_accum.Operation == StackFlowDistance)
     {
-      cout << "Warning!!, LSDFlowInfo::upslope_area_accumulator\n"
-     << "Accumulation raster does not match dimensions of original raster" << endl;
-      return accum_raster;
+      if (this_FLC == 1)
+      {
+        this_result[this_node] = this_result[receiver_node]+DataResolution;
+      }
+      else if (this_FLC == 2)
+      {
+        this_result[this_node] = this_result[receiver_node]+diag_length;
+      }
     }
-  else
+    else
     {
-      // create the data array
-      Array2D<float> accumulated_data_array(NRows,NCols,NoDataValue);
-
-      // loop through all the nodes, accumulating the areas
-      for(int this_node = 0; this_node <NDataNodes; this_node++)
-  {
-    // get the upslope nodes
-    vector<int> node_vec = get_upslope_nodes(this_node);
-
-    // loop through these nodes, adding them to the accumulator
-    float this_node_accumulated = 0;
-    int this_row, this_col;
-    for (int ni = 0; ni<int(node_vec.size()); ni++)
+      float dx = (this_FLC == 2) ? diag_length : DataResolution;
+      if (this_accum.NodeValues.size() == 0)
       {
-        retrieve_current_row_and_col(node_vec[ni],this_row,this_col);
-        this_node_accumulated += accum_raster.get_data_element(this_row, this_col);
+        this_result[this_node] = dx*(pow( (this_accum.A_0/ (float(NContributingNodes[this_node])*pixel_area) ),this_accum.m_over_n))
+                                 + this_result[receiver_node];
       }
-
-    // write the accumulated variable to the array
-    int curr_row, curr_col;
-    retrieve_current_row_and_col(this_node,curr_row,curr_col);
-    accumulated_data_array[curr_row][curr_col] = this_node_accumulated;
+      else
+      {
+        this_result[this_node] = dx*(pow( (this_accum.A_0/ this_accum.NodeValues[this_node] ),this_accum.m_over_n))
+                                 + this_result[receiver_node];
+      }
+    }
   }
-      // create the raster
-      LSDRaster accumulated_flow(NRows, NCols, XMinimum, YMinimum,
-            DataResolution, NoDataValue, accumulated_data_array,GeoReferencingStrings);
-      return accumulated_flow;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This writes the result of an accumulator to an LSDRaster
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+LSDRaster LSDFlowInfo::write_accumulator_to_LSDRaster(StackAccumulator& Accumulator)
+{
+  float ndv = float(NoDataValue);
+  Array2D<float> accumulated_data_array(NRows,NCols,ndv);
+
+  if (int(Accumulator.Result.size()) == NDataNodes)
+  {
+    for(int node = 0; node<NDataNodes; node++)
+    {
+      accumulated_data_array[ RowIndex[node] ][ ColIndex[node] ] = Accumulator.Result[node];
     }
+  }
+  else
+  {
+    cout << "LSDFlowInfo::write_accumulator_to_LSDRaster, the accumulator has no result!" << endl;
+    cout << "Returning a nodata raster" << endl;
+  }
+
+  LSDRaster accumulated_raster(NRows, NCols, XMinimum, YMinimum,
+            DataResolution, ndv, accumulated_data_array,GeoReferencingStrings);
+  return accumulated_raster;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
@@ -2640,20 +3425,73 @@ int LSDFlowInfo::is_node_upstream(int current_node, int test_node)
 {
   int i = 0;
 
+  // the nodes upstream of current_node occupy a contiguous range of the
+  // S vector, so this is just a range check
   int start_SVector_node = SVectorIndex[current_node];
   int end_SVector_node = start_SVector_node+NContributingNodes[current_node];
 
   int SVector_test_node = SVectorIndex[test_node];
 
-  for(int node = start_SVector_node; node < end_SVector_node; node++)
+  if (SVector_test_node >= start_SVector_node && SVector_test_node < end_SVector_node)
+  {
+    i = 1;
+  }
+
+  return i;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This takes a list of nodes and returns, in their original order, only those
+// that have no other node of the list upstream of them, i.e. the furthest
+// upstream nodes. It gives the same result as testing every pair with
+// is_node_upstream, but the nodes of the list are counted in one pass over the
+// stack: the number of listed nodes upstream of a node is then the difference
+// of two entries in the running count. Repeated nodes are kept once, at
+// their first position in the list. Nodes that are not valid node indices
+// (e.g. NoData) are dropped.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+vector<int> LSDFlowInfo::remove_nodes_with_upstream_nodes(vector<int>& Nodes)
+{
+  vector<int> FurthestUpstreamNodes;
+  int n_nodes = Nodes.size();
+
+  // flag the position in the stack of every node in the list
+  vector<int> NodesBeforeInStack(NDataNodes+1,0);
+  for (int i = 0; i<n_nodes; i++)
   {
-    if (node == SVector_test_node)
+    if (Nodes[i] >= 0 && Nodes[i] < NDataNodes)
     {
-      i = 1;
+      NodesBeforeInStack[ SVectorIndex[Nodes[i]]+1 ] = 1;
     }
   }
 
-  return i;
+  // one pass over the stack to get the running count of listed nodes
+  for (int s_index = 0; s_index<NDataNodes; s_index++)
+  {
+    NodesBeforeInStack[s_index+1] += NodesBeforeInStack[s_index];
+  }
+
+  // a node is kept if the only listed node in its upslope range is itself
+  vector<bool> AlreadyKept(NDataNodes,false);
+  for (int i = 0; i<n_nodes; i++)
+  {
+    int this_node = Nodes[i];
+    if (this_node >= 0 && this_node < NDataNodes && AlreadyKept[this_node] == false)
+    {
+      int start_SVector_node = SVectorIndex[this_node];
+      int end_SVector_node = start_SVector_node+NContributingNodes[this_node];
+      if (NodesBeforeInStack[end_SVector_node]-NodesBeforeInStack[start_SVector_node] == 1)
+      {
+        FurthestUpstreamNodes.push_back(this_node);
+        AlreadyKept[this_node] = true;
+      }
+    }
+  }
+
+  return FurthestUpstreamNodes;
 }
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
@@ -2982,8 +3820,25 @@ LSDRaster LSDFlowInfo::get_upslope_chi_from_multiple_starting_nodes(vector<int>&
 LSDRaster LSDFlowInfo::get_upslope_chi_from_all_baselevel_nodes(float m_over_n, float A_0,
                   float area_threshold)
 {
-  LSDRaster all_chi = get_upslope_chi_from_multiple_starting_nodes(BaseLevelNodeList,
-                                      m_over_n, A_0, area_threshold);
+  // the base level nodes cover every node, so chi is done in one pass
+  // up the stack rather than basin by basin
+  vector<StackAccumulator> Accumulators(1);
+  Accumulators[0].Operation = StackChi;
+  Accumulators[0].m_over_n = m_over_n;
+  Accumulators[0].A_0 = A_0;
+  accumulate_over_stack(Accumulators);
+
+  // only keep chi where the drainage area is greater than the threshold
+  float PixelArea = DataResolution*DataResolution;
+  for(int node = 0; node<NDataNodes; node++)
+  {
+    if (PixelArea*NContributingNodes[node] <= area_threshold)
+    {
+      Accumulators[0].Result[node] = NoDataValue;
+    }
+  }
+
+  LSDRaster all_chi = write_accumulator_to_LSDRaster(Accumulators[0]);
   return all_chi;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -3000,8 +3855,30 @@ LSDRaster LSDFlowInfo::get_upslope_chi_from_all_baselevel_nodes(float m_over_n,
 LSDRaster LSDFlowInfo::get_upslope_chi_from_all_baselevel_nodes(float m_over_n, float A_0,
                   float area_threshold, LSDRaster& Discharge)
 {
-  LSDRaster all_chi = get_upslope_chi_from_multiple_starting_nodes(BaseLevelNodeList,
-                                m_over_n, A_0, area_threshold, Discharge);
+  // the base level nodes cover every node, so chi is done in one pass
+  // up the stack rather than basin by basin
+  vector<StackAccumulator> Accumulators(1);
+  Accumulators[0].Operation = StackChi;
+  Accumulators[0].m_over_n = m_over_n;
+  Accumulators[0].A_0 = A_0;
+  Accumulators[0].NodeValues.resize(NDataNodes);
+  for(int node = 0; node<NDataNodes; node++)
+  {
+    Accumulators[0].NodeValues[node] = Discharge.get_data_element(RowIndex[node],ColIndex[node]);
+  }
+  accumulate_over_stack(Accumulators);
+
+  // only keep chi where the drainage area is greater than the threshold
+  float PixelArea = DataResolution*DataResolution;
+  for(int node = 0; node<NDataNodes; node++)
+  {
+    if (PixelArea*NContributingNodes[node] <= area_threshold)
+    {
+      Accumulators[0].Result[node] = NoDataValue;
+    }
+  }
+
+  LSDRaster all_chi = write_accumulator_to_LSDRaster(Accumulators[0]);
   return all_chi;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -3023,67 +3900,13 @@ LSDRaster LSDFlowInfo::get_upslope_chi_from_all_baselevel_nodes(float m_over_n,
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 LSDRaster LSDFlowInfo::distance_from_outlet()
 {
-  // initialize the array2d that will become the LSDRaster
-  float ndv = float(NoDataValue);
-  Array2D<float> flow_distance(NRows,NCols,ndv);
-
-  // initialize the 1/root(2)
-  float root2 = 1.41421356;
-  float diag_length = root2*DataResolution;
-
-  int row,col,bl_row,bl_col,receive_row,receive_col;
-
-  int start_node = 0;
-  int end_node;
-  int nodes_in_bl_tree;
-  int baselevel_node;
-  // loop through the base level node list
-  int n_base_level_nodes = BaseLevelNodeList.size();
-  for(int bl = 0; bl<n_base_level_nodes; bl++)
-  {
-    baselevel_node = BaseLevelNodeList[bl];
-
-    bl_row = RowIndex[baselevel_node];
-    bl_col = ColIndex[baselevel_node];
-    // get the number of nodes upslope and including this node
-    nodes_in_bl_tree = NContributingNodes[baselevel_node];
-    //cout << "LINE 938, FlowInfo, base level: " << bl << " with " << nodes_in_bl_tree << " nodes upstream" << endl;
-
-    end_node = start_node+nodes_in_bl_tree;
-
-    // set the distance of the outlet to zero
-    flow_distance[bl_row][bl_col] = 0;
-
-    // now loop through stack
-    for(int s_node = start_node; s_node < end_node; s_node++)
-    {
-      //cout << "Line 953 flow info, s_node is: " << s_node << endl;
-
-      //cout << SVector.size() << " " << ReceiverVector.size() << " " << RowIndex.size() << " " << ColIndex.size() << endl;
-      row = RowIndex[ SVector[ s_node]  ];
-      col = ColIndex[ SVector[ s_node]  ];
-      //cout << "got rows and columns " << row << " " << col << endl;
-      receive_row = RowIndex[ ReceiverVector[SVector[s_node] ]];
-      receive_col = ColIndex[ ReceiverVector[SVector[s_node] ]];
-      //cout <<  "get receive " << receive_row << " " << receive_col << endl;
+  // the base level nodes have a distance of zero and every other node
+  // adds its flow length to the distance of its receiver
+  vector<StackAccumulator> Accumulators(1);
+  Accumulators[0].Operation = StackFlowDistance;
+  accumulate_over_stack(Accumulators);
 
-      if ( FlowLengthCode[row][col] == 1)
-      {
-        flow_distance[row][col] = flow_distance[receive_row][receive_col]+DataResolution;
-      }
-      else if ( FlowLengthCode[row][col] == 2 )
-      {
-        flow_distance[row][col] = flow_distance[receive_row][receive_col]
-                                  + diag_length;
-      }
-      //cout << "Flow distance: " << flow_distance << endl;
-    }
-    start_node = end_node;
-  }
-  //cout << "LINE 971 FlowInfo Flow distance complete, flow_distance is: " << endl;
-  //cout << flow_distance << endl;
-  LSDRaster FlowLength(NRows,NCols,XMinimum,YMinimum,DataResolution,ndv,
-                       flow_distance,GeoReferencingStrings);
+  LSDRaster FlowLength = write_accumulator_to_LSDRaster(Accumulators[0]);
   return FlowLength;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -3204,6 +4027,111 @@ int LSDFlowInfo::find_farthest_upslope_node(int node, LSDRaster& DistFromOutlet)
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+//
+// This finds the farthest upslope node of every node at once, giving the same
+// node as find_farthest_upslope_node: the upslope node with the greatest
+// distance from the outlet (if it is greater than zero), and of those the first
+// in the stack; if there is none the node itself.
+//
+// The candidates are compared by distance and then by position in the stack,
+// which is a strict order, so the best candidate of a node can be built from
+// the best of each of its donors in any order. This is done with one pass from
+// the top of the stack, run in parallel over the tasks from partition_stack.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDFlowInfo::calculate_farthest_upslope_nodes(LSDRaster& DistFromOutlet,
+                                   vector<int>& FarthestUpslopeNodes,
+                                   vector<float>& FarthestUpslopeDistances)
+{
+  // the candidate of each node: a node of NoDataValue means there is no
+  // upslope node with a distance greater than zero yet
+  FarthestUpslopeNodes.assign(NDataNodes,NoDataValue);
+  FarthestUpslopeDistances.assign(NDataNodes,0.0);
+  #pragma omp parallel for schedule(static)
+  for(int node = 0; node<NDataNodes; node++)
+  {
+    float this_flow_distance = DistFromOutlet.get_data_element(RowIndex[node], ColIndex[node]);
+    if (this_flow_distance > 0)
+    {
+      FarthestUpslopeNodes[node] = node;
+      FarthestUpslopeDistances[node] = this_flow_distance;
+    }
+  }
+
+  vector<int> TopLevelStackNodes;
+  vector<int> TaskStart;
+  vector<int> TaskEnd;
+  int MaxTaskSize = NDataNodes/256;
+  if (MaxTaskSize < 4096)
+  {
+    MaxTaskSize = 4096;
+  }
+  partition_stack(MaxTaskSize, TopLevelStackNodes, TaskStart, TaskEnd);
+  int n_tasks = int(TaskStart.size());
+  int n_top_level = int(TopLevelStackNodes.size());
+
+  // pass the candidates down from the top of each task, leaving the task roots
+  #pragma omp parallel for schedule(dynamic,1)
+  for(int t = 0; t<n_tasks; t++)
+  {
+    for(int s_node = TaskEnd[t]-1; s_node>TaskStart[t]; s_node--)
+    {
+      int this_node = SVector[s_node];
+      int receiver_node = ReceiverVector[this_node];
+      pass_farthest_upslope_node(this_node, receiver_node, FarthestUpslopeNodes, FarthestUpslopeDistances);
+    }
+  }
+
+  // then the task roots and the trunks
+  for(int tl = n_top_level-1; tl>=0; tl--)
+  {
+    int this_node = SVector[ TopLevelStackNodes[tl] ];
+    int receiver_node = ReceiverVector[this_node];
+    if (receiver_node != this_node)
+    {
+      pass_farthest_upslope_node(this_node, receiver_node, FarthestUpslopeNodes, FarthestUpslopeDistances);
+    }
+  }
+
+  // nodes with no candidate are their own farthest upslope node
+  for(int node = 0; node<NDataNodes; node++)
+  {
+    if (FarthestUpslopeNodes[node] == NoDataValue)
+    {
+      FarthestUpslopeNodes[node] = node;
+    }
+  }
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This replaces the farthest upslope candidate of a receiver with that of its
+// donor if the donor's is farther, or as far and earlier in the stack
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDFlowInfo::pass_farthest_upslope_node(int donor_node, int receiver_node,
+                                   vector<int>& FarthestUpslopeNodes,
+                                   vector<float>& FarthestUpslopeDistances)
+{
+  int donor_candidate = FarthestUpslopeNodes[donor_node];
+  if (donor_candidate == NoDataValue)
+  {
+    return;
+  }
+
+  int receiver_candidate = FarthestUpslopeNodes[receiver_node];
+  if (receiver_candidate == NoDataValue
+      || FarthestUpslopeDistances[donor_node] > FarthestUpslopeDistances[receiver_node]
+      || (FarthestUpslopeDistances[donor_node] == FarthestUpslopeDistances[receiver_node]
+          && SVectorIndex[donor_candidate] < SVectorIndex[receiver_candidate]))
+  {
+    FarthestUpslopeNodes[receiver_node] = donor_candidate;
+    FarthestUpslopeDistances[receiver_node] = FarthestUpslopeDistances[donor_node];
+  }
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 //
 // This function takes a list of nodes and sorts them according to a sorting
@@ -7618,6 +8546,13 @@ vector< Array2D<float> > LSDFlowInfo::HilltopFlowRoutingBedrock(LSDRaster Elevat
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 // This method removes end nodes which are not the uppermost extent of the channel network.
+// Each end node that is still a candidate is traced downstream until it reaches
+// another end node, which is then removed, or the edge or an outlet.
+//
+// The end nodes and the nodes already traced through are held in flag vectors.
+// Once a trace reaches a node an earlier trace went through, the rest of its path
+// (and so the end node it would remove) is the same as before, so the trace stops
+// there. Every node is therefore traced through at most once.
 // SWDG 23/7/15
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 vector<int> LSDFlowInfo::ProcessEndPointsToChannelHeads(LSDIndexRaster Ends){
@@ -7625,24 +8560,30 @@ vector<int> LSDFlowInfo::ProcessEndPointsToChannelHeads(LSDIndexRaster Ends){
   Array2D<int> EndArray = Ends.get_RasterData();
   vector<int> Sources;
 
-  //make a map containing each nodeindex where true means it is a valid channel head, eg the top of the network
-  map<int,bool> EndStatus;
+  //flags for each node: is it an end node, is it still a valid channel head
+  //(eg the top of the network), and has a trace already gone through it
+  vector<char> IsEndNode(NDataNodes,0);
+  vector<char> EndStatus(NDataNodes,0);
+  vector<char> Traced(NDataNodes,0);
   vector<int> EndNodes;
 
   for(int i=1; i<NRows-1; ++i){
     for(int j=1; j<NCols-1; ++j){
       if (EndArray[i][j] != NoDataValue){
         int nodeindex = retrieve_node_from_row_and_column (i,j);
-        EndStatus[nodeindex] = true;
-        EndNodes.push_back(nodeindex);
+        //end points off the flow network cannot be channel heads
+        if (nodeindex != NoDataValue){
+          IsEndNode[nodeindex] = 1;
+          EndStatus[nodeindex] = 1;
+          EndNodes.push_back(nodeindex);
+        }
       }
     }
   }
 
   for (int q = 0; q < int(EndNodes.size());++q){
-    cout << flush << q << " of " << EndNodes.size() << "\r";
     int CurrentNode = EndNodes[q];
-    if (EndStatus[CurrentNode] == true){
+    if (EndStatus[CurrentNode] == 1){
 
       bool stop = false;
 
@@ -7651,11 +8592,13 @@ vector<int> LSDFlowInfo::ProcessEndPointsToChannelHeads(LSDIndexRaster Ends){
         int Downslopei;
         int Downslopej;
 
+        Traced[CurrentNode] = 1;
+
         //get steepest descent neighbour
         retrieve_receiver_information(CurrentNode,DownslopeNode,Downslopei,Downslopej);
 
-        if (find(EndNodes.begin(), EndNodes.end(), DownslopeNode) != EndNodes.end()){
-          EndStatus[DownslopeNode] = false;
+        if (IsEndNode[DownslopeNode] == 1){
+          EndStatus[DownslopeNode] = 0;
           stop = true;
         }
 
@@ -7669,16 +8612,20 @@ vector<int> LSDFlowInfo::ProcessEndPointsToChannelHeads(LSDIndexRaster Ends){
           stop = true;
         }
 
+        //the rest of the path has already been traced
+        if (Traced[DownslopeNode] == 1){
+          stop = true;
+        }
+
         CurrentNode = DownslopeNode;
 
       }
 
     }
   }
-  cout << endl;
 
   for (int q = 0; q < int(EndNodes.size());++q){
-    if (EndStatus[EndNodes[q]] == true){
+    if (EndStatus[EndNodes[q]] == 1){
       Sources.push_back(EndNodes[q]);
     }
   }
@@ -7690,11 +8637,15 @@ vector<int> LSDFlowInfo::ProcessEndPointsToChannelHeads(LSDIndexRaster Ends){
 
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-// This method removes single pixel channels from a channel network.
+// This method removes single pixel channels from a channel network: a source
+// whose receiver has a different stream order is removed. The sources that are
+// kept are copied to a new vector rather than erased in place.
 // SWDG 23/7/15
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 vector<int> LSDFlowInfo::RemoveSinglePxChannels(LSDIndexRaster StreamNetwork, vector<int> Sources){
 
+  vector<int> KeptSources;
+
   for (int q = 0; q < int(Sources.size());++q){
 
     int CurrentNode = Sources[q];
@@ -7710,18 +8661,14 @@ vector<int> LSDFlowInfo::RemoveSinglePxChannels(LSDIndexRaster StreamNetwork, ve
     retrieve_receiver_information(CurrentNode,DownslopeNode,Downslopei,Downslopej);
     int DownslopeOrder = StreamNetwork.get_data_element(Downslopei,Downslopej);
 
-    if (CurrentOrder != DownslopeOrder){
-      //remove the value from the list of nodes -> Sources is passed by val, so this will not change values in sources outide this method
-      Sources.erase(remove(Sources.begin(), Sources.end(), Sources[q]), Sources.end());
+    if (CurrentOrder == DownslopeOrder){
+      KeptSources.push_back(CurrentNode);
     }
 
   }
 
-  return Sources;
+  return KeptSources;
 }
-//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-
-
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // This function starts from a given node index and then goes downstream
 // until it either hits a baselevel node or until it has accumulated a
@@ -85,6 +85,45 @@ It is the object that is used to generate contributing area, etc.
 using namespace std;
 using namespace TNT;
 
+/// @brief The quantities that LSDFlowInfo::accumulate_over_stack can compute.
+/// The first three are accumulated from the ridges down to the outlets, so each
+/// node gets the result over itself and all of its upslope nodes. The last two
+/// are integrated from the outlets up to the ridges, with base level nodes at zero.
+enum StackOperation
+{
+  StackSum,           ///< sum of the node values
+  StackMax,           ///< maximum of the node values
+  StackWeightedSum,   ///< sum of the node values times the node weights
+  StackFlowDistance,  ///< flow distance from the outlet, using the FlowLengthCode
+  StackChi            ///< chi, integrating (A_0/A)^(m/n) upstream from the outlet
+};
+
+/// @brief One quantity to be computed by LSDFlowInfo::accumulate_over_stack.
+struct StackAccumulator
+{
+  /// The operation to perform.
+  StackOperation Operation;
+
+  /// The value of each node, indexed by node. If empty every node has a value
+  /// of 1, so a StackSum gives the number of contributing pixels; these are
+  /// copied from NContributingNodes without traversing the stack. For StackChi
+  /// these replace the drainage area (e.g., a discharge); if empty the drainage
+  /// area from NContributingNodes is used.
+  vector<float> NodeValues;
+
+  /// The weight of each node for StackWeightedSum, indexed by node.
+  vector<float> NodeWeights;
+
+  /// The m/n ratio, used by StackChi.
+  float m_over_n;
+
+  /// The reference area (or discharge), used by StackChi.
+  float A_0;
+
+  /// The result for each node, indexed by node.
+  vector<float> Result;
+};
+
 
 /// @brief Object to perform flow routing.
 class LSDFlowInfo
@@ -120,6 +159,18 @@ class LSDFlowInfo
   LSDFlowInfo(vector<string>& BoundaryConditions, LSDRaster& TopoRaster)
                    { create(BoundaryConditions, TopoRaster); }
 
+  /// @brief Creates a FlowInfo object from topography, reusing a cached copy
+  /// if one was made from the same DEM and boundary conditions.
+  /// @details If cache_filename.FIcache matches the inputs it is loaded and no
+  /// flow routing is done; otherwise the flow info is calculated and the cache
+  /// is written. See cache_flow_info.
+  /// @param BoundaryConditions Vector<string> of the boundary conditions at each edge of the
+  /// DEM file (see above).
+  /// @param TopoRaster LSDRaster object containing the topographic data.
+  /// @param cache_filename The cache file, without extension. "NULL" turns the cache off.
+  LSDFlowInfo(vector<string>& BoundaryConditions, LSDRaster& TopoRaster, string cache_filename)
+                   { create(BoundaryConditions, TopoRaster, cache_filename); }
+
   /// @brief Copy of the LSDJunctionNetwork description here when written.
   friend class LSDJunctionNetwork;
 
@@ -331,8 +382,9 @@ class LSDFlowInfo
   /// @return FlowDirection values as a 2D Array.
   Array2D<int> get_FlowDirection() const { return FlowDirection; }
 
-  ///@brief Recursive add_to_stack routine, from Braun and Willett (2012)
-  ///equations 12 and 13.
+  ///@brief add_to_stack routine, from Braun and Willett (2012)
+  ///equations 12 and 13. Uses an explicit stack rather than recursion so
+  ///the depth of the drainage tree is not limited by the call stack.
   ///@param lm_index Integer
   ///@param j_index Integer
   ///@param bl_node Integer
@@ -398,6 +450,15 @@ class LSDFlowInfo
   ///@date 15/11/12
   LSDRaster write_DrainageArea_to_LSDRaster();
 
+  ///@brief Gets the D8 drainage area, the contributing pixels and the flow
+  ///distance from the outlet with a single call to accumulate_over_stack.
+  ///@param DrainageArea replaced with the D8 drainage area
+  ///@param ContributingPixels replaced with the number of contributing pixels
+  ///@param DistanceFromOutlet replaced with the flow distance from the outlet
+  void get_area_pixels_and_flow_distance(LSDRaster& DrainageArea,
+                                         LSDIndexRaster& ContributingPixels,
+                                         LSDRaster& DistanceFromOutlet);
+
   ///@brief Prints the flow information to file.
   ///@param filename String of the output file to be written.
   /// @author SMM
@@ -420,6 +481,41 @@ class LSDFlowInfo
   /// @date 01/016/12
   void pickle(string filename);
 
+  ///@brief Hashes the inputs to the flow routing: the DEM (georeferencing and
+  /// data), the fill applied to it and the boundary conditions. Used to check a
+  /// flow info cache is current.
+  ///@details Hash the DEM before it is filled, with the fill settings in
+  /// FillParameters, so that a matching cache can skip the fill as well.
+  ///@param BoundaryConditions Vector<string> of the boundary conditions.
+  ///@param TopoRaster LSDRaster object containing the topographic data.
+  ///@param FillParameters The settings of the fill that is applied to
+  /// TopoRaster before routing. Empty if the flow is routed over TopoRaster as it is.
+  ///@return A 64 bit hash of the inputs.
+  unsigned long long hash_flow_info_inputs(vector<string>& BoundaryConditions,
+                                           LSDRaster& TopoRaster,
+                                           vector<float>& FillParameters);
+
+  ///@brief Writes the flow info and the filled DEM it was made from to a
+  /// versioned binary cache, filename.FIcache.
+  ///@details The file has a fixed header (format version, byte order, sizes,
+  /// georeferencing, the input hash and a checksum of the data) followed by one
+  /// contiguous, 64 byte aligned block per array, so the arrays can be memory
+  /// mapped. Unlike pickle, the georeferencing strings are kept.
+  ///@param filename The cache file, without extension.
+  ///@param InputHash The hash of the inputs, from hash_flow_info_inputs.
+  ///@param FilledTopography The filled DEM the flow info was made from.
+  void cache_flow_info(string filename, unsigned long long InputHash,
+                       LSDRaster& FilledTopography);
+
+  ///@brief Loads a flow info cache written by cache_flow_info by memory mapping it.
+  ///@param filename The cache file, without extension.
+  ///@param InputHash The hash of the inputs the cache must have been made from.
+  ///@param FilledTopography Replaced by the filled DEM stored in the cache.
+  ///@return false, leaving the object unchanged, if the file is missing, has a
+  /// different version or byte order, was made from other inputs or fails its checksum.
+  bool load_cached_flow_info(string filename, unsigned long long InputHash,
+                             LSDRaster& FilledTopography);
+
   /// @brief This loads a csv file, putting the data into a data map
   /// @param filename The name of the csv file including path and extension
   /// @author SMM (ported into FlowInfo FJC 23/03/17)
@@ -547,11 +643,24 @@ class LSDFlowInfo
   ///to get a discharge raster
   ///@param A raster that contains the variable to be accumulated (e.g., precipitation)
   ///@return A raster containing the accumulated variable: NOTE the accumulation
-  ///does not include the node itself
+  ///includes the node itself
   ///@author SMM
   ///@date 09/06/2014
   LSDRaster upslope_variable_accumulator(LSDRaster& accum_raster);
 
+  ///@brief This function computes a set of quantities in a single traversal
+  ///of the stack in each direction that is needed: all the upslope
+  ///accumulations are done in one pass from the top of the stack and all the
+  ///downstream integrations (flow distance, chi) in one pass from the base.
+  ///@param Accumulators the quantities to compute. The Result vector of each
+  ///is replaced with the value at every node.
+  void accumulate_over_stack(vector<StackAccumulator>& Accumulators);
+
+  ///@brief This writes the result of an accumulator to an LSDRaster.
+  ///@param Accumulator an accumulator that has been through accumulate_over_stack
+  ///@return An LSDRaster of the result, with NoData off the flow network
+  LSDRaster write_accumulator_to_LSDRaster(StackAccumulator& Accumulator);
+
   ///@brief This function tests whether one node is upstream of another node
   ///@param current_node
   ///@param test_node
@@ -560,6 +669,15 @@ class LSDFlowInfo
   ///@date 08/10/13
   int is_node_upstream(int current_node, int test_node);
 
+  ///@brief This function takes a list of nodes and keeps only those with no
+  ///other node of the list upstream, using a single pass over the stack
+  ///rather than testing every pair of nodes.
+  ///@param Nodes the list of nodes
+  ///@return The nodes, in their original order, that have no other listed
+  ///node upstream. Repeated nodes are returned once and invalid node indices
+  ///are dropped.
+  vector<int> remove_nodes_with_upstream_nodes(vector<int>& Nodes);
+
   ///@brief This function tests whether a node is a base level node
   ///@param node
   ///@return int which is 1 if node is base level, 0 if not
@@ -735,6 +853,19 @@ class LSDFlowInfo
   /// @date 25/19/13
   int find_farthest_upslope_node(int node, LSDRaster& DistFromOutlet);
 
+  /// @brief This finds the farthest upslope node of every node in one pass
+  /// over the stack, so that repeated lookups (e.g., for every source in
+  /// DrEICH) do not each have to search the upslope nodes.
+  /// @param DistFromOutlet an LSDRaster containing the distance from the outlet.
+  /// @param FarthestUpslopeNodes returned with, for every node, the node that
+  /// find_farthest_upslope_node would give.
+  /// @param FarthestUpslopeDistances returned with, for every node, the
+  /// distance from the outlet of its farthest upslope node (zero if it is
+  /// its own farthest upslope node because no upslope distance is positive).
+  void calculate_farthest_upslope_nodes(LSDRaster& DistFromOutlet,
+                                        vector<int>& FarthestUpslopeNodes,
+                                        vector<float>& FarthestUpslopeDistances);
+
   /// @brief This takes a list of nodes and sorts them according to a
   ///  sorting raster (it could be anything) fin ascending order
   ///  nodes are then reordered to reflect the sorting of the raster
@@ -1226,10 +1357,48 @@ void get_nodeindices_from_csv(string csv_filename, vector<int>& NIs, vector<floa
   vector<string> BoundaryConditions;
 
   private:
+
+    /// @brief Splits the stack into independent tasks of contiguous sub-trees
+    /// for the parallel traversals.
+    /// @param MaxTaskSize the largest number of nodes in a task
+    /// @param TopLevelStackNodes returned with the stack positions of the task
+    /// roots and of the nodes that are in no task, in stack order
+    /// @param TaskStart returned with the first stack position of each task
+    /// @param TaskEnd returned with one past the last stack position of each task
+    void partition_stack(int MaxTaskSize, vector<int>& TopLevelStackNodes,
+                         vector<int>& TaskStart, vector<int>& TaskEnd);
+
+    /// @brief Combines the running upslope totals of a donor into those of its
+    /// receiver, for accumulate_over_stack.
+    void combine_upslope_totals(double* donor, double* receiver, vector<char>& is_max);
+
+    /// @brief Scales a contributing pixel accumulator to drainage area and
+    /// writes it to an LSDRaster.
+    LSDRaster write_drainage_area_accumulator_to_LSDRaster(StackAccumulator& Accumulator);
+
+    /// @brief Sets the downstream integrations of a node from its receiver,
+    /// for accumulate_over_stack.
+    void integrate_node_downstream(int this_node, vector<StackAccumulator>& Accumulators,
+                                   vector<int>& downstream_accum);
+
+    /// @brief Passes the farthest upslope candidate of a donor on to its
+    /// receiver, for calculate_farthest_upslope_nodes.
+    void pass_farthest_upslope_node(int donor_node, int receiver_node,
+                                    vector<int>& FarthestUpslopeNodes,
+                                    vector<float>& FarthestUpslopeDistances);
+
     void create();
     void create(string fname);
     void create(LSDRaster& TopoRaster);
     void create(vector<string>& temp_BoundaryConditions, LSDRaster& TopoRaster);
+    void create(vector<string>& temp_BoundaryConditions, LSDRaster& TopoRaster,
+                string cache_filename);
+
+    /// @brief Checks and unpacks a flow info cache held in memory, see
+    /// load_cached_flow_info.
+    bool unpack_flow_info_cache(string data_fname, const char* file_data,
+                                long long file_size, unsigned long long InputHash,
+                                LSDRaster& FilledTopography);
 };
 
 #endif
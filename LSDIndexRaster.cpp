@@ -95,6 +95,7 @@
 #include "LSDRaster.hpp"
 #include "LSDStatsTools.hpp"
 #include "LSDShapeTools.hpp"
+#include "LSDRasterInfo.hpp"
 
 using namespace std;
 using namespace TNT;
@@ -275,6 +276,158 @@ void LSDIndexRaster::create(LSDRaster& ARaster, int ConstValue)
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// These create functions read only part of a raster from disk
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDIndexRaster::create(string filename, string extension, int row_start, int col_start,
+                       int n_rows, int n_cols)
+{
+  read_raster_window(filename, extension, row_start, col_start, n_rows, n_cols);
+}
+
+void LSDIndexRaster::create(string filename, string extension, float XMin, float YMin,
+                       float XMax, float YMax, int halo_pixels)
+{
+  read_raster_bounding_box(filename, extension, XMin, YMin, XMax, YMax, halo_pixels);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This reads a window of a raster. The header is read by LSDRasterInfo and
+// for binary files only the window is read from disk.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDIndexRaster::read_raster_window(string filename, string extension, int row_start,
+                                   int col_start, int n_rows, int n_cols)
+{
+  LSDRasterInfo RasterInfo(filename, extension);
+  read_raster_window(RasterInfo, filename, extension, row_start, col_start, n_rows, n_cols);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This reads the part of a raster within a bounding box, plus a halo
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDIndexRaster::read_raster_bounding_box(string filename, string extension, float XMin,
+                                float YMin, float XMax, float YMax, int halo_pixels)
+{
+  LSDRasterInfo RasterInfo(filename, extension);
+  int row_start, col_start, n_rows, n_cols;
+  if (not RasterInfo.get_window_of_bounding_box(XMin, YMin, XMax, YMax, halo_pixels,
+                                                row_start, col_start, n_rows, n_cols))
+  {
+    cout << "\nFATAL ERROR: the bounding box does not overlap the raster "
+         << filename << "." << extension << endl;
+    exit(EXIT_FAILURE);
+  }
+  read_raster_window(RasterInfo, filename, extension, row_start, col_start, n_rows, n_cols);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// The workhorse of the windowed readers
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDIndexRaster::read_raster_window(LSDRasterInfo& RasterInfo, string filename, string extension,
+                                   int row_start, int col_start, int n_rows, int n_cols)
+{
+  string string_filename = filename+"."+extension;
+  int FullNRows = RasterInfo.get_NRows();
+  int FullNCols = RasterInfo.get_NCols();
+
+  // clip the window to the raster
+  if (row_start < 0)
+  {
+    n_rows += row_start;
+    row_start = 0;
+  }
+  if (col_start < 0)
+  {
+    n_cols += col_start;
+    col_start = 0;
+  }
+  if (row_start+n_rows > FullNRows)
+  {
+    n_rows = FullNRows-row_start;
+  }
+  if (col_start+n_cols > FullNCols)
+  {
+    n_cols = FullNCols-col_start;
+  }
+  if (n_rows <= 0 || n_cols <= 0)
+  {
+    cout << "\nFATAL ERROR: the window does not overlap the raster "
+         << string_filename << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // the georeferencing of the window
+  NRows = n_rows;
+  NCols = n_cols;
+  DataResolution = RasterInfo.get_DataResolution();
+  NoDataValue = RasterInfo.get_NoDataValue();
+  XMinimum = RasterInfo.get_XMinimum() + col_start*DataResolution;
+  YMinimum = RasterInfo.get_YMinimum() + (FullNRows-row_start-n_rows)*DataResolution;
+  GeoReferencingStrings = RasterInfo.get_GeoReferencingStrings();
+
+  Array2D<int> data(NRows,NCols);
+  if (extension == "asc")
+  {
+    // ascii data has to be parsed up to the last row of the window,
+    // but only the window is stored
+    ifstream data_in(string_filename.c_str());
+    string str;
+    for (int i = 0; i<12; i++)
+    {
+      data_in >> str;
+    }
+    int temp;
+    for (int i=0; i<row_start+n_rows; ++i)
+    {
+      for (int j=0; j<FullNCols; ++j)
+      {
+        data_in >> temp;
+        if (i >= row_start && j >= col_start && j < col_start+n_cols)
+        {
+          data[i-row_start][j-col_start] = temp;
+        }
+      }
+    }
+    data_in.close();
+  }
+  else if (extension == "flt" || extension == "bil")
+  {
+    // unusual data types: guess the type from the size of the file
+    int DataType = RasterInfo.get_DataType();
+    if (get_ENVI_data_type_size(DataType) == 0)
+    {
+      cout << "WARNING loading ENVI raster with unusual data type. " << endl
+           << "Guessing the type from the size of the file." << endl;
+      DataType = guess_ENVI_data_type(string_filename, RasterInfo.get_HeaderOffset(),
+                                      FullNRows, FullNCols, true);
+    }
+
+    int* data_ptr = &data[0][0];
+    if (not read_ENVI_binary_window(string_filename, DataType,
+                                    RasterInfo.get_ByteOrder(), RasterInfo.get_HeaderOffset(),
+                                    FullNCols, row_start, col_start, n_rows, n_cols, data_ptr))
+    {
+      cout << "\nFATAL ERROR: could not read the data file \"" << string_filename
+           << "\"" << endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  else
+  {
+    cout << "You did not enter and appropriate extension!" << endl
+          << "You entered: " << extension << " options are .flt, .asc and .bil" << endl;
+    exit(EXIT_FAILURE);
+  }
+  RasterData = data;
+
+  // update the map info to the new corner
+  if (GeoReferencingStrings.find("ENVI_map_info") != GeoReferencingStrings.end())
+  {
+    Update_GeoReferencingStrings();
+  }
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // this function reads a DEM
 // One has to provide both the filename and the extension
@@ -329,8 +482,9 @@ void LSDIndexRaster::read_raster(string filename, string extension)
     }
     data_in.close();
 
-    // now update the objects raster data
-    RasterData = data.copy();
+    // now update the objects raster data. TNT assignment shares the
+    // storage so there is no need for a second copy
+    RasterData = data;
   }
   else if (extension == "flt")
   {
@@ -340,6 +494,8 @@ void LSDIndexRaster::read_raster(string filename, string extension)
     string header_extension = "hdr";
     header_filename = filename+dot+header_extension;
 
+    int ByteOrder = get_host_byte_order();
+
     ifstream ifs(header_filename.c_str());
     if( ifs.fail() )
     {
@@ -354,6 +510,20 @@ void LSDIndexRaster::read_raster(string filename, string extension)
         >> str >> XMinimum >> str >> YMinimum
         >> str >> DataResolution
         >> str >> NoDataValue;
+
+      // the optional byteorder line
+      while (ifs >> str)
+      {
+        transform(str.begin(), str.end(), str.begin(), ::toupper);
+        if (str == "MSBFIRST")
+        {
+          ByteOrder = 1;
+        }
+        else if (str == "LSBFIRST")
+        {
+          ByteOrder = 0;
+        }
+      }
     }
     ifs.close();
 
@@ -362,33 +532,19 @@ void LSDIndexRaster::read_raster(string filename, string extension)
          << "Data Resolution: " << DataResolution << " and No Data Value: "
          << NoDataValue << endl;
 
-    // this is the array into which data is fed
-    Array2D<int> data(NRows,NCols,NoDataValue);
-
-    // now read the DEM, using the binary stream option
-    ifstream ifs_data(string_filename.c_str(), ios::in | ios::binary);
-    if( ifs_data.fail() )
+    // this is the array into which data is fed. The float data
+    // is cast to int in chunks as it is read
+    Array2D<int> data(NRows,NCols);
+    if (not read_ENVI_binary_data(string_filename, 4, ByteOrder, 0,
+                                  long(NRows)*long(NCols), &data[0][0]))
     {
-      cout << "\nFATAL ERROR: the data file \"" << string_filename
-           << "\" doesn't exist" << endl;
+      cout << "\nFATAL ERROR: could not read the data file \"" << string_filename
+           << "\"" << endl;
       exit(EXIT_FAILURE);
     }
-    else
-    {
-      float temp;
-      for (int i=0; i<NRows; ++i)
-      {
-        for (int j=0; j<NCols; ++j)
-        {
-          ifs_data.read(reinterpret_cast<char*>(&temp), sizeof(temp));
-          data[i][j] = int(temp);
-        }
-      }
-    }
-    ifs_data.close();
 
     // now update the objects raster data
-    RasterData = data.copy();
+    RasterData = data;
   }
   else if (extension == "bil")
   {
@@ -398,6 +554,8 @@ void LSDIndexRaster::read_raster(string filename, string extension)
     string header_extension = "hdr";
     header_filename = filename+dot+header_extension;
     int NoDataExists = 0;
+    int ByteOrder = get_host_byte_order();
+    long HeaderOffset = 0;
 
     ifstream ifs(header_filename.c_str());
     if( ifs.fail() )
@@ -534,6 +692,50 @@ void LSDIndexRaster::read_raster(string filename, string extension)
           }
         }
 
+        // get byte order
+        counter = 0;
+        str_find = "byte order";
+        while (counter < NLines)
+        {
+          found = lines[counter].find(str_find);
+          if (found!=string::npos)
+          {
+            // get the data using a stringstream
+            istringstream iss(lines[counter]);
+            iss >> str >> str >> str >> str;
+            ByteOrder = atoi(str.c_str());
+
+            // advance to the end so you move on to the new loop
+            counter = lines.size();
+          }
+          else
+          {
+            counter++;
+          }
+        }
+
+        // get header offset
+        counter = 0;
+        str_find = "header offset";
+        while (counter < NLines)
+        {
+          found = lines[counter].find(str_find);
+          if (found!=string::npos)
+          {
+            // get the data using a stringstream
+            istringstream iss(lines[counter]);
+            iss >> str >> str >> str >> str;
+            HeaderOffset = atol(str.c_str());
+
+            // advance to the end so you move on to the new loop
+            counter = lines.size();
+          }
+          else
+          {
+            counter++;
+          }
+        }
+
         // get the map info
         counter = 0;
         string this_map_info = "empty";
@@ -634,98 +836,26 @@ void LSDIndexRaster::read_raster(string filename, string extension)
     {
       NoDataValue = -9999;
     }
-    //bool set_NDV = false;
-    Array2D<int> data(NRows,NCols,NoDataValue);
-
-    // now read the DEM, using the binary stream option
-    ifstream ifs_data(string_filename.c_str(), ios::in | ios::binary);
-    if( ifs_data.fail() )
+    // unusual data types: guess the type from the size of the file
+    if (get_ENVI_data_type_size(DataType) == 0)
     {
-      cout << "\nFATAL ERROR: the data file \"" << string_filename
-           << "\" doesn't exist" << endl;
-      exit(EXIT_FAILURE);
-    }
-    else
+      cout << "WARNING loading ENVI raster with unusual data type. " << endl
+           << "Guessing the type from the size of the file." << endl;
+      DataType = guess_ENVI_data_type(string_filename, HeaderOffset, NRows, NCols, true);
+    }
+
+    // read the raster straight into its storage.
+    // Int data is read in one block, other types are converted in chunks
+    Array2D<int> data(NRows,NCols);
+    long NElements = long(NRows)*long(NCols);
+    int* data_ptr = &data[0][0];
+    if (not read_ENVI_binary_data(string_filename, DataType, ByteOrder, HeaderOffset,
+                                  NElements, data_ptr))
     {
-      if (DataType == 2)
-      {
-        //cout << "Loading raster, recasting data from int to float!" << endl;
-        int temp;
-        //cout << "Integer size: " << sizeof(temp) << endl;
-        for (int i=0; i<NRows; ++i)
-        {
-          for (int j=0; j<NCols; ++j)
-          {
-            ifs_data.read(reinterpret_cast<char*>(&temp), 2);
-            //cout << temp << " ";
-            data[i][j] = int(temp);
-            if (data[i][j]<-1e10)
-            {
-              data[i][j] = NoDataValue;
-            }
-          }
-          //cout << endl;
-        }
-      }
-      else if (DataType == 4)
-      {
-        float temp;
-        //cout << "Float size: " << sizeof(temp) << endl;
-        for (int i=0; i<NRows; ++i)
-        {
-          for (int j=0; j<NCols; ++j)
-          {
-            ifs_data.read(reinterpret_cast<char*>(&temp), sizeof(temp));
-
-            data[i][j] = int(temp);
-            if (data[i][j]<-1e10)
-            {
-              data[i][j] = NoDataValue;
-            }
-          }
-        }
-      }
-      else if (DataType == 13)
-      {
-        unsigned long int temp;
-        //cout << "Float size: " << sizeof(temp) << endl;
-        for (int i=0; i<NRows; ++i)
-        {
-          for (int j=0; j<NCols; ++j)
-          {
-            ifs_data.read(reinterpret_cast<char*>(&temp), sizeof(temp));
-
-            data[i][j] = int(temp);
-            if (data[i][j]<-1e10)
-            {
-              data[i][j] = NoDataValue;
-            }
-          }
-        }
-      }
-      else
-      {
-        cout << "WARNING loading ENVI raster with unusual data type. " << endl
-             << "If you get a crazy DEM go to LINE 604 of LSDIndexRaster.cpp to debug" << endl;
-        int temp;   // might need to change this
-        //cout << "Float size: " << sizeof(temp) << endl;
-        for (int i=0; i<NRows; ++i)
-        {
-          for (int j=0; j<NCols; ++j)
-          {
-            // Use data type to control the bytes being read for each entry
-            ifs_data.read(reinterpret_cast<char*>(&temp), DataType);
-
-            data[i][j] = int(temp);
-            if (data[i][j]<-1e10)
-            {
-              data[i][j] = NoDataValue;
-            }
-          }
-        }
-      }
+      cout << "\nFATAL ERROR: could not read the data file \"" << string_filename
+           << "\"" << endl;
+      exit(EXIT_FAILURE);
     }
-    ifs_data.close();
 
     cout << "Loading ENVI bil file; NCols: " << NCols << " NRows: " << NRows << endl
          << "X minimum: " << XMinimum << " YMinimum: " << YMinimum << endl
@@ -733,7 +863,7 @@ void LSDIndexRaster::read_raster(string filename, string extension)
          << NoDataValue << endl;
 
     // now update the objects raster data
-    RasterData = data.copy();
+    RasterData = data;
   }
   else
   {
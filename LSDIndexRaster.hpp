@@ -87,6 +87,8 @@ using namespace TNT;
 class LSDRaster;        // do not include since it wouldn't compile since there
                         // would be a looped dependency
 
+class LSDRasterInfo;
+
 /// @brief Object to handle integer rasters.
 class LSDIndexRaster
 {
@@ -105,6 +107,31 @@ class LSDIndexRaster
   /// @date 01/01/12
   LSDIndexRaster(string filename, string extension)  { create(filename, extension); }
 
+  /// @brief Create an LSDIndexRaster from a window of a file, reading only the
+  /// rows and columns of the window from disk.
+  /// @param filename A String, the file to be loaded.
+  /// @param extension A String, the file extension to be loaded.
+  /// @param row_start The first row of the window, counted from the top.
+  /// @param col_start The first column of the window.
+  /// @param n_rows The number of rows in the window.
+  /// @param n_cols The number of columns in the window.
+  LSDIndexRaster(string filename, string extension, int row_start, int col_start,
+            int n_rows, int n_cols)
+      { create(filename, extension, row_start, col_start, n_rows, n_cols); }
+
+  /// @brief Create an LSDIndexRaster from the part of a file that lies within a
+  /// bounding box, plus a halo of pixels, reading only that region from disk.
+  /// @param filename A String, the file to be loaded.
+  /// @param extension A String, the file extension to be loaded.
+  /// @param XMin The minimum x coordinate of the box.
+  /// @param YMin The minimum y coordinate of the box.
+  /// @param XMax The maximum x coordinate of the box.
+  /// @param YMax The maximum y coordinate of the box.
+  /// @param halo_pixels The number of pixels added around the box.
+  LSDIndexRaster(string filename, string extension, float XMin, float YMin,
+            float XMax, float YMax, int halo_pixels)
+      { create(filename, extension, XMin, YMin, XMax, YMax, halo_pixels); }
+
   /// @brief Create an LSDIndexRaster from memory.
   /// @return LSDIndexRaster
   /// @param nrows An integer of the number of rows.
@@ -212,6 +239,34 @@ class LSDIndexRaster
   /// @date 01/01/12
   void read_raster(string filename, string extension);
 
+  /// @brief Read a window of a raster into memory from a file.
+  ///
+  /// The header is parsed with LSDRasterInfo and, for .flt and .bil files,
+  /// only the rows and columns of the window are read from disk, so
+  /// memory and I/O scale with the window rather than the full raster.
+  /// The georeferencing is updated to the window. The window is clipped
+  /// to the extent of the raster.
+  /// @param filename a string of the filename _without_ the extension.
+  /// @param extension a string of the extension _without_ the leading dot
+  /// @param row_start The first row of the window, counted from the top.
+  /// @param col_start The first column of the window.
+  /// @param n_rows The number of rows in the window.
+  /// @param n_cols The number of columns in the window.
+  void read_raster_window(string filename, string extension, int row_start,
+                          int col_start, int n_rows, int n_cols);
+
+  /// @brief Read the part of a raster that lies within a bounding box
+  /// into memory from a file. See read_raster_window.
+  /// @param filename a string of the filename _without_ the extension.
+  /// @param extension a string of the extension _without_ the leading dot
+  /// @param XMin The minimum x coordinate of the box.
+  /// @param YMin The minimum y coordinate of the box.
+  /// @param XMax The maximum x coordinate of the box.
+  /// @param YMax The maximum y coordinate of the box.
+  /// @param halo_pixels The number of pixels added on each side of the box.
+  void read_raster_bounding_box(string filename, string extension, float XMin,
+                                float YMin, float XMax, float YMax, int halo_pixels);
+
   /// @brief Read a raster from memory to a file.
   ///
   /// The supported formats are .asc and .flt which are
@@ -612,6 +667,14 @@ class LSDIndexRaster
   private:
   void create();
   void create(string filename, string extension);
+  void create(string filename, string extension, int row_start, int col_start,
+              int n_rows, int n_cols);
+  void create(string filename, string extension, float XMin, float YMin,
+              float XMax, float YMax, int halo_pixels);
+
+  /// @brief Reads a window of the file described by RasterInfo
+  void read_raster_window(LSDRasterInfo& RasterInfo, string filename, string extension,
+                          int row_start, int col_start, int n_rows, int n_cols);
   void create(int ncols, int nrows, float xmin, float ymin,
               float cellsize, int ndv, Array2D<int> data);
   void create(int ncols, int nrows, float xmin, float ymin,
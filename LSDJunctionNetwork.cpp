@@ -88,6 +88,7 @@
 #include <fstream>
 #include <map>
 #include <algorithm>
+#include <queue>
 #include "TNT/tnt.h"
 #include "LSDFlowInfo.hpp"
 #include "LSDRaster.hpp"
@@ -125,6 +126,8 @@ LSDJunctionNetwork& LSDJunctionNetwork::operator=(const LSDJunctionNetwork& rhs)
     SVector  = rhs.SVector;
     SVectorIndex  = rhs.SVectorIndex;
     NContributingJunctions  = rhs.NContributingJunctions;
+    SourceStackVector = rhs.SourceStackVector;
+    SourceStackIndex = rhs.SourceStackIndex;
 
     StreamOrderArray = rhs.StreamOrderArray.copy();
     JunctionArray = rhs.JunctionArray.copy();
@@ -156,11 +159,13 @@ void LSDJunctionNetwork::create( void )
   SVector  = emptyvec;
   SVectorIndex  = emptyvec;
   NContributingJunctions  = emptyvec;
+  SourceStackVector = emptyvec;
+  SourceStackIndex = emptyvec;
 
-  Array2D<int> emptyarray(0,0);
-  StreamOrderArray = emptyarray.copy();
-  JunctionArray = emptyarray.copy();
-  JunctionIndexArray = emptyarray.copy();
+  LSDSparseArray2D emptyarray;
+  StreamOrderArray = emptyarray;
+  JunctionArray = emptyarray;
+  JunctionIndexArray = emptyarray;
 
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -173,8 +178,11 @@ void LSDJunctionNetwork::create( void )
 //
 // SMM 01/09/2012
 //
+// If SparseStorage is true the stream order and junction arrays only store
+// the channel pixels.
+//
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-void LSDJunctionNetwork::create(vector<int> Sources, LSDFlowInfo& FlowInfo)
+void LSDJunctionNetwork::create(vector<int> Sources, LSDFlowInfo& FlowInfo, bool SparseStorage)
 {
   NRows = FlowInfo.NRows;
   NCols = FlowInfo.NCols;
@@ -187,7 +195,7 @@ void LSDJunctionNetwork::create(vector<int> Sources, LSDFlowInfo& FlowInfo)
   SourcesVector = Sources;
 
   // start arrays where the data all begins as nodata
-  Array2D<int> TempLinkArray(NRows,NCols,NoDataValue);
+  LSDSparseArray2D TempLinkArray(NRows,NCols,NoDataValue,SparseStorage);
 
   JunctionArray = TempLinkArray.copy();
   StreamOrderArray = TempLinkArray.copy();
@@ -207,203 +215,272 @@ void LSDJunctionNetwork::create(vector<int> Sources, LSDFlowInfo& FlowInfo)
   int current_node;
   int current_row,current_col;
   int receiver_node;
-  int baselevel_switch;		// 0 if not a base level node, 1 if so
   int current_stream_order;
   int junction_switch;
-  int donor_node, donor_row,donor_col;
-  int n_current_stream_order_donors;
-
-  // loop through sources.
-  // this loop sets the stream orders and identifies the
-  // junctions
-  // it is the first of two loops through the stream network
-  // the second will generate the stream link information
+
+  // The first pass through the stream network sets the stream orders and
+  // identifies the junctions. It visits every channel pixel once.
+  //
+  // NBranches is the number of branches draining into each pixel, so it is
+  // zero for pixels that are not in the channel network. Sources are first
+  // order branches of the channel, so a source that another source drains
+  // through is a junction. NDonorsLeft is the number of channel pixels that
+  // drain into each pixel and have not yet passed on their stream order.
+  // OrderCount holds the highest stream order of the branches of each pixel
+  // times 16 plus the number of branches with that order (a pixel can have
+  // at most eight donors and itself be a source).
+  int n_nodes = FlowInfo.NDataNodes;
+  vector<unsigned char> NBranches(n_nodes,0);
+  vector<unsigned char> NDonorsLeft(n_nodes,0);
+  vector<unsigned short> OrderCount(n_nodes,0);
   for(int src = 0; src<n_sources; src++)
   {
-    baselevel_switch =0;    // 0 == not base level
-    junction_switch = 0;    // 0 == no junction so far
     current_node = SourcesVector[src];
-    current_row = FlowInfo.RowIndex[current_node];
-    current_col = FlowInfo.ColIndex[current_node];
-    receiver_node = FlowInfo.ReceiverVector[current_node];
-
-    current_stream_order = 1;
-
-    if (current_node == receiver_node)
+    if (OrderCount[current_node] != 0)
     {
-      baselevel_switch = 1;
+      // a repeated source
+      continue;
     }
+    OrderCount[current_node] = 1*16+1;
 
-
-    // follow node down through receivers until it hits a base level node
-    // the switch is set to 2 because if there is a baselevel node
-    // the algorithm has to go through the loop once to register the
-    // 'downslope node' as the baselevel
-    while ( baselevel_switch <2 )
+    // follow the source downstream until it reaches a pixel that is already
+    // in the channel network
+    junction_switch = NBranches[current_node];
+    NBranches[current_node]++;
+    while (junction_switch == 0)
     {
-
-      // check if this node has already been added to the channel network
-      // if it hasn't, then this becomes a channel of order of the current order
-      if(StreamOrderArray[current_row][current_col] == NoDataValue)
+      receiver_node = FlowInfo.ReceiverVector[current_node];
+      if (receiver_node == current_node)
       {
-      	StreamOrderArray[current_row][current_col] = current_stream_order;
+        junction_switch = 1;
       }
-      // if it isn't a nodata node:
-      // note that the junction switch starts out as a zero.
-      // the channel is followed looking at nodata values in the stream order array
-      // once it hits the first junction, the StreamOrderArray has finite values,
-      // so this logic is triggered.
-      else if(StreamOrderArray[current_row][current_col] != NoDataValue)
+      else
       {
+        junction_switch = NBranches[receiver_node];
+        NBranches[receiver_node]++;
+        NDonorsLeft[receiver_node]++;
+        current_node = receiver_node;
+      }
+    }
+  }
 
-        // each source contributes a junction unless it is the
-        // only source to go to a given baselevel node
-        // check to see if this is the first time the channel
-        // has hit another channel. If so, add the junction
-        // and set the junction switch to 1 so that no further
-        // junctions are added
-        // also if it is a junction check to see if the stream order has been incremented
-        // if it has not, the base level switch is turn to 2 and the
-        // algorithm exits this loop and goes to the next source
-        // if it has, this and all downstream nodes take on the new stream order
-        // if junction switch is zero it means this is the first visit of a previously visited channel
-        if (junction_switch == 0)
-        {
-          junction_switch = 1;
-          JunctionArray[current_row][current_col]  = 1;
-
-          // if it is the the first junction for this source, the current_stream_order
-          // is one. Therefore any junction will result in a stream order
-          // of at least 2.
-          // If the junction is currently at a stream order of 1, then it
-          // gets incremented
-          if (StreamOrderArray[current_row][current_col] == current_stream_order)
-          {
-            current_stream_order ++;
-            StreamOrderArray[current_row][current_col]= current_stream_order;
-          }
-          // if the junction is two or greater, the loop exits since there can
-          // be no more incrementing of the stream order
-          else
-          {
-            baselevel_switch = 2;
-          }
-        }
-        else
-        {
-          // first, we check to see if it is not a junction. if not, we update the
-          // stream order. If the stream order hasn't changed, then something
-          // is amiss since there is no point moving downstream
-          // when the current stream order is the same as the previous stream order,
-          // since it can't increase stream order downstream
-          // nodes following downstream will be at the current stream order
-          if (JunctionArray[current_row][current_col]  != 1)
-          {
-            // THIS IS NOT A JUNCTION
-            // if the current stream order is bigger than the existing stream order
-            // at this point, then increase the existing stream order
-            if ( current_stream_order > StreamOrderArray[current_row][current_col])
-            {
-              StreamOrderArray[current_row][current_col] = current_stream_order;
-            }
-            else
-            {
-              baselevel_switch = 2;
-            }
+  // now the stream orders are passed downstream in topological order, starting
+  // from the sources that nothing drains into: a pixel is visited once all of
+  // its channel donors have been, and passes its stream order on to its
+  // receiver. Only channel pixels are visited. The stream order increases when
+  // two or more branches share the highest order (Strahler ordering).
+  vector<int> NodesToVisit;
+  for(int src = 0; src<n_sources; src++)
+  {
+    current_node = SourcesVector[src];
+    if (NDonorsLeft[current_node] == 0)
+    {
+      // flag the source so a repeated source is only visited once
+      NDonorsLeft[current_node] = 255;
+      NodesToVisit.push_back(current_node);
+    }
+  }
+  while (NodesToVisit.empty() == false)
+  {
+    current_node = NodesToVisit.back();
+    NodesToVisit.pop_back();
 
-          }
-          // if it is a junction, see if there is an increment
-          // in the current stream order
-          // the node it has come from has an updated current stream order
-          // so just look at the donor nodes to
-          // see if there are two or more
-          // donors at a higher stream order
-          else if (JunctionArray[current_row][current_col]  == 1)
-          {
-            // THIS IS A JUNCTION
-            // first, check to see if this has a higher stream order than the current stream
-            // order
-            if (StreamOrderArray[current_row][current_col] > current_stream_order)
-            {
-              // yes, the stream order at this junction is higher than the current stream order
-              // even if the junction is incremented the downstream search would
-              // stop here, so get out with the baselevel switch
-              baselevel_switch = 2;
-            }
-            else if ( StreamOrderArray[current_row][current_col] == current_stream_order)
-            {
+    current_stream_order = OrderCount[current_node]/16;
+    if (OrderCount[current_node]%16 >= 2)
+    {
+      current_stream_order++;
+    }
 
+    current_row = FlowInfo.RowIndex[current_node];
+    current_col = FlowInfo.ColIndex[current_node];
+    StreamOrderArray.set(current_row, current_col, current_stream_order);
+    if (NBranches[current_node] >= 2)
+    {
+      JunctionArray.set(current_row, current_col, 1);
+    }
 
-              // this means that the current stream order is equal to or less than the streamorder
-              // currently at this node this means you need to check and see if the thing is incremented
-              n_current_stream_order_donors = 0;
-              for(int dnode = 0; dnode<FlowInfo.NDonorsVector[current_node]; dnode++)
-              {
-                donor_node = FlowInfo.DonorStackVector[ FlowInfo.DeltaVector[current_node]+dnode];
-
-                // ignore the base level donor
-                if (donor_node != current_node)
-                {
-                  donor_row = FlowInfo.RowIndex[ donor_node ];
-                  donor_col = FlowInfo.ColIndex[ donor_node ];
-
-                  if (StreamOrderArray[donor_row][donor_col] == current_stream_order)
-                  {
-                    n_current_stream_order_donors++;
-                  }
-                }
-              }
+    receiver_node = FlowInfo.ReceiverVector[current_node];
+    if (receiver_node != current_node)
+    {
+      if (current_stream_order > OrderCount[receiver_node]/16)
+      {
+        OrderCount[receiver_node] = current_stream_order*16+1;
+      }
+      else if (current_stream_order == OrderCount[receiver_node]/16)
+      {
+        OrderCount[receiver_node]++;
+      }
 
-              // now check to see if the stream order has increased
-              if (n_current_stream_order_donors >= 2)
-              {
-                current_stream_order++;
-                StreamOrderArray[current_row][current_col] = current_stream_order;
-              }
-              else    // if it hasn't, the loop ends here.
-              {
-                baselevel_switch = 2;
-              }
+      NDonorsLeft[receiver_node]--;
+      if (NDonorsLeft[receiver_node] == 0)
+      {
+        NodesToVisit.push_back(receiver_node);
+      }
+    }
+  }
 
-            }
-            else if (StreamOrderArray[current_row][current_col] < current_stream_order)
-            {
+  // the second pass numbers the junctions and builds the junction tree
+  build_junctions_from_stream_orders(FlowInfo);
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
-              // the current stream order is higher than the stream order at this point.
-              // the node needs to update its stream order and keep going
-              StreamOrderArray[current_row][current_col] = current_stream_order;
-            }
-            else
-            {
-              cout << "something about the logic has gone wrong. " <<endl;
-              cout << "hhh node: " << current_node << ", current_stream_order " << current_stream_order
-                   << " array: " << StreamOrderArray[current_row][current_col]<<" and src: " << SourcesVector[src] << endl;
-            }
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// update_sources
+// This changes the sources of the channel network without rebuilding it. The
+// stream orders can only change downstream of sources that have been added or
+// removed, so only those flow paths are revisited. The junctions are then
+// renumbered from the stream order and junction arrays, so the network is the
+// same as one created from scratch with the new sources. If more than half of
+// the sources have changed the network is simply created again.
+// The FlowInfo object must be the one the network was created with.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDJunctionNetwork::update_sources(vector<int> NewSources, LSDFlowInfo& FlowInfo)
+{
+  // find the sources that have been added or removed
+  vector<int> OldSourcesSorted = SourcesVector;
+  sort(OldSourcesSorted.begin(), OldSourcesSorted.end());
+  OldSourcesSorted.erase(unique(OldSourcesSorted.begin(), OldSourcesSorted.end()), OldSourcesSorted.end());
+  vector<int> NewSourcesSorted = NewSources;
+  sort(NewSourcesSorted.begin(), NewSourcesSorted.end());
+  NewSourcesSorted.erase(unique(NewSourcesSorted.begin(), NewSourcesSorted.end()), NewSourcesSorted.end());
+  vector<int> ChangedSources;
+  set_symmetric_difference(OldSourcesSorted.begin(), OldSourcesSorted.end(),
+                           NewSourcesSorted.begin(), NewSourcesSorted.end(),
+                           back_inserter(ChangedSources));
+
+  // if most of the sources have changed it is quicker to start again
+  int n_changed = int(ChangedSources.size());
+  if (2*n_changed > int(NewSourcesSorted.size()))
+  {
+    create(NewSources, FlowInfo, StreamOrderArray.is_sparse());
+    return;
+  }
+
+  // put the junction arrays back to the state they were in after the first
+  // pass of create: the second pass numbers the junctions in the
+  // JunctionIndexArray and counts visits to them in the JunctionArray
+  int row,col;
+  for (int junc = 0; junc<NJunctions; junc++)
+  {
+    row = FlowInfo.RowIndex[ JunctionVector[junc] ];
+    col = FlowInfo.ColIndex[ JunctionVector[junc] ];
+    JunctionIndexArray.set(row, col, NoDataValue);
+    if (JunctionArray.get(row, col) != NoDataValue)
+    {
+      JunctionArray.set(row, col, 1);
+    }
+  }
 
-          }  // end logic for if this is a downstream junction
-        }    // end logic for if this is not the first junction
-      }      // end logic for if this is not a NoData node
+  // now reset the stream orders moving downstream from the changed sources.
+  // The nodes waiting to be visited are kept in a heap ordered by their
+  // position in the FlowInfo stack: donors come after their receivers in the
+  // stack, so the node with the largest stack index is visited first and all
+  // of its changed donors have been finished. A node only passes the update
+  // on to its receiver if its stream order has changed, so only the part of
+  // the network that actually changes is revisited. The JunctionIndexArray is
+  // used to mark nodes in the heap until the junctions are renumbered.
+  // The rules are those of the first pass of create: sources are first order
+  // branches and a node with two or more branches is a junction.
+  priority_queue< pair<int,int> > NodesToVisit;
+  for (int i = 0; i<n_changed; i++)
+  {
+    row = FlowInfo.RowIndex[ ChangedSources[i] ];
+    col = FlowInfo.ColIndex[ ChangedSources[i] ];
+    JunctionIndexArray.set(row, col, 1);
+    NodesToVisit.push( make_pair(FlowInfo.SVectorIndex[ ChangedSources[i] ], ChangedSources[i]) );
+  }
 
+  while (NodesToVisit.empty() == false)
+  {
+    int current_node = NodesToVisit.top().second;
+    NodesToVisit.pop();
 
-      // get the next current node, which is this nodes receiver
-      current_node = FlowInfo.ReceiverVector[current_node];
+    int n_branches = 0;
+    int max_order = 0;
+    int n_max_order = 0;
+    if (binary_search(NewSourcesSorted.begin(), NewSourcesSorted.end(), current_node))
+    {
+      n_branches = 1;
+      max_order = 1;
+      n_max_order = 1;
+    }
+    for (int d_index = FlowInfo.DeltaVector[current_node]; d_index<FlowInfo.DeltaVector[current_node+1]; d_index++)
+    {
+      int donor_node = FlowInfo.DonorStackVector[d_index];
+      int donor_order = StreamOrderArray.get(FlowInfo.RowIndex[donor_node], FlowInfo.ColIndex[donor_node]);
+      if (donor_node != current_node && donor_order != NoDataValue)
+      {
+        n_branches++;
+        if (donor_order > max_order)
+        {
+          max_order = donor_order;
+          n_max_order = 1;
+        }
+        else if (donor_order == max_order)
+        {
+          n_max_order++;
+        }
+      }
+    }
 
-      // get the next receiver node, which is the next node
-      receiver_node = FlowInfo.ReceiverVector[current_node];
-      current_row = FlowInfo.RowIndex[current_node];
-      current_col = FlowInfo.ColIndex[current_node];
+    row = FlowInfo.RowIndex[current_node];
+    col = FlowInfo.ColIndex[current_node];
+    JunctionIndexArray.set(row, col, NoDataValue);
+    int old_order = StreamOrderArray.get(row, col);
+    if (n_branches == 0)
+    {
+      // no longer in the channel network
+      StreamOrderArray.set(row, col, NoDataValue);
+      JunctionArray.set(row, col, NoDataValue);
+    }
+    else
+    {
+      StreamOrderArray.set(row, col, (n_max_order >= 2) ? max_order+1 : max_order);
+      JunctionArray.set(row, col, (n_branches >= 2) ? 1 : NoDataValue);
+    }
 
-      // if this is a baselevel node
-      if (current_node == receiver_node)
+    int receiver_node = FlowInfo.ReceiverVector[current_node];
+    if (StreamOrderArray.get(row, col) != old_order && receiver_node != current_node)
+    {
+      row = FlowInfo.RowIndex[receiver_node];
+      col = FlowInfo.ColIndex[receiver_node];
+      if (JunctionIndexArray.get(row, col) == NoDataValue)
       {
-        baselevel_switch ++;
+        JunctionIndexArray.set(row, col, 1);
+        NodesToVisit.push( make_pair(FlowInfo.SVectorIndex[receiver_node], receiver_node) );
       }
+    }
+  }
 
+  SourcesVector = NewSources;
+  build_junctions_from_stream_orders(FlowInfo);
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
-    }    // end flow to baselevel loop
-
-  }      // end sources loop
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This is the second pass of create. It numbers the junctions by following
+// each source downstream, using the StreamOrderArray and the JunctionArray
+// (1 at junctions, NoData elsewhere) set in the first pass, and the
+// JunctionIndexArray, which must be NoData everywhere. It then builds the
+// junction tree and stack from the receivers of the junctions.
+//
+// Split out of create
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDJunctionNetwork::build_junctions_from_stream_orders(LSDFlowInfo& FlowInfo)
+{
+  vector<int> TempVector;
+  JunctionVector = TempVector;
+  BaseLevelJunctions = TempVector;
+  StreamOrderVector = TempVector;
+  ReceiverVector = TempVector;
 
+  int n_sources = SourcesVector.size();
+  int current_node;
+  int current_row,current_col;
+  int receiver_node;
+  int baselevel_switch;		// 0 if not a base level node, 1 if so
+  int junction_switch;
 
   // now you need to loop through the sources once more, creating links
   // each link has a starting node, and ending node
@@ -430,12 +507,12 @@ void LSDJunctionNetwork::create(vector<int> Sources, LSDFlowInfo& FlowInfo)
     JunctionVector.push_back(current_node);
 
     // set the junction Index Array
-    JunctionIndexArray[current_row][current_col] = this_junction;
+    JunctionIndexArray.set(current_row, current_col, this_junction);
 
     // stream order only increases at junctions. So the junction node has a stream
     // order that remains the same until it gets to the next junction, where it possibly
     // could change
-    StreamOrderVector.push_back( StreamOrderArray[current_row][current_col] );
+    StreamOrderVector.push_back( StreamOrderArray.get(current_row, current_col) );
 
     // check if this is a baselevel node
     if(receiver_node == current_node)
@@ -470,27 +547,27 @@ void LSDJunctionNetwork::create(vector<int> Sources, LSDFlowInfo& FlowInfo)
       {
         //cout << "source: " << src << " and BASELEVEL, node: " << current_node << " rnode: " << receiver_node << endl;
         // check to see if it has a junction index number.
-        if(JunctionIndexArray[current_row][current_col] == NoDataValue)
+        if(JunctionIndexArray.get(current_row, current_col) == NoDataValue)
         {
         	// it doens't have a JunctionIndexNumber. This is a new
         	// junction
         	this_junction++;
 
         	// this junction has the this_junction index. Set the JunctionIndexArray
-        	JunctionIndexArray[current_row][current_col] = this_junction;
+        	JunctionIndexArray.set(current_row, current_col, this_junction);
 
           // the receiver node of the previous junction is the new junction
-          ReceiverVector.push_back( JunctionIndexArray[current_row][current_col] );
+          ReceiverVector.push_back( JunctionIndexArray.get(current_row, current_col) );
 
           //push back the junction vector
           JunctionVector.push_back(current_node);
 
           // because this is a baselevel node, the Receiver of this junction
           // is iteself
-          ReceiverVector.push_back( JunctionIndexArray[current_row][current_col] );
+          ReceiverVector.push_back( JunctionIndexArray.get(current_row, current_col) );
 
           // the stream order of this node is also determined by the node
-          StreamOrderVector.push_back( StreamOrderArray[current_row][current_col] );
+          StreamOrderVector.push_back( StreamOrderArray.get(current_row, current_col) );
 
           // finally, this is the first time we have visted this baselevel node.
           // So it gets added to the baselevel vector
@@ -500,7 +577,7 @@ void LSDJunctionNetwork::create(vector<int> Sources, LSDFlowInfo& FlowInfo)
         else    // this junction does have an index number, no new junction is created
         {
           // the receiver node of the previous junction is the new junction
-          ReceiverVector.push_back( JunctionIndexArray[current_row][current_col] );
+          ReceiverVector.push_back( JunctionIndexArray.get(current_row, current_col) );
         }
         junction_switch = 2;
         baselevel_switch = 1;      // this is a baselevel. It will exit the
@@ -512,20 +589,20 @@ void LSDJunctionNetwork::create(vector<int> Sources, LSDFlowInfo& FlowInfo)
         // the node in the junction array is zero if it is not a
         // junction, 1 if it is an unvisited junction, and 2 or more if it
         // is a visited junction
-        if(JunctionArray[current_row][current_col] != NoDataValue)
+        if(JunctionArray.get(current_row, current_col) != NoDataValue)
         {
           //cout << "LINE 338, found a junction at node: " << current_node
           //	 << " JArray: " << JunctionArray[current_row][current_col]  << endl;
-          junction_switch = JunctionArray[current_row][current_col];
-          JunctionArray[current_row][current_col] ++;		// increment the junction array
+          junction_switch = JunctionArray.get(current_row, current_col);
+          JunctionArray.set(current_row, current_col, JunctionArray.get(current_row, current_col)+1);		// increment the junction array
                         // it will be greater than 1 if
                         // the junction has been visited
 
           // if this junction has been visited, it will have a junction number
           // include the receiver vector
-          if (JunctionIndexArray[current_row][current_col] != NoDataValue )
+          if (JunctionIndexArray.get(current_row, current_col) != NoDataValue )
           {
-            ReceiverVector.push_back( JunctionIndexArray[current_row][current_col] );
+            ReceiverVector.push_back( JunctionIndexArray.get(current_row, current_col) );
 
             // the loop will not continue; it will move onto the next
             // source since it has visited an already visited junction
@@ -536,16 +613,16 @@ void LSDJunctionNetwork::create(vector<int> Sources, LSDFlowInfo& FlowInfo)
             this_junction++;
 
             // this junction has the this_junction index. Set the JunctionIndexArray
-            JunctionIndexArray[current_row][current_col] = this_junction;
+            JunctionIndexArray.set(current_row, current_col, this_junction);
 
             // the receiver node of the previous junction is the new junction
-            ReceiverVector.push_back( JunctionIndexArray[current_row][current_col] );
+            ReceiverVector.push_back( JunctionIndexArray.get(current_row, current_col) );
 
             //push back the junction vector; this is a new junction
             JunctionVector.push_back(current_node);
 
             // get the stream order of this new junction
-            StreamOrderVector.push_back( StreamOrderArray[current_row][current_col] );
+            StreamOrderVector.push_back( StreamOrderArray.get(current_row, current_col) );
           }
         }   // end logic for is this a junction
       }     // end logic for not a baselevel node
@@ -694,6 +771,20 @@ void LSDJunctionNetwork::create(vector<int> Sources, LSDFlowInfo& FlowInfo)
   //cout << "LINE 525 did area calcs " << endl;
 
   NContributingJunctions = vectorized_contributing_pixels;
+
+  // index the source junctions by their position in the SVector, so the
+  // sources upstream of any junction can be read off without a search
+  SourceStackVector.clear();
+  SourceStackIndex.assign(NJunctions+1,0);
+  for(int junc = 0; junc<NJunctions; junc++)
+  {
+    SourceStackIndex[junc] = int(SourceStackVector.size());
+    if (NDonorsVector[ SVector[junc] ] == 0)
+    {
+      SourceStackVector.push_back(SVector[junc]);
+    }
+  }
+  SourceStackIndex[NJunctions] = int(SourceStackVector.size());
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
@@ -871,39 +962,40 @@ void LSDJunctionNetwork::get_x_and_y_from_latlong(vector<float> latitude, vector
 
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-// recursive add_to_stack routine, from Braun and Willett eq. 12 and 13
+// add_to_stack routine, from Braun and Willett eq. 12 and 13
+//
+// This adds lm_index and everything upstream of it to the stack in the
+// same depth first order as the original recursive version, but uses an
+// explicit stack of nodes so long flow paths cannot overflow the call stack.
+// Donors are pushed in reverse so they come off the stack in the order they
+// appear in the DonorStackVector.
 //
 // SMM 01/09/2012
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void LSDJunctionNetwork::add_to_stack(int lm_index, int& j_index, int bl_node)
 {
-  //cout << "j_index: " << j_index << " and s_vec: " << lm_index << endl;
+  vector<int> node_stack;
+  node_stack.push_back(lm_index);
 
-  SVector[j_index] = lm_index;
-  BLBasinVector[j_index] = bl_node;
-  j_index++;
+  int this_node;
+  while (!node_stack.empty())
+  {
+    this_node = node_stack.back();
+    node_stack.pop_back();
 
+    SVector[j_index] = this_node;
+    BLBasinVector[j_index] = bl_node;
+    j_index++;
 
-  int begin_m,end_m;
-  int l_index;
-  // if donating to itself, need escape hatch
-  if ( lm_index == bl_node)
-  {
-    begin_m = 0;
-    end_m = 0;
-  }
-  else
-  {
-    begin_m = DeltaVector[lm_index];
-    end_m =  DeltaVector[ lm_index+1];
-  }
-  //cout << "lm_index: " << lm_index << " begin_m: " << begin_m << " end m: " << end_m << endl;
-  for( int m_index = begin_m; m_index<end_m; m_index++)
-  {
-    //cout << "recursion, begin_m: " << begin_m << " and end_m: " << end_m << endl;
-    l_index = DonorStackVector[m_index];
-    add_to_stack(l_index, j_index, bl_node);
+    // if donating to itself, need escape hatch
+    if (this_node != bl_node)
+    {
+      for (int m_index = DeltaVector[this_node+1]-1; m_index>=DeltaVector[this_node]; m_index--)
+      {
+        node_stack.push_back(DonorStackVector[m_index]);
+      }
+    }
   }
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
@@ -944,25 +1036,48 @@ vector<int> LSDJunctionNetwork::get_upslope_junctions(int junction_number_outlet
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // This function takes a junction and finds all the source junction upstream of the
 // junction.
+//
+// The sources are read straight from the SourceStackVector, since the sources
+// upstream of a junction are a contiguous block of it.
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 vector<int> LSDJunctionNetwork::get_all_source_junctions_of_an_outlet_junction(int junction_number_outlet)
 {
-  vector<int> us_junctions = get_upslope_junctions(junction_number_outlet);
-  vector<int> source_junctions;
-
-  int n_upslope_junctions = int(us_junctions.size());
-  for (int j = 0; j<n_upslope_junctions; j++)
+  if(junction_number_outlet < 0 || junction_number_outlet > NJunctions-1)
   {
-    // if the junction has no donors, it is a source
-    if (NDonorsVector[ us_junctions[j] ] == 0)
-    {
-      source_junctions.push_back(us_junctions[j]);
-    }
+    cout << "Tried LSDJunctionNetwork::get_all_source_junctions_of_an_outlet_junction but the"
+         << "  junction number does not exist" << endl;
+    exit(0);
   }
+
+  int start_SVector_junction = SVectorIndex[junction_number_outlet];
+  int end_SVector_junction = start_SVector_junction+NContributingJunctions[junction_number_outlet];
+
+  vector<int> source_junctions(SourceStackVector.begin()+SourceStackIndex[start_SVector_junction],
+                               SourceStackVector.begin()+SourceStackIndex[end_SVector_junction]);
   return source_junctions;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This tests whether test_junction is upstream of current_junction. A junction
+// counts as upstream of itself.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+int LSDJunctionNetwork::is_junction_upstream(int current_junction, int test_junction)
+{
+  int start_SVector_junction = SVectorIndex[current_junction];
+  int test_SVector_junction = SVectorIndex[test_junction];
+
+  int is_upstream = 0;
+  if (test_SVector_junction >= start_SVector_junction &&
+      test_SVector_junction < start_SVector_junction+NContributingJunctions[current_junction])
+  {
+    is_upstream = 1;
+  }
+  return is_upstream;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // This function takes a junction and finds all the source nodes
 // from the flowinfo nodefile upstream of the
@@ -970,17 +1085,13 @@ vector<int> LSDJunctionNetwork::get_all_source_junctions_of_an_outlet_junction(i
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 vector<int> LSDJunctionNetwork::get_all_source_nodes_of_an_outlet_junction(int junction_number_outlet)
 {
-  vector<int> us_junctions = get_upslope_junctions(junction_number_outlet);
+  vector<int> source_junctions = get_all_source_junctions_of_an_outlet_junction(junction_number_outlet);
   vector<int> source_nodes;
 
-  int n_upslope_junctions = int(us_junctions.size());
-  for (int j = 0; j<n_upslope_junctions; j++)
+  int n_source_junctions = int(source_junctions.size());
+  for (int j = 0; j<n_source_junctions; j++)
   {
-    // if the junction has no donors, it is a source
-    if (NDonorsVector[ us_junctions[j] ] == 0)
-    {
-      source_nodes.push_back(JunctionVector[ us_junctions[j] ]);
-    }
+    source_nodes.push_back(JunctionVector[ source_junctions[j] ]);
   }
   return source_nodes;
 }
@@ -1390,7 +1501,7 @@ int LSDJunctionNetwork::get_Junction_of_Node(int Node, LSDFlowInfo& FlowInfo)
   int JunctionNumber, Row, Col;
 
   FlowInfo.retrieve_current_row_and_col(Node, Row, Col);
-  JunctionNumber = JunctionIndexArray[Row][Col];
+  JunctionNumber = JunctionIndexArray.get(Row, Col);
 
   return JunctionNumber;
 }
@@ -1663,7 +1774,7 @@ void LSDJunctionNetwork::extract_tributary_junctions_to_main_stem(LSDIndexChanne
   // the channel starts at a junction, get this junction and set it to
   // be the previous_junction
   MainStem.get_node_row_col_in_channel(0, node, row, col);
-  previous_junc = JunctionIndexArray[row][col];
+  previous_junc = JunctionIndexArray.get(row, col);
 
   // now loop through channel, starting at the top
   for(int ch_node = 1; ch_node<n_channel_nodes; ch_node++)
@@ -1671,7 +1782,7 @@ void LSDJunctionNetwork::extract_tributary_junctions_to_main_stem(LSDIndexChanne
     // get the node index as well as the row and column of the current node in the channel
     MainStem.get_node_row_col_in_channel(ch_node, node, row, col);
 
-    curr_junc = JunctionIndexArray[row][col];
+    curr_junc = JunctionIndexArray.get(row, col);
     // if the current junction does not equal the no data value, look for
     // donor nodes
     if(curr_junc != NoDataValue)
@@ -2053,7 +2164,7 @@ int LSDJunctionNetwork::get_StreamOrder_of_Node(LSDFlowInfo& FlowInfo, int node)
   int row,col;
 
   FlowInfo.retrieve_current_row_and_col(node,row,col);
-  StreamOrder = StreamOrderArray[row][col];
+  StreamOrder = StreamOrderArray.get(row, col);
 
   return StreamOrder;
 }
@@ -2077,7 +2188,7 @@ int LSDJunctionNetwork::get_StreamOrder_of_Junction(LSDFlowInfo& FlowInfo, int j
   int node = get_Node_of_Junction(junction);
 
   FlowInfo.retrieve_current_row_and_col(node,row,col);
-  StreamOrder = StreamOrderArray[row][col];
+  StreamOrder = StreamOrderArray.get(row, col);
 
   return StreamOrder;
 }
@@ -2183,28 +2294,13 @@ int LSDJunctionNetwork::get_Receiver_of_Junction(int junction) const
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-=
 // Function to get the junction downstream of the next
 // Added by FJC 08/10/15
+//
+// The first junction reached moving downstream from a junction is its
+// receiver, so this no longer follows the channel.
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-=
 int LSDJunctionNetwork::get_downstream_junction(int starting_junction, LSDFlowInfo& FlowInfo)
 {
-    int start_node = get_Node_of_Junction(starting_junction);
-    int receiver_node, receiver_row, receiver_col, receiver_junction;
-    int i = 0;
-    while (i == 0)
-    {
-      FlowInfo.retrieve_receiver_information(start_node, receiver_node, receiver_row, receiver_col);
-      receiver_junction = get_Junction_of_Node(receiver_node, FlowInfo);
-      if (receiver_junction == NoDataValue)
-      {
-        start_node = receiver_node;
-      }
-      else
-      {
-        //cout << "Reached downstream junction" << endl;
-        i=1;
-      }
-    }
-
-    return receiver_junction;
+  return get_Receiver_of_Junction(starting_junction);
 }
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-=
@@ -2504,6 +2600,24 @@ int LSDJunctionNetwork::GetChannelHeadsChiMethodFromNode(int NodeNumber,
                                       int MinSegLength, float A_0, float m_over_n,
                                       LSDFlowInfo& FlowInfo, LSDRaster& FlowDistance,
                                       LSDRaster& ElevationRaster)
+{
+  // get the hilltop node from this junction
+  int hilltop_node = FlowInfo.find_farthest_upslope_node(NodeNumber, FlowDistance);
+
+  int channel_head_node = GetChannelHeadsChiMethodFromNode(NodeNumber, hilltop_node,
+                                      MinSegLength, A_0, m_over_n, FlowInfo, ElevationRaster);
+  return channel_head_node;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-=
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-=
+// As above, but the hilltop node is given, e.g. from the table of
+// LSDFlowInfo::calculate_farthest_upslope_nodes
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-=
+int LSDJunctionNetwork::GetChannelHeadsChiMethodFromNode(int NodeNumber, int HilltopNode,
+                                      int MinSegLength, float A_0, float m_over_n,
+                                      LSDFlowInfo& FlowInfo, LSDRaster& ElevationRaster)
 {
   //vector<int> ChannelHeadNodes;
   float downslope_chi = 0;
@@ -2514,8 +2628,7 @@ int LSDJunctionNetwork::GetChannelHeadsChiMethodFromNode(int NodeNumber,
   int second_order_junction = get_Receiver_of_Junction(first_order_junction);
   int second_order_node = get_Node_of_Junction(second_order_junction);
 
-  // get the hilltop node from this junction
-  int hilltop_node = FlowInfo.find_farthest_upslope_node(NodeNumber, FlowDistance);
+  int hilltop_node = HilltopNode;
 
   //perform chi segment fitting
   LSDChannel new_channel(hilltop_node, second_order_node, downslope_chi, m_over_n, A_0, FlowInfo,  ElevationRaster);
@@ -2544,13 +2657,32 @@ int LSDJunctionNetwork::GetChannelHeadsChiMethodFromSourceNode(int NodeNumber,
                                       int MinSegLength, float A_0, float m_over_n,
                                       LSDFlowInfo& FlowInfo, LSDRaster& FlowDistance,
                                       LSDRaster& ElevationRaster, int NJunctions)
+{
+  // get the hilltop node from this source node
+  int hilltop_node = FlowInfo.find_farthest_upslope_node(NodeNumber, FlowDistance);
+
+  int channel_head_node = GetChannelHeadsChiMethodFromSourceNode(NodeNumber, hilltop_node,
+                                      MinSegLength, A_0, m_over_n, FlowInfo,
+                                      ElevationRaster, NJunctions);
+  return channel_head_node;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+// As above, but the hilltop node is given, e.g. from the table of
+// LSDFlowInfo::calculate_farthest_upslope_nodes
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+int LSDJunctionNetwork::GetChannelHeadsChiMethodFromSourceNode(int NodeNumber, int HilltopNode,
+                                      int MinSegLength, float A_0, float m_over_n,
+                                      LSDFlowInfo& FlowInfo, LSDRaster& ElevationRaster,
+                                      int NJunctions)
 {
   int channel_head_node;
   //vector<int> ChannelHeadNodes;
   float downslope_chi = 0;
 
-  // get the hilltop node from this source node
-  int hilltop_node = FlowInfo.find_farthest_upslope_node(NodeNumber, FlowDistance);
+  int hilltop_node = HilltopNode;
 
   //get the junction at the source node
   int source_junction = get_Junction_of_Node(NodeNumber, FlowInfo);
@@ -2600,11 +2732,16 @@ void LSDJunctionNetwork::write_valley_hilltop_chi_profiles_to_csv(vector<int> so
 {
 	float downslope_chi = 0;
 
+	// get the farthest upslope hilltop node of every node in one go
+	vector<int> FarthestUpslopeNodes;
+	vector<float> FarthestUpslopeDistances;
+	FlowInfo.calculate_farthest_upslope_nodes(FlowDistance, FarthestUpslopeNodes, FarthestUpslopeDistances);
+
 	//loop through all the sources and get the channel profile from the valley to the hilltop
 	for (int i = 0; i < int(sources.size()); i++)
 	{
 		// get the farthest upslope hilltop node
-		int hilltop_node = FlowInfo.find_farthest_upslope_node(sources[i], FlowDistance);
+		int hilltop_node = FarthestUpslopeNodes[ sources[i] ];
 		// get the valley node
 		int source_junction = get_Junction_of_Node(sources[i], FlowInfo);
 		// move downstream the specified number of junctions
@@ -2639,14 +2776,33 @@ LSDIndexRaster LSDJunctionNetwork::GetChannelfromDreich(int NodeNumber,
                                       int MinSegLength, float A_0, float m_over_n,
                                       LSDFlowInfo& FlowInfo, LSDRaster& FlowDistance,
                                       LSDRaster& ElevationRaster, string path_name, int NJunctions)
+{
+  // get the hilltop node from this junction
+  int hilltop_node = FlowInfo.find_farthest_upslope_node(NodeNumber, FlowDistance);
+
+  LSDIndexRaster ChannelRaster = GetChannelfromDreich(NodeNumber, hilltop_node, MinSegLength,
+                                      A_0, m_over_n, FlowInfo, ElevationRaster,
+                                      path_name, NJunctions);
+  return ChannelRaster;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+// As above, but the hilltop node is given, e.g. from the table of
+// LSDFlowInfo::calculate_farthest_upslope_nodes
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+LSDIndexRaster LSDJunctionNetwork::GetChannelfromDreich(int NodeNumber, int HilltopNode,
+                                      int MinSegLength, float A_0, float m_over_n,
+                                      LSDFlowInfo& FlowInfo, LSDRaster& ElevationRaster,
+                                      string path_name, int NJunctions)
 {
   //vector<int> ChannelHeadNodes;
   float downslope_chi = 0;
 
   //get the junction at the source node
   int Junction = get_Junction_of_Node(NodeNumber, FlowInfo);
-  // get the hilltop node from this junction
-  int hilltop_node = FlowInfo.find_farthest_upslope_node(NodeNumber, FlowDistance);
+  int hilltop_node = HilltopNode;
 
   // get the nth junction downstream
   for (int i = 0; i < NJunctions; i++)
@@ -2757,50 +2913,36 @@ vector<int> LSDJunctionNetwork::GetChannelHeadsChiMethodFromValleys(vector<int>
   vector<int> ChannelHeadNodes;
   vector<int> ChannelHeadNodes_temp;
 
+  // get the farthest upslope (hilltop) node of every node in one pass
+  vector<int> FarthestUpslopeNodes;
+  vector<float> FarthestUpslopeDistances;
+  FlowInfo.calculate_farthest_upslope_nodes(FlowDistance, FarthestUpslopeNodes, FarthestUpslopeDistances);
+
   int max_nodes = ValleyNodes.size();
-  int node_number = 0;
+  cout << "Fitting channel heads from " << max_nodes << " nodes" << endl;
 
-  //loop through junctions collecting channel heads
+  // the nodes are independent, so they are fitted in parallel. Each head is
+  // stored at the position of its node so the list is in the same order
+  // whatever the number of threads.
+  ChannelHeadNodes_temp.resize(max_nodes);
+  #pragma omp parallel for schedule(dynamic,1)
   for (int i = 0; i < max_nodes; i++)
   {
-    cout << flush << "Node = " << i+1 << " of " << max_nodes << "\r";
-
     // get the junction number
-    node_number = ValleyNodes[i];
+    int node_number = ValleyNodes[i];
 
     // get a local list of channel heads
 	  int channel_head_node = GetChannelHeadsChiMethodFromNode(node_number,
+                                      			FarthestUpslopeNodes[node_number],
                                       			MinSegLength, A_0, m_over_n, FlowInfo,
-                                       			FlowDistance, ElevationRaster);
+                                       			ElevationRaster);
 
-     // now append these channel heads to the master list
-    ChannelHeadNodes_temp.push_back(channel_head_node);
+     // now add these channel heads to the master list
+    ChannelHeadNodes_temp[i] = channel_head_node;
   }
 
   //removing any nodes that are not the furthest upstream
-  int upstream_test = 0;
-  vector<int>::iterator find_it;
-
-  for (int node = 0; node < int(ChannelHeadNodes_temp.size()); node++)
-  {
-    vector<int> tests;
-    int current_node = ChannelHeadNodes_temp[node];
-    for (int i = 0; i < int(ChannelHeadNodes_temp.size()); i++)
-    {
-      if (ChannelHeadNodes_temp[i] != current_node)
-      {
-        int test_node = ChannelHeadNodes_temp[i];
-        upstream_test = FlowInfo.is_node_upstream(current_node, test_node);
-        tests.push_back(upstream_test);
-      }
-    }
-    find_it = find(tests.begin(), tests.end(), 1);
-    if (find_it == tests.end())
-    {
-      ChannelHeadNodes.push_back(current_node);
-    }
-
-  }
+  ChannelHeadNodes = FlowInfo.remove_nodes_with_upstream_nodes(ChannelHeadNodes_temp);
 
   cout << "No of source nodes: " << ChannelHeadNodes.size() << endl;
 
@@ -2826,50 +2968,36 @@ vector<int> LSDJunctionNetwork::GetChannelHeadsChiMethodFromSources(vector<int>
   vector<int> ChannelHeadNodes;
   vector<int> ChannelHeadNodes_temp;
 
+  // get the farthest upslope (hilltop) node of every node in one pass
+  vector<int> FarthestUpslopeNodes;
+  vector<float> FarthestUpslopeDistances;
+  FlowInfo.calculate_farthest_upslope_nodes(FlowDistance, FarthestUpslopeNodes, FarthestUpslopeDistances);
+
   int max_nodes = ValleySources.size();
-  int node_number = 0;
+  cout << "Fitting channel heads from " << max_nodes << " sources" << endl;
 
-  //loop through junctions collecting channel heads
+  // the sources are independent, so they are fitted in parallel. Each head is
+  // stored at the position of its source so the list is in the same order
+  // whatever the number of threads.
+  ChannelHeadNodes_temp.resize(max_nodes);
+  #pragma omp parallel for schedule(dynamic,1)
   for (int i = 0; i < max_nodes; i++)
   {
-    cout << flush << "Node = " << i+1 << " of " << max_nodes << "\r";
-
     // get the junction number
-    node_number = ValleySources[i];
+    int node_number = ValleySources[i];
 
     // get a local list of channel heads
     int channel_head_node = GetChannelHeadsChiMethodFromSourceNode(node_number,
+                                      FarthestUpslopeNodes[node_number],
                                       MinSegLength, A_0, m_over_n, FlowInfo,
-                                      FlowDistance, ElevationRaster, NJunctions);
+                                      ElevationRaster, NJunctions);
 
-     // now append these channel heads to the master list
-    ChannelHeadNodes_temp.push_back(channel_head_node);
+     // now add these channel heads to the master list
+    ChannelHeadNodes_temp[i] = channel_head_node;
   }
 
   //removing any nodes that are not the furthest upstream
-  int upstream_test = 0;
-  vector<int>::iterator find_it;
-
-  for (int node = 0; node < int(ChannelHeadNodes_temp.size()); node++)
-  {
-    vector<int> tests;
-    int current_node = ChannelHeadNodes_temp[node];
-    for (int i = 0; i < int(ChannelHeadNodes_temp.size()); i++)
-    {
-      if (ChannelHeadNodes_temp[i] != current_node)
-      {
-        int test_node = ChannelHeadNodes_temp[i];
-        upstream_test = FlowInfo.is_node_upstream(current_node, test_node);
-        tests.push_back(upstream_test);
-      }
-    }
-    find_it = find(tests.begin(), tests.end(), 1);
-    if (find_it == tests.end())
-    {
-      ChannelHeadNodes.push_back(current_node);
-    }
-
-  }
+  ChannelHeadNodes = FlowInfo.remove_nodes_with_upstream_nodes(ChannelHeadNodes_temp);
 
   cout << "No of source nodes: " << ChannelHeadNodes.size() << endl;
 
@@ -2891,6 +3019,11 @@ LSDIndexRaster LSDJunctionNetwork::GetChannelsDreich(vector<int> ValleySources,
 {
   Array2D<int> channel_nodes(NRows,NCols,NoDataValue);
 
+  // get the farthest upslope (hilltop) node of every node in one pass
+  vector<int> FarthestUpslopeNodes;
+  vector<float> FarthestUpslopeDistances;
+  FlowInfo.calculate_farthest_upslope_nodes(FlowDistance, FarthestUpslopeNodes, FarthestUpslopeDistances);
+
   int max_nodes = ValleySources.size();
   int node_number = 0;
 
@@ -2903,8 +3036,9 @@ LSDIndexRaster LSDJunctionNetwork::GetChannelsDreich(vector<int> ValleySources,
     node_number = ValleySources[i];
 
     // get an index raster with the channel data
-    LSDIndexRaster Channel = GetChannelfromDreich(node_number, MinSegLength, A_0, m_over_n,
-                         FlowInfo, FlowDistance, ElevationRaster, path_name, NJunctions);
+    LSDIndexRaster Channel = GetChannelfromDreich(node_number, FarthestUpslopeNodes[node_number],
+                         MinSegLength, A_0, m_over_n, FlowInfo, ElevationRaster,
+                         path_name, NJunctions);
     Array2D<int> ChannelData = Channel.get_RasterData();
 
     //copy this array to a master array
@@ -3262,28 +3396,7 @@ vector<int> LSDJunctionNetwork::GetSourceNodesChiMethodAllPixels(int JunctionNum
   // find the furthest upslope nodes classified as being part of the channel network (use as sources for next
   // step of chi method)
 
-  int upstream_test = 0;
-  vector<int>::iterator find_it;
-
-  for (unsigned int node =0; node < channel_nodes.size(); node++)
-  {
-     vector<int> tests;
-     int current_node = channel_nodes[node];
-     for (unsigned int i = 0; i < channel_nodes.size(); i++)
-     {
-      if (channel_nodes[i] != current_node)
-      {
-        int test_node = channel_nodes[i];
-        upstream_test = FlowInfo.is_node_upstream(current_node, test_node);
-        tests.push_back(upstream_test);
-      }
-     }
-     find_it = find(tests.begin(), tests.end(), 1);
-     if (find_it == tests.end())
-     {
-      source_nodes.push_back(current_node);
-     }
-  }
+  source_nodes = FlowInfo.remove_nodes_with_upstream_nodes(channel_nodes);
   cout << "No of channel nodes: " << channel_nodes.size() << endl;
   cout << "No of source nodes: " << source_nodes.size() << endl;
   return source_nodes;
@@ -3467,143 +3580,82 @@ vector<int> LSDJunctionNetwork::calculate_pelletier_channel_heads_DTM(LSDFlowInf
 // restricts flow to within convergent parts of the topography to prevent flow
 // crossing noses etc.
 // DTM 03/06/2014
-vector<int> LSDJunctionNetwork::identify_upstream_limits(LSDFlowInfo& FlowInfo, Array2D<float>& topography, vector<int> source_row_vec,vector<int> source_col_vec, Array2D<float>& tan_curv)
+//
+// Flow is only ever passed to strictly lower cells, so rather than sorting the
+// whole DEM by elevation the downslope pathways are now traced directly from the
+// possible sources, and only the cells on them are visited. A possible source is
+// kept if no visited cell passes flow to it.
+//------------------------------------------------------------------------------
+vector<int> LSDJunctionNetwork::identify_upstream_limits(LSDFlowInfo& FlowInfo, Array2D<float>& topography, vector<int>& source_row_vec,vector<int>& source_col_vec, Array2D<float>& tan_curv)
 {
+  // the eight neighbours of a cell
+  int d_row[8] = {-1,-1,-1, 0, 1, 1, 1, 0};
+  int d_col[8] = {-1, 0, 1, 1, 1, 0,-1,-1};
+
+  // flags are held row major: IsPossibleSource marks the possible sources,
+  // Visited marks cells on a downslope pathway from a possible source and
+  // ReceivesFlow marks cells that a visited cell passes flow to
+  int n_cells = NRows*NCols;
+  vector<char> IsPossibleSource(n_cells,0);
+  vector<char> Visited(n_cells,0);
+  vector<char> ReceivesFlow(n_cells,0);
+  vector<int> cells_to_visit;
 
-  //create output array, populated with nodata
-  Array2D<float> area(NRows, NCols, NoDataValue);
-  Array2D<int> sources_array(NRows, NCols, int(NoDataValue));
-  Array2D<int> times_visited(NRows, NCols, int(NoDataValue));
-  //declare variables
-  vector<float> flat;
-  vector<float> sorted;
-  vector<size_t> index_map;
-  float one_ov_root_2 = 0.707106781187;
-  float p = 1.1; //value avoids preferential flow to diagonals
-
-  //loop through the dem cells creating a row major 1D vector, flat, and
-  //setting the cell area to every npn ndv cell
-  for (int i = 0; i < NRows; ++i)
-  {
-    for (int j = 0; j < NCols; ++j)
-    {
-      flat.push_back(topography[i][j]);
-      if (topography[i][j] != NoDataValue)
-      {
-        area[i][j] = 0;
-        times_visited[i][j] = 0;
-      }
-    }
-  }
   int n_possible_sources = source_row_vec.size();
   int row,col;
   for(int i = 0; i<n_possible_sources; ++i)
   {
-    row = source_row_vec[i];
-    col = source_col_vec[i];
-    area[row][col] = 1.0;
-    times_visited[row][col] = 1;
+    int cell = source_row_vec[i]*NCols+source_col_vec[i];
+    IsPossibleSource[cell] = 1;
+    if (Visited[cell] == 0)
+    {
+      Visited[cell] = 1;
+      cells_to_visit.push_back(cell);
+    }
   }
-  Array2D<int> temp = times_visited.copy() ;
-  //sort the 1D elevation vector and produce an index
-  matlab_float_sort_descending(flat, sorted, index_map);
 
-  //int i_source = 0;
-  for(int q = 0 ;q < int(flat.size()); ++q)
+  // follow every downslope pathway within the convergent topography
+  while (cells_to_visit.empty() == false)
   {
+    int cell = cells_to_visit.back();
+    cells_to_visit.pop_back();
+    int i = cell / NCols;
+    int j = cell % NCols;
 
-    if (sorted[q] != NoDataValue)
+    // edge cells and nodata cells do not pass on flow
+    if (i == 0 || j == 0 || i == NRows-1 || j == NCols-1 || topography[i][j] == NoDataValue)
     {
-      //use row major ordering to reconstruct each cell's i,j coordinates
-      int i = index_map[q] / NCols;
-       int j = index_map[q] % NCols;
-
-      //skip edge cells and cells above the source pixel
-      if (i != 0 && j != 0 && i != NRows-1 && j != NCols-1){
-
-        //reset variables on each loop
-        float total = 0;
-        float slope1 = 0;
-        float slope2 = 0;
-        float slope3 = 0;
-        float slope4 = 0;
-        float slope5 = 0;
-        float slope6 = 0;
-        float slope7 = 0;
-        float slope8 = 0;
-
-        //Get sum of magnitude of downslope flow, total, and store the magnitude of
-        //each of the 8 downslope cells as slope1->8 *Avoids NDVs*
-        if (topography[i][j] > topography[i-1][j-1] && topography[i-1][j-1] != NoDataValue){
-          slope1 = pow(((topography[i][j] - topography[i-1][j-1]) * one_ov_root_2),p);
-          total += slope1;
-          if(times_visited[i][j] > 0 && tan_curv[i-1][j-1]>0) times_visited[i-1][j-1]+=1;
-        }
-        if (topography[i][j] > topography[i-1][j] && topography[i-1][j] != NoDataValue){
-          slope2 = pow((topography[i][j] - topography[i-1][j]),p);
-          total += slope2;
-          if(times_visited[i][j] > 0 && tan_curv[i-1][j]>0) times_visited[i-1][j]+=1;
-        }
-        if (topography[i][j] > topography[i-1][j+1] && topography[i-1][j+1] != NoDataValue){
-          slope3 = pow(((topography[i][j] - topography[i-1][j+1]) * one_ov_root_2),p);
-          total += slope3;
-          if(times_visited[i][j] > 0 && tan_curv[i-1][j+1]>0) times_visited[i-1][j+1] += 1;
-        }
-        if (topography[i][j] > topography[i][j+1] && topography[i][j+1] != NoDataValue){
-          slope4 = pow((topography[i][j] - topography[i][j+1]),p);
-          total += slope4;
-          if(times_visited[i][j] > 0 && tan_curv[i][j+1]>0) times_visited[i][j+1] += 1;
-        }
-        if (topography[i][j] > topography[i+1][j+1] && topography[i+1][j+1] != NoDataValue){
-          slope5 = pow(((topography[i][j] - topography[i+1][j+1]) * one_ov_root_2),p);
-          total += slope5;
-          if(times_visited[i][j] > 0 && tan_curv[i+1][j+1]>0) times_visited[i+1][j+1]+=1;
-        }
-        if (topography[i][j] > topography[i+1][j] && topography[i+1][j] != NoDataValue){
-          slope6 = pow((topography[i][j] - topography[i+1][j]),p);
-          total += slope6;
-          if(times_visited[i][j] > 0 && tan_curv[i+1][j]>0) times_visited[i+1][j]+=1;
-        }
-        if (topography[i][j] > topography[i+1][j-1] && topography[i+1][j-1] != NoDataValue){
-          slope7 = pow(((topography[i][j] - topography[i+1][j-1]) * one_ov_root_2),p);
-          total += slope7;
-          if(times_visited[i][j] > 0 && tan_curv[i+1][j-1]>0) times_visited[i+1][j-1]+=1;
-        }
-        if (topography[i][j] > topography[i][j-1] && topography[i][j-1] != NoDataValue){
-          slope8 = pow((topography[i][j] - topography[i][j-1]),p);
-          total += slope8;
-          if(times_visited[i][j] > 0 && tan_curv[i][j-1]>0) times_visited[i][j-1]+=1;
-        }
+      continue;
+    }
 
-        //divide slope by total to get the proportion of flow directed to each cell
-        //and increment the downslope cells. If no downslope flow to a node, 0 is
-        //added, so no change is seen.
-        area[i-1][j-1] += (area[i][j] * (slope1)/total);
-        area[i-1][j] += (area[i][j] * (slope2)/total);
-        area[i-1][j+1] += (area[i][j] * (slope3)/total);
-        area[i][j+1] += (area[i][j] * (slope4)/total);
-        area[i+1][j+1] += (area[i][j] * (slope5)/total);
-        area[i+1][j] += (area[i][j] * (slope6)/total);
-        area[i+1][j-1] += (area[i][j] * (slope7)/total);
-        area[i][j-1] += (area[i][j] * (slope8)/total);
+    for (int n = 0; n < 8; ++n)
+    {
+      int nrow = i+d_row[n];
+      int ncol = j+d_col[n];
+      if (topography[i][j] > topography[nrow][ncol] && topography[nrow][ncol] != NoDataValue
+          && tan_curv[nrow][ncol] > 0)
+      {
+        int ncell = nrow*NCols+ncol;
+        ReceivesFlow[ncell] = 1;
+        if (Visited[ncell] == 0)
+        {
+          Visited[ncell] = 1;
+          cells_to_visit.push_back(ncell);
+        }
       }
     }
   }
+
   vector<int> source_nodes;
   for(int i = 0; i<n_possible_sources; ++i)
   {
     row = source_row_vec[i];
     col = source_col_vec[i];
-    if (times_visited[row][col] == 1)
+    if (ReceivesFlow[row*NCols+col] == 0)
     {
       source_nodes.push_back(FlowInfo.retrieve_node_from_row_and_column(row, col));
-      //sources_array[row][col] = 1;
     }
   }
-//   //write output LSDRaster object
-//   LSDIndexRaster SourcesRaster(NRows, NCols, XMinimum, YMinimum, DataResolution, int(NoDataValue), sources_array);
-//   LSDRaster AreaRaster(NRows, NCols, XMinimum, YMinimum, DataResolution, NoDataValue, area);
-//   AreaRaster.write_raster("area","flt");
   return source_nodes;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-=
@@ -3680,8 +3732,8 @@ Array2D<int> LSDJunctionNetwork::find_valleys(LSDFlowInfo& FlowInfo, Array2D<flo
           {
             FlowInfo.retrieve_current_row_and_col(this_node, current_row, current_col);
             FlowInfo.retrieve_receiver_information(this_node, downslope_node, downslope_row, downslope_col);
-            current_SO = StreamOrderArray[current_row][current_col];
-            downslope_SO = StreamOrderArray[downslope_row][downslope_col];
+            current_SO = StreamOrderArray.get(current_row, current_col);
+            downslope_SO = StreamOrderArray.get(downslope_row, downslope_col);
             NodesVisitedBeforeTemp[current_row][current_col] = 1;
             bool BeentoReceiver = false;
             if (downslope_SO > current_SO)
@@ -3753,8 +3805,8 @@ vector<int> LSDJunctionNetwork::get_outlet_nodes_from_sources(LSDFlowInfo& FlowI
     {
       FlowInfo.retrieve_current_row_and_col(this_node, current_row, current_col);
       FlowInfo.retrieve_receiver_information(this_node, downslope_node, downslope_row, downslope_col);
-      current_SO = StreamOrderArray[current_row][current_col];
-      downslope_SO = StreamOrderArray[downslope_row][downslope_col];
+      current_SO = StreamOrderArray.get(current_row, current_col);
+      downslope_SO = StreamOrderArray.get(downslope_row, downslope_col);
       NodesVisitedBeforeTemp[current_row][current_col] = 1;
       bool BeentoReceiver = false;
       int base_level = FlowInfo.is_node_base_level(downslope_node);
@@ -3853,8 +3905,8 @@ Array2D<int> LSDJunctionNetwork::find_valleys_adaptive_threshold(LSDFlowInfo& Fl
           {
             FlowInfo.retrieve_current_row_and_col(this_node, current_row, current_col);
             FlowInfo.retrieve_receiver_information(this_node, downslope_node, downslope_row, downslope_col);
-            current_SO = StreamOrderArray[current_row][current_col];
-            downslope_SO = StreamOrderArray[downslope_row][downslope_col];
+            current_SO = StreamOrderArray.get(current_row, current_col);
+            downslope_SO = StreamOrderArray.get(downslope_row, downslope_col);
             NodesVisitedBeforeTemp[current_row][current_col] = 1;
             bool BeentoReceiver = false;
             if (downslope_SO > current_SO)
@@ -3951,8 +4003,8 @@ Array2D<int> LSDJunctionNetwork::find_valleys_using_channel_mask(LSDFlowInfo& Fl
           {
             FlowInfo.retrieve_current_row_and_col(this_node, current_row, current_col);
             FlowInfo.retrieve_receiver_information(this_node, downslope_node, downslope_row, downslope_col);
-            current_SO = StreamOrderArray[current_row][current_col];
-            downslope_SO = StreamOrderArray[downslope_row][downslope_col];
+            current_SO = StreamOrderArray.get(current_row, current_col);
+            downslope_SO = StreamOrderArray.get(downslope_row, downslope_col);
             NodesVisitedBeforeTemp[current_row][current_col] = 1;
             bool BeentoReceiver = false;
             if (downslope_SO > current_SO)
@@ -4526,7 +4578,7 @@ void LSDJunctionNetwork::GetChannelNodesAndJunctions(LSDFlowInfo& flowinfo, vect
     flowinfo.retrieve_current_row_and_col(sourcenodeindex,row,col);
     NI_vector.push_back(sourcenodeindex);
     JI_vector.push_back(q);
-    SO_vector.push_back(StreamOrderArray[row][col]);
+    SO_vector.push_back(StreamOrderArray.get(row, col));
 
     bool Flag = false; //Flag used to indicate if end of stream segemnt has been reached
     int CurrentNodeIndex = 0;
@@ -4561,7 +4613,7 @@ void LSDJunctionNetwork::GetChannelNodesAndJunctions(LSDFlowInfo& flowinfo, vect
       {
         NI_vector.push_back(next_receiver);
         JI_vector.push_back(q);
-        SO_vector.push_back(StreamOrderArray[row][col]);
+        SO_vector.push_back(StreamOrderArray.get(row, col));
       }
     }
   }
@@ -4627,8 +4679,8 @@ LSDIndexRaster LSDJunctionNetwork::SplitChannel(LSDFlowInfo& FlowInfo, vector<in
       }
       // Now check to see whether stream order increases (want to start a new
       // segment if this is the case)
-      ReceiverStreamOrder = StreamOrderArray[ReceiverRow][ReceiverCol];
-      CurrentStreamOrder = StreamOrderArray[CurrentRow][CurrentCol];
+      ReceiverStreamOrder = StreamOrderArray.get(ReceiverRow, ReceiverCol);
+      CurrentStreamOrder = StreamOrderArray.get(CurrentRow, CurrentCol);
       if (ReceiverStreamOrder > CurrentStreamOrder)
       {
         NodeCount = 0;
@@ -4795,8 +4847,8 @@ void LSDJunctionNetwork::TypologyModel(LSDFlowInfo& FlowInfo, vector<int> Source
         // get the distance to check the segment length
         float ThisDistance = FlowInfo.get_Euclidian_distance(ThisStartNode,CurrentNode);
 
-        ReceiverStreamOrder = StreamOrderArray[ReceiverRow][ReceiverCol];
-        CurrentStreamOrder = StreamOrderArray[CurrentRow][CurrentCol];
+        ReceiverStreamOrder = StreamOrderArray.get(ReceiverRow, ReceiverCol);
+        CurrentStreamOrder = StreamOrderArray.get(CurrentRow, CurrentCol);
 
         bool ReceiverVisitedBefore = false;
         // test to see whether we have visited this node before
@@ -5372,7 +5424,7 @@ vector<int> LSDJunctionNetwork::Get_Channel_Head_Junctions(vector<int> Sources,
 
   for (int q = 0; q < int(Sources.size()); ++q){
     FlowInfo.retrieve_current_row_and_col(Sources[q],i,j);
-    Channel_Head_Junctions.push_back(JunctionIndexArray[i][j]);
+    Channel_Head_Junctions.push_back(JunctionIndexArray.get(i, j));
   }
 
   return Channel_Head_Junctions;
@@ -5577,6 +5629,10 @@ LSDIndexRaster LSDJunctionNetwork::extract_basins_from_junction_vector_nested(ve
 	matlab_int_sort(basin_junctions_CP, basin_junctions_CP, index_map);
 	matlab_int_reorder(basin_junctions, index_map, basin_junctions);
 
+  // for each position in the FlowInfo stack, the end of the largest basin
+  // labelled so far that starts there
+  vector<int> SkipTo(FlowInfo.NDataNodes,0);
+
   for (vector<int>::iterator it = basin_junctions.begin(); it !=  basin_junctions.end(); ++it)
   {
 		cout << "Basin junction: " << *it << endl;
@@ -5603,18 +5659,32 @@ LSDIndexRaster LSDJunctionNetwork::extract_basins_from_junction_vector_nested(ve
     int node,row,col;
 
     basin_outlet = StreamLinkVector.get_node_in_channel(n_nodes_in_channel-2);
-    vector<int> BasinNodeVector = FlowInfo.get_upslope_nodes(basin_outlet);
-    // Loop through basin to label basin pixels with basin ID
-    for (int BasinIndex = 0; BasinIndex < int(BasinNodeVector.size()); ++BasinIndex)
+
+    // The basin is a contiguous block of the FlowInfo stack. Smaller basins are
+    // blocks nested inside it that have already been labelled, and SkipTo
+    // jumps from the start of each of these to its end, so every pixel is
+    // only visited once.
+    int start_SVector_node = FlowInfo.SVectorIndex[basin_outlet];
+    int end_SVector_node = start_SVector_node+FlowInfo.NContributingNodes[basin_outlet];
+    int SVector_node = start_SVector_node;
+    while (SVector_node < end_SVector_node)
     {
-      node = BasinNodeVector[BasinIndex];
-      FlowInfo.retrieve_current_row_and_col(node,row,col);
-			if (Basin[row][col] == NoDataValue)
-			{
-      	Basin[row][col] = basin_junction;
-			}
+      if (SkipTo[SVector_node] > SVector_node)
+      {
+        SVector_node = SkipTo[SVector_node];
+      }
+      else
+      {
+        node = FlowInfo.SVector[SVector_node];
+        FlowInfo.retrieve_current_row_and_col(node,row,col);
+        Basin[row][col] = basin_junction;
+        SVector_node++;
+      }
+    }
+    if (SkipTo[start_SVector_node] < end_SVector_node)
+    {
+      SkipTo[start_SVector_node] = end_SVector_node;
     }
-
   }
 
   LSDIndexRaster IR(NRows,NCols, XMinimum, YMinimum, DataResolution, NoDataValue, Basin,GeoReferencingStrings);
@@ -5662,7 +5732,7 @@ LSDIndexRaster LSDJunctionNetwork::extract_basins_from_junctions_rudimentary(vec
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 LSDIndexRaster LSDJunctionNetwork::StreamOrderArray_to_LSDIndexRaster()
 {
-  LSDIndexRaster IR(NRows,NCols, XMinimum, YMinimum, DataResolution, NoDataValue, StreamOrderArray,GeoReferencingStrings);
+  LSDIndexRaster IR(NRows,NCols, XMinimum, YMinimum, DataResolution, NoDataValue, StreamOrderArray.to_Array2D(),GeoReferencingStrings);
   return IR;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
@@ -5697,11 +5767,11 @@ void LSDJunctionNetwork::StreamOrderArray_to_WGS84CSV(string FileName_prefix)
   {
     for(int j = 0; j < NCols; ++j)
     {
-      if (StreamOrderArray[i][j] != NoDataValue)
+      if (StreamOrderArray.get(i, j) != NoDataValue)
       {
         get_lat_and_long_locations(i, j, latitude, longitude, Converter);
 
-        WriteData << latitude << "," << longitude << "," << StreamOrderArray[i][j] << endl;
+        WriteData << latitude << "," << longitude << "," << StreamOrderArray.get(i, j) << endl;
       }
     }
   }
@@ -5776,7 +5846,7 @@ void LSDJunctionNetwork::PrintChannelNetworkToCSV(LSDFlowInfo& flowinfo, string
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 LSDIndexRaster LSDJunctionNetwork::JunctionArray_to_LSDIndexRaster()
 {
-  LSDIndexRaster IR(NRows,NCols, XMinimum, YMinimum, DataResolution, NoDataValue, JunctionArray,GeoReferencingStrings);
+  LSDIndexRaster IR(NRows,NCols, XMinimum, YMinimum, DataResolution, NoDataValue, JunctionArray.to_Array2D(),GeoReferencingStrings);
   return IR;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
@@ -5792,7 +5862,7 @@ LSDIndexRaster LSDJunctionNetwork::JunctionArray_to_LSDIndexRaster()
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 LSDIndexRaster LSDJunctionNetwork::JunctionIndexArray_to_LSDIndexRaster()
 {
-  LSDIndexRaster IR(NRows,NCols, XMinimum, YMinimum, DataResolution, NoDataValue, JunctionIndexArray,GeoReferencingStrings);
+  LSDIndexRaster IR(NRows,NCols, XMinimum, YMinimum, DataResolution, NoDataValue, JunctionIndexArray.to_Array2D(),GeoReferencingStrings);
   return IR;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
@@ -5815,11 +5885,11 @@ LSDIndexRaster LSDJunctionNetwork::StreamOrderArray_to_BinaryNetwork_LSDIndexRas
   {
     for (int col = 0; col<NCols; col++)
     {
-      if(StreamOrderArray[row][col] == NoDataValue)
+      if(StreamOrderArray.get(row, col) == NoDataValue)
       {
         BinaryNetwork[row][col] = NoDataValue;
       }
-      else if (StreamOrderArray[row][col] >= 1)
+      else if (StreamOrderArray.get(row, col) >= 1)
       {
         BinaryNetwork[row][col] = 1;
       }
@@ -5927,8 +5997,8 @@ LSDIndexRaster LSDJunctionNetwork::GetStreams(int order)
 
   for (int i = 0; i < NRows; ++i){
     for (int j = 0; j < NCols; ++j){
-      if (StreamOrderArray[i][j] == order){
-        SingleStream[i][j] = StreamOrderArray[i][j];
+      if (StreamOrderArray.get(i, j) == order){
+        SingleStream[i][j] = StreamOrderArray.get(i, j);
       }
     }
   }
@@ -5953,8 +6023,8 @@ LSDIndexRaster LSDJunctionNetwork::GetStreams(int min_order, int max_order)
 
   for (int i = 0; i < NRows; ++i){
     for (int j = 0; j < NCols; ++j){
-      if (StreamOrderArray[i][j] >= min_order && StreamOrderArray[i][j] <= max_order){
-        SelectedStreams[i][j] = StreamOrderArray[i][j];
+      if (StreamOrderArray.get(i, j) >= min_order && StreamOrderArray.get(i, j) <= max_order){
+        SelectedStreams[i][j] = StreamOrderArray.get(i, j);
       }
     }
   }
@@ -6324,7 +6394,7 @@ int LSDJunctionNetwork::get_nodeindex_of_nearest_channel_for_specified_coordinat
     NearestChannel = NoDataValue;
 
     // check to see if this node has a stream order >= 1
-    if(StreamOrderArray[CurrentRow][CurrentCol] >= threshold_stream_order)
+    if(StreamOrderArray.get(CurrentRow, CurrentCol) >= threshold_stream_order)
     {
       NearestChannel = CurrentNode;
     }
@@ -6354,7 +6424,7 @@ int LSDJunctionNetwork::get_nodeindex_of_nearest_channel_for_specified_coordinat
           // only test if it within size of the Stream Order array
           if(this_krow >= 0 && this_krow < NRows-1 && this_kcol >= 0 && this_kcol < NCols-1)
           {
-            this_SO = StreamOrderArray[this_krow][this_kcol];
+            this_SO = StreamOrderArray.get(this_krow, this_kcol);
             if (this_SO >= threshold_stream_order && this_SO > largest_SO_in_kernal)
             {
               largest_SO_in_kernal = this_SO;
@@ -6405,7 +6475,7 @@ void LSDJunctionNetwork::get_info_nearest_channel_to_node(int& StartingNode, int
 	int BaseLevel = FlowInfo.is_node_base_level(CurrentNode);
 	FlowInfo.retrieve_current_row_and_col(StartingNode, row, col);
 	//check if you are already at a channel
-	if (StreamOrderArray[row][col] != NoDataValue && StreamOrderArray[row][col] >= threshold_SO
+	if (StreamOrderArray.get(row, col) != NoDataValue && StreamOrderArray.get(row, col) >= threshold_SO
 	&& BaseLevel == 0)
 	{
 		ChannelNode = FlowInfo.NodeIndex[row][col];
@@ -6430,8 +6500,8 @@ void LSDJunctionNetwork::get_info_nearest_channel_to_node(int& StartingNode, int
 				//cout << "You reached a baselevel node, returning baselevel" << endl;
 			}
 			//if receiver is a channel > threshold then get the stream order
-			if (StreamOrderArray[ReceiverRow][ReceiverCol] != NoDataValue &&
-			StreamOrderArray[ReceiverRow][ReceiverCol] >= threshold_SO)
+			if (StreamOrderArray.get(ReceiverRow, ReceiverCol) != NoDataValue &&
+			StreamOrderArray.get(ReceiverRow, ReceiverCol) >= threshold_SO)
 			{
 				ChannelNode = FlowInfo.NodeIndex[ReceiverRow][ReceiverCol];
 				// get the upstream distance of the nearest channel node
@@ -6549,7 +6619,7 @@ int LSDJunctionNetwork::find_upstream_junction_from_channel_nodeindex(int Channe
   FlowInfo.retrieve_current_row_and_col(CurrentNode,CurrentRow,CurrentCol);
 
   // get the stream order
-  int this_channel_order = StreamOrderArray[CurrentRow][CurrentCol];
+  int this_channel_order = StreamOrderArray.get(CurrentRow, CurrentCol);
 
   if (this_channel_order != NoDataValue)
   {
@@ -6574,7 +6644,7 @@ int LSDJunctionNetwork::find_upstream_junction_from_channel_nodeindex(int Channe
       {
         //cout << "this donor: " << this_donor << " and the donor NI: " << donors[this_donor] << endl;
         FlowInfo.retrieve_current_row_and_col(donors[this_donor],CurrentRow,CurrentCol);
-        donor_channel_order = StreamOrderArray[CurrentRow][CurrentCol];
+        donor_channel_order = StreamOrderArray.get(CurrentRow, CurrentCol);
         //cout << "donor_channel_order: " << donor_channel_order << " and tcho: " << this_channel_order << endl;
 
         this_donor++;
@@ -6618,7 +6688,7 @@ int LSDJunctionNetwork::check_stream_order_of_upstream_nodes(int junction, LSDFl
   FlowInfo.retrieve_current_row_and_col(CurrentNode,CurrentRow,CurrentCol);
 
   // get the stream order
-  int CurrentSO = StreamOrderArray[CurrentRow][CurrentCol];
+  int CurrentSO = StreamOrderArray.get(CurrentRow, CurrentCol);
   //cout << "Current SO: " << CurrentSO << endl;
 
   //loop through all the donor nodes and check the stream order
@@ -6628,7 +6698,7 @@ int LSDJunctionNetwork::check_stream_order_of_upstream_nodes(int junction, LSDFl
     // get the upstream row and column
     FlowInfo.retrieve_current_row_and_col(donors[i],UpstreamRow,UpstreamCol);
     // get the stream order
-    int UpstreamSO = StreamOrderArray[UpstreamRow][UpstreamCol];
+    int UpstreamSO = StreamOrderArray.get(UpstreamRow, UpstreamCol);
     //cout << "Upstream stream order: " << UpstreamSO << endl;
     if(UpstreamSO == CurrentSO)
     {
@@ -6884,7 +6954,7 @@ LSDRaster LSDJunctionNetwork::calculate_relief_from_channel(LSDRaster& Elevation
         int CurrentNode = FlowInfo.retrieve_node_from_row_and_column(row,col);
         int BaseLevel = FlowInfo.is_node_base_level(CurrentNode);
         //if already at a channel then set relief to 0
-        if (StreamOrderArray[row][col] != NoDataValue && StreamOrderArray[row][col] >= threshold_SO
+        if (StreamOrderArray.get(row, col) != NoDataValue && StreamOrderArray.get(row, col) >= threshold_SO
         && BaseLevel == 0)
         {
           ReliefArray[row][col] = 0;
@@ -6904,8 +6974,8 @@ LSDRaster LSDJunctionNetwork::calculate_relief_from_channel(LSDRaster& Elevation
               ReachedChannel = true;
             }
             //if receiver is a channel > threshold then get the relief
-            if (StreamOrderArray[ReceiverRow][ReceiverCol] != NoDataValue &&
-            StreamOrderArray[ReceiverRow][ReceiverCol] >= threshold_SO)
+            if (StreamOrderArray.get(ReceiverRow, ReceiverCol) != NoDataValue &&
+            StreamOrderArray.get(ReceiverRow, ReceiverCol) >= threshold_SO)
             {
               ReachedChannel = true;
               float channel_elevation = ElevationRaster.get_data_element(ReceiverRow, ReceiverCol);
@@ -7091,7 +7161,7 @@ float LSDJunctionNetwork::find_mean_elevation_of_channel_reach(int StartingNode,
 		int SO_test = 0;
 		//get the current stream order
 		FlowInfo.retrieve_current_row_and_col(this_node, row, col);
-		int this_SO = StreamOrderArray[row][col];
+		int this_SO = StreamOrderArray.get(row, col);
 
 		//look through the donor nodes for the same stream order
 		vector<int> donor_nodes = FlowInfo.get_donor_nodes(this_node);
@@ -7099,7 +7169,7 @@ float LSDJunctionNetwork::find_mean_elevation_of_channel_reach(int StartingNode,
 		{
 			int donor_row, donor_col;
 			FlowInfo.retrieve_current_row_and_col(donor_nodes[i], donor_row, donor_col);
-			int DonorSO = StreamOrderArray[donor_row][donor_col];
+			int DonorSO = StreamOrderArray.get(donor_row, donor_col);
 			if (DonorSO == this_SO)
 			{
 				SO_test = 1;
@@ -7122,12 +7192,12 @@ float LSDJunctionNetwork::find_mean_elevation_of_channel_reach(int StartingNode,
 	{
 		//get current stream order
 		FlowInfo.retrieve_current_row_and_col(this_node, row, col);
-		int this_SO = StreamOrderArray[row][col];
+		int this_SO = StreamOrderArray.get(row, col);
 
 		//get receiver info
 		int receiver_node, receiver_row, receiver_col;
 		FlowInfo.retrieve_receiver_information(this_node, receiver_node, receiver_row, receiver_col);
-		int receiver_SO = StreamOrderArray[receiver_row][receiver_col];
+		int receiver_SO = StreamOrderArray.get(receiver_row, receiver_col);
 
 		//push back receiver elevation to the vector
 		elevations.push_back(ElevationRaster.get_data_element(receiver_row, receiver_col));
@@ -7179,14 +7249,14 @@ float LSDJunctionNetwork::find_distance_to_nearest_floodplain_pixel(int point_no
 	{
 		int SO_test = 0;
 		FlowInfo.retrieve_current_row_and_col(this_node, row, col);
-		int this_SO = StreamOrderArray[row][col];
+		int this_SO = StreamOrderArray.get(row, col);
 		int this_FP = FloodplainRaster.get_data_element(row, col);
 		vector<int> donor_nodes = FlowInfo.get_donor_nodes(this_node);
 		for (int i = 0; i < int(donor_nodes.size()); i++)
 		{
 			int donor_row, donor_col;
 			FlowInfo.retrieve_current_row_and_col(donor_nodes[i], donor_row, donor_col);
-			int DonorSO = StreamOrderArray[donor_row][donor_col];
+			int DonorSO = StreamOrderArray.get(donor_row, donor_col);
 			if (DonorSO == this_SO)
 			{
 				SO_test = 1;
@@ -79,6 +79,7 @@ contains a number of analysis tools built around drainage networks.
 #include <vector>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include "TNT/tnt.h"
 #include "LSDFlowInfo.hpp"
 #include "LSDRaster.hpp"
@@ -89,6 +90,110 @@ contains a number of analysis tools built around drainage networks.
 using namespace std;
 using namespace TNT;
 
+///@brief An integer array over the pixels of a DEM that can store only the
+/// pixels holding data.
+///@details The junction network keeps several arrays over the DEM, but only
+/// channel pixels ever hold data. In sparse mode only pixels that are not
+/// NoData are stored, in a hash map keyed on their position, so memory scales
+/// with the size of the channel network rather than the DEM. In dense mode it
+/// is a plain Array2D.
+class LSDSparseArray2D
+{
+  public:
+  /// @brief Makes an empty dense array.
+  LSDSparseArray2D()  { create(0, 0, -9999, false); }
+
+  /// @brief Makes an array where every pixel is NoData.
+  /// @param nrows the number of rows
+  /// @param ncols the number of columns
+  /// @param nodata the NoDataValue
+  /// @param sparse true to store only the pixels holding data
+  LSDSparseArray2D(int nrows, int ncols, int nodata, bool sparse)
+                  { create(nrows, ncols, nodata, sparse); }
+
+  /// @return the value at a pixel, NoData if it has not been set
+  int get(int row, int col) const
+  {
+    if (Sparse == false)
+    {
+      return Dense[row][col];
+    }
+    unordered_map<long,int>::const_iterator it = Pixels.find(long(row)*NCols+col);
+    return (it == Pixels.end()) ? NoDataValue : it->second;
+  }
+
+  /// @brief Sets the value at a pixel. In sparse mode setting a pixel to
+  /// NoData removes it.
+  void set(int row, int col, int value)
+  {
+    if (Sparse == false)
+    {
+      Dense[row][col] = value;
+    }
+    else if (value == NoDataValue)
+    {
+      Pixels.erase(long(row)*NCols+col);
+    }
+    else
+    {
+      Pixels[long(row)*NCols+col] = value;
+    }
+  }
+
+  /// @return true if only the pixels holding data are stored
+  bool is_sparse() const             { return Sparse; }
+
+  /// @return a deep copy of the array
+  LSDSparseArray2D copy() const
+  {
+    LSDSparseArray2D Copied = *this;
+    Copied.Dense = Dense.copy();
+    return Copied;
+  }
+
+  /// @return the array as a full Array2D
+  Array2D<int> to_Array2D() const
+  {
+    if (Sparse == false)
+    {
+      return Dense.copy();
+    }
+    Array2D<int> Full(NRows, NCols, NoDataValue);
+    for (unordered_map<long,int>::const_iterator it = Pixels.begin(); it != Pixels.end(); ++it)
+    {
+      Full[int(it->first/NCols)][int(it->first%NCols)] = it->second;
+    }
+    return Full;
+  }
+
+  private:
+  void create(int nrows, int ncols, int nodata, bool sparse)
+  {
+    NRows = nrows;
+    NCols = ncols;
+    NoDataValue = nodata;
+    Sparse = sparse;
+    if (Sparse == false)
+    {
+      Array2D<int> TempDense(NRows, NCols, NoDataValue);
+      Dense = TempDense;
+    }
+  }
+
+  /// number of rows
+  int NRows;
+  /// number of columns
+  int NCols;
+  /// the value of pixels that have not been set
+  int NoDataValue;
+  /// true if only pixels holding data are stored
+  bool Sparse;
+  /// the data in dense mode
+  Array2D<int> Dense;
+  /// the data in sparse mode, keyed on row*NCols+col
+  unordered_map<long,int> Pixels;
+};
+
 ///@brief Object to create a channel network from an LSDFlowInfo object.
 class LSDJunctionNetwork
 {
@@ -104,12 +209,30 @@ class LSDJunctionNetwork
   /// @author SMM
   /// @date 01/09/12
   LSDJunctionNetwork(vector<int> Sources, LSDFlowInfo& FlowInfo)
-                  { create(Sources, FlowInfo); }
+                  { create(Sources, FlowInfo, false); }
+
+  /// @brief This defines a channel network based on a FlowInfo object and a list of source nodes.
+  /// @param FlowInfo LSDFlowInfo object.
+  /// @param Sources vector of source nodes.
+  /// @param SparseStorage if true the stream order and junction arrays only
+  ///  store the channel pixels. This uses far less memory on large DEMs but
+  ///  lookups are slower.
+  LSDJunctionNetwork(vector<int> Sources, LSDFlowInfo& FlowInfo, bool SparseStorage)
+                  { create(Sources, FlowInfo, SparseStorage); }
 
 
   /// @brief Assignment operator.
   LSDJunctionNetwork& operator=(const LSDJunctionNetwork& LSDR);
 
+  /// @brief This replaces the sources of the channel network.
+  /// @details Only the flow paths downstream of sources that are added or
+  /// removed are revisited, so this is much cheaper than creating a new network
+  /// when the sources are being refined. The result is the same as a network
+  /// created from the new sources.
+  /// @param NewSources vector of source nodes.
+  /// @param FlowInfo the LSDFlowInfo object the network was created with.
+  void update_sources(vector<int> NewSources, LSDFlowInfo& FlowInfo);
+
   /// @brief this function gets the UTM_zone and a boolean that is true if
   /// the map is in the northern hemisphere
   /// @param UTM_zone the UTM zone. Replaced in function.
@@ -165,8 +288,9 @@ class LSDJunctionNetwork
   void get_x_and_y_from_latlong(vector<float> latitude, vector<float> longitude,
                                                    vector<float>& UTME,vector<float>& UTMN);
 
-  ///@brief Recursive add_to_stack routine to build the junction tree, from Braun and Willett (2012)
-  ///equations 12 and 13.
+  ///@brief add_to_stack routine to build the junction tree, from Braun and Willett (2012)
+  ///equations 12 and 13. Uses an explicit stack rather than recursion so
+  ///the depth of the drainage tree is not limited by the call stack.
   ///@param lm_index Integer
   ///@param j_index Integer
   ///@param bl_node Integer
@@ -191,6 +315,14 @@ class LSDJunctionNetwork
   /// @date 18/05/2016
   vector<int> get_all_source_junctions_of_an_outlet_junction(int junction_number_outlet);
 
+  /// @brief This tests whether one junction is upstream of another junction.
+  /// @details Everything upstream of a junction is a contiguous block of the
+  /// SVector, so this is a constant time test.
+  /// @param current_junction The junction of interest
+  /// @param test_junction The junction that might be upstream of it
+  /// @return 1 if test_junction is upstream of (or is) current_junction, 0 if not
+  int is_junction_upstream(int current_junction, int test_junction);
+
   /// @brief This finds all the nodes that are source nodes upslope of a
   ///  given junction
   /// @param junction_number_outlet The junction number of the outlet
@@ -417,7 +549,7 @@ class LSDJunctionNetwork
   /// @author SMM
   /// @date 01/09/12
   int retrieve_junction_number_at_row_and_column(int row,int col)
-                       { return JunctionIndexArray[ row ][ col ]; }
+                       { return JunctionIndexArray.get(row,col); }
 
   /// @brief Function for printing out the longest channel upstream of a point.
   /// @param outlet_junction
@@ -676,7 +808,8 @@ class LSDJunctionNetwork
   /// downstream to the penultamite node.
 	/// UPDATED so that if basins are nested, they don't overwrite each other - basins are
 	/// sorted by the number of contributing pixels, and the smaller basins are written
-	/// first.
+	/// first. Pixels already in a smaller basin are skipped over, so each pixel is
+	/// only visited once.
   ///
   /// @param basin_junctions Vector of junction numbers of basins to be extracted.
   /// @param FlowInfo LSDFlowInfo object.
@@ -742,6 +875,12 @@ class LSDJunctionNetwork
                               int MinSegLength, float A_0, float m_over_n,
             LSDFlowInfo& FlowInfo, LSDRaster& FlowDistance, LSDRaster& ElevationRaster);
 
+  /// @brief As GetChannelHeadsChiMethodFromNode, but with the hilltop node
+  /// given, e.g. from LSDFlowInfo::calculate_farthest_upslope_nodes
+  int GetChannelHeadsChiMethodFromNode(int NodeNumber, int HilltopNode,
+                              int MinSegLength, float A_0, float m_over_n,
+            LSDFlowInfo& FlowInfo, LSDRaster& ElevationRaster);
+
   /// @brief This function generates LSDChannels that run from the hilltops above
   /// all the sources from the valley network down to a specified number of downstream junctions below
   /// the sources
@@ -751,6 +890,12 @@ class LSDJunctionNetwork
                         int MinSegLength, float A_0, float m_over_n,
                         LSDFlowInfo& FlowInfo, LSDRaster& FlowDistance, LSDRaster& ElevationRaster, int NJunctions);
 
+  /// @brief As GetChannelHeadsChiMethodFromSourceNode, but with the hilltop node
+  /// given, e.g. from LSDFlowInfo::calculate_farthest_upslope_nodes
+  int GetChannelHeadsChiMethodFromSourceNode(int NodeNumber, int HilltopNode,
+                        int MinSegLength, float A_0, float m_over_n,
+                        LSDFlowInfo& FlowInfo, LSDRaster& ElevationRaster, int NJunctions);
+
   /// @brief This function generates LSDChannels that run from the hilltops above
   /// all the sources from the valley network down to a specified number of downstream junctions below
   /// the sources and writes the profile to csv
@@ -773,6 +918,12 @@ class LSDJunctionNetwork
   LSDIndexRaster GetChannelfromDreich(int NodeNumber, int MinSegLength, float A_0, float m_over_n,
                                       LSDFlowInfo& FlowInfo, LSDRaster& FlowDistance, LSDRaster& ElevationRaster, string path_name, int NJunctions);
 
+  /// @brief As GetChannelfromDreich, but with the hilltop node given, e.g.
+  /// from LSDFlowInfo::calculate_farthest_upslope_nodes
+  LSDIndexRaster GetChannelfromDreich(int NodeNumber, int HilltopNode, int MinSegLength,
+                                      float A_0, float m_over_n, LSDFlowInfo& FlowInfo,
+                                      LSDRaster& ElevationRaster, string path_name, int NJunctions);
+
 
 
   /// @brief This function returns all potential channel heads in a DEM. It looks for
@@ -935,6 +1086,7 @@ vector<int> GetChannelHeadsChiMethodFromValleys(vector<int> ValleyNodes,
   /// removes channelised pixels that are on ANY downslope pathway, within convergent part
   /// of the topography, from previous sources.  It uses a similar algorithm to the
   /// Freeman multi-directional flow routing algorithm in the LSDRaster object.
+  /// Only the cells on downslope pathways from the possible sources are visited.
   ///
   /// @param FlowInfo object
   /// @param raster containing elevation data
@@ -944,7 +1096,7 @@ vector<int> GetChannelHeadsChiMethodFromValleys(vector<int> ValleyNodes,
   /// @author DTM
   /// @date 03/06/2014
   vector<int> identify_upstream_limits(LSDFlowInfo& FlowInfo, Array2D<float>& topography,
-                  vector<int> source_row_vec,vector<int> source_col_vec, Array2D<float>& tan_curv);
+                  vector<int>& source_row_vec,vector<int>& source_col_vec, Array2D<float>& tan_curv);
 
   /// @brief This function is used to identify concave portions of the landscape using a tangential curvature threshold.
   ///
@@ -1463,7 +1615,7 @@ void get_info_nearest_channel_to_node_main_stem(int& StartingNode, LSDFlowInfo&
   vector<int> get_SourcesVector() const { return SourcesVector; }
 
 	/// @return the stream order array
-	Array2D<int> get_StreamOrderArray() const { return StreamOrderArray; }
+	Array2D<int> get_StreamOrderArray() const { return StreamOrderArray.to_Array2D(); }
 
   void couple_hillslope_nodes_to_channel_nodes(LSDRaster& Elevation, LSDFlowInfo& FlowInfo, LSDRaster& D_inf_Flowdir, LSDIndexRaster& ChannelNodeNetwork, int OutletJunction, vector<int>& hillslope_nodes, vector<int>& baselevel_channel_nodes);
 
@@ -1624,27 +1776,43 @@ vector<int> get_channel_pixels_along_line(vector<int> line_rows, vector<int> lin
   /// upslope of any and all nodes in the junction list.
   vector<int> NContributingJunctions;
 
+  /// The source junctions (junctions with no donors) in the order they appear in the SVector.
+  vector<int> SourceStackVector;
+
+  /// @brief The number of source junctions in the SVector before each position.
+  ///
+  ///@details It has NJunctions+1 elements. The sources upstream of a junction are
+  /// SourceStackVector[SourceStackIndex[SVectorIndex[junction]]] up to (but not
+  /// including) SourceStackVector[SourceStackIndex[SVectorIndex[junction]+NContributingJunctions[junction]]].
+  vector<int> SourceStackIndex;
+
   // the following arrays are for keeping track of the junctions. For large DEMs this will be quite memory intensive
   // it might be sensible to try to devise a less data intensive method in the future.
   // one could do it with much less memory but that would involve searching
 
   /// This array stores the stream indices of all the channels.
-  Array2D<int> StreamOrderArray;
+  LSDSparseArray2D StreamOrderArray;
 
   /// @brief This array stores a junction counter.
   ///
   /// @details If zero there is no junction \n
   /// if 1 it is a junction unvisted by the junction gathering algorithm \n
   /// if 2 or more it is a previously visited junction
-  Array2D<int> JunctionArray;
+  LSDSparseArray2D JunctionArray;
 
   /// This is an array where the elements are nodata if there is no junction
   /// and an integer indicating the junction number.
-  Array2D<int> JunctionIndexArray;
+  LSDSparseArray2D JunctionIndexArray;
 
   private:
   void create( void );
-  void create(vector<int> Sources, LSDFlowInfo& FlowInfo);
+  void create(vector<int> Sources, LSDFlowInfo& FlowInfo, bool SparseStorage);
+
+  /// @brief Numbers the junctions and builds the junction tree and stack
+  /// once the stream orders and junctions are in the StreamOrderArray and
+  /// JunctionArray.
+  /// @param FlowInfo LSDFlowInfo object.
+  void build_junctions_from_stream_orders(LSDFlowInfo& FlowInfo);
 };
 
 #endif
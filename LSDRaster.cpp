@@ -107,6 +107,7 @@
 #include "LSDStatsTools.hpp"
 #include "LSDIndexRaster.hpp"
 #include "LSDShapeTools.hpp"
+#include "LSDRasterInfo.hpp"
 using namespace std;
 using namespace TNT;
 using namespace JAMA;
@@ -247,6 +248,206 @@ void LSDRaster::create(int nrows, int ncols, float xmin, float ymin,
 
 
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// These create functions read only part of a raster from disk
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDRaster::create(string filename, string extension, int row_start, int col_start,
+                       int n_rows, int n_cols)
+{
+  read_raster_window(filename, extension, row_start, col_start, n_rows, n_cols);
+}
+
+void LSDRaster::create(string filename, string extension, float XMin, float YMin,
+                       float XMax, float YMax, int halo_pixels)
+{
+  read_raster_bounding_box(filename, extension, XMin, YMin, XMax, YMax, halo_pixels);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This reads a window of a raster. The header is read by LSDRasterInfo and
+// for binary files only the window is read from disk.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDRaster::read_raster_window(string filename, string extension, int row_start,
+                                   int col_start, int n_rows, int n_cols)
+{
+  LSDRasterInfo RasterInfo(filename, extension);
+  read_raster_window(RasterInfo, filename, extension, row_start, col_start, n_rows, n_cols);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This reads the part of a raster within a bounding box, plus a halo
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDRaster::read_raster_bounding_box(string filename, string extension, float XMin,
+                                float YMin, float XMax, float YMax, int halo_pixels)
+{
+  LSDRasterInfo RasterInfo(filename, extension);
+  int row_start, col_start, n_rows, n_cols;
+  if (not RasterInfo.get_window_of_bounding_box(XMin, YMin, XMax, YMax, halo_pixels,
+                                                row_start, col_start, n_rows, n_cols))
+  {
+    cout << "\nFATAL ERROR: the bounding box does not overlap the raster "
+         << filename << "." << extension << endl;
+    exit(EXIT_FAILURE);
+  }
+  read_raster_window(RasterInfo, filename, extension, row_start, col_start, n_rows, n_cols);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// The workhorse of the windowed readers
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDRaster::read_raster_window(LSDRasterInfo& RasterInfo, string filename, string extension,
+                                   int row_start, int col_start, int n_rows, int n_cols)
+{
+  string string_filename = filename+"."+extension;
+  int FullNRows = RasterInfo.get_NRows();
+  int FullNCols = RasterInfo.get_NCols();
+
+  // clip the window to the raster
+  if (row_start < 0)
+  {
+    n_rows += row_start;
+    row_start = 0;
+  }
+  if (col_start < 0)
+  {
+    n_cols += col_start;
+    col_start = 0;
+  }
+  if (row_start+n_rows > FullNRows)
+  {
+    n_rows = FullNRows-row_start;
+  }
+  if (col_start+n_cols > FullNCols)
+  {
+    n_cols = FullNCols-col_start;
+  }
+  if (n_rows <= 0 || n_cols <= 0)
+  {
+    cout << "\nFATAL ERROR: the window does not overlap the raster "
+         << string_filename << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // the georeferencing of the window
+  NRows = n_rows;
+  NCols = n_cols;
+  DataResolution = RasterInfo.get_DataResolution();
+  NoDataValue = RasterInfo.get_NoDataValue();
+  XMinimum = RasterInfo.get_XMinimum() + col_start*DataResolution;
+  YMinimum = RasterInfo.get_YMinimum() + (FullNRows-row_start-n_rows)*DataResolution;
+  GeoReferencingStrings = RasterInfo.get_GeoReferencingStrings();
+
+  if ((extension == "flt" || extension == "bil") &&
+      get_ENVI_data_type_size(RasterInfo.get_DataType()) == 0)
+  {
+    cout << "WARNING loading ENVI raster with unusual data type. " << endl
+         << "Guessing the type from the size of the file." << endl;
+  }
+
+  Array2D<float> data;
+  if (not read_raster_window_data(RasterInfo, filename, extension, row_start, col_start,
+                                  n_rows, n_cols, data))
+  {
+    cout << "\nFATAL ERROR: could not read the data file \"" << string_filename
+         << "\"" << endl;
+    exit(EXIT_FAILURE);
+  }
+  RasterData = data;
+
+  // update the map info to the new corner
+  if (GeoReferencingStrings.find("ENVI_map_info") != GeoReferencingStrings.end())
+  {
+    Update_GeoReferencingStrings();
+  }
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// Reads the data in a window, which must lie inside the raster, into data.
+// Unlike read_raster_window this never exits: it returns false if the data
+// cannot be read, so it can be called from inside a parallel region.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+bool LSDRaster::read_raster_window_data(LSDRasterInfo& RasterInfo, string filename,
+                                        string extension, int row_start, int col_start,
+                                        int n_rows, int n_cols, Array2D<float>& data)
+{
+  string string_filename = filename+"."+extension;
+  int FullNCols = RasterInfo.get_NCols();
+  int WindowNoDataValue = RasterInfo.get_NoDataValue();
+
+  Array2D<float> window_data(n_rows,n_cols);
+  if (extension == "asc")
+  {
+    // ascii data has to be parsed up to the last row of the window,
+    // but only the window is stored
+    ifstream data_in(string_filename.c_str());
+    if( data_in.fail() )
+    {
+      cout << "\nERROR: the data file \"" << string_filename << "\" doesn't exist" << endl;
+      return false;
+    }
+    string str;
+    for (int i = 0; i<12; i++)
+    {
+      data_in >> str;
+    }
+    float temp;
+    for (int i=0; i<row_start+n_rows; ++i)
+    {
+      for (int j=0; j<FullNCols; ++j)
+      {
+        data_in >> temp;
+        if (i >= row_start && j >= col_start && j < col_start+n_cols)
+        {
+          window_data[i-row_start][j-col_start] = temp;
+        }
+      }
+    }
+    if (data_in.fail())
+    {
+      cout << "\nERROR: the file " << string_filename
+           << " is shorter than the header says it should be!" << endl;
+      return false;
+    }
+    data_in.close();
+  }
+  else if (extension == "flt" || extension == "bil")
+  {
+    // unusual data types: guess the type from the size of the file
+    int DataType = RasterInfo.get_DataType();
+    if (get_ENVI_data_type_size(DataType) == 0)
+    {
+      DataType = guess_ENVI_data_type(string_filename, RasterInfo.get_HeaderOffset(),
+                                      RasterInfo.get_NRows(), FullNCols, false);
+    }
+
+    long NElements = long(n_rows)*long(n_cols);
+    float* data_ptr = &window_data[0][0];
+    if (not read_ENVI_binary_window(string_filename, DataType,
+                                    RasterInfo.get_ByteOrder(), RasterInfo.get_HeaderOffset(),
+                                    FullNCols, row_start, col_start, n_rows, n_cols, data_ptr))
+    {
+      return false;
+    }
+    for (long i = 0; i<NElements; ++i)
+    {
+      if (data_ptr[i]<-1e10)
+      {
+        data_ptr[i] = WindowNoDataValue;
+      }
+    }
+  }
+  else
+  {
+    cout << "You did not enter and appropriate extension!" << endl
+          << "You entered: " << extension << " options are .flt, .asc and .bil" << endl;
+    return false;
+  }
+  data = window_data;
+  return true;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 // This function reads a DEM
 // One has to provide both the filename and the extension
@@ -270,10 +471,6 @@ void LSDRaster::read_raster(string filename, string extension)
   string_filename = filename+dot+extension;
   //cout << "\n\nLoading an LSDRaster, the filename is " << string_filename << endl;
 
-  // First get the size of the file
-  int rc = get_file_size(string_filename);
-  //cout << "The size of the file is: " << rc << endl;
-
 
   if (extension == "asc")
   {
@@ -317,8 +514,9 @@ void LSDRaster::read_raster(string filename, string extension)
     }
     data_in.close();
 
-    // now update the objects raster data
-    RasterData = data.copy();
+    // now update the objects raster data. TNT assignment shares the
+    // storage so there is no need for a second copy
+    RasterData = data;
   }
   else if (extension == "flt")
   {
@@ -328,6 +526,8 @@ void LSDRaster::read_raster(string filename, string extension)
     string header_extension = "hdr";
     header_filename = filename+dot+header_extension;
 
+    int ByteOrder = get_host_byte_order();
+
     ifstream ifs(header_filename.c_str());
     if( ifs.fail() )
     {
@@ -345,6 +545,20 @@ void LSDRaster::read_raster(string filename, string extension)
       ifs >> str >> XMinimum >> str >> YMinimum
           >> str >> DataResolution
           >> str >> NoDataValue;
+
+      // the optional byteorder line
+      while (ifs >> str)
+      {
+        transform(str.begin(), str.end(), str.begin(), ::toupper);
+        if (str == "MSBFIRST")
+        {
+          ByteOrder = 1;
+        }
+        else if (str == "LSBFIRST")
+        {
+          ByteOrder = 0;
+        }
+      }
     }
     ifs.close();
 
@@ -353,33 +567,19 @@ void LSDRaster::read_raster(string filename, string extension)
     //     << "Data Resolution: " << DataResolution << " and No Data Value: "
     //     << NoDataValue << endl;
 
-    // this is the array into which data is fed
-    Array2D<float> data(NRows,NCols,NoDataValue);
-
-    // now read the DEM, using the binary stream option
-    ifstream ifs_data(string_filename.c_str(), ios::in | ios::binary);
-    if( ifs_data.fail() )
+    // this is the array into which data is fed. The data is read straight
+    // into its storage in one block
+    Array2D<float> data(NRows,NCols);
+    if (not read_ENVI_binary_data(string_filename, 4, ByteOrder, 0,
+                                  long(NRows)*long(NCols), &data[0][0]))
     {
-      cout << "\nFATAL ERROR: the data file \"" << string_filename
-           << "\" doesn't exist" << endl;
+      cout << "\nFATAL ERROR: could not read the data file \"" << string_filename
+           << "\"" << endl;
       exit(EXIT_FAILURE);
     }
-    else
-    {
-      float temp;
-      for (int i=0; i<NRows; ++i)
-      {
-        for (int j=0; j<NCols; ++j)
-        {
-          ifs_data.read(reinterpret_cast<char*>(&temp), sizeof(temp));
-          data[i][j] = float(temp);
-        }
-      }
-    }
-    ifs_data.close();
 
     // now update the objects raster data
-    RasterData = data.copy();
+    RasterData = data;
   }
   else if (extension == "bil")
   {
@@ -390,6 +590,8 @@ void LSDRaster::read_raster(string filename, string extension)
     header_filename = filename+dot+header_extension;
     int NoDataExists = 0;
     int DataType = 4;     // default is float data
+    int ByteOrder = get_host_byte_order();
+    long HeaderOffset = 0;
 
     ifstream ifs(header_filename.c_str());
     if( ifs.fail() )
@@ -526,6 +728,50 @@ void LSDRaster::read_raster(string filename, string extension)
           }
         }
 
+        // get byte order
+        counter = 0;
+        str_find = "byte order";
+        while (counter < NLines)
+        {
+          found = lines[counter].find(str_find);
+          if (found!=string::npos)
+          {
+            // get the data using a stringstream
+            istringstream iss(lines[counter]);
+            iss >> str >> str >> str >> str;
+            ByteOrder = atoi(str.c_str());
+
+            // advance to the end so you move on to the new loop
+            counter = lines.size();
+          }
+          else
+          {
+            counter++;
+          }
+        }
+
+        // get header offset
+        counter = 0;
+        str_find = "header offset";
+        while (counter < NLines)
+        {
+          found = lines[counter].find(str_find);
+          if (found!=string::npos)
+          {
+            // get the data using a stringstream
+            istringstream iss(lines[counter]);
+            iss >> str >> str >> str >> str;
+            HeaderOffset = atol(str.c_str());
+
+            // advance to the end so you move on to the new loop
+            counter = lines.size();
+          }
+          else
+          {
+            counter++;
+          }
+        }
+
         // get the map info
         counter = 0;
         string this_map_info = "empty";
@@ -626,151 +872,38 @@ void LSDRaster::read_raster(string filename, string extension)
     {
       NoDataValue = -9999;
     }
-    //bool set_NDV = false;
-    Array2D<float> data(NRows,NCols,NoDataValue);
+    // unusual data types: guess the type from the size of the file
+    if (get_ENVI_data_type_size(DataType) == 0)
+    {
+      cout << "WARNING loading ENVI raster with unusual data type. " << endl
+           << "Guessing the type from the size of the file." << endl;
+      DataType = guess_ENVI_data_type(string_filename, HeaderOffset, NRows, NCols, false);
+    }
+    else if (DataType != 4)
+    {
+      cout << "Loading raster, recasting data of ENVI type " << DataType
+           << " to float!" << endl;
+    }
 
-    // now read the DEM, using the binary stream option
-    ifstream ifs_data(string_filename.c_str(), ios::in | ios::binary);
-    if( ifs_data.fail() )
+    // read the DEM straight into the storage of the raster.
+    // Float data is read in one block, other types are converted in chunks
+    Array2D<float> data(NRows,NCols);
+    long NElements = long(NRows)*long(NCols);
+    float* data_ptr = &data[0][0];
+    if (not read_ENVI_binary_data(string_filename, DataType, ByteOrder, HeaderOffset,
+                                  NElements, data_ptr))
     {
-      cout << "\nFATAL ERROR: the data file \"" << string_filename
-           << "\" doesn't exist" << endl;
+      cout << "\nFATAL ERROR: could not read the data file \"" << string_filename
+           << "\"" << endl;
       exit(EXIT_FAILURE);
     }
-    else
+    for (long i = 0; i<NElements; ++i)
     {
-      if (DataType == 2)
-      {
-        cout << "Loading raster, recasting data from int to float!" << endl;
-        short int temp;
-        cout << "Integer size: " << sizeof(temp) << endl;
-        for (int i=0; i<NRows; ++i)
-        {
-          for (int j=0; j<NCols; ++j)
-          {
-            ifs_data.read(reinterpret_cast<char*>(&temp), sizeof(temp));
-            //cout << temp << " ";
-            data[i][j] = float(temp);
-            if (data[i][j]<-1e10)
-            {
-              data[i][j] = NoDataValue;
-            }
-          }
-          //cout << endl;
-        }
-      }
-      else if (DataType == 4)
-      {
-        float temp;
-        //cout << "Float size: " << sizeof(temp) << endl;
-        for (int i=0; i<NRows; ++i)
-        {
-          for (int j=0; j<NCols; ++j)
-          {
-            ifs_data.read(reinterpret_cast<char*>(&temp), sizeof(temp));
-
-            data[i][j] = float(temp);
-            if (data[i][j]<-1e10)
-            {
-              data[i][j] = NoDataValue;
-            }
-          }
-        }
-      }
-      else if (DataType == 5)
-      {
-        double temp;
-        cout << "I am trying to load a double precision raster. Wish me luck!" << endl;
-        for (int i=0; i<NRows; ++i)
-        {
-          for (int j=0; j<NCols; ++j)
-          {
-            ifs_data.read(reinterpret_cast<char*>(&temp), sizeof(temp));
-
-            data[i][j] = double(temp);
-            if (data[i][j]<-1e10)
-            {
-              data[i][j] = NoDataValue;
-            }
-          }
-        }
-      }
-      else if (DataType == 13)
-      {
-        unsigned long int temp;
-        cout << "size unsigned long int: " << sizeof(temp) << endl;
-
-        float temp2;
-        cout << "size float: " << sizeof(temp2) << endl;
-
-        int temp3;
-        cout << "size int: " << sizeof(temp3) << endl;
-
-        // figure out the size of the file
-        cout << "the size of the file is: " << rc << endl;
-
-        int data_size = int(sizeof(temp));
-
-        // see if this matches the dimensions of the DEM
-        if (NRows*NCols*int(sizeof(temp)) != rc)
-        {
-          cout << "Something is funny here, I expect a file size of: "
-               << NRows*NCols*int(data_size) << endl;
-          cout << "changing to the right data size: ";
-          data_size = rc/(NRows*NCols);
-          cout << data_size << endl;
-        }
-
-        //data_size= 8;
-
-        for (int i=0; i<NRows; ++i)
-        {
-          for (int j=0; j<NCols; ++j)
-          {
-            ifs_data.read(reinterpret_cast<char*>(&temp3), data_size);
-
-            //if (i%250 == 0 && j%250 == 0)
-            //{
-            //  cout << "["<<i<<"]["<<j<<"]: " << temp3 << " recast: " << float(temp3) << endl;
-            //}
-
-            data[i][j] = float(temp3);
-
-            if (data[i][j]<-1e10)
-            {
-              data[i][j] = NoDataValue;
-            }
-          }
-        }
-      }
-      else
+      if (data_ptr[i]<-1e10)
       {
-        cout << "WARNING loading ENVI raster with unusual data type. " << endl
-             << "If you get a crazy DEM go to LINE 625 of LSDRaster.cpp to debug" << endl;
-
-        int DataSize = rc/(NRows*NCols);
-
-        float temp;   // might need to change this
-        //cout << "Float size: " << sizeof(temp) << endl;
-        for (int i=0; i<NRows; ++i)
-        {
-          for (int j=0; j<NCols; ++j)
-          {
-
-
-            // Use data type to control the bytes being read for each entry
-            ifs_data.read(reinterpret_cast<char*>(&temp), DataSize);
-
-            data[i][j] = float(temp);
-            if (data[i][j]<-1e10)
-            {
-              data[i][j] = NoDataValue;
-            }
-          }
-        }
+        data_ptr[i] = NoDataValue;
       }
     }
-    ifs_data.close();
 
     //cout << "Loading ENVI bil file; NCols: " << NCols << " NRows: " << NRows << endl
     //   << "X minimum: " << XMinimum << " YMinimum: " << YMinimum << endl
@@ -778,7 +911,7 @@ void LSDRaster::read_raster(string filename, string extension)
     //     << NoDataValue << endl;
 
     // now update the objects raster data
-    RasterData = data.copy();
+    RasterData = data;
   }
   else
   {
@@ -901,90 +1034,39 @@ void LSDRaster::read_ascii_raster_integers(string FILENAME)
 }
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-// write_raster
-// this function writes a raster. One has to give the filename and extension
-// currently the options are for .asc and .flt files
-//
-// SMM 2012
-//
+// Writes the header file of a flt or bil raster. Used by write_raster and by
+// the tiled fill, which writes the data one tile at a time.
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-void LSDRaster::write_raster(string filename, string extension)
+void LSDRaster::write_raster_header(string filename, string extension)
 {
-  string string_filename;
   string dot = ".";
-  string_filename = filename+dot+extension;
-  cout << "The filename is " << string_filename << endl;
+  string string_filename = filename+dot+extension;
+  if (extension == "flt")
+  {
+    // float data (a binary format created by ArcMap) has a header file
+    // this file must be opened first
+    string header_filename;
+    string header_extension = "hdr";
+    header_filename = filename+dot+header_extension;
 
-  // this first bit of logic is for the asc file.
-  if (extension == "asc")
+    ofstream header_ofs(header_filename.c_str());
+    string str;
+    header_ofs <<  "ncols         " << NCols
+      << "\nnrows         " << NRows
+      << "\nxllcorner     " << setprecision(14) << XMinimum
+      << "\nyllcorner     " << setprecision(14) << YMinimum
+      << "\ncellsize      " << DataResolution
+      << "\nNODATA_value  " << NoDataValue
+      << "\nbyteorder     LSBFIRST" << endl;
+    header_ofs.close();
+  }
+  else if (extension == "bil")
   {
-    // open the data file
-    ofstream data_out(string_filename.c_str());
-
-    if( data_out.fail() )
-    {
-      cout << "\nFATAL ERROR: unable to write to " << string_filename << endl;
-      exit(EXIT_FAILURE);
-    }
-
-    data_out <<  "ncols\t" << NCols
-       << "\nnrows\t" << NRows
-       << "\nxllcorner\t" << setprecision(14) << XMinimum
-       << "\nyllcorner\t" << setprecision(14) << YMinimum
-       << "\ncellsize\t" << DataResolution
-       << "\nNODATA_value\t" << NoDataValue << endl;
-
-
-    for (int i=0; i<NRows; ++i)
-    {
-      for (int j=0; j<NCols; ++j)
-      {
-        data_out << setprecision(6) << RasterData[i][j] << " ";
-      }
-      if (i != NRows-1) data_out << endl;
-    }
-    data_out.close();
-
-  }
-  else if (extension == "flt")
-  {
-    // float data (a binary format created by ArcMap) has a header file
-    // this file must be opened first
-    string header_filename;
-    string header_extension = "hdr";
-    header_filename = filename+dot+header_extension;
-
-    ofstream header_ofs(header_filename.c_str());
-    string str;
-    header_ofs <<  "ncols         " << NCols
-      << "\nnrows         " << NRows
-      << "\nxllcorner     " << setprecision(14) << XMinimum
-      << "\nyllcorner     " << setprecision(14) << YMinimum
-      << "\ncellsize      " << DataResolution
-      << "\nNODATA_value  " << NoDataValue
-      << "\nbyteorder     LSBFIRST" << endl;
-    header_ofs.close();
-
-    // now do the main data
-    ofstream data_ofs(string_filename.c_str(), ios::out | ios::binary);
-    float temp;
-    for (int i=0; i<NRows; ++i)
-    {
-      for (int j=0; j<NCols; ++j)
-      {
-        temp = float(RasterData[i][j]);
-        data_ofs.write(reinterpret_cast<char *>(&temp),sizeof(temp));
-      }
-    }
-    data_ofs.close();
-  }
-  else if (extension == "bil")
-  {
-    // float data (a binary format created by ArcMap) has a header file
-    // this file must be opened first
-    string header_filename;
-    string header_extension = "hdr";
-    header_filename = filename+dot+header_extension;
+    // float data (a binary format created by ArcMap) has a header file
+    // this file must be opened first
+    string header_filename;
+    string header_extension = "hdr";
+    header_filename = filename+dot+header_extension;
 
     // you need to strip the filename
     string frontslash = "/";
@@ -1040,6 +1122,80 @@ void LSDRaster::write_raster(string filename, string extension)
     header_ofs <<  "data ignore value = " << NoDataValue << endl;
 
     header_ofs.close();
+  }
+  else
+  {
+    cout << "write_raster_header: only flt and bil files have a header file" << endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// write_raster
+// this function writes a raster. One has to give the filename and extension
+// currently the options are for .asc and .flt files
+//
+// SMM 2012
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDRaster::write_raster(string filename, string extension)
+{
+  string string_filename;
+  string dot = ".";
+  string_filename = filename+dot+extension;
+  cout << "The filename is " << string_filename << endl;
+
+  // this first bit of logic is for the asc file.
+  if (extension == "asc")
+  {
+    // open the data file
+    ofstream data_out(string_filename.c_str());
+
+    if( data_out.fail() )
+    {
+      cout << "\nFATAL ERROR: unable to write to " << string_filename << endl;
+      exit(EXIT_FAILURE);
+    }
+
+    data_out <<  "ncols\t" << NCols
+       << "\nnrows\t" << NRows
+       << "\nxllcorner\t" << setprecision(14) << XMinimum
+       << "\nyllcorner\t" << setprecision(14) << YMinimum
+       << "\ncellsize\t" << DataResolution
+       << "\nNODATA_value\t" << NoDataValue << endl;
+
+
+    for (int i=0; i<NRows; ++i)
+    {
+      for (int j=0; j<NCols; ++j)
+      {
+        data_out << setprecision(6) << RasterData[i][j] << " ";
+      }
+      if (i != NRows-1) data_out << endl;
+    }
+    data_out.close();
+
+  }
+  else if (extension == "flt")
+  {
+    write_raster_header(filename, extension);
+
+    // now do the main data
+    ofstream data_ofs(string_filename.c_str(), ios::out | ios::binary);
+    float temp;
+    for (int i=0; i<NRows; ++i)
+    {
+      for (int j=0; j<NCols; ++j)
+      {
+        temp = float(RasterData[i][j]);
+        data_ofs.write(reinterpret_cast<char *>(&temp),sizeof(temp));
+      }
+    }
+    data_ofs.close();
+  }
+  else if (extension == "bil")
+  {
+    write_raster_header(filename, extension);
 
     // now do the main data
     ofstream data_ofs(string_filename.c_str(), ios::out | ios::binary);
@@ -5950,6 +6106,8 @@ struct FillNode
   int RowIndex;
   /// @brief Column index value.
   int ColIndex;
+  /// @brief Order in which the node was queued, used to break ties in Zeta.
+  int Order;
 };
 
 //Overload the less than and greater than operators to consider Zeta data only
@@ -5965,6 +6123,27 @@ bool operator<( const FillNode& lhs, const FillNode& rhs )
   return lhs.Zeta < rhs.Zeta;
 }
 
+//Compares Zeta data, with nodes of equal Zeta ordered by when they were queued.
+//The tie break makes the order nodes are popped in (and so the epsilon added to
+//filled nodes) independent of the internals of the priority queue. It is used by
+//the tiled fills; fill(MinSlope) keeps the Zeta only comparison so its output is
+//unchanged.
+bool fill_node_ordered_less( const FillNode& lhs, const FillNode& rhs )
+{
+  if (lhs.Zeta != rhs.Zeta)
+  {
+    return lhs.Zeta < rhs.Zeta;
+  }
+  return lhs.Order < rhs.Order;
+}
+struct FillNodeOrderedGreater
+{
+  bool operator()( const FillNode& lhs, const FillNode& rhs ) const
+  {
+    return fill_node_ordered_less(rhs, lhs);
+  }
+};
+
 LSDRaster LSDRaster::fill(float& MinSlope)
 {
   //cout << "Inside NewFill" << endl;
@@ -6140,6 +6319,1093 @@ LSDRaster LSDRaster::fill(float& MinSlope)
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+//  Improved priority flood, after Barnes et al. (2014), Computers & Geosciences
+//  62, 117-127.
+//
+//  Only the unraised frontier of the fill goes through the priority queue. Nodes
+//  that are raised inside a depression take the elevation of the node they were
+//  raised from and are pushed onto a plain FIFO queue, which is emptied before
+//  the next node is taken from the priority queue. Without an epsilon the filled
+//  elevation of every node is its lowest spill elevation, whatever order nodes of
+//  equal elevation are visited in, so the result is bit-identical to fill(MinSlope).
+//
+//  With a nonzero MinSlope the node that reaches a neighbour first decides which
+//  increment it is raised by, and which of two tied nodes comes off the heap
+//  first depends on everything that has been pushed onto it. Only the same heap
+//  gives the same result, so this calls fill(MinSlope), as it does if
+//  ImprovedPriorityFlood is false.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+LSDRaster LSDRaster::fill(float& MinSlope, bool ImprovedPriorityFlood)
+{
+  if (!ImprovedPriorityFlood || MinSlope > 0)
+  {
+    return fill(MinSlope);
+  }
+
+  // neighbour offsets, in the same order as the kernal in fill(MinSlope)
+  const int row_offset[8] = {-1,-1, 0, 1, 1, 1, 0,-1};
+  const int col_offset[8] = { 0, 1, 1, 1, 0,-1,-1,-1};
+
+  //Declare the priority Queue with greater than comparison, and the queue
+  //for raised nodes
+  priority_queue< FillNode, vector<FillNode>, greater<FillNode> > PriorityQueue;
+  queue<FillNode> PitQueue;
+  FillNode TempFillNode, CentreFillNode;
+
+  //Index array to track whether nodes are in queue or have been processed
+  //-1 = no_data, 0 = data but not processed or in queue,
+  //1 = in queue or processed
+  Array2D<int> FillIndex(NRows,NCols,-1);
+  Array2D<float> FilledZeta;
+  FilledZeta = RasterData.copy();
+
+  //Collect boundary cells
+  for (int i=0; i<NRows; ++i)
+  {
+    for (int j=0; j<NCols; ++j)
+    {
+      if (FilledZeta[i][j] != NoDataValue)
+      {
+        FillIndex[i][j] = 0;
+
+        //If we're at the edge or next to an NoDataValue then
+        //put the cell into the priority queue
+        if (i==0 || j==0 || i==NRows-1 || j==NCols-1 ||
+          FilledZeta[i-1][j-1]==NoDataValue || FilledZeta[i-1][j]==NoDataValue ||
+          FilledZeta[i-1][j+1]==NoDataValue || FilledZeta[i][j-1]==NoDataValue ||
+          FilledZeta[i][j+1]==NoDataValue || FilledZeta[i+1][j-1]==NoDataValue ||
+          FilledZeta[i+1][j]==NoDataValue || FilledZeta[i+1][j+1]==NoDataValue)
+        {
+          TempFillNode.Zeta = FilledZeta[i][j];
+          TempFillNode.RowIndex = i;
+          TempFillNode.ColIndex = j;
+          PriorityQueue.push(TempFillNode);
+          FillIndex[i][j] = 1;
+        }
+      }
+    }
+  }
+
+  while (!PriorityQueue.empty() || !PitQueue.empty())
+  {
+    // the raised nodes go first
+    if (!PitQueue.empty())
+    {
+      CentreFillNode = PitQueue.front();
+      PitQueue.pop();
+    }
+    else
+    {
+      CentreFillNode = PriorityQueue.top();
+      PriorityQueue.pop();
+    }
+    int row=CentreFillNode.RowIndex, col=CentreFillNode.ColIndex;
+
+    //loop through neighbours
+    for (int Neighbour = 0; Neighbour<8; ++Neighbour)
+    {
+      int nrow = row+row_offset[Neighbour];
+      int ncol = col+col_offset[Neighbour];
+      if (nrow < 0 || nrow >= NRows || ncol < 0 || ncol >= NCols ||
+          FillIndex[nrow][ncol] != 0)
+      {
+        continue;
+      }
+
+      FillIndex[nrow][ncol] = 1;
+      TempFillNode.RowIndex = nrow;
+      TempFillNode.ColIndex = ncol;
+
+      //check if neighbour is equal/lower and therefore needs filling
+      if (FilledZeta[nrow][ncol] <= CentreFillNode.Zeta)
+      {
+        FilledZeta[nrow][ncol] = CentreFillNode.Zeta;
+        TempFillNode.Zeta = CentreFillNode.Zeta;
+        PitQueue.push(TempFillNode);
+      }
+      else
+      {
+        TempFillNode.Zeta = FilledZeta[nrow][ncol];
+        PriorityQueue.push(TempFillNode);
+      }
+    }
+  }
+
+  LSDRaster FilledDEM(NRows,NCols,XMinimum,YMinimum,DataResolution,
+                      NoDataValue,FilledZeta,GeoReferencingStrings);
+  return FilledDEM;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+//  Tiled, parallel priority flood, after Barnes (2016), Parallel priority-flood
+//  depression filling for trillion cell digital elevation models on desktops or
+//  clusters, Computers & Geosciences 96, 56-68.
+//
+//  The DEM is split into square tiles, each of which is read with a one pixel halo
+//  so nodes next to nodata or the edge of the DEM can be recognised.
+//
+//  1) Each tile is filled on its own, seeded from every node on the tile perimeter.
+//     Every node inherits the label of the perimeter node it was flooded from
+//     (nodes seeded from the edge of the DEM are labelled as the outlet) and the
+//     lowest spill between each pair of labels is recorded. Neighbouring
+//     perimeter nodes in adjacent tiles are joined directly.
+//  2) The spill-over graph of perimeter nodes is solved with a priority flood
+//     from the outlet, which gives the elevation every perimeter node is filled to.
+//  3) Each tile is filled again, seeded with the perimeter nodes at their solved
+//     elevations.
+//
+//  Without an epsilon the result is identical to fill with a MinSlope of zero.
+//
+//  With an epsilon the elevation a path raises a node to depends on the elevation
+//  it starts from, so each spill is stored as max(Spill, start + Increment), where
+//  Increment is the sum of the epsilons along the path. In pass 1 every node keeps
+//  the sums it needs to build these for the path back to its seed, and in pass 3
+//  each tile is filled with a Dijkstra search that lets a node be lowered if a
+//  cheaper path reaches it. The solved perimeter elevations are never lower than
+//  the ones the tiles reach in pass 3, so every filled node still drains through
+//  a strictly lower neighbour. The result can differ from fill(MinSlope) by
+//  epsilon sized increments.
+//
+//  Tiles are processed on all cores with OpenMP, and only one tile per thread is
+//  held in memory beyond the filled DEM itself (which can also be written to disk
+//  tile by tile).
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+///@brief An edge in the spill-over graph of the tiled fill. Nodes are global node
+/// indices of tile perimeter nodes, or -1 for the outlet (the edge of the DEM).
+struct FillGraphEdge
+{
+  /// @brief The node at one end of the edge (the start if the edge is directed).
+  long NodeA;
+  /// @brief The node at the other end of the edge.
+  long NodeB;
+  /// @brief The elevation the far node is filled to, whatever the elevation of
+  /// the near node.
+  double Spill;
+  /// @brief The sum of the epsilons added along the path between the nodes.
+  double Increment;
+  /// @brief The number of steps on the path between the nodes.
+  int NSteps;
+  /// @brief If false water can spill either way along the edge.
+  bool Directed;
+};
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// The elevation the far end of an edge is filled to if the near end is filled
+// to Zeta (-numeric_limits<float>::max() is the outlet). The fill adds the epsilons
+// in float one step at a time, so the rounding of each addition is allowed for and
+// the result is rounded up: it is never lower than what the fill reaches.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+float fill_graph_edge_elevation(const FillGraphEdge& Edge, float Zeta)
+{
+  bool from_outlet = (Zeta == -numeric_limits<float>::max());
+  double reached = Edge.Spill;
+  double magnitude = fabs(Edge.Spill);
+  if (!from_outlet)
+  {
+    reached = max(reached, double(Zeta)+Edge.Increment);
+    magnitude = max(magnitude, fabs(double(Zeta)));
+  }
+  if (Edge.Increment > 0)
+  {
+    // each float addition rounds by at most half a unit in the last place
+    magnitude += Edge.Increment;
+    reached += Edge.NSteps*ldexp(1.0,ilogb(magnitude)-23);
+  }
+  float reached_float = float(reached);
+  if (double(reached_float) < reached)
+  {
+    reached_float = nextafterf(reached_float,numeric_limits<float>::max());
+  }
+  return reached_float;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This fills a tile (with its halo) from the nodes already in the queues, without
+// an epsilon, labelling nodes as it goes. Labels are only used if TileLabel has
+// the same dimensions as TileZeta. FillIndex is 0 for nodes yet to be visited.
+// If labels are used, spill elevations between labels are added to LabelSpill.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void flood_fill_tile(Array2D<float>& TileZeta, Array2D<int>& FillIndex,
+                     Array2D<int>& TileLabel, long NLabels,
+                     priority_queue< FillNode, vector<FillNode>, FillNodeOrderedGreater >& PriorityQueue,
+                     map<long,float>& LabelSpill)
+{
+  const int row_offset[8] = {-1,-1, 0, 1, 1, 1, 0,-1};
+  const int col_offset[8] = { 0, 1, 1, 1, 0,-1,-1,-1};
+  int TileNRows = TileZeta.dim1();
+  int TileNCols = TileZeta.dim2();
+  bool use_labels = (TileLabel.dim1() == TileNRows && TileLabel.dim2() == TileNCols);
+
+  // without an epsilon the raised nodes all have the elevation of the
+  // node they were raised from, so a plain queue stays sorted
+  queue<FillNode> PitQueue;
+  FillNode TempFillNode, CentreFillNode;
+  int NQueued = PriorityQueue.size();
+
+  while (!PriorityQueue.empty() || !PitQueue.empty())
+  {
+    if (!PitQueue.empty() &&
+        (PriorityQueue.empty() || PitQueue.front().Zeta <= PriorityQueue.top().Zeta))
+    {
+      CentreFillNode = PitQueue.front();
+      PitQueue.pop();
+    }
+    else
+    {
+      CentreFillNode = PriorityQueue.top();
+      PriorityQueue.pop();
+    }
+    int row=CentreFillNode.RowIndex, col=CentreFillNode.ColIndex;
+
+    for (int Neighbour = 0; Neighbour<8; ++Neighbour)
+    {
+      // the halo is never filled
+      int nrow = row+row_offset[Neighbour];
+      int ncol = col+col_offset[Neighbour];
+      if (nrow < 1 || nrow >= TileNRows-1 || ncol < 1 || ncol >= TileNCols-1)
+      {
+        continue;
+      }
+
+      if (FillIndex[nrow][ncol] == 0)
+      {
+        FillIndex[nrow][ncol] = 1;
+        if (use_labels)
+        {
+          TileLabel[nrow][ncol] = TileLabel[row][col];
+        }
+        TempFillNode.RowIndex = nrow;
+        TempFillNode.ColIndex = ncol;
+        TempFillNode.Order = NQueued++;
+        if (TileZeta[nrow][ncol] <= CentreFillNode.Zeta)
+        {
+          TileZeta[nrow][ncol] = CentreFillNode.Zeta;
+          TempFillNode.Zeta = CentreFillNode.Zeta;
+          PitQueue.push(TempFillNode);
+        }
+        else
+        {
+          TempFillNode.Zeta = TileZeta[nrow][ncol];
+          PriorityQueue.push(TempFillNode);
+        }
+      }
+      else if (use_labels && FillIndex[nrow][ncol] == 1 &&
+               TileLabel[nrow][ncol] != TileLabel[row][col])
+      {
+        // two watersheds meet: keep the lowest spill between them
+        long LabelA = min(TileLabel[row][col],TileLabel[nrow][ncol]);
+        long LabelB = max(TileLabel[row][col],TileLabel[nrow][ncol]);
+        long key = LabelA*NLabels+LabelB;
+        float spill = max(CentreFillNode.Zeta,TileZeta[nrow][ncol]);
+        map<long,float>::iterator it = LabelSpill.find(key);
+        if (it == LabelSpill.end())
+        {
+          LabelSpill[key] = spill;
+        }
+        else if (spill < it->second)
+        {
+          it->second = spill;
+        }
+      }
+    }
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// As flood_fill_tile, but with an epsilon, for pass 1 of the tiled fill. Every
+// node keeps, for the path back to the seed it was flooded from:
+//  PathIncrement: the sum of the epsilons along the path
+//  PathSteps: the number of steps on the path
+//  ForwardSpill: the elevation the path raises the node to, ignoring the seed
+//  ReverseSpill: the elevation the reversed path raises the seed to, ignoring
+//                the node itself
+// When two labels meet, the spill from each label into the other is built from
+// these and the cheapest, judged from the unfilled elevation of the seed
+// (LabelZeta), is kept in LabelEdges, keyed by source*NLabels+target.
+// Spills into the outlet (label 0) are not needed.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void flood_fill_tile_with_paths(Array2D<float>& TileZeta, Array2D<float>& OriginalZeta,
+                     Array2D<int>& FillIndex, Array2D<int>& TileLabel,
+                     vector<long>& LabelNodes, vector<float>& LabelZeta,
+                     float cardinal_increment, float diagonal_increment,
+                     Array2D<double>& PathIncrement, Array2D<int>& PathSteps,
+                     Array2D<double>& ForwardSpill, Array2D<double>& ReverseSpill,
+                     priority_queue< FillNode, vector<FillNode>, FillNodeOrderedGreater >& PriorityQueue,
+                     map<long,FillGraphEdge>& LabelEdges)
+{
+  const int row_offset[8] = {-1,-1, 0, 1, 1, 1, 0,-1};
+  const int col_offset[8] = { 0, 1, 1, 1, 0,-1,-1,-1};
+  int TileNRows = TileZeta.dim1();
+  int TileNCols = TileZeta.dim2();
+  long NLabels = LabelNodes.size();
+
+  // as in fill(MinSlope, true) the raised nodes go through two plain queues
+  queue<FillNode> CardinalPitQueue;
+  queue<FillNode> DiagonalPitQueue;
+  FillNode TempFillNode, CentreFillNode;
+  FillGraphEdge TempEdge;
+  TempEdge.Directed = true;
+  int NQueued = PriorityQueue.size();
+
+  while (!PriorityQueue.empty() || !CardinalPitQueue.empty() || !DiagonalPitQueue.empty())
+  {
+    int lowest_queue = -1;
+    if (!PriorityQueue.empty())
+    {
+      CentreFillNode = PriorityQueue.top();
+      lowest_queue = 0;
+    }
+    if (!CardinalPitQueue.empty() &&
+        (lowest_queue == -1 || fill_node_ordered_less(CardinalPitQueue.front(), CentreFillNode)))
+    {
+      CentreFillNode = CardinalPitQueue.front();
+      lowest_queue = 1;
+    }
+    if (!DiagonalPitQueue.empty() &&
+        (lowest_queue == -1 || fill_node_ordered_less(DiagonalPitQueue.front(), CentreFillNode)))
+    {
+      CentreFillNode = DiagonalPitQueue.front();
+      lowest_queue = 2;
+    }
+    if (lowest_queue == 0)
+    {
+      PriorityQueue.pop();
+    }
+    else if (lowest_queue == 1)
+    {
+      CardinalPitQueue.pop();
+    }
+    else
+    {
+      DiagonalPitQueue.pop();
+    }
+    int row=CentreFillNode.RowIndex, col=CentreFillNode.ColIndex;
+
+    for (int Neighbour = 0; Neighbour<8; ++Neighbour)
+    {
+      // the halo is never filled
+      int nrow = row+row_offset[Neighbour];
+      int ncol = col+col_offset[Neighbour];
+      if (nrow < 1 || nrow >= TileNRows-1 || ncol < 1 || ncol >= TileNCols-1)
+      {
+        continue;
+      }
+      float increment = (Neighbour%2 == 0) ? cardinal_increment : diagonal_increment;
+
+      if (FillIndex[nrow][ncol] == 0)
+      {
+        FillIndex[nrow][ncol] = 1;
+        TileLabel[nrow][ncol] = TileLabel[row][col];
+        PathIncrement[nrow][ncol] = PathIncrement[row][col]+increment;
+        PathSteps[nrow][ncol] = PathSteps[row][col]+1;
+        ForwardSpill[nrow][ncol] = max(double(OriginalZeta[nrow][ncol]),
+                                       ForwardSpill[row][col]+increment);
+        ReverseSpill[nrow][ncol] = max(ReverseSpill[row][col],
+                                       OriginalZeta[row][col]+PathIncrement[row][col]);
+
+        TempFillNode.RowIndex = nrow;
+        TempFillNode.ColIndex = ncol;
+        TempFillNode.Order = NQueued++;
+        if (TileZeta[nrow][ncol] <= CentreFillNode.Zeta)
+        {
+          TileZeta[nrow][ncol] = CentreFillNode.Zeta + increment;
+          TempFillNode.Zeta = TileZeta[nrow][ncol];
+          if (Neighbour%2 == 0)
+          {
+            CardinalPitQueue.push(TempFillNode);
+          }
+          else
+          {
+            DiagonalPitQueue.push(TempFillNode);
+          }
+        }
+        else
+        {
+          TempFillNode.Zeta = TileZeta[nrow][ncol];
+          PriorityQueue.push(TempFillNode);
+        }
+      }
+      else if (FillIndex[nrow][ncol] == 1 &&
+               TileLabel[nrow][ncol] != TileLabel[row][col])
+      {
+        // two watersheds meet: the path from each seed into the other watershed
+        // runs down to this pair of nodes, across, and back up to the other seed
+        for (int direction = 0; direction<2; ++direction)
+        {
+          int brow = (direction == 0) ? row : nrow;
+          int bcol = (direction == 0) ? col : ncol;
+          int arow = (direction == 0) ? nrow : row;
+          int acol = (direction == 0) ? ncol : col;
+          long source = TileLabel[brow][bcol];
+          long target = TileLabel[arow][acol];
+          if (target == 0)
+          {
+            continue;
+          }
+          TempEdge.NodeA = LabelNodes[source];
+          TempEdge.NodeB = LabelNodes[target];
+          TempEdge.Spill = max(ReverseSpill[arow][acol],
+                               max(OriginalZeta[arow][acol]+PathIncrement[arow][acol],
+                                   ForwardSpill[brow][bcol]+increment+PathIncrement[arow][acol]));
+          TempEdge.Increment = PathIncrement[brow][bcol]+increment+PathIncrement[arow][acol];
+          TempEdge.NSteps = PathSteps[brow][bcol]+1+PathSteps[arow][acol];
+
+          long key = source*NLabels+target;
+          map<long,FillGraphEdge>::iterator it = LabelEdges.find(key);
+          if (it == LabelEdges.end())
+          {
+            LabelEdges[key] = TempEdge;
+          }
+          else if (fill_graph_edge_elevation(TempEdge,LabelZeta[source]) <
+                   fill_graph_edge_elevation(it->second,LabelZeta[source]))
+          {
+            it->second = TempEdge;
+          }
+        }
+      }
+    }
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// Pass 3 of the tiled fill with an epsilon. The seeds are already in the queue
+// with their elevations in TileZeta; every other node of the tile starts at
+// numeric_limits<float>::max(). Nodes are settled in order of elevation and a
+// node, including a seed, is lowered whenever a path from a settled node raises
+// it less, so every node that is not left at its seed elevation has a strictly
+// lower neighbour. FillIndex is 0 for nodes yet to be settled.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void relax_fill_tile(Array2D<float>& TileZeta, Array2D<float>& OriginalZeta,
+                     Array2D<int>& FillIndex, float cardinal_increment,
+                     float diagonal_increment,
+                     priority_queue< FillNode, vector<FillNode>, FillNodeOrderedGreater >& PriorityQueue)
+{
+  const int row_offset[8] = {-1,-1, 0, 1, 1, 1, 0,-1};
+  const int col_offset[8] = { 0, 1, 1, 1, 0,-1,-1,-1};
+  int TileNRows = TileZeta.dim1();
+  int TileNCols = TileZeta.dim2();
+  FillNode TempFillNode, CentreFillNode;
+  int NQueued = PriorityQueue.size();
+
+  while (!PriorityQueue.empty())
+  {
+    CentreFillNode = PriorityQueue.top();
+    PriorityQueue.pop();
+    int row=CentreFillNode.RowIndex, col=CentreFillNode.ColIndex;
+    if (FillIndex[row][col] != 0 || CentreFillNode.Zeta != TileZeta[row][col])
+    {
+      continue;
+    }
+    FillIndex[row][col] = 1;
+
+    for (int Neighbour = 0; Neighbour<8; ++Neighbour)
+    {
+      // the halo is never filled
+      int nrow = row+row_offset[Neighbour];
+      int ncol = col+col_offset[Neighbour];
+      if (nrow < 1 || nrow >= TileNRows-1 || ncol < 1 || ncol >= TileNCols-1 ||
+          FillIndex[nrow][ncol] != 0)
+      {
+        continue;
+      }
+      float increment = (Neighbour%2 == 0) ? cardinal_increment : diagonal_increment;
+      float reached = CentreFillNode.Zeta + increment;
+      if (reached < OriginalZeta[nrow][ncol])
+      {
+        reached = OriginalZeta[nrow][ncol];
+      }
+      if (reached < TileZeta[nrow][ncol])
+      {
+        TileZeta[nrow][ncol] = reached;
+        TempFillNode.Zeta = reached;
+        TempFillNode.RowIndex = nrow;
+        TempFillNode.ColIndex = ncol;
+        TempFillNode.Order = NQueued++;
+        PriorityQueue.push(TempFillNode);
+      }
+    }
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This loads a tile with a one pixel halo. Pixels outside the DEM are NoData.
+// The tile comes from the raster in memory or, if read_from_file is true, from
+// the file described by RasterInfo. Returns false if the tile cannot be read.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+bool LSDRaster::load_fill_tile(LSDRasterInfo& RasterInfo, bool read_from_file,
+                               string filename, string extension, int row_start,
+                               int col_start, int n_rows, int n_cols,
+                               Array2D<float>& TileZeta)
+{
+  Array2D<float> Tile(n_rows+2,n_cols+2,NoDataValue);
+
+  // the part of the halo tile inside the DEM
+  int first_row = max(row_start-1,0);
+  int first_col = max(col_start-1,0);
+  int last_row = min(row_start+n_rows,NRows-1);
+  int last_col = min(col_start+n_cols,NCols-1);
+
+  if (read_from_file)
+  {
+    Array2D<float> WindowZeta;
+    if (not read_raster_window_data(RasterInfo, filename, extension, first_row, first_col,
+                                    last_row-first_row+1, last_col-first_col+1, WindowZeta))
+    {
+      return false;
+    }
+    for (int row = first_row; row<=last_row; ++row)
+    {
+      for (int col = first_col; col<=last_col; ++col)
+      {
+        Tile[row-row_start+1][col-col_start+1] = WindowZeta[row-first_row][col-first_col];
+      }
+    }
+  }
+  else
+  {
+    for (int row = first_row; row<=last_row; ++row)
+    {
+      for (int col = first_col; col<=last_col; ++col)
+      {
+        Tile[row-row_start+1][col-col_start+1] = RasterData[row][col];
+      }
+    }
+  }
+  TileZeta = Tile;
+  return true;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// The workhorse of the tiled fill. NRows, NCols and NoDataValue must already be
+// set. If out_data_filename is "NULL" FilledZeta is overwritten with the filled
+// DEM, otherwise each filled tile is written into that (existing, float) file.
+// Nothing inside the parallel loops exits: tiles that cannot be read or written
+// are flagged and reported once the loop is finished.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDRaster::priority_flood_tiles(LSDRasterInfo& RasterInfo, bool read_from_file,
+                                     string filename, string extension, float MinSlope,
+                                     int TileSize, string out_data_filename,
+                                     Array2D<float>& FilledZeta)
+{
+  if (TileSize < 2)
+  {
+    TileSize = 2;
+  }
+  int NTileRows = (NRows+TileSize-1)/TileSize;
+  int NTileCols = (NCols+TileSize-1)/TileSize;
+  int NTiles = NTileRows*NTileCols;
+  bool write_to_file = (out_data_filename != "NULL");
+
+  // the increments added to raised nodes, as in fill(MinSlope)
+  float one_over_root2 = 0.707106781;
+  float cardinal_increment = 0;
+  float diagonal_increment = 0;
+  bool use_epsilon = (MinSlope > 0);
+  if (use_epsilon)
+  {
+    cardinal_increment = MinSlope*DataResolution;
+    diagonal_increment = MinSlope*DataResolution*one_over_root2;
+  }
+
+  // the perimeter nodes of each tile, in the order they are scanned, and
+  // the edges of the spill-over graph found in each tile
+  vector< vector<long> > TilePerimeterNodes(NTiles);
+  vector< vector<FillGraphEdge> > TileEdges(NTiles);
+  vector<int> TileOK(NTiles,1);
+
+  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+  // pass 1: fill and label each tile
+  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+  #pragma omp parallel for schedule(dynamic)
+  for (int tile = 0; tile<NTiles; ++tile)
+  {
+    int row_start = (tile/NTileCols)*TileSize;
+    int col_start = (tile%NTileCols)*TileSize;
+    int n_rows = min(TileSize,NRows-row_start);
+    int n_cols = min(TileSize,NCols-col_start);
+
+    Array2D<float> TileZeta;
+    if (not load_fill_tile(RasterInfo, read_from_file, filename, extension,
+                           row_start, col_start, n_rows, n_cols, TileZeta))
+    {
+      TileOK[tile] = 0;
+      continue;
+    }
+    Array2D<int> FillIndex(n_rows+2,n_cols+2,0);
+    Array2D<int> TileLabel(n_rows+2,n_cols+2,0);
+
+    // the path sums are only needed with an epsilon
+    Array2D<float> OriginalZeta;
+    Array2D<double> PathIncrement, ForwardSpill, ReverseSpill;
+    Array2D<int> PathSteps;
+    double no_spill = -numeric_limits<double>::infinity();
+    if (use_epsilon)
+    {
+      OriginalZeta = TileZeta.copy();
+      Array2D<double> ZeroIncrement(n_rows+2,n_cols+2,0.0);
+      Array2D<double> NoForwardSpill(n_rows+2,n_cols+2,no_spill);
+      Array2D<double> NoReverseSpill(n_rows+2,n_cols+2,no_spill);
+      Array2D<int> ZeroSteps(n_rows+2,n_cols+2,0);
+      PathIncrement = ZeroIncrement;
+      ForwardSpill = NoForwardSpill;
+      ReverseSpill = NoReverseSpill;
+      PathSteps = ZeroSteps;
+    }
+
+    priority_queue< FillNode, vector<FillNode>, FillNodeOrderedGreater > PriorityQueue;
+    FillNode TempFillNode;
+    vector<long>& PerimeterNodes = TilePerimeterNodes[tile];
+    vector<FillGraphEdge>& Edges = TileEdges[tile];
+    FillGraphEdge TempEdge;
+
+    // seed the queue with the perimeter and with nodes on the edge of the DEM.
+    // label 0 is the outlet, label k is PerimeterNodes[k-1]
+    for (int i = 1; i<=n_rows; ++i)
+    {
+      for (int j = 1; j<=n_cols; ++j)
+      {
+        if (TileZeta[i][j] == NoDataValue)
+        {
+          FillIndex[i][j] = 2;
+          continue;
+        }
+        int row = row_start+i-1;
+        int col = col_start+j-1;
+        bool is_perimeter = (i==1 || j==1 || i==n_rows || j==n_cols);
+        bool is_boundary = (row==0 || col==0 || row==NRows-1 || col==NCols-1 ||
+          TileZeta[i-1][j-1]==NoDataValue || TileZeta[i-1][j]==NoDataValue ||
+          TileZeta[i-1][j+1]==NoDataValue || TileZeta[i][j-1]==NoDataValue ||
+          TileZeta[i][j+1]==NoDataValue || TileZeta[i+1][j-1]==NoDataValue ||
+          TileZeta[i+1][j]==NoDataValue || TileZeta[i+1][j+1]==NoDataValue);
+        if (!is_perimeter && !is_boundary)
+        {
+          continue;
+        }
+
+        long this_node = long(row)*long(NCols)+long(col);
+        if (is_perimeter)
+        {
+          PerimeterNodes.push_back(this_node);
+          TileLabel[i][j] = PerimeterNodes.size();
+          if (is_boundary)
+          {
+            // the outlet fills an edge node to its own elevation
+            TempEdge.NodeA = -1;
+            TempEdge.NodeB = this_node;
+            TempEdge.Spill = TileZeta[i][j];
+            TempEdge.Increment = 0;
+            TempEdge.NSteps = 0;
+            TempEdge.Directed = use_epsilon;
+            Edges.push_back(TempEdge);
+          }
+
+          // join to the perimeter nodes of the neighbouring tiles. Each pair is
+          // added from the tile holding the lower node index
+          for (int di = -1; di<=1; ++di)
+          {
+            for (int dj = -1; dj<=1; ++dj)
+            {
+              int ni = i+di, nj = j+dj;
+              bool outside_tile = (ni < 1 || nj < 1 || ni > n_rows || nj > n_cols);
+              long other_node = long(row+di)*long(NCols)+long(col+dj);
+              if (outside_tile && TileZeta[ni][nj] != NoDataValue &&
+                  other_node > this_node)
+              {
+                if (use_epsilon)
+                {
+                  // a single step in each direction
+                  TempEdge.Increment = (di == 0 || dj == 0) ? cardinal_increment
+                                                            : diagonal_increment;
+                  TempEdge.NSteps = 1;
+                  TempEdge.Directed = true;
+                  TempEdge.NodeA = this_node;
+                  TempEdge.NodeB = other_node;
+                  TempEdge.Spill = TileZeta[ni][nj];
+                  Edges.push_back(TempEdge);
+                  TempEdge.NodeA = other_node;
+                  TempEdge.NodeB = this_node;
+                  TempEdge.Spill = TileZeta[i][j];
+                  Edges.push_back(TempEdge);
+                }
+                else
+                {
+                  TempEdge.NodeA = this_node;
+                  TempEdge.NodeB = other_node;
+                  TempEdge.Spill = max(TileZeta[i][j],TileZeta[ni][nj]);
+                  TempEdge.Increment = 0;
+                  TempEdge.NSteps = 0;
+                  TempEdge.Directed = false;
+                  Edges.push_back(TempEdge);
+                }
+              }
+            }
+          }
+        }
+        else if (use_epsilon)
+        {
+          // edge nodes inside the tile are filled from their own elevation
+          ForwardSpill[i][j] = TileZeta[i][j];
+        }
+        FillIndex[i][j] = 1;
+        TempFillNode.Zeta = TileZeta[i][j];
+        TempFillNode.RowIndex = i;
+        TempFillNode.ColIndex = j;
+        TempFillNode.Order = PriorityQueue.size();
+        PriorityQueue.push(TempFillNode);
+      }
+    }
+
+    long NLabels = long(PerimeterNodes.size())+1;
+    if (use_epsilon)
+    {
+      vector<long> LabelNodes(NLabels,-1);
+      vector<float> LabelZeta(NLabels,-numeric_limits<float>::max());
+      for (long label = 1; label<NLabels; ++label)
+      {
+        long node = PerimeterNodes[label-1];
+        LabelNodes[label] = node;
+        int tile_row = int(node/NCols)-row_start+1;
+        int tile_col = int(node%NCols)-col_start+1;
+        LabelZeta[label] = TileZeta[tile_row][tile_col];
+      }
+      map<long,FillGraphEdge> LabelEdges;
+      flood_fill_tile_with_paths(TileZeta, OriginalZeta, FillIndex, TileLabel,
+                                 LabelNodes, LabelZeta, cardinal_increment,
+                                 diagonal_increment, PathIncrement, PathSteps,
+                                 ForwardSpill, ReverseSpill, PriorityQueue, LabelEdges);
+      for (map<long,FillGraphEdge>::iterator it = LabelEdges.begin(); it != LabelEdges.end(); ++it)
+      {
+        Edges.push_back(it->second);
+      }
+    }
+    else
+    {
+      map<long,float> LabelSpill;
+      flood_fill_tile(TileZeta, FillIndex, TileLabel, NLabels, PriorityQueue, LabelSpill);
+      for (map<long,float>::iterator it = LabelSpill.begin(); it != LabelSpill.end(); ++it)
+      {
+        long LabelA = it->first/NLabels;
+        long LabelB = it->first%NLabels;
+        TempEdge.NodeA = (LabelA == 0) ? -1 : PerimeterNodes[LabelA-1];
+        TempEdge.NodeB = (LabelB == 0) ? -1 : PerimeterNodes[LabelB-1];
+        TempEdge.Spill = it->second;
+        TempEdge.Increment = 0;
+        TempEdge.NSteps = 0;
+        TempEdge.Directed = false;
+        Edges.push_back(TempEdge);
+      }
+    }
+  }
+  for (int tile = 0; tile<NTiles; ++tile)
+  {
+    if (TileOK[tile] == 0)
+    {
+      cout << "\nFATAL ERROR: could not read tile " << tile << " of "
+           << filename << "." << extension << endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+  // solve the spill-over graph
+  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+  // the perimeter nodes of each tile are scanned in order of node index, so a
+  // node is found in the graph from the tile it lies in
+  vector<int> TileFirstIndex(NTiles+1,0);
+  for (int tile = 0; tile<NTiles; ++tile)
+  {
+    TileFirstIndex[tile+1] = TileFirstIndex[tile]+TilePerimeterNodes[tile].size();
+  }
+  int NGraphNodes = TileFirstIndex[NTiles];
+  int Outlet = NGraphNodes;
+
+  vector< vector<FillGraphEdge> > GraphNeighbours(NGraphNodes+1);
+  for (int tile = 0; tile<NTiles; ++tile)
+  {
+    for (int e = 0; e< int(TileEdges[tile].size()); ++e)
+    {
+      FillGraphEdge edge = TileEdges[tile][e];
+      int ends[2];
+      for (int end = 0; end<2; ++end)
+      {
+        long node = (end == 0) ? edge.NodeA : edge.NodeB;
+        if (node == -1)
+        {
+          ends[end] = Outlet;
+        }
+        else
+        {
+          int node_tile = int(node/NCols)/TileSize*NTileCols + int(node%NCols)/TileSize;
+          vector<long>& Nodes = TilePerimeterNodes[node_tile];
+          ends[end] = TileFirstIndex[node_tile]
+                      + int(lower_bound(Nodes.begin(),Nodes.end(),node)-Nodes.begin());
+        }
+      }
+      edge.NodeA = ends[0];
+      edge.NodeB = ends[1];
+      GraphNeighbours[ends[0]].push_back(edge);
+      if (!edge.Directed)
+      {
+        edge.NodeA = ends[1];
+        edge.NodeB = ends[0];
+        GraphNeighbours[ends[1]].push_back(edge);
+      }
+    }
+    vector<FillGraphEdge>().swap(TileEdges[tile]);
+  }
+
+  // a priority flood over the graph: the spill elevation of a node is the
+  // lowest, over all paths to the outlet, elevation the path fills it to
+  float not_reached = numeric_limits<float>::max();
+  vector<float> SpillElevation(NGraphNodes+1,not_reached);
+  vector<bool> Settled(NGraphNodes+1,false);
+  priority_queue< pair<float,int>, vector< pair<float,int> >,
+                  greater< pair<float,int> > > GraphQueue;
+  SpillElevation[Outlet] = -not_reached;
+  GraphQueue.push(make_pair(SpillElevation[Outlet],Outlet));
+  while (!GraphQueue.empty())
+  {
+    int node = GraphQueue.top().second;
+    GraphQueue.pop();
+    if (Settled[node])
+    {
+      continue;
+    }
+    Settled[node] = true;
+    for (int n = 0; n< int(GraphNeighbours[node].size()); ++n)
+    {
+      int other = GraphNeighbours[node][n].NodeB;
+      float spill = fill_graph_edge_elevation(GraphNeighbours[node][n],SpillElevation[node]);
+      if (!Settled[other] && spill < SpillElevation[other])
+      {
+        SpillElevation[other] = spill;
+        GraphQueue.push(make_pair(spill,other));
+      }
+    }
+  }
+  vector< vector<FillGraphEdge> >().swap(GraphNeighbours);
+
+  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+  // pass 2: fill each tile from its perimeter
+  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+  Array2D<float> Filled;
+  if (!write_to_file)
+  {
+    Array2D<float> FilledArray(NRows,NCols,NoDataValue);
+    Filled = FilledArray;
+  }
+  #pragma omp parallel for schedule(dynamic)
+  for (int tile = 0; tile<NTiles; ++tile)
+  {
+    int row_start = (tile/NTileCols)*TileSize;
+    int col_start = (tile%NTileCols)*TileSize;
+    int n_rows = min(TileSize,NRows-row_start);
+    int n_cols = min(TileSize,NCols-col_start);
+
+    Array2D<float> TileZeta;
+    if (not load_fill_tile(RasterInfo, read_from_file, filename, extension,
+                           row_start, col_start, n_rows, n_cols, TileZeta))
+    {
+      TileOK[tile] = 0;
+      continue;
+    }
+    Array2D<float> OriginalZeta;
+    if (use_epsilon)
+    {
+      OriginalZeta = TileZeta.copy();
+    }
+    Array2D<int> FillIndex(n_rows+2,n_cols+2,0);
+    Array2D<int> NoLabels;
+    map<long,float> NoLabelSpill;
+    priority_queue< FillNode, vector<FillNode>, FillNodeOrderedGreater > PriorityQueue;
+    FillNode TempFillNode;
+    int perimeter_node = TileFirstIndex[tile];
+
+    for (int i = 1; i<=n_rows; ++i)
+    {
+      for (int j = 1; j<=n_cols; ++j)
+      {
+        if (TileZeta[i][j] == NoDataValue)
+        {
+          FillIndex[i][j] = 2;
+          continue;
+        }
+        int row = row_start+i-1;
+        int col = col_start+j-1;
+        bool is_perimeter = (i==1 || j==1 || i==n_rows || j==n_cols);
+        bool is_boundary = (row==0 || col==0 || row==NRows-1 || col==NCols-1 ||
+          TileZeta[i-1][j-1]==NoDataValue || TileZeta[i-1][j]==NoDataValue ||
+          TileZeta[i-1][j+1]==NoDataValue || TileZeta[i][j-1]==NoDataValue ||
+          TileZeta[i][j+1]==NoDataValue || TileZeta[i+1][j-1]==NoDataValue ||
+          TileZeta[i+1][j]==NoDataValue || TileZeta[i+1][j+1]==NoDataValue);
+        if (is_perimeter)
+        {
+          // perimeter nodes are scanned in the same order as in pass 1
+          TileZeta[i][j] = max(TileZeta[i][j],SpillElevation[perimeter_node]);
+          perimeter_node++;
+        }
+        else if (!is_boundary)
+        {
+          if (use_epsilon)
+          {
+            TileZeta[i][j] = not_reached;
+          }
+          continue;
+        }
+        if (!use_epsilon)
+        {
+          FillIndex[i][j] = 1;
+        }
+        TempFillNode.Zeta = TileZeta[i][j];
+        TempFillNode.RowIndex = i;
+        TempFillNode.ColIndex = j;
+        TempFillNode.Order = PriorityQueue.size();
+        PriorityQueue.push(TempFillNode);
+      }
+    }
+
+    if (use_epsilon)
+    {
+      relax_fill_tile(TileZeta, OriginalZeta, FillIndex, cardinal_increment,
+                      diagonal_increment, PriorityQueue);
+    }
+    else
+    {
+      flood_fill_tile(TileZeta, FillIndex, NoLabels, 0, PriorityQueue, NoLabelSpill);
+    }
+
+    if (write_to_file)
+    {
+      Array2D<float> TileFilled(n_rows,n_cols);
+      for (int i = 1; i<=n_rows; ++i)
+      {
+        for (int j = 1; j<=n_cols; ++j)
+        {
+          TileFilled[i-1][j-1] = TileZeta[i][j];
+        }
+      }
+      if (not write_ENVI_binary_window(out_data_filename, NCols, row_start, col_start,
+                                       n_rows, n_cols, &TileFilled[0][0]))
+      {
+        TileOK[tile] = 0;
+      }
+    }
+    else
+    {
+      for (int i = 1; i<=n_rows; ++i)
+      {
+        for (int j = 1; j<=n_cols; ++j)
+        {
+          Filled[row_start+i-1][col_start+j-1] = TileZeta[i][j];
+        }
+      }
+    }
+  }
+  for (int tile = 0; tile<NTiles; ++tile)
+  {
+    if (TileOK[tile] == 0)
+    {
+      cout << "\nFATAL ERROR: could not fill tile " << tile << " of "
+           << filename << "." << extension << endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  FilledZeta = Filled;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// Tiled, parallel fill of a DEM held in memory. See priority_flood_tiles.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+LSDRaster LSDRaster::fill_tiled(float& MinSlope, int TileSize)
+{
+  LSDRasterInfo RasterInfo;
+  Array2D<float> FilledZeta;
+  priority_flood_tiles(RasterInfo, false, "NULL", "NULL", MinSlope, TileSize, "NULL",
+                       FilledZeta);
+
+  LSDRaster FilledDEM(NRows,NCols,XMinimum,YMinimum,DataResolution,
+                      NoDataValue,FilledZeta,GeoReferencingStrings);
+  return FilledDEM;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// Tiled, parallel fill of a DEM read from disk one tile at a time, so the
+// unfilled DEM is never held in memory. The filled DEM is loaded into this
+// raster. See fill_tiled.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDRaster::read_raster_and_fill_tiled(string filename, string extension,
+                                           float& MinSlope, int TileSize)
+{
+  LSDRasterInfo RasterInfo(filename, extension);
+  NRows = RasterInfo.get_NRows();
+  NCols = RasterInfo.get_NCols();
+  XMinimum = RasterInfo.get_XMinimum();
+  YMinimum = RasterInfo.get_YMinimum();
+  DataResolution = RasterInfo.get_DataResolution();
+  NoDataValue = RasterInfo.get_NoDataValue();
+  GeoReferencingStrings = RasterInfo.get_GeoReferencingStrings();
+
+  Array2D<float> FilledZeta;
+  priority_flood_tiles(RasterInfo, true, filename, extension, MinSlope, TileSize, "NULL",
+                       FilledZeta);
+  RasterData = FilledZeta;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// Tiled, parallel fill from disk to disk: tiles are read from the DEM, and the
+// filled tiles are written straight into out_filename, so neither the DEM nor
+// the filled DEM is ever held in memory. Only the georeferencing of the DEM is
+// loaded into this raster.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDRaster::read_raster_fill_tiled_and_write(string filename, string extension,
+                                                 string out_filename, string out_extension,
+                                                 float& MinSlope, int TileSize)
+{
+  if (out_extension != "flt" && out_extension != "bil")
+  {
+    cout << "\nFATAL ERROR: the tiled fill can only write flt or bil files, "
+         << "you entered: " << out_extension << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  LSDRasterInfo RasterInfo(filename, extension);
+  NRows = RasterInfo.get_NRows();
+  NCols = RasterInfo.get_NCols();
+  XMinimum = RasterInfo.get_XMinimum();
+  YMinimum = RasterInfo.get_YMinimum();
+  DataResolution = RasterInfo.get_DataResolution();
+  NoDataValue = RasterInfo.get_NoDataValue();
+  GeoReferencingStrings = RasterInfo.get_GeoReferencingStrings();
+
+  // write the header and size the data file, which the tiles are written into
+  string out_data_filename = out_filename+"."+out_extension;
+  write_raster_header(out_filename, out_extension);
+  ofstream data_ofs(out_data_filename.c_str(), ios::out | ios::binary);
+  if( data_ofs.fail() )
+  {
+    cout << "\nFATAL ERROR: unable to write to " << out_data_filename << endl;
+    exit(EXIT_FAILURE);
+  }
+  long NBytes = long(NRows)*long(NCols)*long(sizeof(float));
+  if (NBytes > 0)
+  {
+    char zero = 0;
+    data_ofs.seekp(NBytes-1, ios::beg);
+    data_ofs.write(&zero,1);
+  }
+  data_ofs.close();
+
+  Array2D<float> NoFilledZeta;
+  priority_flood_tiles(RasterInfo, true, filename, extension, MinSlope, TileSize,
+                       out_data_filename, NoFilledZeta);
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
 
 
 
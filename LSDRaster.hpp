@@ -110,6 +110,8 @@ Tools are included to:
 using namespace std;
 using namespace TNT;
 
+class LSDRasterInfo;
+
 ///@brief Main analysis object to interface with other LSD objects.
 class LSDRaster
 {
@@ -130,6 +132,31 @@ class LSDRaster
   /// @param extension A String, the file extension to be loaded.
   LSDRaster(string filename, string extension)  { create(filename, extension); }
 
+  /// @brief Create an LSDRaster from a window of a file, reading only the
+  /// rows and columns of the window from disk.
+  /// @param filename A String, the file to be loaded.
+  /// @param extension A String, the file extension to be loaded.
+  /// @param row_start The first row of the window, counted from the top.
+  /// @param col_start The first column of the window.
+  /// @param n_rows The number of rows in the window.
+  /// @param n_cols The number of columns in the window.
+  LSDRaster(string filename, string extension, int row_start, int col_start,
+            int n_rows, int n_cols)
+      { create(filename, extension, row_start, col_start, n_rows, n_cols); }
+
+  /// @brief Create an LSDRaster from the part of a file that lies within a
+  /// bounding box, plus a halo of pixels, reading only that region from disk.
+  /// @param filename A String, the file to be loaded.
+  /// @param extension A String, the file extension to be loaded.
+  /// @param XMin The minimum x coordinate of the box.
+  /// @param YMin The minimum y coordinate of the box.
+  /// @param XMax The maximum x coordinate of the box.
+  /// @param YMax The maximum y coordinate of the box.
+  /// @param halo_pixels The number of pixels added around the box.
+  LSDRaster(string filename, string extension, float XMin, float YMin,
+            float XMax, float YMax, int halo_pixels)
+      { create(filename, extension, XMin, YMin, XMax, YMax, halo_pixels); }
+
   /// @brief Create an LSDRaster from memory.
   /// @return LSDRaster
   /// @param nrows An integer of the number of rows.
@@ -237,6 +264,34 @@ class LSDRaster
   /// @date 01/01/12
   void read_raster(string filename, string extension);
 
+  /// @brief Read a window of a raster into memory from a file.
+  ///
+  /// The header is parsed with LSDRasterInfo and, for .flt and .bil files,
+  /// only the rows and columns of the window are read from disk, so
+  /// memory and I/O scale with the window rather than the full raster.
+  /// The georeferencing is updated to the window. The window is clipped
+  /// to the extent of the raster.
+  /// @param filename a string of the filename _without_ the extension.
+  /// @param extension a string of the extension _without_ the leading dot
+  /// @param row_start The first row of the window, counted from the top.
+  /// @param col_start The first column of the window.
+  /// @param n_rows The number of rows in the window.
+  /// @param n_cols The number of columns in the window.
+  void read_raster_window(string filename, string extension, int row_start,
+                          int col_start, int n_rows, int n_cols);
+
+  /// @brief Read the part of a raster that lies within a bounding box
+  /// into memory from a file. See read_raster_window.
+  /// @param filename a string of the filename _without_ the extension.
+  /// @param extension a string of the extension _without_ the leading dot
+  /// @param XMin The minimum x coordinate of the box.
+  /// @param YMin The minimum y coordinate of the box.
+  /// @param XMax The maximum x coordinate of the box.
+  /// @param YMax The maximum y coordinate of the box.
+  /// @param halo_pixels The number of pixels added on each side of the box.
+  void read_raster_bounding_box(string filename, string extension, float XMin,
+                                float YMin, float XMax, float YMax, int halo_pixels);
+
   /// @brief Reads a raster from an ascii file for use in LSDCatchmentModel
   /// @bug You can't return a TNT::Array properly in a function. See google for details.
   /// @author DAV
@@ -1374,6 +1429,64 @@ class LSDRaster
   /// @date 12/3/13
   LSDRaster fill(float& MinSlope);
 
+  /// @brief Fills pits/sinks using the improved priority flood of
+  /// Barnes et al. (2014), Computers & Geosciences 62, 117-127.
+  ///
+  /// @details Only the unraised frontier goes through the priority queue;
+  /// nodes raised inside depressions go through a plain FIFO queue, so
+  /// depressions are filled in linear time. The result is bit-identical to
+  /// fill(MinSlope). With a nonzero MinSlope the increment a node is raised by
+  /// depends on the order tied nodes leave the priority queue, so the FIFO
+  /// queue is only used when MinSlope is zero; otherwise this calls
+  /// fill(MinSlope).
+  /// @param MinSlope The minimum slope between two Nodes once filled. If set
+  /// to zero will create flats.
+  /// @param ImprovedPriorityFlood If true use the FIFO queue, if false this
+  /// is the same as fill(MinSlope).
+  /// @return Filled LSDRaster object.
+  LSDRaster fill(float& MinSlope, bool ImprovedPriorityFlood);
+
+  /// @brief Fills pits/sinks tile by tile on all cores, using the parallel
+  /// priority flood of Barnes (2016), Computers & Geosciences 96, 56-68.
+  ///
+  /// @details Each tile is filled on its own while recording where its
+  /// watersheds spill into each other and into neighbouring tiles. The small
+  /// graph of spills between tile perimeters is then solved and every tile is
+  /// filled again from its corrected perimeter. Without an epsilon the result
+  /// is identical to fill(MinSlope). If MinSlope is greater than zero the
+  /// gradient is carried through the spill graph as well, so every filled
+  /// node drains, but the result can differ from fill(MinSlope) by epsilon
+  /// sized increments.
+  /// @param MinSlope The minimum slope between two Nodes once filled. If set
+  /// to zero will create flats.
+  /// @param TileSize The number of rows and columns in each tile.
+  /// @return Filled LSDRaster object.
+  LSDRaster fill_tiled(float& MinSlope, int TileSize);
+
+  /// @brief Reads a DEM from disk one tile at a time and fills it with the
+  /// tiled priority flood (see fill_tiled). The unfilled DEM is never held in
+  /// memory; the filled DEM is loaded into this raster.
+  /// @param filename a string of the filename _without_ the extension.
+  /// @param extension a string of the extension _without_ the leading dot
+  /// @param MinSlope The minimum slope between two Nodes once filled.
+  /// @param TileSize The number of rows and columns in each tile.
+  void read_raster_and_fill_tiled(string filename, string extension,
+                                  float& MinSlope, int TileSize);
+
+  /// @brief Fills a DEM from disk to disk with the tiled priority flood (see
+  /// fill_tiled). Tiles are read from the DEM and written to the output as they
+  /// are filled, so neither the DEM nor the filled DEM is held in memory. Only
+  /// the georeferencing of the DEM is loaded into this raster.
+  /// @param filename a string of the filename _without_ the extension.
+  /// @param extension a string of the extension _without_ the leading dot
+  /// @param out_filename the filled DEM, _without_ the extension.
+  /// @param out_extension the extension of the filled DEM: flt or bil.
+  /// @param MinSlope The minimum slope between two Nodes once filled.
+  /// @param TileSize The number of rows and columns in each tile.
+  void read_raster_fill_tiled_and_write(string filename, string extension,
+                                        string out_filename, string out_extension,
+                                        float& MinSlope, int TileSize);
+
   // multidirection flow routing
   /// @brief Generate a flow area raster using a multi direction algorithm.
   ///
@@ -2313,6 +2426,39 @@ protected:
   private:
   void create();
   void create(string filename, string extension);
+  void create(string filename, string extension, int row_start, int col_start,
+              int n_rows, int n_cols);
+  void create(string filename, string extension, float XMin, float YMin,
+              float XMax, float YMax, int halo_pixels);
+
+  /// @brief Reads a window of the file described by RasterInfo
+  void read_raster_window(LSDRasterInfo& RasterInfo, string filename, string extension,
+                          int row_start, int col_start, int n_rows, int n_cols);
+
+  /// @brief Reads the data in a window of the file described by RasterInfo.
+  /// Returns false rather than exiting if the data cannot be read.
+  bool read_raster_window_data(LSDRasterInfo& RasterInfo, string filename,
+                               string extension, int row_start, int col_start,
+                               int n_rows, int n_cols, Array2D<float>& data);
+
+  /// @brief Writes the header of a flt or bil raster.
+  void write_raster_header(string filename, string extension);
+
+  /// @brief Loads a tile of the DEM with a one pixel halo for the tiled fill,
+  /// either from RasterData or, if read_from_file is true, from disk.
+  /// Returns false if the tile cannot be read.
+  bool load_fill_tile(LSDRasterInfo& RasterInfo, bool read_from_file,
+                      string filename, string extension, int row_start,
+                      int col_start, int n_rows, int n_cols, Array2D<float>& TileZeta);
+
+  /// @brief The tiled priority flood used by fill_tiled,
+  /// read_raster_and_fill_tiled and read_raster_fill_tiled_and_write.
+  /// FilledZeta is replaced by the filled DEM, unless out_data_filename is
+  /// not "NULL", in which case the tiles are written into that file.
+  void priority_flood_tiles(LSDRasterInfo& RasterInfo, bool read_from_file,
+                            string filename, string extension, float MinSlope,
+                            int TileSize, string out_data_filename,
+                            Array2D<float>& FilledZeta);
   void create(int ncols, int nrows, float xmin, float ymin,
               float cellsize, float ndv, Array2D<float> data);
   void create(int ncols, int nrows, double xmin, double ymin,
@@ -54,9 +54,12 @@
 #include <fstream>
 #include <string>
 #include <map>
+#include <algorithm>
+#include <math.h>
 #include "LSDRaster.hpp"
 #include "LSDIndexRaster.hpp"
 #include "LSDRasterInfo.hpp"
+#include "LSDStatsTools.hpp"
 using namespace std;
 
 
@@ -66,7 +69,11 @@ using namespace std;
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 void LSDRasterInfo::create()
-{}
+{
+  DataType = 4;
+  ByteOrder = get_host_byte_order();
+  HeaderOffset = 0;
+}
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 //
@@ -94,6 +101,9 @@ void LSDRasterInfo::create(LSDRaster& Raster)
   DataResolution = Raster.get_DataResolution();
   NoDataValue = Raster.get_NoDataValue();
   GeoReferencingStrings = Raster.get_GeoReferencingStrings();
+  DataType = 4;
+  ByteOrder = get_host_byte_order();
+  HeaderOffset = 0;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -112,6 +122,9 @@ void LSDRasterInfo::create(LSDIndexRaster& IRaster)
   DataResolution = IRaster.get_DataResolution();
   NoDataValue = IRaster.get_NoDataValue();
   GeoReferencingStrings = IRaster.get_GeoReferencingStrings();
+  DataType = 4;
+  ByteOrder = get_host_byte_order();
+  HeaderOffset = 0;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -209,6 +222,11 @@ void LSDRasterInfo::read_header(string filename, string extension)
   string_filename = filename+dot+extension;
   //cout << "\n\nLoading LSDRasterInfo, the filename is " << string_filename << endl;
 
+  // defaults for the binary layout, updated below if the header says otherwise
+  DataType = 4;
+  ByteOrder = get_host_byte_order();
+  HeaderOffset = 0;
+
   if (extension == "asc")
   {
     // open the data file
@@ -263,6 +281,20 @@ void LSDRasterInfo::read_header(string filename, string extension)
       ifs >> str >> XMinimum >> str >> YMinimum
           >> str >> DataResolution
           >> str >> NoDataValue;
+
+      // the optional byteorder line
+      while (ifs >> str)
+      {
+        transform(str.begin(), str.end(), str.begin(), ::toupper);
+        if (str == "MSBFIRST")
+        {
+          ByteOrder = 1;
+        }
+        else if (str == "LSBFIRST")
+        {
+          ByteOrder = 0;
+        }
+      }
     }
     ifs.close();
 
@@ -280,7 +312,6 @@ void LSDRasterInfo::read_header(string filename, string extension)
     string header_extension = "hdr";
     header_filename = filename+dot+header_extension;
     int NoDataExists = 0;
-    int DataType = 4;     // default is float data
 
     ifstream ifs(header_filename.c_str());
     if( ifs.fail() )
@@ -413,6 +444,50 @@ void LSDRasterInfo::read_header(string filename, string extension)
           }
         }  
         
+        // get byte order
+        counter = 0;
+        str_find = "byte order";
+        while (counter < NLines)
+        {
+          found = lines[counter].find(str_find);
+          if (found!=string::npos)
+          {
+            // get the data using a stringstream
+            istringstream iss(lines[counter]);
+            iss >> str >> str >> str >> str;
+            ByteOrder = atoi(str.c_str());
+
+            // advance to the end so you move on to the new loop
+            counter = lines.size();
+          }
+          else
+          {
+            counter++;
+          }
+        }
+
+        // get header offset
+        counter = 0;
+        str_find = "header offset";
+        while (counter < NLines)
+        {
+          found = lines[counter].find(str_find);
+          if (found!=string::npos)
+          {
+            // get the data using a stringstream
+            istringstream iss(lines[counter]);
+            iss >> str >> str >> str >> str;
+            HeaderOffset = atol(str.c_str());
+
+            // advance to the end so you move on to the new loop
+            counter = lines.size();
+          }
+          else
+          {
+            counter++;
+          }
+        }
+
         // get the map info
         counter = 0;
         string this_map_info = "empty";
@@ -627,4 +702,53 @@ bool LSDRasterInfo::check_if_point_is_in_raster(float X_coordinate,float Y_coord
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+//
+// This converts a bounding box in map coordinates into a window of rows and
+// columns. The window is expanded by halo_pixels on every side and then
+// clipped to the extent of the raster. Rows are counted from the top of the
+// raster, as in the data files. Returns false if the box misses the raster.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+bool LSDRasterInfo::get_window_of_bounding_box(float XMin, float YMin, float XMax, float YMax,
+                                 int halo_pixels, int& row_start, int& col_start,
+                                 int& n_rows, int& n_cols)
+{
+  float YMaximum = YMinimum + NRows*DataResolution;
+
+  int col_end, row_end;
+  col_start = int(floor((XMin-XMinimum)/DataResolution)) - halo_pixels;
+  col_end = int(ceil((XMax-XMinimum)/DataResolution)) - 1 + halo_pixels;
+  row_start = int(floor((YMaximum-YMax)/DataResolution)) - halo_pixels;
+  row_end = int(ceil((YMaximum-YMin)/DataResolution)) - 1 + halo_pixels;
+
+  if (col_start < 0)
+  {
+    col_start = 0;
+  }
+  if (row_start < 0)
+  {
+    row_start = 0;
+  }
+  if (col_end > NCols-1)
+  {
+    col_end = NCols-1;
+  }
+  if (row_end > NRows-1)
+  {
+    row_end = NRows-1;
+  }
+
+  n_rows = row_end-row_start+1;
+  n_cols = col_end-col_start+1;
+  if (n_rows <= 0 || n_cols <= 0)
+  {
+    n_rows = 0;
+    n_cols = 0;
+    return false;
+  }
+  return true;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
 #endif
@@ -116,10 +116,32 @@ class LSDRasterInfo
     float get_YMinimum() const        { return YMinimum; }
     /// @return Data resolution as an integer.
     float get_DataResolution() const        { return DataResolution; }
-    /// @return No Data Value as an integer.
-    int get_NoDataValue() const        { return NoDataValue; }
+    /// @return No Data Value as a float.
+    float get_NoDataValue() const        { return NoDataValue; }
     /// @return map containing the georeferencing strings
     map<string,string> get_GeoReferencingStrings() const { return GeoReferencingStrings; }
+    /// @return The ENVI data type code of the data file (4 is float)
+    int get_DataType() const        { return DataType; }
+    /// @return The ENVI byte order of the data file (0 little endian, 1 big endian)
+    int get_ByteOrder() const        { return ByteOrder; }
+    /// @return The number of bytes before the data starts in the data file
+    long get_HeaderOffset() const        { return HeaderOffset; }
+
+    /// @brief Converts a bounding box in map coordinates to a window of rows
+    /// and columns of this raster. Rows are counted from the top of the raster.
+    /// @param XMin the minimum x coordinate of the box
+    /// @param YMin the minimum y coordinate of the box
+    /// @param XMax the maximum x coordinate of the box
+    /// @param YMax the maximum y coordinate of the box
+    /// @param halo_pixels the number of pixels to pad the box by on each side
+    /// @param row_start the first row of the window. Replaced in function.
+    /// @param col_start the first column of the window. Replaced in function.
+    /// @param n_rows the number of rows in the window. Replaced in function.
+    /// @param n_cols the number of columns in the window. Replaced in function.
+    /// @return false if the box does not overlap the raster
+    bool get_window_of_bounding_box(float XMin, float YMin, float XMax, float YMax,
+                                    int halo_pixels, int& row_start, int& col_start,
+                                    int& n_rows, int& n_cols);
 
   protected:
 
@@ -149,12 +171,19 @@ class LSDRasterInfo
     float YMinimum;
     ///Data resolution.
     float DataResolution;
-    ///No data value.
-    int NoDataValue;
+    ///No data value. Parsed the same way as in LSDRaster::read_raster.
+    float NoDataValue;
 
     ///A map of strings for holding georeferencing information
     map<string,string> GeoReferencingStrings;
 
+    ///The ENVI data type of the data file
+    int DataType;
+    ///The ENVI byte order of the data file
+    int ByteOrder;
+    ///Bytes to skip at the start of the data file
+    long HeaderOffset;
+
 
   private:
     void create();
@@ -96,6 +96,7 @@
 #include "LSDRasterSpectral.hpp"
 #include "LSDStatsTools.hpp"
 #include "LSDIndexRaster.hpp"
+#include "LSDRasterInfo.hpp"
 #include "fftw-3.3.4/api/fftw3.h"
 using namespace std;
 using namespace TNT;
@@ -123,7 +124,7 @@ LSDRasterSpectral& LSDRasterSpectral::operator=(const LSDRasterSpectral& rhs)
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void LSDRasterSpectral::create()
 {
-  cout << "LSDRasterSpectral line 63 You need to initialize with a filename!" << endl;
+  //cout << "LSDRasterSpectral line 63 You need to initialize with a filename!" << endl;
   //exit(EXIT_FAILURE);
 }
 
@@ -144,12 +145,12 @@ void LSDRasterSpectral::create(int raster_order, float cellsize, float ndv)
   YMinimum = 0.0;
   DataResolution = cellsize;
   NoDataValue = ndv;
-  Ly = int(pow(2,ceil(log(NRows)/log(2))));
-  Lx = int(pow(2,ceil(log(NCols)/log(2))));
+  Ly = get_fft_padded_size(NRows);
+  Lx = get_fft_padded_size(NCols);
   dfx = 1/(DataResolution*float(Lx));
   dfy = 1/(DataResolution*float(Ly));
   NyquistFreq = 1/(2*DataResolution);
-  WSS=float(NRows*NCols);
+  WSS=float(NRows)*float(NCols);
   cout << "Created square raster with NRows = " << NRows << " and Ly: " << Ly << endl;
   cout << "NCols: " << NCols << " and Lx: " << Lx << endl;
 
@@ -164,12 +165,12 @@ void LSDRasterSpectral::create(int raster_order, float cellsize, float ndv)
 void LSDRasterSpectral::create(string filename, string extension)
 {
   read_raster(filename,extension);
-  Ly = int(pow(2,ceil(log(NRows)/log(2))));
-  Lx = int(pow(2,ceil(log(NCols)/log(2)))); 
+  Ly = get_fft_padded_size(NRows);
+  Lx = get_fft_padded_size(NCols);
   dfx = 1/(DataResolution*float(Lx));
   dfy = 1/(DataResolution*float(Ly));      
   NyquistFreq = 1/(2*DataResolution);
-  WSS=float(NRows*NCols);
+  WSS=float(NRows)*float(NCols);
 }
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -184,12 +185,12 @@ void LSDRasterSpectral::create(int nrows, int ncols, float xmin, float ymin,
   YMinimum = ymin;
   DataResolution = cellsize;
   NoDataValue = ndv;
-  Ly = int(pow(2,ceil(log(NRows)/log(2))));
-  Lx = int(pow(2,ceil(log(NCols)/log(2)))); 
+  Ly = get_fft_padded_size(NRows);
+  Lx = get_fft_padded_size(NCols);
   dfx = 1/(DataResolution*float(Lx));
   dfy = 1/(DataResolution*float(Ly));   
   NyquistFreq = 1/(2*DataResolution);
-  WSS=float(NRows*NCols);
+  WSS=float(NRows)*float(NCols);
   RasterData = data.copy();
 
   if (RasterData.dim1() != NRows)
@@ -219,12 +220,12 @@ void LSDRasterSpectral::create(int nrows, int ncols, float xmin, float ymin,
   DataResolution = cellsize;
   NoDataValue = ndv;
   GeoReferencingStrings = temp_GRS;
-  Ly = int(pow(2,ceil(log(NRows)/log(2))));
-  Lx = int(pow(2,ceil(log(NCols)/log(2)))); 
+  Ly = get_fft_padded_size(NRows);
+  Lx = get_fft_padded_size(NCols);
   dfx = 1/(DataResolution*float(Lx));
   dfy = 1/(DataResolution*float(Ly));   
   NyquistFreq = 1/(2*DataResolution);
-  WSS=float(NRows*NCols);
+  WSS=float(NRows)*float(NCols);
   RasterData = data.copy();
 
   if (RasterData.dim1() != NRows)
@@ -254,12 +255,12 @@ void LSDRasterSpectral::create(LSDRaster& An_LSDRaster)
   DataResolution = An_LSDRaster.get_DataResolution();
   NoDataValue = An_LSDRaster.get_NoDataValue();
   GeoReferencingStrings = An_LSDRaster.get_GeoReferencingStrings();
-  Ly = int(pow(2,ceil(log(NRows)/log(2))));
-  Lx = int(pow(2,ceil(log(NCols)/log(2)))); 
+  Ly = get_fft_padded_size(NRows);
+  Lx = get_fft_padded_size(NCols);
   dfx = 1/(DataResolution*float(Lx));
   dfy = 1/(DataResolution*float(Ly));      
   NyquistFreq = 1/(2*DataResolution);
-  WSS=float(NRows*NCols);
+  WSS=float(NRows)*float(NCols);
   RasterData = An_LSDRaster.get_RasterData();
   
   cout << "Loaded a spectralreaster from another raster. Here are the vitalstatistix." << endl;
@@ -288,6 +289,35 @@ void LSDRasterSpectral::create(LSDRaster& An_LSDRaster)
 // but are useful in Fourier analysis so are located here as member functions
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This function returns the smallest integer >= N whose only prime factors are
+// 2, 3, 5 and 7. FFTW is fast for these sizes, so padding to them rather than
+// to the next power of two keeps the transforms quick while wasting far less
+// memory on zeros (a 1025 cell grid pads to 1029 rather than 2048)
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+int LSDRasterSpectral::get_fft_padded_size(int N)
+{
+  if (N <= 1)
+  {
+    return 1;
+  }
+
+  int padded_size = N;
+  while (true)
+  {
+    int remainder = padded_size;
+    while (remainder%2 == 0) { remainder /= 2; }
+    while (remainder%3 == 0) { remainder /= 3; }
+    while (remainder%5 == 0) { remainder /= 5; }
+    while (remainder%7 == 0) { remainder /= 7; }
+    if (remainder == 1)
+    {
+      return padded_size;
+    }
+    padded_size++;
+  }
+}
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 // This function returns the frequencies in the direction of the rows
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
@@ -299,14 +329,14 @@ vector<float> LSDRasterSpectral::get_row_direction_frequencies_unshifted()
   int lastrow = 0;
   for(int row = 0; row<=(NRows-1)/2; row++)
   {
-    freq_values[row] = float(row)*DataResolution/(float(NRows));
+    freq_values[row] = float(row)/(DataResolution*float(NRows));
     //cout << "Row: " << row << endl;
     lastrow = row;
   }
   for(int row = (NRows)/2; row > 0; row--)
   {
     lastrow++;
-    freq_values[lastrow] = -float(row)*DataResolution/(float(NRows));
+    freq_values[lastrow] = -float(row)/(DataResolution*float(NRows));
     //cout << "Row is: " << lastrow << "and selection is: " << -row << endl;
   }
 
@@ -324,14 +354,14 @@ vector<float> LSDRasterSpectral::get_col_direction_frequencies_unshifted()
   int lastcol = 0;
   for(int col = 0; col<=(NCols-1)/2; col++)
   {
-    freq_values[col] = float(col)*DataResolution/(float(NCols));
+    freq_values[col] = float(col)/(DataResolution*float(NCols));
     //cout << "Col: " << col << endl;
     lastcol = col;
   }
   for(int col = (NCols)/2; col > 0; col--)
   {
     lastcol++;
-    freq_values[lastcol] = -float(col)*DataResolution/(float(NCols));
+    freq_values[lastcol] = -float(col)/(DataResolution*float(NCols));
     //cout << "Col is: " << lastcol << "and selection is: " << -col << endl;
   }
 
@@ -447,6 +477,154 @@ void LSDRasterSpectral::generate_fractal_surface_spectral_method(float beta)
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// FFTW PLAN CACHE
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Planning with FFTW_MEASURE times several candidate algorithms, which can
+// take longer than the transform itself.  Plans are therefore made once per
+// shape and direction and shared by all LSDRasterSpectral objects for the
+// rest of the run.  They are executed on new arrays with the fftw_execute_dft
+// family, which is allowed as long as the arrays come from fftw_malloc.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+map< vector<int>, fftw_plan_s* > LSDRasterSpectral::DoublePlanCache;
+map< vector<int>, fftwf_plan_s* > LSDRasterSpectral::FloatPlanCache;
+int LSDRasterSpectral::FFTWThreads = 1;
+
+fftw_plan_s* LSDRasterSpectral::get_dfftw2D_plan(int ny, int nx, int transform_direction)
+{
+  vector<int> key(3);
+  key[0] = transform_direction;
+  key[1] = ny;
+  key[2] = nx;
+  map< vector<int>, fftw_plan_s* >::iterator it = DoublePlanCache.find(key);
+  if (it != DoublePlanCache.end())
+  {
+    return it->second;
+  }
+
+  // FFTW_MEASURE overwrites the arrays, so plan on scratch arrays
+  fftw_complex *input = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*ny*nx);
+  fftw_complex *output = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*ny*nx);
+  fftw_plan plan = fftw_plan_dft_2d(ny,nx,input,output,transform_direction,FFTW_MEASURE);
+  fftw_free(input);
+  fftw_free(output);
+
+  DoublePlanCache[key] = plan;
+  return plan;
+}
+
+fftwf_plan_s* LSDRasterSpectral::get_sfftw2D_plan(int ny, int nx, int transform_direction)
+{
+  vector<int> key(3);
+  key[0] = transform_direction;
+  key[1] = ny;
+  key[2] = nx;
+  map< vector<int>, fftwf_plan_s* >::iterator it = FloatPlanCache.find(key);
+  if (it != FloatPlanCache.end())
+  {
+    return it->second;
+  }
+
+  // FFTW_MEASURE overwrites the arrays, so plan on scratch arrays
+  float *real_array = (float*)fftwf_malloc(sizeof(float)*ny*nx);
+  fftwf_complex *complex_array = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*ny*(nx/2+1));
+  fftwf_plan plan;
+  if (transform_direction == -1)
+  {
+    plan = fftwf_plan_dft_r2c_2d(ny,nx,real_array,complex_array,FFTW_MEASURE);
+  }
+  else
+  {
+    plan = fftwf_plan_dft_c2r_2d(ny,nx,complex_array,real_array,FFTW_MEASURE);
+  }
+  fftwf_free(real_array);
+  fftwf_free(complex_array);
+
+  FloatPlanCache[key] = plan;
+  return plan;
+}
+
+void LSDRasterSpectral::clear_fftw_plan_cache()
+{
+  for (map< vector<int>, fftw_plan_s* >::iterator it = DoublePlanCache.begin(); it != DoublePlanCache.end(); ++it)
+  {
+    fftw_destroy_plan(it->second);
+  }
+  for (map< vector<int>, fftwf_plan_s* >::iterator it = FloatPlanCache.begin(); it != FloatPlanCache.end(); ++it)
+  {
+    fftwf_destroy_plan(it->second);
+  }
+  DoublePlanCache.clear();
+  FloatPlanCache.clear();
+}
+
+//------------------------------------------------------------------------------
+// FFTW THREADS
+// The threaded FFTW libraries split each transform between n_threads.  Plans
+// remember their thread count, so the cache is emptied if it changes.
+//
+//------------------------------------------------------------------------------
+void LSDRasterSpectral::set_fftw_threads(int n_threads)
+{
+  static bool threads_initialised = false;
+  if (n_threads < 1)
+  {
+    n_threads = 1;
+  }
+  if (!threads_initialised)
+  {
+    if (!fftw_init_threads() || !fftwf_init_threads())
+    {
+      cout << "Warning: FFTW could not start its threads, the transforms will run on one thread." << endl;
+      return;
+    }
+    threads_initialised = true;
+  }
+  if (n_threads != FFTWThreads)
+  {
+    clear_fftw_plan_cache();
+  }
+  FFTWThreads = n_threads;
+  fftw_plan_with_nthreads(n_threads);
+  fftwf_plan_with_nthreads(n_threads);
+}
+
+//------------------------------------------------------------------------------
+// FFTW WISDOM
+// Wisdom records the plans FFTW_MEASURE picked, so a later run on the same
+// grid shapes can make its plans straight away.  Double and single precision
+// wisdom are kept in separate files.
+//
+//------------------------------------------------------------------------------
+void LSDRasterSpectral::import_fftw_wisdom(string wisdom_prefix)
+{
+  string double_name = wisdom_prefix+"_fftw.wisdom";
+  string float_name = wisdom_prefix+"_fftwf.wisdom";
+  if (fftw_import_wisdom_from_filename(double_name.c_str()))
+  {
+    cout << "Loaded FFTW wisdom from " << double_name << endl;
+  }
+  if (fftwf_import_wisdom_from_filename(float_name.c_str()))
+  {
+    cout << "Loaded FFTW wisdom from " << float_name << endl;
+  }
+}
+
+void LSDRasterSpectral::export_fftw_wisdom(string wisdom_prefix)
+{
+  string double_name = wisdom_prefix+"_fftw.wisdom";
+  string float_name = wisdom_prefix+"_fftwf.wisdom";
+  if (!DoublePlanCache.empty() && !fftw_export_wisdom_to_filename(double_name.c_str()))
+  {
+    cout << "Warning: could not write FFTW wisdom to " << double_name << endl;
+  }
+  if (!FloatPlanCache.empty() && !fftwf_export_wisdom_to_filename(float_name.c_str()))
+  {
+    cout << "Warning: could not write FFTW wisdom to " << float_name << endl;
+  }
+}
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // FAST FOURIER TRANSFORM MODULE
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -472,7 +650,7 @@ void LSDRasterSpectral::dfftw2D_fwd(Array2D<float>& InputArray, Array2D<float>&
   if (transform_direction==-1)
   {
     //     cout << "  Running 2D discrete FORWARD fast fourier transform..." << endl;
-    plan = fftw_plan_dft_2d(Ly,Lx,input,output,transform_direction,FFTW_MEASURE);
+    plan = get_dfftw2D_plan(Ly,Lx,transform_direction);
   }
   else
   {
@@ -491,7 +669,7 @@ void LSDRasterSpectral::dfftw2D_fwd(Array2D<float>& InputArray, Array2D<float>&
   }
 
   // EXECUTE PLAN
-  fftw_execute(plan);
+  fftw_execute_dft(plan,input,output);
 
   // RETRIEVE OUTPUT - since data is real, we only need to extract real part of
   // the output.
@@ -504,8 +682,7 @@ void LSDRasterSpectral::dfftw2D_fwd(Array2D<float>& InputArray, Array2D<float>&
     }
   }
 
-  // DEALLOCATE PLAN AND ARRAYS
-  fftw_destroy_plan(plan);
+  // DEALLOCATE ARRAYS (the plan is kept in the cache)
   fftw_free(input);
   fftw_free(output);
 }
@@ -531,7 +708,7 @@ void LSDRasterSpectral::dfftw2D_inv(Array2D<float>& InputArrayReal,
   if (transform_direction==1)
   {
 //     cout << "  Running 2D discrete INVERSE fast fourier transform..." << endl;
-    plan = fftw_plan_dft_2d(Ly,Lx,input,output,transform_direction,FFTW_MEASURE);
+    plan = get_dfftw2D_plan(Ly,Lx,transform_direction);
   }
   else
   {
@@ -550,7 +727,7 @@ void LSDRasterSpectral::dfftw2D_inv(Array2D<float>& InputArrayReal,
   }
 
   // EXECUTE PLAN
-  fftw_execute(plan);
+  fftw_execute_dft(plan,input,output);
 
   // RETRIEVE OUTPUT ARRAY
   for (int i=0;i<Ly;++i)
@@ -561,8 +738,7 @@ void LSDRasterSpectral::dfftw2D_inv(Array2D<float>& InputArrayReal,
     }
   }
 
-  // DEALLOCATE PLAN AND ARRAYS
-  fftw_destroy_plan(plan);
+  // DEALLOCATE ARRAYS (the plan is kept in the cache)
   fftw_free(input);
   fftw_free(output);
 }
@@ -591,7 +767,7 @@ Array2D<float>& OutputArray, int transform_direction)
   if (transform_direction==1)
   {
     cout << "  Running 2D discrete INVERSE fast fourier transform..." << endl;
-    plan = fftw_plan_dft_2d(Ly,Lx,input,output,transform_direction,FFTW_MEASURE);
+    plan = get_dfftw2D_plan(Ly,Lx,transform_direction);
   }
   else
   {
@@ -612,7 +788,7 @@ Array2D<float>& OutputArray, int transform_direction)
   }
 
   // EXECUTE PLAN
-  fftw_execute(plan);
+  fftw_execute_dft(plan,input,output);
 
   // RETRIEVE OUTPUT ARRAY
   for (int i=0;i<Ly;++i)
@@ -623,13 +799,128 @@ Array2D<float>& OutputArray, int transform_direction)
     }
   }
 
-  // DEALLOCATE PLAN AND ARRAYS
-  fftw_destroy_plan(plan);
+  // DEALLOCATE ARRAYS (the plan is kept in the cache)
   fftw_free(input);
   fftw_free(output);
   
 }
 
+//------------------------------------------------------------------------------
+// SINGLE PRECISION REAL-TO-COMPLEX FORWARD TRANSFORM
+// The spectrum of a real dataset is Hermitian, so FFTW only computes the
+// Ly x (Lx/2+1) non-redundant half.  This takes about half the time of the
+// complex transform and, in single precision, a quarter of the memory.
+//    - InputArray = zeta_padded (padded DEM)
+//    - OutputSpectrum = unshifted half spectrum
+//
+//------------------------------------------------------------------------------
+void LSDRasterSpectral::sfftw2D_fwd(Array2D<float>& InputArray, Array2D< complex<float> >& OutputSpectrum)
+{
+  int Lx_half = Lx/2+1;
+  float *input;
+  fftwf_complex *output;
+  fftwf_plan plan;
+
+  // Declare one_dimensional contiguous arrays
+  input = (float*)fftwf_malloc(sizeof(float)*Ly*Lx);
+  output = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*Ly*Lx_half);
+
+  // SET UP PLAN
+  plan = get_sfftw2D_plan(Ly,Lx,-1);
+
+  // LOAD DATA IN ROW MAJOR ORDER
+  #pragma omp parallel for schedule(static)
+  for (int i=0;i<Ly;++i)
+  {
+    for (int j=0;j<Lx;++j)
+    {
+      input[Lx*i+j] = InputArray[i][j];
+    }
+  }
+
+  // EXECUTE PLAN
+  fftwf_execute_dft_r2c(plan,input,output);
+
+  // RETRIEVE OUTPUT
+  Array2D< complex<float> > Spectrum(Ly,Lx_half);
+  #pragma omp parallel for schedule(static)
+  for (int i=0;i<Ly;++i)
+  {
+    for (int j=0;j<Lx_half;++j)
+    {
+      Spectrum[i][j] = complex<float>(output[Lx_half*i+j][0],output[Lx_half*i+j][1]);
+    }
+  }
+  OutputSpectrum = Spectrum;
+
+  // DEALLOCATE ARRAYS (the plan is kept in the cache)
+  fftwf_free(input);
+  fftwf_free(output);
+}
+
+//------------------------------------------------------------------------------
+// SINGLE PRECISION COMPLEX-TO-REAL INVERSE TRANSFORM
+//    - InputSpectrum = unshifted half spectrum
+//    - OutputArray = reconstructed DEM (not normalised)
+//
+//------------------------------------------------------------------------------
+void LSDRasterSpectral::sfftw2D_inv(Array2D< complex<float> >& InputSpectrum, Array2D<float>& OutputArray)
+{
+  int Lx_half = Lx/2+1;
+  fftwf_complex *input;
+  float *output;
+  fftwf_plan plan;
+
+  // Declare one_dimensional contiguous arrays
+  input = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*Ly*Lx_half);
+  output = (float*)fftwf_malloc(sizeof(float)*Ly*Lx);
+
+  // SET UP PLAN
+  plan = get_sfftw2D_plan(Ly,Lx,1);
+
+  // LOAD DATA IN ROW MAJOR ORDER
+  #pragma omp parallel for schedule(static)
+  for (int i=0;i<Ly;++i)
+  {
+    for (int j=0;j<Lx_half;++j)
+    {
+      input[Lx_half*i+j][0] = InputSpectrum[i][j].real();
+      input[Lx_half*i+j][1] = InputSpectrum[i][j].imag();
+    }
+  }
+
+  // EXECUTE PLAN
+  fftwf_execute_dft_c2r(plan,input,output);
+
+  // RETRIEVE OUTPUT ARRAY
+  #pragma omp parallel for schedule(static)
+  for (int i=0;i<Ly;++i)
+  {
+    for (int j=0;j<Lx;++j)
+    {
+      OutputArray[i][j] = output[Lx*i+j];
+    }
+  }
+
+  // DEALLOCATE ARRAYS (the plan is kept in the cache)
+  fftwf_free(input);
+  fftwf_free(output);
+}
+
+//------------------------------------------------------------------------------
+// RADIAL FREQUENCY OF AN ELEMENT OF THE HALF SPECTRUM
+// Rows above the Nyquist row hold the negative wavenumbers.  The wavenumbers
+// are the same as (y - Ly/2) and (x - Lx/2) in the shifted spectrum, so the
+// frequency is identical to the one used by the filters below.
+//
+//------------------------------------------------------------------------------
+float LSDRasterSpectral::get_half_spectrum_frequency(int row, int col)
+{
+  float ky = (row < (Ly+1)/2) ? float(row) : float(row-Ly);
+  float kx = (col < (Lx+1)/2) ? float(col) : float(col-Lx);
+  return sqrt(ky*ky*dfy*dfy + kx*kx*dfx*dfx);
+}
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // DETREND DATA MODULE
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -649,33 +940,58 @@ void LSDRasterSpectral::detrend2D(Array2D<float>& zeta, Array2D<float>& zeta_det
   Array2D<float> A(3,3,0.0);
   Array1D<float> bb(3,0.0);
   Array1D<float> coeffs(3);
-  
+
+  // The sums are built up row by row so the rows can be shared between
+  // threads. The row sums are then added in row order, which keeps the
+  // result independent of the number of threads.
+  // Each row holds sum x^2, xy, x, y^2, y, n, zx, zy, z
+  vector<double> RowSums(9*NRows,0.0);
+  #pragma omp parallel for schedule(static)
   for (int i=0; i<NRows; ++i)
-  {      
+  {
+    double* sums = &RowSums[9*i];
     for (int j=0; j<NCols; ++j)
     {
       if(zeta[i][j] != NoDataValue)
       {
-        float x = j;
-        float y = i;
-        // Generate matrix A
-        A[0][0] += pow(x,2);
-        A[0][1] += x*y;
-        A[0][2] += x;
-        A[1][0] += y*x;
-        A[1][1] += pow(y,2);
-        A[1][2] += y;
-        A[2][0] += x;
-        A[2][1] += y;
-        A[2][2] += 1;
-
-        // Generate vector bb
-        bb[0] += zeta[i][j]*x;
-        bb[1] += zeta[i][j]*y;
-        bb[2] += zeta[i][j];
+        double x = j;
+        double y = i;
+        sums[0] += x*x;
+        sums[1] += x*y;
+        sums[2] += x;
+        sums[3] += y*y;
+        sums[4] += y;
+        sums[5] += 1;
+        sums[6] += zeta[i][j]*x;
+        sums[7] += zeta[i][j]*y;
+        sums[8] += zeta[i][j];
       }
     }
   }
+  vector<double> Sums(9,0.0);
+  for (int i=0; i<NRows; ++i)
+  {
+    for (int k=0; k<9; ++k)
+    {
+      Sums[k] += RowSums[9*i+k];
+    }
+  }
+
+  // Generate matrix A
+  A[0][0] = Sums[0];
+  A[0][1] = Sums[1];
+  A[0][2] = Sums[2];
+  A[1][0] = Sums[1];
+  A[1][1] = Sums[3];
+  A[1][2] = Sums[4];
+  A[2][0] = Sums[2];
+  A[2][1] = Sums[4];
+  A[2][2] = Sums[5];
+
+  // Generate vector bb
+  bb[0] = Sums[6];
+  bb[1] = Sums[7];
+  bb[2] = Sums[8];
 
   // Solve matrix equations using LU decomposition using the TNT JAMA package:
   // A.coefs = b, where coefs is the coefficients vector.
@@ -686,6 +1002,7 @@ void LSDRasterSpectral::detrend2D(Array2D<float>& zeta, Array2D<float>& zeta_det
   float c_plane = coeffs[2];
 
   // Create detrended surface
+  #pragma omp parallel for schedule(static)
   for (int i=0; i<NRows; ++i)
   {
     for (int j=0; j<NCols; ++j)
@@ -729,7 +1046,7 @@ void LSDRasterSpectral::window_data(Array2D<float>& input, Array2D<float>& outpu
     output=input.copy();
     Array2D<float> window_array(NRows,NCols,1.0);
     window = window_array.copy(); 
-    WSS=float(NRows*NCols); 
+    WSS=float(NRows)*float(NCols); 
   }
   else
   {
@@ -981,15 +1298,13 @@ void LSDRasterSpectral::window_data_Hamming2D(Array2D<float>& zeta_detrend, Arra
 
 void LSDRasterSpectral::shift_spectrum(Array2D<float>& spectrum_real,  Array2D<float>& spectrum_imaginary, Array2D<float>& spectrum_real_shift, Array2D<float>& spectrum_imaginary_shift)
 {
-  vector<int> shifted_row_indices, shifted_col_indices;
-  int p2y =(Ly+1)/2; 
-  int p2x =(Lx+1)/2; 
-  
-  for(int i = p2y; i < Ly; ++i)  shifted_row_indices.push_back(i);
-  for(int i = 0; i < p2y; ++i)   shifted_row_indices.push_back(i);
-  for(int i = p2x; i < Lx; ++i)  shifted_col_indices.push_back(i);
-  for(int i = 0; i < p2x; ++i)   shifted_col_indices.push_back(i);
+  // row r moves to (r + Ly/2) % Ly, so the zero wavenumber ends up at
+  // (Ly/2, Lx/2) for odd as well as even sizes
+  vector<int> shifted_row_indices(Ly), shifted_col_indices(Lx);
+  for(int i = 0; i < Ly; ++i)  shifted_row_indices[i] = (i + Ly/2) % Ly;
+  for(int i = 0; i < Lx; ++i)  shifted_col_indices[i] = (i + Lx/2) % Lx;
   
+  #pragma omp parallel for schedule(static)
   for(int row = 0; row < Ly; ++row)
   {
     for(int col = 0; col < Lx; ++col)
@@ -1014,15 +1329,12 @@ void LSDRasterSpectral::shift_spectrum(Array2D<float>& spectrum_real,  Array2D<f
 // required for the inverse fourier transform algorithm.
 void LSDRasterSpectral::shift_spectrum_inv(Array2D<float>& FilteredSpectrumReal, Array2D<float>& FilteredSpectrumImaginary, Array2D<float>& FilteredSpectrumReal_deshift, Array2D<float>& FilteredSpectrumImaginary_deshift)
 {
-  vector<int> i_shifted_row_indices, i_shifted_col_indices;
-  int p2y =Ly-(Ly+1)/2; 
-  int p2x =Lx-(Lx+1)/2;
-  
-  for(int i = p2y; i < Ly; ++i)  i_shifted_row_indices.push_back(i);
-  for(int i = 0; i < p2y; ++i)   i_shifted_row_indices.push_back(i);
-  for(int i = p2x; i < Lx; ++i)  i_shifted_col_indices.push_back(i);
-  for(int i = 0; i < p2x; ++i)   i_shifted_col_indices.push_back(i);
+  // undoes shift_spectrum: the element at i goes back to (i - Ly/2) % Ly
+  vector<int> i_shifted_row_indices(Ly), i_shifted_col_indices(Lx);
+  for(int i = 0; i < Ly; ++i)  i_shifted_row_indices[i] = (i + Ly - Ly/2) % Ly;
+  for(int i = 0; i < Lx; ++i)  i_shifted_col_indices[i] = (i + Lx - Lx/2) % Lx;
   
+  #pragma omp parallel for schedule(static)
   for(int row = 0; row < Ly; ++row)
   {
     for(int col = 0; col < Lx; ++col)
@@ -1061,6 +1373,34 @@ void LSDRasterSpectral::calculate_2D_PSD(Array2D<float>& spectrum_real_shift, Ar
     }
   }
 }
+//------------------------------------------------------------------------------
+// Version for the half spectrum from sfftw2D_fwd.  The element at (ky,kx) of
+// the shifted periodogram is taken from (ky,kx) of the half spectrum if kx is
+// in it, otherwise from its conjugate at (-ky,-kx), which has the same power.
+//
+void LSDRasterSpectral::calculate_2D_PSD(Array2D< complex<float> >& HalfSpectrum)
+{
+  Array2D<float> temp(Ly,Lx,0.0);
+  P_DFT = temp.copy();
+  float fLx = float(Lx);
+  float fLy = float(Ly);
+
+  #pragma omp parallel for schedule(static)
+  for (int i=0; i<Ly; ++i)
+  {
+    for (int j=0; j<Lx; ++j)
+    {
+      int row = (i - Ly/2 + Ly) % Ly;
+      int col = (j - Lx/2 + Lx) % Lx;
+      if (col > Lx/2)
+      {
+        row = (Ly - row) % Ly;
+        col = Lx - col;
+      }
+      P_DFT[i][j] = norm(HalfSpectrum[row][col])/(fLy*fLx*WSS);
+    }
+  }
+}
 void LSDRasterSpectral::scale_spectrum(Array2D<float> SpectrumReal, Array2D<float> SpectrumIm,  float beta)
 {
   float f,x,y;
@@ -1084,6 +1424,26 @@ void LSDRasterSpectral::scale_spectrum(Array2D<float> SpectrumReal, Array2D<floa
     }
   }
 }
+// Version for the unshifted half spectrum from sfftw2D_fwd.
+void LSDRasterSpectral::scale_spectrum(Array2D< complex<float> >& HalfSpectrum, float beta)
+{
+  #pragma omp parallel for schedule(static)
+  for (int i=0; i < HalfSpectrum.dim1(); ++i)
+  {
+    for (int j=0; j < HalfSpectrum.dim2(); ++j)
+    {
+      float f = get_half_spectrum_frequency(i,j); // Radial Frequency
+      if (f == 0)
+      {
+        HalfSpectrum[i][j] = 0;
+      }
+      else
+      {
+        HalfSpectrum[i][j] = HalfSpectrum[i][j]/float(pow(f,beta));
+      }
+    }
+  }
+}
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // GET RADIAL POWER SPECTRUM
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -1105,9 +1465,11 @@ void LSDRasterSpectral::calculate_radial_PSD()
     {
       float x = float(j);
       float y = float(i);
-      float fLy = float(Ly);
-      float fLx = float(Lx);
-      RadialFreq = sqrt((y - (fLy/2))*(y - (fLy/2))*dfy*dfy + (x - (fLx/2))*(x - (fLx/2))*dfx*dfx); // distance from centre to this point. Converting position in frequency into an absolute frequency
+      // the zero frequency sits at (Ly/2,Lx/2) in the shifted spectrum, using
+      // integer division so that odd padded sizes are centred correctly
+      float fcy = float(Ly/2);
+      float fcx = float(Lx/2);
+      RadialFreq = sqrt((y - fcy)*(y - fcy)*dfy*dfy + (x - fcx)*(x - fcx)*dfx*dfx); // distance from centre to this point. Converting position in frequency into an absolute frequency
       if (RadialFreq <= NyquistFreq)  // Ignore radial frequencies greater than the Nyquist frequency as these are aliased
         {
           RadialFrequencyRaw[count] = RadialFreq;
@@ -1193,7 +1555,7 @@ void LSDRasterSpectral::fftw2D_spectral_analysis(char* file_id, float LogBinWidt
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
   // 2D DISCRETE FAST FOURIER TRANSFORM
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // PAD DATA WITH ZEROS TO A POWER OF TWO (facilitates FFT)
+  // PAD DATA WITH ZEROS TO A 7-SMOOTH SIZE (facilitates FFT)
 
   Array2D<float> zeta_padded(Ly,Lx);
   for (int i=0;i<Ly;++i)
@@ -1549,6 +1911,104 @@ void LSDRasterSpectral::highpass_filter_remainder(Array2D<float>& RawSpectrumRea
   }
 }
 
+//------------------------------------------------------------------------------
+// FILTER WEIGHT
+// The weights of the five filters above as a function of the radial frequency,
+// so they can be applied to the half spectrum.
+//
+float LSDRasterSpectral::get_filter_weight(int FilterType, float f, float f1, float f2)
+{
+  float weight = 1;
+  float sigma;
+  if (FilterType == 1)
+  {
+    sigma = sqrt((f2-f1)*(f2-f1))/6;
+    weight = exp(-(f - 0.5*(f1 + f2))*(f - 0.5*(f1 + f2))/(2*sigma*sigma));
+  }
+  else if (FilterType == 2 || FilterType == 4)
+  {
+    if (f < f1)
+    {
+      weight = 1;
+    }
+    else if (f2 > f1)
+    {
+      sigma = sqrt((f2-f1)*(f2-f1))/3;
+      weight = exp(-(f - f1)*(f-f1)/(2*sigma*sigma));
+    }
+    else
+    {
+      weight = 0;
+    }
+    if (FilterType == 4) weight = 1-weight;
+  }
+  else if (FilterType == 3 || FilterType == 5)
+  {
+    if (f > f2)
+    {
+      weight = 1;
+    }
+    else if (f2 > f1)
+    {
+      sigma = sqrt((f2-f1)*(f2-f1))/3;
+      weight = exp(-(f - f2)*(f-f2)/(2*sigma*sigma));
+    }
+    else
+    {
+      weight = 0;
+    }
+    if (FilterType == 5) weight = 1-weight;
+  }
+  return weight;
+}
+
+//------------------------------------------------------------------------------
+// FILTER HALF SPECTRUM
+// Applies one of the filters above in place to the unshifted half spectrum.
+// The weights only depend on the radial frequency, so there is no need to
+// shift the spectrum.
+//
+void LSDRasterSpectral::filter_half_spectrum(Array2D< complex<float> >& HalfSpectrum, int FilterType, float f1, float f2)
+{
+  if (FilterType == 1)
+  {
+    cout << "  Gaussian bandpass filter between f1 = " << f1 << " and f2 = " << f2 << endl;
+  }
+  else if (FilterType == 2 || FilterType == 4)
+  {
+    cout << "  Lowpass filter with edges controlled by radial Gaussian function between f1 = " << f1 << " and f2 = " << f2 << endl;
+  }
+  else if (FilterType == 3)
+  {
+    cout << "    Highpass filter with edges controlled by radial Gaussian function between f1 = " << f1 << " and f2 = " << f2 << endl;
+  }
+  else if (FilterType == 5)
+  {
+    cout << "    Lowpass filter version 2, this gives residual topography to that produced from a highpass filter with edges controlled by radial Gaussian function between f1 = " << f1 << " and f2 = " << f2 << endl;
+  }
+  else
+  {
+    // the full spectrum versions leave the spectrum as zeros in this case
+    cout << "  Unknown filter type " << FilterType << ", removing the whole spectrum" << endl;
+  }
+
+  #pragma omp parallel for schedule(static)
+  for (int i=0; i < HalfSpectrum.dim1(); ++i)
+  {
+    for (int j=0; j < HalfSpectrum.dim2(); ++j)
+    {
+      if (FilterType < 1 || FilterType > 5)
+      {
+        HalfSpectrum[i][j] = 0;
+      }
+      else
+      {
+        HalfSpectrum[i][j] *= get_filter_weight(FilterType, get_half_spectrum_frequency(i,j), f1, f2);
+      }
+    }
+  }
+}
+
 //------------------------------------------------------------------------------
 // WIENER FILTER
 // The Wiener filter is a spectral filter that removes noise from an image or
@@ -1576,25 +2036,95 @@ void LSDRasterSpectral::wiener_filter(Array2D<float>& RawSpectrumReal, Array2D<f
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
   // GET 2D POWER SPECTRUM
   calculate_2D_PSD(RawSpectrumReal, RawSpectrumImaginary);
+  float m_model,c_model,WhiteNoiseAmplitude;
+  fit_wiener_noise_model(c_model, m_model, WhiteNoiseAmplitude);
+
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // GET RADIAL POWER SPECTRUM
-  // For forward transform, return the spectral power of the topography both
-  // in a 2D array, and also as a one dimensional array of radial frequency
-  calculate_radial_PSD();
-  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // FIT POWER LAW TO SPECTRUM BETWEEN RANGE OF WAVELENGTHS 1000m - 100m (THE
-  // RANGE EXPECTED TO FALL WITHIN WAVELENGTHS CONTROLLED BY RIDGE-VALLEY
-  // TOPOGRAPHY)
-  cout << "  Fitting power law to data..." << endl;
-  vector<float> LogRadialFrequency;
-  vector<float> LogRadialPSD;
-  int n_freqs = RadialFrequency.size();
-  float f_low = 0.001; // frequency at wavelength of 1000m
-  float f_high = 0.01; // frequency at wavelength of 100m
-  float m_model,logc_model,c_model;      // Coefficients of power law fit => logPSD = logc + m*log(freq) => PSD = c*freq^m
-  for (int i = 0; i < n_freqs; ++i)
+  // WIENER FILTER
+  // Determine Wiener Coefficients and apply to spectrum
+  // WienerCoefficient = Signal/(Signal + Noise).  Basically acts as a lowpass
+  // filter to remove noise from image.
+  float model;
+  float noise;
+  float f; // radial frequency
+  float WienerCoefficient; // Filter weight
+  for (int i=0; i < Ly; ++i)
   {
-    //cout << RadialFrequency[i] << endl;
+    for (int j=0; j < Lx; ++j)
+    {
+      float x = j;
+      float y = i;
+      f = sqrt((y - (Ly/2))*(y - (Ly/2))*dfy*dfy + (x - (Lx/2))*(x - (Lx/2))*dfx*dfx); // Radial Frequency
+      model = c_model*pow(f,m_model);
+      //noise = c_noise*pow(f,m_noise);
+      noise = WhiteNoiseAmplitude;
+      if (f == 0) WienerCoefficient = 1;
+      else WienerCoefficient = model/(model+noise);
+      FilteredSpectrumReal[i][j] = WienerCoefficient*RawSpectrumReal[i][j];
+      FilteredSpectrumImaginary[i][j] = WienerCoefficient*RawSpectrumImaginary[i][j];
+    }
+  }
+}
+//------------------------------------------------------------------------------
+// Version of the Wiener filter that works in place on the unshifted half
+// spectrum from sfftw2D_fwd.
+void LSDRasterSpectral::wiener_filter(Array2D< complex<float> >& HalfSpectrum)
+{
+  // GET 2D POWER SPECTRUM
+  calculate_2D_PSD(HalfSpectrum);
+  float m_model,c_model,WhiteNoiseAmplitude;
+  fit_wiener_noise_model(c_model, m_model, WhiteNoiseAmplitude);
+
+  // WIENER FILTER
+  wiener_filter(HalfSpectrum, c_model, m_model, WhiteNoiseAmplitude);
+}
+//------------------------------------------------------------------------------
+// Applies the Wiener filter to the unshifted half spectrum using a signal
+// and noise model that has already been fitted, for example to another part
+// of the DEM.
+void LSDRasterSpectral::wiener_filter(Array2D< complex<float> >& HalfSpectrum, float c_model,
+                                      float m_model, float WhiteNoiseAmplitude)
+{
+  #pragma omp parallel for schedule(static)
+  for (int i=0; i < HalfSpectrum.dim1(); ++i)
+  {
+    for (int j=0; j < HalfSpectrum.dim2(); ++j)
+    {
+      float f = get_half_spectrum_frequency(i,j); // Radial Frequency
+      float model = c_model*pow(f,m_model);
+      float WienerCoefficient; // Filter weight
+      if (f == 0) WienerCoefficient = 1;
+      else WienerCoefficient = model/(model+WhiteNoiseAmplitude);
+      HalfSpectrum[i][j] *= WienerCoefficient;
+    }
+  }
+}
+//------------------------------------------------------------------------------
+// FIT WIENER NOISE MODEL
+// Fits the power law signal model and the white noise amplitude used to
+// weight the Wiener filter.  P_DFT must already have been calculated.
+// Split out of wiener_filter
+void LSDRasterSpectral::fit_wiener_noise_model(float& c_model, float& m_model, float& WhiteNoiseAmplitude)
+{
+  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+  // GET RADIAL POWER SPECTRUM
+  // For forward transform, return the spectral power of the topography both
+  // in a 2D array, and also as a one dimensional array of radial frequency
+  calculate_radial_PSD();
+  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+  // FIT POWER LAW TO SPECTRUM BETWEEN RANGE OF WAVELENGTHS 1000m - 100m (THE
+  // RANGE EXPECTED TO FALL WITHIN WAVELENGTHS CONTROLLED BY RIDGE-VALLEY
+  // TOPOGRAPHY)
+  cout << "  Fitting power law to data..." << endl;
+  vector<float> LogRadialFrequency;
+  vector<float> LogRadialPSD;
+  int n_freqs = RadialFrequency.size();
+  float f_low = 0.001; // frequency at wavelength of 1000m
+  float f_high = 0.01; // frequency at wavelength of 100m
+  float logc_model;      // Coefficients of power law fit => logPSD = logc + m*log(freq) => PSD = c*freq^m
+  for (int i = 0; i < n_freqs; ++i)
+  {
+    //cout << RadialFrequency[i] << endl;
     if(RadialFrequency[i] <= f_high && RadialFrequency[i] >= f_low)
     {
       LogRadialFrequency.push_back(log10(RadialFrequency[i]));
@@ -1653,7 +2183,7 @@ void LSDRasterSpectral::wiener_filter(Array2D<float>& RawSpectrumReal, Array2D<f
     f_highpass = 1/L_highpass;
   }
   
-  float WhiteNoiseAmplitude = 0;
+  WhiteNoiseAmplitude = 0;
 //   for (int i = 0; i < int(RadiallyAveragedPSD.size()); ++i)
   for (int i = 0; i < int(RadialPSD.size()); ++i)
   {
@@ -1699,32 +2229,84 @@ void LSDRasterSpectral::wiener_filter(Array2D<float>& RawSpectrumReal, Array2D<f
     Noise_model[i] = WhiteNoiseAmplitude;
   }
   //cout << "Modeled noise exponent = " << m_noise << endl;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// DETRENDED HALF SPECTRUM
+// Detrends the DEM, pads it with zeros and returns the non-redundant half of
+// its spectrum, left unshifted. Shared by the spectral filters.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDRasterSpectral::get_detrended_half_spectrum(Array2D<float>& trend_plane,
+                                                    Array2D< complex<float> >& Spectrum)
+{
+  // DETREND DATA => DO NOT WINDOW!
+  // FIT PLANE BY LEAST SQUARES REGRESSION AND USE COEFFICIENTS TO DETERMINE
+  // LOCAL SLOPE ax + by + c = z
+  Array2D<float> zeta_detrend(NRows,NCols);
+  Array2D<float> temp_plane(NRows,NCols);
+  detrend2D(RasterData, zeta_detrend, temp_plane);
+  trend_plane = temp_plane;
+
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // WIENER FILTER
-  // Determine Wiener Coefficients and apply to spectrum
-  // WienerCoefficient = Signal/(Signal + Noise).  Basically acts as a lowpass
-  // filter to remove noise from image.
-  float model;
-  float noise;
-  float f; // radial frequency
-  float WienerCoefficient; // Filter weight
-  for (int i=0; i < Ly; ++i)
+  // 2D DISCRETE FAST FOURIER TRANSFORM
+  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+  // PAD DATA WITH ZEROS TO A 7-SMOOTH SIZE (facilitates FFT)
+
+  Array2D<float> zeta_padded(Ly,Lx);
+  #pragma omp parallel for schedule(static)
+  for (int i=0;i<Ly;++i)
   {
-    for (int j=0; j < Lx; ++j)
+    for (int j=0;j<Lx;++j)
     {
-      float x = j;
-      float y = i;
-      f = sqrt((y - (Ly/2))*(y - (Ly/2))*dfy*dfy + (x - (Lx/2))*(x - (Lx/2))*dfx*dfx); // Radial Frequency
-      model = c_model*pow(f,m_model);
-      //noise = c_noise*pow(f,m_noise);
-      noise = WhiteNoiseAmplitude;
-      if (f == 0) WienerCoefficient = 1;
-      else WienerCoefficient = model/(model+noise);
-      FilteredSpectrumReal[i][j] = WienerCoefficient*RawSpectrumReal[i][j];
-      FilteredSpectrumImaginary[i][j] = WienerCoefficient*RawSpectrumImaginary[i][j];
+      if (i<NRows && j<NCols)
+      {
+        zeta_padded[i][j] = zeta_detrend[i][j];
+      }
+      else
+      {
+        zeta_padded[i][j]=0;
+      }
+    }
+  }
+  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+  // DO 2D FORWARD FAST FOURIER TRANSFORM
+  // Only the non-redundant half of the spectrum is computed, and it is left
+  // unshifted since the filter weights only depend on the radial frequency.
+  sfftw2D_fwd(zeta_padded, Spectrum);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// FILTERED TOPOGRAPHY
+// Inverse transforms a filtered half spectrum and returns the topography,
+// with the trend removed by get_detrended_half_spectrum added back.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+Array2D<float> LSDRasterSpectral::get_filtered_topography(Array2D< complex<float> >& Spectrum,
+                                                         Array2D<float>& trend_plane)
+{
+  Array2D<float> FilteredTopographyPadded(Ly,Lx);
+  sfftw2D_inv(Spectrum, FilteredTopographyPadded);
+  // Need to scale output by the number of pixels, and by the Hann window to
+  // recover the topography, before adding the planar trend back to the dataset
+  cout << "  Scaling output filtered topography..." << endl;
+  Array2D<float> FilteredTopography(NRows,NCols,NoDataValue);
+  #pragma omp parallel for schedule(static)
+  for (int i=0; i < NRows; ++i)
+  {
+    for (int j=0; j < NCols; ++j)
+    {
+      if(RasterData[i][j]!=NoDataValue) FilteredTopography[i][j] = FilteredTopographyPadded[i][j]/(Lx*Ly) + trend_plane[i][j];
+    }
+  }
+  // Remove areas initially classified as NoData in the original DEM (only really necessary for irregular shaped datasets)
+  for (int i=0; i < NRows; ++i)
+  {
+    for (int j=0; j < NCols; ++j)
+    {
+      if(RasterData[i][j]==NoDataValue) FilteredTopography[i][j] = NoDataValue;
     }
   }
+  return FilteredTopography;
 }
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // MAIN FUNCTIONS USING SPECTRAL FILTERS
@@ -1764,46 +2346,11 @@ LSDRaster LSDRasterSpectral::fftw2D_filter(int FilterType, float FLow, float FHi
   // for FORWARD TRANSFORM
   cout << "\n***fftw_2Dfilt_v1.1: spectral filtering of array***" << endl;
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // DETREND DATA => DO NOT WINDOW!
-  // FIT PLANE BY LEAST SQUARES REGRESSION AND USE COEFFICIENTS TO DETERMINE
-  // LOCAL SLOPE ax + by + c = z
-  Array2D<float> zeta_detrend(NRows,NCols);
-  Array2D<float> trend_plane(NRows,NCols);
-  detrend2D(RasterData, zeta_detrend, trend_plane);
+  // DETREND DATA => DO NOT WINDOW!, PAD AND DO 2D FORWARD FAST FOURIER TRANSFORM
   //float WSS = 1; // dataset is not windowed
-
-  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // 2D DISCRETE FAST FOURIER TRANSFORM
-  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // PAD DATA WITH ZEROS TO A POWER OF TWO (facilitates FFT)
-
-  Array2D<float> zeta_padded(Ly,Lx);
-  for (int i=0;i<Ly;++i)
-  {
-    for (int j=0;j<Lx;++j)
-    {
-      if (i<NRows && j<NCols)
-      {
-        zeta_padded[i][j] = zeta_detrend[i][j];
-      }
-      else
-      {
-        zeta_padded[i][j]=0;
-      }
-    }
-  }
-  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // DO 2D FORWARD FAST FOURIER TRANSFORM
-  int transform_direction = -1;
-  Array2D<float> spectrum_real(Ly,Lx);
-  Array2D<float> spectrum_imaginary(Ly,Lx);
-  dfftw2D_fwd(zeta_padded, spectrum_real, spectrum_imaginary, transform_direction);
-
-  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // REARRANGE SPECTRUM SO THAT ORIGIN IS AT THE CENTRE
-  Array2D<float> spectrum_real_shift(Ly,Lx);
-  Array2D<float> spectrum_imaginary_shift(Ly,Lx);
-  shift_spectrum(spectrum_real, spectrum_imaginary, spectrum_real_shift, spectrum_imaginary_shift);
+  Array2D<float> trend_plane;
+  Array2D< complex<float> > Spectrum;
+  get_detrended_half_spectrum(trend_plane, Spectrum);
 
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
   // INVERSE TRANSFORM
@@ -1811,62 +2358,11 @@ LSDRaster LSDRasterSpectral::fftw2D_filter(int FilterType, float FLow, float FHi
   // band and return spectrally filtered topography
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
   // APPLY FILTER
-  // First, remove the frequency ranges that are not wanted
-  Array2D<float> FilteredSpectrumReal(Ly,Lx,0.0);
-  Array2D<float> FilteredSpectrumImaginary(Ly,Lx,0.0);
-
-  // SET FILTER PARAMETERS
-  if (FilterType == 1)
-  {
-    bandpass_filter(spectrum_real_shift, spectrum_imaginary_shift, FilteredSpectrumReal, FilteredSpectrumImaginary,FLow, FHigh);
-  }
-  else if (FilterType == 2)
-  {
-    lowpass_filter(spectrum_real_shift, spectrum_imaginary_shift, FilteredSpectrumReal, FilteredSpectrumImaginary, FLow, FHigh);
-  }
-  else if (FilterType == 3)
-  {
-    highpass_filter(spectrum_real_shift, spectrum_imaginary_shift, FilteredSpectrumReal, FilteredSpectrumImaginary, FLow, FHigh);
-  }  
-  else if (FilterType == 4)
-  {
-    lowpass_filter_remainder(spectrum_real_shift, spectrum_imaginary_shift, FilteredSpectrumReal, FilteredSpectrumImaginary, FLow, FHigh);
-  }
-  else if (FilterType == 5)
-  {
-    highpass_filter_remainder(spectrum_real_shift, spectrum_imaginary_shift, FilteredSpectrumReal, FilteredSpectrumImaginary, FLow, FHigh);
-  }
-  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // DE-SHIFT ORIGIN OF SPECTRUM
-  // Return filtered spectrum to original format (de-shifted)
-  Array2D<float> FilteredSpectrumReal_deshift(Ly,Lx);
-  Array2D<float> FilteredSpectrumImaginary_deshift(Ly,Lx);
-  shift_spectrum_inv(FilteredSpectrumReal, FilteredSpectrumImaginary, FilteredSpectrumReal_deshift, FilteredSpectrumImaginary_deshift);
+  filter_half_spectrum(Spectrum, FilterType, FLow, FHigh);
 
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
   // DO 2D INVERSE FAST FOURIER TRANSFORM
-  transform_direction = 1;
-  Array2D<float> FilteredTopographyPadded(Ly,Lx);
-  dfftw2D_inv(FilteredSpectrumReal_deshift, FilteredSpectrumImaginary_deshift, FilteredTopographyPadded, transform_direction);
-  // Need to scale output by the number of pixels, and by the Hann window to
-  // recover the topography, before adding the planar trend back to the dataset
-  cout << "  Scaling output filtered topography..." << endl;
-  Array2D<float> FilteredTopography(NRows,NCols,NoDataValue);
-  for (int i=0; i < NRows; ++i)
-  {
-    for (int j=0; j < NCols; ++j)
-    {
-      if(RasterData[i][j]!=NoDataValue) FilteredTopography[i][j] = FilteredTopographyPadded[i][j]/(Lx*Ly) + trend_plane[i][j];
-    }
-  }
-  // Remove areas initially classified as NoData in the original DEM (only really necessary for irregular shaped datasets)
-  for (int i=0; i < NRows; ++i)
-  {
-    for (int j=0; j < NCols; ++j)
-    {
-      if(RasterData[i][j]==NoDataValue) FilteredTopography[i][j] = NoDataValue;
-    }
-  }
+  Array2D<float> FilteredTopography = get_filtered_topography(Spectrum, trend_plane);
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
   LSDRaster FilteredTopographyRaster(NRows,NCols,XMinimum,YMinimum,DataResolution,NoDataValue,FilteredTopography,GeoReferencingStrings);
   return FilteredTopographyRaster;
@@ -1918,97 +2414,403 @@ LSDRaster LSDRasterSpectral::fftw2D_filter(int FilterType, float FLow, float FHi
 LSDRaster LSDRasterSpectral::fftw2D_wiener()
 {
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // DETREND DATA => DO NOT WINDOW!
-  // FIT PLANE BY LEAST SQUARES REGRESSION AND USE COEFFICIENTS TO DETERMINE
-  // LOCAL SLOPE ax + by + c = z
-  Array2D<float> zeta_detrend(NRows,NCols);
-  Array2D<float> trend_plane(NRows,NCols);
-  detrend2D(RasterData, zeta_detrend, trend_plane);
+  // DETREND DATA => DO NOT WINDOW!, PAD AND DO 2D FORWARD FAST FOURIER TRANSFORM
   WSS = 1; // dataset is not windowed
+  Array2D<float> trend_plane;
+  Array2D< complex<float> > Spectrum;
+  get_detrended_half_spectrum(trend_plane, Spectrum);
 
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // 2D DISCRETE FAST FOURIER TRANSFORM
+  // APPLY FILTER
+  wiener_filter(Spectrum);
+
+  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+  // DO 2D INVERSE FAST FOURIER TRANSFORM
+  Array2D<float> FilteredTopography = get_filtered_topography(Spectrum, trend_plane);
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // PAD DATA WITH ZEROS TO A POWER OF TWO (facilitates FFT)
-  Ly = int(pow(2,ceil(log(NRows)/log(2))));
-  Lx = int(pow(2,ceil(log(NCols)/log(2))));
+  LSDRaster FilteredTopographyRaster(NRows,NCols,XMinimum,YMinimum,DataResolution,NoDataValue,FilteredTopography,GeoReferencingStrings);
+  return FilteredTopographyRaster;
+}
 
-  Array2D<float> zeta_padded(Ly,Lx);
-  for (int i=0;i<Ly;++i)
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TILED WIENER FILTER
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+//
+// Transforming the whole DEM at once needs several padded Ly x Lx work arrays
+// alive at the same time, which rules out region scale lidar. Instead the DEM
+// is cut into tiles, each tile is filtered together with a margin of
+// TileOverlap cells on each side, and the filtered windows are blended back
+// together (overlap-add). Across an overlap the weight of a tile rises from 0
+// to 1 as a raised cosine, and the weight of its neighbour falls by the same
+// amount, so the weights always sum to one.
+//
+// The noise model can be fitted once for the whole DEM, to the periodogram
+// averaged over square windows laid across the DEM (Welch's method), or for
+// each tile to a window centred on that tile.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This loads a window of the DEM as a spectral raster, from the raster in
+// memory or, if read_from_file is true, from disk.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+LSDRasterSpectral LSDRasterSpectral::load_spectral_window(bool read_from_file, string filename,
+                                        string extension, int row_start, int col_start,
+                                        int n_rows, int n_cols, int& NDataCells)
+{
+  Array2D<float> WindowZeta(n_rows,n_cols);
+  if (read_from_file)
   {
-    for (int j=0;j<Lx;++j)
+    LSDRaster WindowRaster(filename, extension, row_start, col_start, n_rows, n_cols);
+    WindowZeta = WindowRaster.get_RasterData();
+  }
+  else
+  {
+    for (int row = 0; row<n_rows; ++row)
     {
-      if (i<NRows && j<NCols)
+      for (int col = 0; col<n_cols; ++col)
       {
-        zeta_padded[i][j] = zeta_detrend[i][j];
+        WindowZeta[row][col] = RasterData[row_start+row][col_start+col];
       }
-      else
+    }
+  }
+
+  NDataCells = 0;
+  for (int row = 0; row<n_rows; ++row)
+  {
+    for (int col = 0; col<n_cols; ++col)
+    {
+      if (WindowZeta[row][col] != NoDataValue)
       {
-        zeta_padded[i][j]=0;
+        NDataCells++;
       }
     }
   }
-  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // DO 2D FORWARD FAST FOURIER TRANSFORM
-  int transform_direction = -1;
-  Array2D<float> spectrum_real(Ly,Lx);
-  Array2D<float> spectrum_imaginary(Ly,Lx);
-  dfftw2D_fwd(zeta_padded, spectrum_real, spectrum_imaginary, transform_direction);
 
-  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // REARRANGE SPECTRUM SO THAT ORIGIN IS AT THE CENTRE
-  Array2D<float> spectrum_real_shift(Ly,Lx);
-  Array2D<float> spectrum_imaginary_shift(Ly,Lx);
-  shift_spectrum(spectrum_real, spectrum_imaginary, spectrum_real_shift, spectrum_imaginary_shift);
+  float WindowXMinimum = XMinimum + col_start*DataResolution;
+  float WindowYMinimum = YMinimum + (NRows-row_start-n_rows)*DataResolution;
+  LSDRasterSpectral Window(n_rows,n_cols,WindowXMinimum,WindowYMinimum,
+                           DataResolution,NoDataValue,WindowZeta);
+  return Window;
+}
 
-  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // INVERSE TRANSFORM
-  // For inverse tranform, take 2D power spectrum.  Filter for desired frequncy
-  // band and return spectrally filtered topography
-  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // APPLY FILTER
-  // First, remove the frequency ranges that are not wanted
-  Array2D<float> FilteredSpectrumReal(Ly,Lx,0.0);
-  Array2D<float> FilteredSpectrumImaginary(Ly,Lx,0.0);
-  // SET FILTER PARAMETERS
-  wiener_filter(spectrum_real_shift, spectrum_imaginary_shift, FilteredSpectrumReal, FilteredSpectrumImaginary);
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Fits the Wiener signal and noise models to a single window of the DEM
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+bool LSDRasterSpectral::fit_wiener_noise_model_to_window(bool read_from_file, string filename,
+                                        string extension, int row_start, int col_start,
+                                        int n_rows, int n_cols, float& c_model,
+                                        float& m_model, float& WhiteNoiseAmplitude)
+{
+  int NDataCells;
+  LSDRasterSpectral Window = load_spectral_window(read_from_file, filename, extension,
+                                   row_start, col_start, n_rows, n_cols, NDataCells);
+  if (NDataCells == 0)
+  {
+    return false;
+  }
 
-  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // DE-SHIFT ORIGIN OF SPECTRUM
-  // Return filtered spectrum to original format (de-shifted)
-  Array2D<float> FilteredSpectrumReal_deshift(Ly,Lx);
-  Array2D<float> FilteredSpectrumImaginary_deshift(Ly,Lx);
-  shift_spectrum_inv(FilteredSpectrumReal, FilteredSpectrumImaginary, FilteredSpectrumReal_deshift, FilteredSpectrumImaginary_deshift);
+  Array2D<float> trend_plane;
+  Array2D< complex<float> > Spectrum;
+  Window.WSS = 1; // dataset is not windowed
+  Window.get_detrended_half_spectrum(trend_plane, Spectrum);
+  Window.calculate_2D_PSD(Spectrum);
+  Window.fit_wiener_noise_model(c_model, m_model, WhiteNoiseAmplitude);
+  return true;
+}
 
-  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // DO 2D INVERSE FAST FOURIER TRANSFORM
-  transform_direction = 1;
-  Array2D<float> FilteredTopographyPadded(Ly,Lx);
-  dfftw2D_inv(FilteredSpectrumReal_deshift, FilteredSpectrumImaginary_deshift, FilteredTopographyPadded, transform_direction);
-  // Need to scale output by the number of pixels, and by the Hann window to
-  // recover the topography, before adding the planar trend back to the dataset
-  cout << "  Scaling output filtered topography..." << endl;
-  Array2D<float> FilteredTopography(NRows,NCols,NoDataValue);
-  for (int i=0; i < NRows; ++i)
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Fits the Wiener signal and noise models to the periodogram averaged over
+// non-overlapping square windows of NoiseWindowSize cells. Windows that are
+// less than half data are skipped. The DEM is only ever read one window at a
+// time.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDRasterSpectral::fit_wiener_noise_model_to_windows(bool read_from_file, string filename,
+                                        string extension, int NoiseWindowSize,
+                                        float& c_model, float& m_model,
+                                        float& WhiteNoiseAmplitude)
+{
+  int WindowRows = min(NoiseWindowSize,NRows);
+  int WindowCols = min(NoiseWindowSize,NCols);
+  int NWindowRows = NRows/WindowRows;
+  int NWindowCols = NCols/WindowCols;
+
+  // the sum of the periodograms, which all have the same padded size
+  Array2D<float> SumP_DFT;
+  int NWindowsUsed = 0;
+  for (int window = 0; window<NWindowRows*NWindowCols; ++window)
+  {
+    int row_start = (window/NWindowCols)*WindowRows;
+    int col_start = (window%NWindowCols)*WindowCols;
+
+    int NDataCells;
+    LSDRasterSpectral Window = load_spectral_window(read_from_file, filename, extension,
+                                row_start, col_start, WindowRows, WindowCols, NDataCells);
+    if (2*NDataCells < WindowRows*WindowCols)
+    {
+      continue;
+    }
+
+    Array2D<float> trend_plane;
+    Array2D< complex<float> > Spectrum;
+    Window.WSS = 1; // dataset is not windowed
+    Window.get_detrended_half_spectrum(trend_plane, Spectrum);
+    Window.calculate_2D_PSD(Spectrum);
+
+    if (NWindowsUsed == 0)
+    {
+      SumP_DFT = Window.P_DFT.copy();
+    }
+    else
+    {
+      #pragma omp parallel for schedule(static)
+      for (int i=0; i<SumP_DFT.dim1(); ++i)
+      {
+        for (int j=0; j<SumP_DFT.dim2(); ++j)
+        {
+          SumP_DFT[i][j] += Window.P_DFT[i][j];
+        }
+      }
+    }
+    NWindowsUsed++;
+  }
+
+  if (NWindowsUsed == 0)
   {
-    for (int j=0; j < NCols; ++j)
+    cout << "FATAL ERROR: none of the " << WindowRows << " by " << WindowCols
+         << " windows used to fit the Wiener noise model is at least half data." << endl
+         << "Try a smaller noise window." << endl;
+    exit(EXIT_FAILURE);
+  }
+  cout << "  Fitting the Wiener noise model to the mean periodogram of "
+       << NWindowsUsed << " windows" << endl;
+
+  // the model is fitted by a raster with the size of the windows
+  Array2D<float> ModelZeta(WindowRows,WindowCols,0.0);
+  LSDRasterSpectral ModelRaster(WindowRows,WindowCols,XMinimum,YMinimum,
+                                DataResolution,NoDataValue,ModelZeta);
+  #pragma omp parallel for schedule(static)
+  for (int i=0; i<SumP_DFT.dim1(); ++i)
+  {
+    for (int j=0; j<SumP_DFT.dim2(); ++j)
     {
-      if(RasterData[i][j]!=NoDataValue) FilteredTopography[i][j] = FilteredTopographyPadded[i][j]/(Lx*Ly) + trend_plane[i][j];
+      SumP_DFT[i][j] /= float(NWindowsUsed);
     }
   }
-  // Remove areas initially classified as NoData in the original DEM (only really necessary for irregular shaped datasets)
-  for (int i=0; i < NRows; ++i)
+  ModelRaster.P_DFT = SumP_DFT;
+  ModelRaster.fit_wiener_noise_model(c_model, m_model, WhiteNoiseAmplitude);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The blending weight along one axis. Within TileOverlap cells of an edge
+// that is shared with another tile the weight follows a raised cosine over the
+// 2*TileOverlap cells either side of the edge; at the edge of the DEM it is 1.
+// Needs TileOverlap <= (tile_end-tile_start)/2 so the two ramps don't meet.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+float LSDRasterSpectral::get_tile_blend_weight(int pos, int tile_start, int tile_end,
+                                               int N, int TileOverlap)
+{
+  double PI = 3.14159265358979;
+  double RampLength = 2*TileOverlap;
+  if (tile_start > 0 && pos < tile_start+TileOverlap)
   {
-    for (int j=0; j < NCols; ++j)
+    if (pos < tile_start-TileOverlap)
     {
-      if(RasterData[i][j]==NoDataValue) FilteredTopography[i][j] = NoDataValue;
+      return 0;
     }
+    double x = pos-(tile_start-TileOverlap)+0.5;
+    return float(0.5-0.5*cos(PI*x/RampLength));
   }
-  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  LSDRaster FilteredTopographyRaster(NRows,NCols,XMinimum,YMinimum,DataResolution,NoDataValue,FilteredTopography,GeoReferencingStrings);
+  if (tile_end < N && pos >= tile_end-TileOverlap)
+  {
+    if (pos >= tile_end+TileOverlap)
+    {
+      return 0;
+    }
+    double x = pos-(tile_end-TileOverlap)+0.5;
+    return float(0.5+0.5*cos(PI*x/RampLength));
+  }
+  return 1;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The workhorse of the tiled Wiener filter. The tiles are done one after the
+// other; each one uses all the threads for its transforms and pixel loops.
+// The tiling does not depend on the number of threads, but FFTW plans made for
+// a different number of threads can round differently, so the filtered values
+// can change in the last bits with the number of FFTW threads.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDRasterSpectral::wiener_filter_tiles(bool read_from_file, string filename, string extension,
+                                            int TileSize, int TileOverlap, bool GlobalNoiseModel,
+                                            int NoiseWindowSize, Array2D<float>& FilteredZeta)
+{
+  if (TileSize < 2)
+  {
+    TileSize = 2;
+  }
+  if (TileOverlap < 0)
+  {
+    TileOverlap = 0;
+  }
+  if (TileOverlap > TileSize/2)
+  {
+    cout << "Warning: the Wiener tile overlap is more than half the tile size. "
+         << "Setting it to " << TileSize/2 << endl;
+    TileOverlap = TileSize/2;
+  }
+  // without a noise window each tile fits the model to its own window
+  bool FitToTileWindow = (NoiseWindowSize <= 0);
+  if (FitToTileWindow)
+  {
+    NoiseWindowSize = TileSize+2*TileOverlap;
+  }
+  if (NoiseWindowSize*DataResolution < 1000)
+  {
+    cout << "Warning: the Wiener noise window is less than 1 km across. The signal "
+         << "model is fitted at wavelengths of 100 to 1000 m, so it may be poorly constrained." << endl;
+  }
+  int NTileRows = (NRows+TileSize-1)/TileSize;
+  int NTileCols = (NCols+TileSize-1)/TileSize;
+  int NTiles = NTileRows*NTileCols;
+
+  float c_model = 0;
+  float m_model = 0;
+  float WhiteNoiseAmplitude = 0;
+  if (GlobalNoiseModel)
+  {
+    fit_wiener_noise_model_to_windows(read_from_file, filename, extension, NoiseWindowSize,
+                                      c_model, m_model, WhiteNoiseAmplitude);
+  }
+
+  Array2D<float> Filtered(NRows,NCols,0.0);
+  for (int tile = 0; tile<NTiles; ++tile)
+  {
+    cout << "  Wiener filtering tile " << tile+1 << " of " << NTiles << endl;
+    int tile_row_start = (tile/NTileCols)*TileSize;
+    int tile_col_start = (tile%NTileCols)*TileSize;
+    int tile_row_end = min(tile_row_start+TileSize,NRows);
+    int tile_col_end = min(tile_col_start+TileSize,NCols);
+
+    // the tile plus its margin, clipped to the DEM
+    int row_start = max(tile_row_start-TileOverlap,0);
+    int col_start = max(tile_col_start-TileOverlap,0);
+    int n_rows = min(tile_row_end+TileOverlap,NRows)-row_start;
+    int n_cols = min(tile_col_end+TileOverlap,NCols)-col_start;
+
+    int NDataCells;
+    LSDRasterSpectral Window = load_spectral_window(read_from_file, filename, extension,
+                                     row_start, col_start, n_rows, n_cols, NDataCells);
+    Array2D<float> FilteredWindow(n_rows,n_cols,NoDataValue);
+    if (NDataCells > 0)
+    {
+      Array2D<float> trend_plane;
+      Array2D< complex<float> > Spectrum;
+      Window.WSS = 1; // dataset is not windowed
+      Window.get_detrended_half_spectrum(trend_plane, Spectrum);
+
+      bool HaveModel = GlobalNoiseModel;
+      if (not GlobalNoiseModel && not FitToTileWindow)
+      {
+        // the noise window is centred on the tile and kept inside the DEM
+        int noise_rows = min(NoiseWindowSize,NRows);
+        int noise_cols = min(NoiseWindowSize,NCols);
+        int noise_row_start = (tile_row_start+tile_row_end)/2 - noise_rows/2;
+        int noise_col_start = (tile_col_start+tile_col_end)/2 - noise_cols/2;
+        noise_row_start = max(0,min(noise_row_start,NRows-noise_rows));
+        noise_col_start = max(0,min(noise_col_start,NCols-noise_cols));
+        HaveModel = fit_wiener_noise_model_to_window(read_from_file, filename, extension,
+                                    noise_row_start, noise_col_start, noise_rows, noise_cols,
+                                    c_model, m_model, WhiteNoiseAmplitude);
+      }
+
+      if (HaveModel)
+      {
+        Window.wiener_filter(Spectrum, c_model, m_model, WhiteNoiseAmplitude);
+      }
+      else
+      {
+        // fit the model to the filtering window itself
+        Window.wiener_filter(Spectrum);
+      }
+      FilteredWindow = Window.get_filtered_topography(Spectrum, trend_plane);
+    }
+
+    // blend the window into the DEM. NoData is the same in every window
+    // that covers a cell, so once a cell is NoData it stays NoData.
+    #pragma omp parallel for schedule(static)
+    for (int row = 0; row<n_rows; ++row)
+    {
+      int i = row_start+row;
+      float row_weight = get_tile_blend_weight(i, tile_row_start, tile_row_end,
+                                               NRows, TileOverlap);
+      for (int col = 0; col<n_cols; ++col)
+      {
+        int j = col_start+col;
+        if (Filtered[i][j] == NoDataValue)
+        {
+          continue;
+        }
+        if (FilteredWindow[row][col] == NoDataValue)
+        {
+          Filtered[i][j] = NoDataValue;
+        }
+        else
+        {
+          float weight = row_weight*get_tile_blend_weight(j, tile_col_start, tile_col_end,
+                                                          NCols, TileOverlap);
+          Filtered[i][j] += weight*FilteredWindow[row][col];
+        }
+      }
+    }
+  }
+  FilteredZeta = Filtered;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Tiled Wiener filter of a DEM held in memory. See wiener_filter_tiles.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+LSDRaster LSDRasterSpectral::fftw2D_wiener_tiled(int TileSize, int TileOverlap,
+                                                 bool GlobalNoiseModel, int NoiseWindowSize)
+{
+  Array2D<float> FilteredZeta;
+  wiener_filter_tiles(false, "NULL", "NULL", TileSize, TileOverlap, GlobalNoiseModel,
+                      NoiseWindowSize, FilteredZeta);
+
+  LSDRaster FilteredTopographyRaster(NRows,NCols,XMinimum,YMinimum,DataResolution,NoDataValue,FilteredZeta,GeoReferencingStrings);
   return FilteredTopographyRaster;
 }
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Tiled Wiener filter of a DEM read from disk one window at a time, so the
+// unfiltered DEM is never held in memory. The filtered DEM is loaded into
+// this raster. See wiener_filter_tiles.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDRasterSpectral::read_raster_and_fftw2D_wiener_tiled(string filename, string extension,
+                                        int TileSize, int TileOverlap, bool GlobalNoiseModel,
+                                        int NoiseWindowSize)
+{
+  LSDRasterInfo RasterInfo(filename, extension);
+  NRows = RasterInfo.get_NRows();
+  NCols = RasterInfo.get_NCols();
+  XMinimum = RasterInfo.get_XMinimum();
+  YMinimum = RasterInfo.get_YMinimum();
+  DataResolution = RasterInfo.get_DataResolution();
+  NoDataValue = RasterInfo.get_NoDataValue();
+  GeoReferencingStrings = RasterInfo.get_GeoReferencingStrings();
+  Ly = get_fft_padded_size(NRows);
+  Lx = get_fft_padded_size(NCols);
+  dfx = 1/(DataResolution*float(Lx));
+  dfy = 1/(DataResolution*float(Ly));
+  NyquistFreq = 1/(2*DataResolution);
+  WSS=float(NRows)*float(NCols);
+
+  Array2D<float> FilteredZeta;
+  wiener_filter_tiles(true, filename, extension, TileSize, TileOverlap, GlobalNoiseModel,
+                      NoiseWindowSize, FilteredZeta);
+  RasterData = FilteredZeta;
+}
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 // SPECTRUM NORMALISATION - following Perron et al., 2008
@@ -2158,8 +2960,7 @@ void LSDRasterSpectral::calculate_background_spectrum(float rollover_frequency,
   float range = 1.0;
   //int feature_order = 7;
   float RadialFreq;
-  Array2D<float> SpectrumReal(Ly,Lx,0.0);
-  Array2D<float> SpectrumImaginary(Ly,Lx,0.0);
+  Array2D< complex<float> > Spectrum;
   Array2D<float> fractal_raster_array(Ly,Lx,0.0);      
   Array2D<float> fractal_raster_clip(NRows,NCols,0.0);         
   Array2D<float> fractal_raster_dt(NRows,NCols,0.0);          
@@ -2168,7 +2969,6 @@ void LSDRasterSpectral::calculate_background_spectrum(float rollover_frequency,
   Array2D<float> trend_plane(NRows,NCols,0.0);
   Array2D<float> window(NRows,NCols,0.0);     
   float mean_fractal,variance_fractal,mean_topo,variance_topo,mean_dt,variance_dt;
-  int transform_direction;
   mean_topo = get_mean_ignore_ndv(RasterData, NoDataValue);
   variance_topo = get_variance_ignore_ndv(RasterData, NoDataValue, mean_topo);
   detrend2D(RasterData, raster_dt, trend_plane);
@@ -2185,17 +2985,13 @@ void LSDRasterSpectral::calculate_background_spectrum(float rollover_frequency,
     fractal_raster_array = fractal_raster.get_RasterData();
     
     // perform the forward fourier annalysis
-    transform_direction = -1;   // this means it will be a forward transform
-    fractal_raster.dfftw2D_fwd(fractal_raster_array, SpectrumReal, SpectrumImaginary,transform_direction);
+    fractal_raster.sfftw2D_fwd(fractal_raster_array, Spectrum);
     
-    // Now scale spectrum
-    fractal_raster.shift_spectrum(SpectrumReal, SpectrumImaginary);
-    fractal_raster.scale_spectrum(SpectrumReal, SpectrumImaginary,  sub_rollover_beta/2); 
-    fractal_raster.shift_spectrum_inv(SpectrumReal, SpectrumImaginary);
+    // Now scale spectrum (the half spectrum doesn't need shifting)
+    fractal_raster.scale_spectrum(Spectrum, sub_rollover_beta/2); 
     
     //now perform inverse transform
-    transform_direction = 1;   // this means it will be a reverse transform
-    fractal_raster.dfftw2D_inv(SpectrumReal, SpectrumImaginary, fractal_raster_array, transform_direction);
+    fractal_raster.sfftw2D_inv(Spectrum, fractal_raster_array);
     
     // Now clip the raster to the same size as the reference topography
     for (int i=0;i<NRows;++i)
@@ -2250,15 +3046,12 @@ void LSDRasterSpectral::calculate_background_spectrum(float rollover_frequency,
     }
     
     // perform the forward fourier analysis
-    transform_direction = -1;   // this means it will be a forward transform
-    fractal_clip.dfftw2D_fwd(fractal_raster_padded, SpectrumReal, SpectrumImaginary,transform_direction);
-    // Now compute the periodogram of this spectrum
-    fractal_clip.shift_spectrum(SpectrumReal, SpectrumImaginary);
+    fractal_clip.sfftw2D_fwd(fractal_raster_padded, Spectrum);
 
     // CALCULATE THE DFT PERIODOGRAM
     // Multiply output by complex conjugate and normalise.
     // Note that for complex number z=x+iy, z*=x-iy, z.z* = x^2 + y^2
-    fractal_clip.calculate_2D_PSD(SpectrumReal, SpectrumImaginary); 
+    fractal_clip.calculate_2D_PSD(Spectrum); 
     //float variance_ratio = 0;
     float variance_fractal_spectrum=0;
     float variance_topo_spectrum=0;
@@ -2347,7 +3140,7 @@ void LSDRasterSpectral::full_spectral_analysis(float log_bin_width, int N_iterat
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
   // 2D DISCRETE FAST FOURIER TRANSFORM
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // PAD DATA WITH ZEROS TO A POWER OF TWO (facilitates FFT)
+  // PAD DATA WITH ZEROS TO A 7-SMOOTH SIZE (facilitates FFT)
   Array2D<float> zeta_padded(Ly,Lx,0.0);
   for (int i=0;i<Ly;++i)
   {
@@ -2361,15 +3154,9 @@ void LSDRasterSpectral::full_spectral_analysis(float log_bin_width, int N_iterat
   }
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
   // DO 2D FORWARD FAST FOURIER TRANSFORM
-  int transform_direction = -1;
-  Array2D<float> SpectrumReal(Ly,Lx,0.0);
-  Array2D<float> SpectrumImaginary(Ly,Lx,0.0);
+  Array2D< complex<float> > Spectrum;
   cout << "\t Forward transform" << endl;
-  dfftw2D_fwd(zeta_padded, SpectrumReal, SpectrumImaginary, transform_direction);
-  //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  // REARRANGE SPECTRUM SO THAT ORIGIN IS AT THE CENTRE
-  cout << "\t Shifting spectrum..." << endl;
-  shift_spectrum(SpectrumReal, SpectrumImaginary);                                               
+  sfftw2D_fwd(zeta_padded, Spectrum);
   
   // CALCULATE THE DFT PERIODOGRAM
   // Multiply output by complex conjugate and normalise.
@@ -2378,7 +3165,8 @@ void LSDRasterSpectral::full_spectral_analysis(float log_bin_width, int N_iterat
   float mean = get_mean_ignore_ndv(zeta_window, NoDataValue);
   float variance_hann =  get_variance_ignore_ndv(zeta_window, NoDataValue, mean);
   
-  calculate_2D_PSD(SpectrumReal, SpectrumImaginary);
+  // The shifted periodogram is built straight from the half spectrum
+  calculate_2D_PSD(Spectrum);
   // now get the total of the P_DFT
   float total_power = 0;
   for (int row = 0; row<NRows; row++)
@@ -2522,6 +3310,16 @@ LSDIndexRaster LSDRasterSpectral::IsolateChannelsWienerQQ(float area_threshold,
   //float slope_percentile = 90;
   //float dt = 0.1;
   LSDRaster FilteredTopo = fftw2D_wiener();
+  return IsolateChannelsWienerQQ(FilteredTopo, area_threshold, window_radius, q_q_filename);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// As above, starting from a DEM that has already been Wiener filtered (for
+// example tile by tile with fftw2D_wiener_tiled)
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+LSDIndexRaster LSDRasterSpectral::IsolateChannelsWienerQQ(LSDRaster& FilteredTopo, float area_threshold,
+                                                          float window_radius, string q_q_filename)
+{
   // calculate curvature
   vector<LSDRaster> output_rasters;
 //  float window_radius = 1;
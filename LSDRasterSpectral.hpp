@@ -72,6 +72,7 @@
 
 #include <string>
 #include <vector>   
+#include <map>
 #include <complex>
 
 #include "TNT/tnt.h"
@@ -82,6 +83,10 @@ using namespace TNT;
 #ifndef LSDRasterSpectral_H
 #define LSDRasterSpectral_H
 
+// FFTW plans are pointers to these (see fftw3.h)
+struct fftw_plan_s;
+struct fftwf_plan_s;
+
 /// @brief This object performs spectral analysis.
 class LSDRasterSpectral: public LSDRaster
 {
@@ -136,6 +141,13 @@ public:
   // Fourier helper functions
   // these functions are used to manipulate fourier transformed data
 
+  /// @brief This returns the size to which a dimension is padded before it
+  /// is Fourier transformed: the smallest integer >= N with no prime factors
+  /// other than 2, 3, 5 and 7.
+  /// @param N the unpadded number of rows or columns
+  /// @return the padded size
+  static int get_fft_padded_size(int N);
+
   /// @brief This returns the frequency values of an UNSHIFTED DFT along the rows.
   /// @return A float vector containing the frequency
   /// @author SMM
@@ -224,6 +236,59 @@ public:
   /// @author DAV
   /// @date 22/10/2014
   void dfftw2D_inv_complex(Array2D< complex<float> >& InputArrayComplex, Array2D<float>& OutputArray, int transform_direction);
+
+  /// @brief Computes the single precision real-to-complex forward fast fourier
+  /// transform of a 2D discrete dataset.
+  ///
+  /// @details Since the input is real the spectrum is Hermitian, so only the
+  /// non-redundant half is returned. It is not shifted: element [i][j] holds
+  /// the row wavenumber i (or i-Ly above the Nyquist row) and the column
+  /// wavenumber j, for j = 0 to Lx/2.
+  /// @param InputArray = zeta_padded (padded DEM), Ly rows by Lx columns.
+  /// @param OutputSpectrum = half spectrum, Ly rows by Lx/2+1 columns.
+  void sfftw2D_fwd(Array2D<float>& InputArray, Array2D< complex<float> >& OutputSpectrum);
+
+  /// @brief Computes the single precision complex-to-real inverse fast fourier
+  /// transform of a half spectrum produced by sfftw2D_fwd().
+  ///
+  /// @details As with dfftw2D_inv() the output is not normalised, so it
+  /// needs to be divided by Lx*Ly.
+  /// @param InputSpectrum = half spectrum, Ly rows by Lx/2+1 columns.
+  /// @param OutputArray = reconstructed DEM, Ly rows by Lx columns.
+  void sfftw2D_inv(Array2D< complex<float> >& InputSpectrum, Array2D<float>& OutputArray);
+
+  /// @brief Gets the radial frequency of an element of an unshifted half spectrum.
+  /// @param row Row in the half spectrum.
+  /// @param col Column in the half spectrum.
+  /// @return The radial frequency. It is the same as that of the corresponding
+  /// element of the shifted full spectrum.
+  float get_half_spectrum_frequency(int row, int col);
+
+  /// @brief Loads FFTW wisdom saved by export_fftw_wisdom().
+  ///
+  /// @details With wisdom loaded, plans for grid shapes seen in an earlier run
+  /// are made without measuring. The wisdom files are
+  /// wisdom_prefix+"_fftw.wisdom" (double precision) and
+  /// wisdom_prefix+"_fftwf.wisdom" (single precision). Missing files are
+  /// skipped.
+  /// @param wisdom_prefix The path and prefix of the wisdom files.
+  static void import_fftw_wisdom(string wisdom_prefix);
+
+  /// @brief Saves the FFTW wisdom gathered so far so later runs can skip planning.
+  /// @param wisdom_prefix The path and prefix of the wisdom files.
+  static void export_fftw_wisdom(string wisdom_prefix);
+
+  /// @brief Destroys all the cached FFTW plans.
+  static void clear_fftw_plan_cache();
+
+  /// @brief Sets the number of threads FFTW uses for each transform.
+  ///
+  /// @details This needs to be called before any other FFTW call (including
+  /// import_fftw_wisdom()). Cached plans made with a different number of
+  /// threads are discarded. Plans for different numbers of threads can round
+  /// differently, so transforms may change in the last bits with n_threads.
+  /// @param n_threads The number of threads. Values below 1 are treated as 1.
+  static void set_fftw_threads(int n_threads);
   
   /// @brief Detrend Data.
   ///
@@ -324,6 +389,13 @@ public:
   /// @author David Milodowski
   /// @date 18/12/2012
   void calculate_2D_PSD(Array2D<float>& spectrum_real_shift, Array2D<float>& spectrum_imaginary_shift);
+
+  /// @brief CALCULATE THE DFT PERIODOGRAM FROM A HALF SPECTRUM.
+  ///
+  /// @details Same as above, but the full shifted periodogram is filled in from
+  /// the half spectrum returned by sfftw2D_fwd() using its Hermitian symmetry.
+  /// @param HalfSpectrum Unshifted half spectrum.
+  void calculate_2D_PSD(Array2D< complex<float> >& HalfSpectrum);
     
   /// @brief SCALE SPECTRUM
   ///
@@ -334,6 +406,13 @@ public:
   /// @author David Milodowski
   /// @date 30/10/2014
   void scale_spectrum(Array2D<float> SpectrumReal, Array2D<float> SpectrumIm,  float beta);
+
+  /// @brief SCALE HALF SPECTRUM
+  ///
+  /// @details Scales an unshifted half spectrum by 1/f^beta.
+  /// @param HalfSpectrum
+  /// @param beta
+  void scale_spectrum(Array2D< complex<float> >& HalfSpectrum, float beta);
     
   /// @brief GET RADIAL POWER SPECTRUM.
   ///
@@ -441,6 +520,22 @@ public:
          Array2D<float>& FilteredSpectrumReal, Array2D<float>& FilteredSpectrumImaginary,
          float f1, float f2);
 
+  /// @brief Gets the weight of one of the filters above at a radial frequency.
+  /// @param FilterType 1 = bandpass, 2 = lowpass, 3 = highpass,
+  /// 4 = lowpass remainder, 5 = highpass remainder.
+  /// @param f Radial frequency.
+  /// @param f1
+  /// @param f2
+  /// @return The filter weight.
+  float get_filter_weight(int FilterType, float f, float f1, float f2);
+
+  /// @brief Applies one of the filters above in place to an unshifted half spectrum.
+  /// @param HalfSpectrum
+  /// @param FilterType See get_filter_weight().
+  /// @param f1
+  /// @param f2
+  void filter_half_spectrum(Array2D< complex<float> >& HalfSpectrum, int FilterType, float f1, float f2);
+
   /// @brief WIENER FILTER.
   ///
   /// @details The Wiener filter is a spectral filter that removes noise from an image or DEM.
@@ -456,6 +551,28 @@ public:
   void wiener_filter(Array2D<float>& RawSpectrumReal, Array2D<float>& RawSpectrumImaginary,
          Array2D<float>& FilteredSpectrumReal, Array2D<float>& FilteredSpectrumImaginary);
 
+  /// @brief WIENER FILTER applied in place to an unshifted half spectrum.
+  /// @param HalfSpectrum
+  void wiener_filter(Array2D< complex<float> >& HalfSpectrum);
+
+  /// @brief WIENER FILTER applied in place to an unshifted half spectrum
+  /// using a signal and noise model that has already been fitted.
+  /// @param HalfSpectrum
+  /// @param c_model Coefficient of the signal model c_model*f^m_model.
+  /// @param m_model Exponent of the signal model.
+  /// @param WhiteNoiseAmplitude Amplitude of the noise.
+  void wiener_filter(Array2D< complex<float> >& HalfSpectrum, float c_model,
+                     float m_model, float WhiteNoiseAmplitude);
+
+  /// @brief Fits the signal and white noise models used by the Wiener filter.
+  ///
+  /// @details P_DFT needs to have been calculated. The signal model is
+  /// c_model*f^m_model.
+  /// @param c_model Output coefficient of the signal model.
+  /// @param m_model Output exponent of the signal model.
+  /// @param WhiteNoiseAmplitude Output amplitude of the noise.
+  void fit_wiener_noise_model(float& c_model, float& m_model, float& WhiteNoiseAmplitude);
+
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
   // MAIN FUNCTIONS USING SPECTRAL FILTERS
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -540,6 +657,40 @@ public:
   /// @date 18/12/2012
   LSDRaster fftw2D_wiener();
 
+  /// @brief Wiener filters the DEM in overlapping tiles, so that only tile
+  /// sized spectral arrays are held in memory at any one time.
+  ///
+  /// @details Each tile is filtered along with a margin of TileOverlap cells
+  /// on every side, and is detrended on its own. The filtered windows are
+  /// blended back together with a raised cosine taper across the overlaps.
+  /// The tapers of neighbouring tiles sum to one.
+  /// If GlobalNoiseModel is true the signal and noise models are fitted once,
+  /// to the periodogram averaged over square windows of NoiseWindowSize cells
+  /// laid across the DEM. Otherwise they are fitted for each tile to a window
+  /// of NoiseWindowSize cells centred on the tile. If NoiseWindowSize <= 0 the
+  /// filtering window of a tile (TileSize+2*TileOverlap) is used. The signal
+  /// model is fitted between wavelengths of 100 m and 1000 m, so the noise
+  /// windows should be at least a kilometre across.
+  /// @param TileSize The number of rows and columns in each tile.
+  /// @param TileOverlap The margin filtered around each tile. At most TileSize/2.
+  /// @param GlobalNoiseModel Fit one noise model for the whole DEM.
+  /// @param NoiseWindowSize The size of the windows the noise model is fitted to.
+  /// @return The filtered LSDRaster.
+  LSDRaster fftw2D_wiener_tiled(int TileSize, int TileOverlap, bool GlobalNoiseModel,
+                                int NoiseWindowSize);
+
+  /// @brief Reads a DEM from disk one window at a time and Wiener filters it
+  /// in tiles (see fftw2D_wiener_tiled). The unfiltered DEM is never held in
+  /// memory; the filtered DEM is loaded into this raster.
+  /// @param filename a string of the filename _without_ the extension.
+  /// @param extension a string of the extension _without_ the leading dot
+  /// @param TileSize The number of rows and columns in each tile.
+  /// @param TileOverlap The margin filtered around each tile. At most TileSize/2.
+  /// @param GlobalNoiseModel Fit one noise model for the whole DEM.
+  /// @param NoiseWindowSize The size of the windows the noise model is fitted to.
+  void read_raster_and_fftw2D_wiener_tiled(string filename, string extension, int TileSize,
+                                int TileOverlap, bool GlobalNoiseModel, int NoiseWindowSize);
+
   //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
   // FUNCTIONS TO PRINT RADIAL SPECTRA
   //------------------------------------------------------------------------------
@@ -564,6 +715,15 @@ public:
   /// @author DTM
   /// @date 10/07/2015
   LSDIndexRaster IsolateChannelsWienerQQ(float area_threshold, float window_radius, string q_q_filename);
+
+  /// @brief As above, but starting from a DEM that has already been Wiener
+  /// filtered, for example with fftw2D_wiener_tiled.
+  /// @param FilteredTopo The Wiener filtered DEM.
+  /// @param a catchment area threshold for pruning
+  /// @param a window radius for surface fitting from which curvature calculation is performed
+  /// @return LSDIndexRaster A binary raster where the pixel value is 1 where the input raster exceeded the defined threshold
+  LSDIndexRaster IsolateChannelsWienerQQ(LSDRaster& FilteredTopo, float area_threshold,
+                                         float window_radius, string q_q_filename);
   LSDIndexRaster IsolateChannelsWienerQQAdaptive(float area_threshold, float window_radius, string q_q_filename);
 
 protected:
@@ -584,6 +744,78 @@ protected:
   vector<float> R_sq;
   vector<float> beta;
 
+  /// @brief Gets a double precision complex plan, planning it the first time
+  /// a shape and direction is asked for.
+  /// @param ny Number of rows.
+  /// @param nx Number of columns.
+  /// @param transform_direction -1 = forward, 1 = inverse.
+  /// @return The plan. Execute it with fftw_execute_dft on fftw_malloc'd arrays.
+  static fftw_plan_s* get_dfftw2D_plan(int ny, int nx, int transform_direction);
+
+  /// @brief Gets a single precision plan, planning it the first time
+  /// a shape and direction is asked for.
+  /// @param ny Number of rows.
+  /// @param nx Number of columns.
+  /// @param transform_direction -1 = forward (r2c), 1 = inverse (c2r).
+  /// @return The plan. Execute it with fftwf_execute_dft_r2c or
+  /// fftwf_execute_dft_c2r on fftwf_malloc'd arrays.
+  static fftwf_plan_s* get_sfftw2D_plan(int ny, int nx, int transform_direction);
+
+  /// Cached double precision plans, keyed by {transform_direction, ny, nx}.
+  static map< vector<int>, fftw_plan_s* > DoublePlanCache;
+
+  /// Cached single precision plans, keyed by {transform_direction, ny, nx}.
+  static map< vector<int>, fftwf_plan_s* > FloatPlanCache;
+
+  /// The number of threads FFTW plans are made with.
+  static int FFTWThreads;
+
+  /// @brief Detrends RasterData, pads it with zeros to Ly by Lx and returns
+  /// its half spectrum.
+  void get_detrended_half_spectrum(Array2D<float>& trend_plane,
+                                   Array2D< complex<float> >& Spectrum);
+
+  /// @brief Inverse transforms a filtered half spectrum, adds the trend back
+  /// and returns the NRows by NCols topography, with NoData where RasterData
+  /// has NoData.
+  Array2D<float> get_filtered_topography(Array2D< complex<float> >& Spectrum,
+                                         Array2D<float>& trend_plane);
+
+  /// @brief Loads a window of the DEM, either from RasterData or, if
+  /// read_from_file is true, from disk. The window must lie inside the DEM.
+  /// NDataCells returns the number of cells in the window that are not NoData.
+  LSDRasterSpectral load_spectral_window(bool read_from_file, string filename,
+                                         string extension, int row_start, int col_start,
+                                         int n_rows, int n_cols, int& NDataCells);
+
+  /// @brief Fits the Wiener signal and noise models to a window of the DEM.
+  /// Returns false, leaving the models unchanged, if the window has no data.
+  bool fit_wiener_noise_model_to_window(bool read_from_file, string filename,
+                                        string extension, int row_start, int col_start,
+                                        int n_rows, int n_cols, float& c_model,
+                                        float& m_model, float& WhiteNoiseAmplitude);
+
+  /// @brief Fits the Wiener signal and noise models to the periodogram
+  /// averaged over square windows of NoiseWindowSize cells laid across the DEM.
+  void fit_wiener_noise_model_to_windows(bool read_from_file, string filename,
+                                         string extension, int NoiseWindowSize,
+                                         float& c_model, float& m_model,
+                                         float& WhiteNoiseAmplitude);
+
+  /// @brief The weight of the tile spanning [tile_start, tile_end) at pos,
+  /// along one axis of length N, for blending tiles that overlap by
+  /// TileOverlap cells on each side.
+  static float get_tile_blend_weight(int pos, int tile_start, int tile_end,
+                                     int N, int TileOverlap);
+
+  /// @brief The tiled Wiener filter used by fftw2D_wiener_tiled and
+  /// read_raster_and_fftw2D_wiener_tiled. NRows, NCols, DataResolution and
+  /// NoDataValue must already be set. FilteredZeta is replaced by the
+  /// filtered DEM.
+  void wiener_filter_tiles(bool read_from_file, string filename, string extension,
+                           int TileSize, int TileOverlap, bool GlobalNoiseModel,
+                           int NoiseWindowSize, Array2D<float>& FilteredZeta);
+
 private:
   void create();
   void create(string filename, string extension);
@@ -58,6 +58,7 @@
 #include <functional> // For string splitter
 #include <iostream>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
 #include <cmath>
 #include <ctime>
@@ -5927,19 +5928,373 @@ void Count_Instances(vector<int> Data, vector<int> Key_Values, map<int,int>& Dat
 // This gets the size of a file.
 // From http://stackoverflow.com/questions/5840148/how-can-i-get-a-files-size-in-c
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
-int get_file_size(string filename) // path to file
+long get_file_size(string filename) // path to file
 {
     //cout << "Opening file: " << filename << endl;
     FILE *p_file = NULL;
     p_file = fopen(filename.c_str(),"rb");
+    if (p_file == NULL)
+    {
+      return 0;
+    }
     fseek(p_file,0,SEEK_END);
     //cout << "Getting the end" << endl;
-    int size = ftell(p_file);
+    long size = ftell(p_file);
     fclose(p_file);
     return size;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+// Returns the number of bytes per element of an ENVI data type code
+// (1 = byte, 2 = int16, 3 = int32, 4 = float32, 5 = float64, 12 = uint16,
+// 13 = uint32, 14 = int64, 15 = uint64). Returns 0 for unsupported codes.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+int get_ENVI_data_type_size(int DataType)
+{
+  switch (DataType)
+  {
+    case 1:  return 1;
+    case 2:  return 2;
+    case 3:  return 4;
+    case 4:  return 4;
+    case 5:  return 8;
+    case 12: return 2;
+    case 13: return 4;
+    case 14: return 8;
+    case 15: return 8;
+    default: return 0;
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+// Guesses the data type of an ENVI raster whose header gives a code that
+// get_ENVI_data_type_size does not support, from the size of the data file.
+// 1 and 2 byte elements are read as byte and int16. Integer rasters read
+// 8 byte elements as int64 and anything else as int32; float rasters read
+// them as float64 and float32.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+int guess_ENVI_data_type(string filename, long HeaderOffset, int NRows, int NCols,
+                         bool IntegerData)
+{
+  long rc = get_file_size(filename)-HeaderOffset;
+  long DataSize = rc/(long(NRows)*long(NCols));
+  if (DataSize == 1)
+  {
+    return 1;
+  }
+  else if (DataSize == 2)
+  {
+    return 2;
+  }
+  else if (DataSize == 8)
+  {
+    return (IntegerData) ? 14 : 5;
+  }
+  else
+  {
+    return (IntegerData) ? 3 : 4;
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+// Returns the ENVI byte order code of the machine we are running on
+// (0 = little endian, 1 = big endian)
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+int get_host_byte_order()
+{
+  unsigned int test_int = 1;
+  unsigned char first_byte;
+  memcpy(&first_byte, &test_int, 1);
+  return (first_byte == 1) ? 0 : 1;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+// A 64 bit FNV-1a style hash of a block of memory. The data is consumed eight
+// bytes at a time, so this is fast enough to checksum whole rasters. Pass the
+// result of a previous call as the seed to hash several blocks; the first call
+// should use the default seed.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+unsigned long long hash_bytes(const char* data, long NBytes, unsigned long long seed)
+{
+  const unsigned long long prime = 1099511628211ULL;
+  unsigned long long hash = seed;
+  unsigned long long word;
+  long NWords = NBytes/8;
+  for (long i = 0; i<NWords; i++)
+  {
+    memcpy(&word, data+i*8, 8);
+    hash = (hash^word)*prime;
+  }
+  for (long i = NWords*8; i<NBytes; i++)
+  {
+    hash = (hash^(unsigned char)(data[i]))*prime;
+  }
+  return hash;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+// Reverses the bytes of NElements consecutive elements, each ElementSize
+// bytes long, in place
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+void swap_byte_order(char* buffer, int ElementSize, long NElements)
+{
+  for (long i = 0; i<NElements; i++)
+  {
+    reverse(buffer+i*ElementSize, buffer+(i+1)*ElementSize);
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+// Casts a block of raw ENVI data of type DataType into the destination type
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+template<class T, class S>
+void cast_ENVI_block(const char* buffer, long NElements, T* Data)
+{
+  for (long i = 0; i<NElements; i++)
+  {
+    S temp;
+    memcpy(&temp, buffer+i*long(sizeof(S)), sizeof(S));
+    Data[i] = T(temp);
+  }
+}
+
+template<class T>
+bool cast_ENVI_block(int DataType, const char* buffer, long NElements, T* Data)
+{
+  switch (DataType)
+  {
+    case 1:  cast_ENVI_block<T,unsigned char>(buffer,NElements,Data);  break;
+    case 2:  cast_ENVI_block<T,short>(buffer,NElements,Data);          break;
+    case 3:  cast_ENVI_block<T,int>(buffer,NElements,Data);            break;
+    case 4:  cast_ENVI_block<T,float>(buffer,NElements,Data);          break;
+    case 5:  cast_ENVI_block<T,double>(buffer,NElements,Data);         break;
+    case 12: cast_ENVI_block<T,unsigned short>(buffer,NElements,Data); break;
+    case 13: cast_ENVI_block<T,unsigned int>(buffer,NElements,Data);   break;
+    case 14: cast_ENVI_block<T,long long>(buffer,NElements,Data);      break;
+    case 15: cast_ENVI_block<T,unsigned long long>(buffer,NElements,Data); break;
+    default: return false;
+  }
+  return true;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+// The workhorse of the ENVI binary readers. Reads a contiguous run of
+// NElements from the current position of an open stream.
+// If the data on disk already has the type of the destination it is read
+// with a single bulk read directly into Data. Otherwise it is read
+// in fixed size chunks that are swapped and cast into Data, so that we never
+// hold a second full copy of the raster.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+template<class T>
+bool read_ENVI_run(ifstream& ifs_data, int DataType, bool swap_bytes,
+                   long NElements, int NativeDataType, T* Data)
+{
+  int ElementSize = get_ENVI_data_type_size(DataType);
+  if (DataType == NativeDataType)
+  {
+    // fast path: one read straight into the destination
+    ifs_data.read(reinterpret_cast<char*>(Data), NElements*long(sizeof(T)));
+    if (ifs_data.gcount() != NElements*long(sizeof(T)))
+    {
+      return false;
+    }
+    if (swap_bytes)
+    {
+      swap_byte_order(reinterpret_cast<char*>(Data), ElementSize, NElements);
+    }
+  }
+  else
+  {
+    // conversion path: go through a bounded buffer
+    long ChunkElements = min(NElements, long(1048576));
+    vector<char> buffer(ChunkElements*ElementSize);
+    long NRead = 0;
+    while (NRead < NElements)
+    {
+      long this_chunk = min(ChunkElements, NElements-NRead);
+      ifs_data.read(&buffer[0], this_chunk*ElementSize);
+      if (ifs_data.gcount() != this_chunk*ElementSize)
+      {
+        return false;
+      }
+      if (swap_bytes)
+      {
+        swap_byte_order(&buffer[0], ElementSize, this_chunk);
+      }
+      cast_ENVI_block(DataType, &buffer[0], this_chunk, Data+NRead);
+      NRead += this_chunk;
+    }
+  }
+  return true;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+// Reads NElements from the start of the data in a binary raster file
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+template<class T>
+bool read_ENVI_binary_data_template(string filename, int DataType, int ByteOrder,
+                                    long HeaderOffset, long NElements,
+                                    int NativeDataType, T* Data)
+{
+  int ElementSize = get_ENVI_data_type_size(DataType);
+  if (ElementSize == 0)
+  {
+    cout << "read_ENVI_binary_data: unsupported ENVI data type " << DataType << endl;
+    return false;
+  }
+
+  ifstream ifs_data(filename.c_str(), ios::in | ios::binary);
+  if( ifs_data.fail() )
+  {
+    cout << "\nFATAL ERROR: the data file \"" << filename
+         << "\" doesn't exist" << endl;
+    exit(EXIT_FAILURE);
+  }
+  if (HeaderOffset > 0)
+  {
+    ifs_data.seekg(HeaderOffset, ios::beg);
+  }
+
+  bool swap_bytes = (ByteOrder != get_host_byte_order() && ElementSize > 1);
+  bool read_ok = read_ENVI_run(ifs_data, DataType, swap_bytes, NElements,
+                               NativeDataType, Data);
+  if (not read_ok)
+  {
+    cout << "read_ENVI_binary_data: the file " << filename
+         << " is shorter than the header says it should be!" << endl;
+  }
+  ifs_data.close();
+  return read_ok;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+// Reads a rectangular window of a band interleaved binary raster with
+// FullNCols columns, one seek and one run per row of the window.
+// If the window spans whole rows it is contiguous on disk and is read
+// as a single run.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+template<class T>
+bool read_ENVI_binary_window_template(string filename, int DataType, int ByteOrder,
+                                      long HeaderOffset, int FullNCols,
+                                      int row_start, int col_start, int n_rows, int n_cols,
+                                      int NativeDataType, T* Data)
+{
+  int ElementSize = get_ENVI_data_type_size(DataType);
+  if (ElementSize == 0)
+  {
+    cout << "read_ENVI_binary_data: unsupported ENVI data type " << DataType << endl;
+    return false;
+  }
+
+  ifstream ifs_data(filename.c_str(), ios::in | ios::binary);
+  if( ifs_data.fail() )
+  {
+    cout << "\nERROR: the data file \"" << filename
+         << "\" doesn't exist" << endl;
+    return false;
+  }
+
+  bool swap_bytes = (ByteOrder != get_host_byte_order() && ElementSize > 1);
+  bool read_ok = true;
+  if (col_start == 0 && n_cols == FullNCols)
+  {
+    // whole rows: the window is contiguous on disk
+    ifs_data.seekg(HeaderOffset+long(row_start)*long(FullNCols)*ElementSize, ios::beg);
+    read_ok = read_ENVI_run(ifs_data, DataType, swap_bytes, long(n_rows)*long(n_cols),
+                            NativeDataType, Data);
+  }
+  else
+  {
+    for (int row = 0; row<n_rows && read_ok; row++)
+    {
+      long offset = HeaderOffset
+                     +(long(row_start+row)*long(FullNCols)+long(col_start))*ElementSize;
+      ifs_data.seekg(offset, ios::beg);
+      read_ok = read_ENVI_run(ifs_data, DataType, swap_bytes, long(n_cols),
+                              NativeDataType, Data+long(row)*long(n_cols));
+    }
+  }
+  if (not read_ok)
+  {
+    cout << "read_ENVI_binary_data: the file " << filename
+         << " is shorter than the header says it should be!" << endl;
+  }
+  ifs_data.close();
+  return read_ok;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+// Reads NElements values of an ENVI data type from a binary raster file
+// directly into contiguous float or int storage (for example &RasterData[0][0]).
+// ByteOrder is the ENVI byte order code of the file (0 = little endian,
+// 1 = big endian) and HeaderOffset is the number of bytes to skip at the
+// start of the file. Returns false if the data cannot be read.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+bool read_ENVI_binary_data(string filename, int DataType, int ByteOrder,
+                           long HeaderOffset, long NElements, float* Data)
+{
+  return read_ENVI_binary_data_template(filename, DataType, ByteOrder, HeaderOffset,
+                                        NElements, 4, Data);
+}
+
+bool read_ENVI_binary_data(string filename, int DataType, int ByteOrder,
+                           long HeaderOffset, long NElements, int* Data)
+{
+  return read_ENVI_binary_data_template(filename, DataType, ByteOrder, HeaderOffset,
+                                        NElements, 3, Data);
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+// Reads the window of n_rows by n_cols starting at (row_start, col_start)
+// from a band interleaved binary raster that has FullNCols columns.
+// The window is written row by row into contiguous storage, so only the
+// region of interest is ever read or held in memory.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+bool read_ENVI_binary_window(string filename, int DataType, int ByteOrder,
+                             long HeaderOffset, int FullNCols,
+                             int row_start, int col_start, int n_rows, int n_cols,
+                             float* Data)
+{
+  return read_ENVI_binary_window_template(filename, DataType, ByteOrder, HeaderOffset,
+                                          FullNCols, row_start, col_start, n_rows, n_cols,
+                                          4, Data);
+}
+
+bool read_ENVI_binary_window(string filename, int DataType, int ByteOrder,
+                             long HeaderOffset, int FullNCols,
+                             int row_start, int col_start, int n_rows, int n_cols,
+                             int* Data)
+{
+  return read_ENVI_binary_window_template(filename, DataType, ByteOrder, HeaderOffset,
+                                          FullNCols, row_start, col_start, n_rows, n_cols,
+                                          3, Data);
+}
+
+bool write_ENVI_binary_window(string filename, int FullNCols,
+                              int row_start, int col_start, int n_rows, int n_cols,
+                              float* Data)
+{
+  fstream fs_data(filename.c_str(), ios::in | ios::out | ios::binary);
+  if( fs_data.fail() )
+  {
+    cout << "\nERROR: unable to write to " << filename << endl;
+    return false;
+  }
+  for (int row = 0; row<n_rows; row++)
+  {
+    long offset = (long(row_start+row)*long(FullNCols)+long(col_start))*long(sizeof(float));
+    fs_data.seekp(offset, ios::beg);
+    fs_data.write(reinterpret_cast<char *>(Data+long(row)*long(n_cols)),
+                  long(n_cols)*long(sizeof(float)));
+  }
+  bool write_ok = not fs_data.fail();
+  fs_data.close();
+  return write_ok;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--==
 // Given a filestream object, read the file into memory and return
 // it as a string. From: http://www.cplusplus.com/forum/general/58945/
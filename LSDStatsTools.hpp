@@ -561,7 +561,57 @@ void split_delimited_string(const string& s, char c, vector<string>& v);
 
 // THis gets the size of a file
 // SMM 16/10/2015
-int get_file_size(string filename);
+long get_file_size(string filename);
+
+// Returns the number of bytes per element of an ENVI data type code.
+// Returns 0 for unsupported codes.
+int get_ENVI_data_type_size(int DataType);
+
+// Guesses the data type of an ENVI raster with an unsupported type code from
+// the size of its data file. IntegerData picks int32/int64 over float32/float64.
+int guess_ENVI_data_type(string filename, long HeaderOffset, int NRows, int NCols,
+                         bool IntegerData);
+
+// Returns the ENVI byte order code of this machine (0 = little endian, 1 = big endian)
+int get_host_byte_order();
+
+// A 64 bit FNV-1a style hash of NBytes bytes of data, read eight bytes at a
+// time. Chain calls by passing the previous hash as the seed.
+unsigned long long hash_bytes(const char* data, long NBytes,
+                              unsigned long long seed = 14695981039346656037ULL);
+
+// Reverses the bytes of NElements elements of ElementSize bytes, in place
+void swap_byte_order(char* buffer, int ElementSize, long NElements);
+
+// Reads NElements values of ENVI data type DataType and byte order ByteOrder
+// from a binary raster file straight into contiguous storage, skipping
+// HeaderOffset bytes. Data that already matches the destination type is read
+// with a single bulk read; other types are swapped and cast chunk by chunk.
+// Returns false if the data type is unsupported or the file is too short.
+bool read_ENVI_binary_data(string filename, int DataType, int ByteOrder,
+                           long HeaderOffset, long NElements, float* Data);
+bool read_ENVI_binary_data(string filename, int DataType, int ByteOrder,
+                           long HeaderOffset, long NElements, int* Data);
+
+// Reads the n_rows by n_cols window starting at (row_start, col_start) of a
+// band interleaved binary raster that has FullNCols columns, seeking past
+// everything outside the window. Types are handled as in read_ENVI_binary_data.
+bool read_ENVI_binary_window(string filename, int DataType, int ByteOrder,
+                             long HeaderOffset, int FullNCols,
+                             int row_start, int col_start, int n_rows, int n_cols,
+                             float* Data);
+bool read_ENVI_binary_window(string filename, int DataType, int ByteOrder,
+                             long HeaderOffset, int FullNCols,
+                             int row_start, int col_start, int n_rows, int n_cols,
+                             int* Data);
+
+// Writes n_rows by n_cols floats into the window starting at (row_start,
+// col_start) of an existing float binary raster that has FullNCols columns.
+// Other parts of the file are left untouched, so disjoint windows can be
+// written by different threads. Returns false if the file cannot be written.
+bool write_ENVI_binary_window(string filename, int FullNCols,
+                              int row_start, int col_start, int n_rows, int n_cols,
+                              float* Data);
 
 //Takes an integer vector of data and an integer vector of key values and
 //returns a map of the counts of each value tied to its key.
@@ -69,6 +69,7 @@
 #include "../LSDRasterInfo.hpp"
 #include "../LSDSpatialCSVReader.hpp"
 #include "../LSDParameterParser.hpp"
+#include "../LSDAsyncWriter.hpp"
 
 int main (int nNumberofArgs,char *argv[])
 {
@@ -127,6 +128,21 @@ int main (int nNumberofArgs,char *argv[])
   int_default_map["threshold_contributing_pixels"] = 1000;
   int_default_map["connected_components_threshold"] = 100;
   int_default_map["number_of_junctions_dreich"] = 1;
+  int_default_map["fill_tile_size"] = 2000;
+
+  // the number of threads used to write output in the background.
+  // 0 means outputs are written as soon as they are made
+  int_default_map["n_writer_threads"] = 1;
+
+  // the number of threads FFTW splits each Fourier transform between
+  int_default_map["n_fftw_threads"] = 1;
+
+  // the tiles of the tiled wiener filter, the margin filtered around each
+  // tile, and the size of the windows the noise model is fitted to
+  // (0 means the tile plus its margin)
+  int_default_map["wiener_tile_size"] = 1024;
+  int_default_map["wiener_tile_overlap"] = 128;
+  int_default_map["wiener_noise_window"] = 0;
 
   // set default in parameter
   float_default_map["min_slope_for_fill"] = 0.0001;
@@ -139,6 +155,16 @@ int main (int nNumberofArgs,char *argv[])
 
   // set default methods
   bool_default_map["load_filled_raster"] = false;
+  // the improved fill gives a bit-identical filled DEM; it is only faster
+  // when min_slope_for_fill is zero
+  bool_default_map["improved_priority_flood_fill"] = true;
+  bool_default_map["tiled_fill"] = false;
+  bool_default_map["tiled_wiener_filter"] = false;
+  bool_default_map["global_wiener_noise_model"] = true;
+  // reuse the fill and flow info of an earlier run with the same inputs
+  bool_default_map["cache_flow_info"] = true;
+  bool_default_map["sparse_junction_network"] = false;
+  bool_default_map["cache_fftw_wisdom"] = true;
   bool_default_map["print_area_threshold_channels"] = true;
   bool_default_map["print_dreich_channels"] = false;
   bool_default_map["print_pelletier_channels"] = false;
@@ -187,6 +213,10 @@ int main (int nNumberofArgs,char *argv[])
   vector<string> boundary_conditions = LSDPP.get_boundary_conditions();
   string CHeads_file = LSDPP.get_CHeads_file();
 
+  // rasters and csv files are handed to this object, which writes them on
+  // worker threads while the next stage of the computation runs
+  LSDAsyncWriter Writer(this_int_map["n_writer_threads"]);
+
   cout << "Read filename is: " <<  DATA_DIR+DEM_ID << endl;
   cout << "Write filename is: " << OUT_DIR+OUT_ID << endl;
 
@@ -208,15 +238,65 @@ int main (int nNumberofArgs,char *argv[])
     LSDRaster load_fill((OUT_DIR+OUT_ID+"_Fill"), raster_ext);
     filled_topography = load_fill;
   }
-  else
+
+  // If the cache is on, a cached flow info made from the same DEM, fill and
+  // boundary conditions is reused. The cache holds the filled DEM too, so the
+  // unfilled DEM is hashed and both the fill and the flow routing are skipped
+  LSDFlowInfo FlowInfo;
+  bool flow_info_from_cache = false;
+  unsigned long long flow_info_hash = 0;
+  string flow_info_cache_name = OUT_DIR+OUT_ID+"_FlowInfo";
+  if (this_bool_map["cache_flow_info"])
+  {
+    vector<float> fill_parameters;
+    if (this_bool_map["load_filled_raster"])
+    {
+      flow_info_hash = FlowInfo.hash_flow_info_inputs(boundary_conditions, filled_topography,
+                                                      fill_parameters);
+    }
+    else
+    {
+      fill_parameters.push_back(this_float_map["min_slope_for_fill"]);
+      fill_parameters.push_back(this_bool_map["tiled_fill"] ? 1 : 0);
+      fill_parameters.push_back(this_bool_map["tiled_fill"] ? this_int_map["fill_tile_size"] : 0);
+      fill_parameters.push_back(this_bool_map["improved_priority_flood_fill"] ? 1 : 0);
+      flow_info_hash = FlowInfo.hash_flow_info_inputs(boundary_conditions, topography_raster,
+                                                      fill_parameters);
+    }
+    LSDRaster cached_topography;
+    flow_info_from_cache = FlowInfo.load_cached_flow_info(flow_info_cache_name, flow_info_hash,
+                                                          cached_topography);
+    if (flow_info_from_cache)
+    {
+      cout << "Loaded the fill and flow info from the cache " << flow_info_cache_name << endl;
+      if (not this_bool_map["load_filled_raster"])
+      {
+        filled_topography = cached_topography;
+      }
+    }
+  }
+
+  if (not this_bool_map["load_filled_raster"])
   {
-    cout << "Filling topography." << endl;
-    filled_topography = topography_raster.fill(this_float_map["min_slope_for_fill"]);
+    if (not flow_info_from_cache)
+    {
+      cout << "Filling topography." << endl;
+      if (this_bool_map["tiled_fill"])
+      {
+        filled_topography = topography_raster.fill_tiled(this_float_map["min_slope_for_fill"],
+                                                         this_int_map["fill_tile_size"]);
+      }
+      else
+      {
+        filled_topography = topography_raster.fill(this_float_map["min_slope_for_fill"],
+                                                   this_bool_map["improved_priority_flood_fill"]);
+      }
+    }
 
     if (this_bool_map["print_fill_raster"])
     {
       string filled_raster_name = OUT_DIR+OUT_ID+"_Fill";
-      filled_topography.write_raster(filled_raster_name,raster_ext);
+      Writer.write_raster(filled_topography,filled_raster_name,raster_ext);
     }
   }
 
@@ -229,11 +309,32 @@ int main (int nNumberofArgs,char *argv[])
     LSDRaster hs_raster = topography_raster.hillshade(hs_altitude,hs_azimuth,hs_z_factor);
 
     string hs_fname = OUT_DIR+OUT_ID+"_hs";
-    hs_raster.write_raster(hs_fname,raster_ext);
+    Writer.write_raster(hs_raster,hs_fname,raster_ext);
   }
 
-  // get the flow info object
-  LSDFlowInfo FlowInfo(boundary_conditions,filled_topography);
+  // get the flow info object, unless it came from the cache
+  if (not flow_info_from_cache)
+  {
+    LSDFlowInfo RoutedFlowInfo(boundary_conditions,filled_topography);
+    FlowInfo = RoutedFlowInfo;
+    if (this_bool_map["cache_flow_info"])
+    {
+      FlowInfo.cache_flow_info(flow_info_cache_name, flow_info_hash, filled_topography);
+    }
+  }
+
+  // the D8 drainage area, the contributing pixels and the flow distance
+  // all come from one pass of the accumulator engine
+  LSDRaster D8DrainageArea;
+  LSDIndexRaster ContributingPixels;
+  LSDRaster DistanceFromOutlet;
+  if (this_bool_map["print_d8_drainage_area_raster"] ||
+      this_bool_map["print_area_threshold_channels"] ||
+      this_bool_map["print_dreich_channels"])
+  {
+    FlowInfo.get_area_pixels_and_flow_distance(D8DrainageArea, ContributingPixels,
+                                               DistanceFromOutlet);
+  }
 
   //=================================================================
   // Now, if you want, calculate drainage areas
@@ -245,15 +346,14 @@ int main (int nNumberofArgs,char *argv[])
 
     // get some randon points
     //cout << "dinf:" << endl <<  DA1.get_data_element(452,364) << " " << DA1.get_data_element(1452,762) << endl;
-    DA1.write_raster(DA_raster_name,raster_ext);
+    Writer.write_raster(DA1,DA_raster_name,raster_ext);
   }
 
   if (this_bool_map["print_d8_drainage_area_raster"])
   {
     string DA_raster_name = OUT_DIR+OUT_ID+"_d8_area";
-    LSDRaster DA2 = FlowInfo.write_DrainageArea_to_LSDRaster();
-    //cout << "d8:" << endl <<  DA2.get_data_element(452,364) << " " << DA2.get_data_element(1452,762) << endl;
-    DA2.write_raster(DA_raster_name,raster_ext);
+    //cout << "d8:" << endl <<  D8DrainageArea.get_data_element(452,364) << " " << D8DrainageArea.get_data_element(1452,762) << endl;
+    Writer.write_raster(D8DrainageArea,DA_raster_name,raster_ext);
   }
 
   if (this_bool_map["print_QuinnMD_drainage_area_raster"])
@@ -261,7 +361,7 @@ int main (int nNumberofArgs,char *argv[])
     string DA_raster_name = OUT_DIR+OUT_ID+"_QMD_area";
     LSDRaster DA3 = filled_topography.QuinnMDFlow();
     //cout << "Qiunn:" << endl <<  DA3.get_data_element(452,364) << " " << DA3.get_data_element(1452,762) << endl;
-    DA3.write_raster(DA_raster_name,raster_ext);
+    Writer.write_raster(DA3,DA_raster_name,raster_ext);
   }
 
   if (this_bool_map["print_FreemanMD_drainage_area_raster"])
@@ -269,14 +369,14 @@ int main (int nNumberofArgs,char *argv[])
     string DA_raster_name = OUT_DIR+OUT_ID+"_FMD_area";
     LSDRaster DA4 = filled_topography.FreemanMDFlow();
     //cout << "Freeman:" << endl <<  DA4.get_data_element(452,364) << " " << DA4.get_data_element(1452,762) << endl;
-    DA4.write_raster(DA_raster_name,raster_ext);
+    Writer.write_raster(DA4,DA_raster_name,raster_ext);
   }
 
   if (this_bool_map["print_MD_drainage_area_raster"])
   {
     string DA_raster_name = OUT_DIR+OUT_ID+"_MD_area";
     LSDRaster DA5 = filled_topography.M2DFlow();
-    DA5.write_raster(DA_raster_name,raster_ext);
+    Writer.write_raster(DA5,DA_raster_name,raster_ext);
   }
 
   //=================================================================
@@ -290,7 +390,7 @@ int main (int nNumberofArgs,char *argv[])
     cout << "\t Got sources!" << endl;
 
     // now get the junction network
-    LSDJunctionNetwork ChanNetwork(sources, FlowInfo);
+    LSDJunctionNetwork ChanNetwork(sources, FlowInfo, this_bool_map["sparse_junction_network"]);
 
     if( this_bool_map["print_stream_order_raster"])
     {
@@ -298,20 +398,14 @@ int main (int nNumberofArgs,char *argv[])
 
       //write stream order array to a raster
       LSDIndexRaster SOArray = ChanNetwork.StreamOrderArray_to_LSDIndexRaster();
-      SOArray.write_raster(SO_raster_name,raster_ext);
+      Writer.write_raster(SOArray,SO_raster_name,raster_ext);
     }
 
     if( this_bool_map["print_channels_to_csv"])
     {
       string channel_csv_name = OUT_DIR+OUT_ID+"_FromCHF_CN";
-      ChanNetwork.PrintChannelNetworkToCSV(FlowInfo, channel_csv_name);
-
-      if ( this_bool_map["convert_csv_to_geojson"])
-      {
-        string gjson_name = OUT_DIR+OUT_ID+"_FromCHF_CN.geojson";
-        LSDSpatialCSVReader thiscsv(OUT_DIR+OUT_ID+"_FromCHF_CN.csv");
-        thiscsv.print_data_to_geojson(gjson_name);
-      }
+      Writer.write_channel_network_csv(ChanNetwork, FlowInfo, channel_csv_name,
+                                       this_bool_map["convert_csv_to_geojson"]);
     }
   }
 
@@ -325,33 +419,27 @@ int main (int nNumberofArgs,char *argv[])
     cout << "I am calculating channels using an area threshold." << endl;
     cout << "Only use this if you aren't that bothered about where the channel heads actually are!" << endl;
 
-    // get some relevant rasters
-    LSDRaster DistanceFromOutlet = FlowInfo.distance_from_outlet();
-    LSDIndexRaster ContributingPixels = FlowInfo.write_NContributingNodes_to_LSDIndexRaster();
-
     //get the sources: note: this is only to select basins!
     vector<int> sources;
     sources = FlowInfo.get_sources_index_threshold(ContributingPixels, this_int_map["threshold_contributing_pixels"]);
 
     // now get the junction network
-    LSDJunctionNetwork ChanNetwork(sources, FlowInfo);
+    LSDJunctionNetwork ChanNetwork(sources, FlowInfo, this_bool_map["sparse_junction_network"]);
 
 
     // Print sources
     if( this_bool_map["print_sources_to_csv"])
     {
       string sources_csv_name = OUT_DIR+OUT_ID+"_ATsources.csv";
-
-      //write channel_heads to a csv file
-      FlowInfo.print_vector_of_nodeindices_to_csv_file_with_latlong(sources, sources_csv_name);
-
+      string gjson_name = "NULL";
       if ( this_bool_map["convert_csv_to_geojson"])
       {
-        string gjson_name = OUT_DIR+OUT_ID+"_ATsources.geojson";
-        LSDSpatialCSVReader thiscsv(sources_csv_name);
-        thiscsv.print_data_to_geojson(gjson_name);
+        gjson_name = OUT_DIR+OUT_ID+"_ATsources.geojson";
       }
 
+      //write channel_heads to a csv file
+      Writer.write_nodeindices_csv(FlowInfo, sources, sources_csv_name, gjson_name);
+
 
     }
 
@@ -361,7 +449,7 @@ int main (int nNumberofArgs,char *argv[])
 
       //write channel heads to a raster
       LSDIndexRaster Channel_heads_raster = FlowInfo.write_NodeIndexVector_to_LSDIndexRaster(sources);
-      Channel_heads_raster.write_raster(sources_raster_name,raster_ext);
+      Writer.write_raster(Channel_heads_raster,sources_raster_name,raster_ext);
     }
 
     if( this_bool_map["print_stream_order_raster"])
@@ -370,24 +458,27 @@ int main (int nNumberofArgs,char *argv[])
 
       //write stream order array to a raster
       LSDIndexRaster SOArray = ChanNetwork.StreamOrderArray_to_LSDIndexRaster();
-      SOArray.write_raster(SO_raster_name,raster_ext);
+      Writer.write_raster(SOArray,SO_raster_name,raster_ext);
     }
 
     if( this_bool_map["print_channels_to_csv"])
     {
       string channel_csv_name = OUT_DIR+OUT_ID+"_AT_CN";
-      ChanNetwork.PrintChannelNetworkToCSV(FlowInfo, channel_csv_name);
-
-      if ( this_bool_map["convert_csv_to_geojson"])
-      {
-        string gjson_name = OUT_DIR+OUT_ID+"_AT_CN.geojson";
-        LSDSpatialCSVReader thiscsv(OUT_DIR+OUT_ID+"_AT_CN.csv");
-        thiscsv.print_data_to_geojson(gjson_name);
-      }
+      Writer.write_channel_network_csv(ChanNetwork, FlowInfo, channel_csv_name,
+                                       this_bool_map["convert_csv_to_geojson"]);
 
     }
   }
 
+  // FFTW plans are expensive to measure. If the wisdom cache is on, plans
+  // from an earlier run on the same grid sizes are loaded here and saved at the end
+  string fftw_wisdom_name = OUT_DIR+OUT_ID;
+  LSDRasterSpectral::set_fftw_threads(this_int_map["n_fftw_threads"]);
+  if (this_bool_map["cache_fftw_wisdom"])
+  {
+    LSDRasterSpectral::import_fftw_wisdom(fftw_wisdom_name);
+  }
+
   //===============================================================
   // DREICH
   //===============================================================
@@ -395,15 +486,28 @@ int main (int nNumberofArgs,char *argv[])
   {
     cout << "I am calculating channels using the dreich algorighm (DOI: 10.1002/2013WR015167)." << endl;
 
-    // get some relevant rasters
-    LSDRaster DistanceFromOutlet = FlowInfo.distance_from_outlet();
-
-    LSDRasterSpectral raster(topography_raster);
     string QQ_fname = OUT_DIR+OUT_ID+"__qq.txt";
 
     cout << "I am am getting the connected components using a weiner QQ filter." << endl;
-    LSDIndexRaster connected_components = raster.IsolateChannelsWienerQQ(this_float_map["pruning_drainage_area"],
+    LSDIndexRaster connected_components;
+    if (this_bool_map["tiled_wiener_filter"])
+    {
+      // the DEM is streamed from disk tile by tile
+      LSDRasterSpectral topo_wiener;
+      topo_wiener.read_raster_and_fftw2D_wiener_tiled((DATA_DIR+DEM_ID), raster_ext,
+                                     this_int_map["wiener_tile_size"],
+                                     this_int_map["wiener_tile_overlap"],
+                                     this_bool_map["global_wiener_noise_model"],
+                                     this_int_map["wiener_noise_window"]);
+      connected_components = topo_wiener.IsolateChannelsWienerQQ(topo_wiener, this_float_map["pruning_drainage_area"],
+                                                       this_float_map["surface_fitting_radius"], QQ_fname);
+    }
+    else
+    {
+      LSDRasterSpectral raster(topography_raster);
+      connected_components = raster.IsolateChannelsWienerQQ(this_float_map["pruning_drainage_area"],
                                                        this_float_map["surface_fitting_radius"], QQ_fname);
+    }
 
     cout << "Filtering by connected components." << endl;
     LSDIndexRaster connected_components_filtered = connected_components.filter_by_connected_components(this_int_map["connected_components_threshold"]);
@@ -413,7 +517,7 @@ int main (int nNumberofArgs,char *argv[])
     LSDIndexRaster skeleton_raster = connected_components_filtered.thin_to_skeleton();
     cout << "finding end points" << endl;
     LSDIndexRaster Ends = skeleton_raster.find_end_points();
-    Ends.remove_downstream_endpoints(CC_raster, raster);
+    Ends.remove_downstream_endpoints(CC_raster, topography_raster);
 
 
     cout << "Starting channel head processing" << endl;
@@ -424,16 +528,17 @@ int main (int nNumberofArgs,char *argv[])
     cout << "processed all end points" << endl;
 
     // we need a temp junction network to search for single pixel channels
-    LSDJunctionNetwork tmpJunctionNetwork(tmpsources, FlowInfo);
-    LSDIndexRaster tmpStreamNetwork = tmpJunctionNetwork.StreamOrderArray_to_LSDIndexRaster();
+    LSDJunctionNetwork JunctionNetwork(tmpsources, FlowInfo, this_bool_map["sparse_junction_network"]);
+    LSDIndexRaster tmpStreamNetwork = JunctionNetwork.StreamOrderArray_to_LSDIndexRaster();
 
     cout << "removing single px channels" << endl;
     vector<int> FinalSources = FlowInfo.RemoveSinglePxChannels(tmpStreamNetwork, tmpsources);
 
     // using these sources as the input to run the DrEICH algorithm  - FJC
 
-    //Generate a channel netowrk from the sources
-    LSDJunctionNetwork JunctionNetwork(FinalSources, FlowInfo);
+    //Generate a channel netowrk from the sources. Only a few sources have been
+    // removed so the temp network is updated rather than built again.
+    JunctionNetwork.update_sources(FinalSources, FlowInfo);
     LSDIndexRaster JIArray = JunctionNetwork.JunctionIndexArray_to_LSDIndexRaster();
 
     LSDIndexRaster StreamNetwork = JunctionNetwork.StreamOrderArray_to_LSDIndexRaster();
@@ -447,23 +552,21 @@ int main (int nNumberofArgs,char *argv[])
     LSDIndexRaster Channel_heads_raster_temp = FlowInfo.write_NodeIndexVector_to_LSDIndexRaster(ChannelHeadNodes_temp);
 
     //create a channel network based on these channel heads
-    LSDJunctionNetwork NewChanNetwork(ChannelHeadNodes_temp, FlowInfo);
+    LSDJunctionNetwork NewChanNetwork(ChannelHeadNodes_temp, FlowInfo, this_bool_map["sparse_junction_network"]);
 
 
     // Print sources
     if( this_bool_map["print_sources_to_csv"])
     {
       string sources_csv_name = OUT_DIR+OUT_ID+"_Dsources.csv";
-
-      //write channel_heads to a csv file
-      FlowInfo.print_vector_of_nodeindices_to_csv_file_with_latlong(ChannelHeadNodes_temp, sources_csv_name);
-
+      string gjson_name = "NULL";
       if ( this_bool_map["convert_csv_to_geojson"])
       {
-        string gjson_name = OUT_DIR+OUT_ID+"_Dsources.geojson";
-        LSDSpatialCSVReader thiscsv(OUT_DIR+OUT_ID+"_Dsources.csv");
-        thiscsv.print_data_to_geojson(gjson_name);
+        gjson_name = OUT_DIR+OUT_ID+"_Dsources.geojson";
       }
+
+      //write channel_heads to a csv file
+      Writer.write_nodeindices_csv(FlowInfo, ChannelHeadNodes_temp, sources_csv_name, gjson_name);
     }
 
     if( this_bool_map["print_sources_to_raster"])
@@ -472,7 +575,7 @@ int main (int nNumberofArgs,char *argv[])
 
       //write channel heads to a raster
       LSDIndexRaster Channel_heads_raster = FlowInfo.write_NodeIndexVector_to_LSDIndexRaster(ChannelHeadNodes_temp);
-      Channel_heads_raster.write_raster(sources_raster_name,raster_ext);
+      Writer.write_raster(Channel_heads_raster,sources_raster_name,raster_ext);
     }
 
     if( this_bool_map["print_stream_order_raster"])
@@ -481,20 +584,14 @@ int main (int nNumberofArgs,char *argv[])
 
       //write stream order array to a raster
       LSDIndexRaster SOArray = NewChanNetwork.StreamOrderArray_to_LSDIndexRaster();
-      SOArray.write_raster(SO_raster_name,raster_ext);
+      Writer.write_raster(SOArray,SO_raster_name,raster_ext);
     }
 
     if( this_bool_map["print_channels_to_csv"])
     {
       string channel_csv_name = OUT_DIR+OUT_ID+"_D_CN";
-      NewChanNetwork.PrintChannelNetworkToCSV(FlowInfo, channel_csv_name);
-
-      if ( this_bool_map["convert_csv_to_geojson"])
-      {
-        string gjson_name = OUT_DIR+OUT_ID+"_D_CN.geojson";
-        LSDSpatialCSVReader thiscsv(OUT_DIR+OUT_ID+"_D_CN.csv");
-        thiscsv.print_data_to_geojson(gjson_name);
-      }
+      Writer.write_channel_network_csv(NewChanNetwork, FlowInfo, channel_csv_name,
+                                       this_bool_map["convert_csv_to_geojson"]);
 
     }
 
@@ -511,28 +608,73 @@ int main (int nNumberofArgs,char *argv[])
     cout << "On a 3 Gb vagrant box a 100 Mb DEM is likeley to crash the machine." << endl;
     cout << "If you have this problem try reducing DEM resolution (3-5 m is okay, see Grieve et al 2016 ESURF)" << endl;
     cout << "or tile your DEM and run this multiple times. Or get a linux workstation." << endl << endl;
-    LSDRasterSpectral SpectralRaster(topography_raster);
 
     cout << "I am running a wiener filter" << endl;
-    LSDRaster topo_test_wiener = SpectralRaster.fftw2D_wiener();
+    LSDRaster topo_test_wiener;
+    if (this_bool_map["tiled_wiener_filter"])
+    {
+      // the DEM is streamed from disk tile by tile
+      LSDRasterSpectral SpectralRaster;
+      SpectralRaster.read_raster_and_fftw2D_wiener_tiled((DATA_DIR+DEM_ID), raster_ext,
+                                     this_int_map["wiener_tile_size"],
+                                     this_int_map["wiener_tile_overlap"],
+                                     this_bool_map["global_wiener_noise_model"],
+                                     this_int_map["wiener_noise_window"]);
+      topo_test_wiener = SpectralRaster;
+    }
+    else
+    {
+      LSDRasterSpectral SpectralRaster(topography_raster);
+      topo_test_wiener = SpectralRaster.fftw2D_wiener();
+    }
     int border_width = 100;
     topo_test_wiener = topo_test_wiener.border_with_nodata(border_width);
 
-    cout << "I am going to fill and calculate flow info based on the filtered DEM." << endl;
-    LSDRaster filter_fill = topo_test_wiener.fill(this_float_map["min_slope_for_fill"]);
-    LSDFlowInfo FilterFlowInfo(boundary_conditions,filter_fill);
+    // as above, a matching cache skips both the fill and the flow routing
+    LSDFlowInfo FilterFlowInfo;
+    bool filter_flow_info_from_cache = false;
+    unsigned long long filter_flow_info_hash = 0;
+    string filter_flow_info_cache_name = OUT_DIR+OUT_ID+"_FilterFlowInfo";
+    if (this_bool_map["cache_flow_info"])
+    {
+      vector<float> filter_fill_parameters;
+      filter_fill_parameters.push_back(this_float_map["min_slope_for_fill"]);
+      filter_fill_parameters.push_back(this_bool_map["improved_priority_flood_fill"] ? 1 : 0);
+      filter_flow_info_hash = FilterFlowInfo.hash_flow_info_inputs(boundary_conditions,
+                                                  topo_test_wiener, filter_fill_parameters);
+      LSDRaster cached_filter_fill;
+      filter_flow_info_from_cache = FilterFlowInfo.load_cached_flow_info(filter_flow_info_cache_name,
+                                                  filter_flow_info_hash, cached_filter_fill);
+    }
+    if (filter_flow_info_from_cache)
+    {
+      cout << "Loaded the filtered fill and flow info from the cache "
+           << filter_flow_info_cache_name << endl;
+    }
+    else
+    {
+      cout << "I am going to fill and calculate flow info based on the filtered DEM." << endl;
+      LSDRaster filter_fill = topo_test_wiener.fill(this_float_map["min_slope_for_fill"],
+                                                   this_bool_map["improved_priority_flood_fill"]);
+      LSDFlowInfo RoutedFilterFlowInfo(boundary_conditions,filter_fill);
+      FilterFlowInfo = RoutedFilterFlowInfo;
+      if (this_bool_map["cache_flow_info"])
+      {
+        FilterFlowInfo.cache_flow_info(filter_flow_info_cache_name, filter_flow_info_hash,
+                                       filter_fill);
+      }
+    }
 
     // get some relevant rasters
-    LSDRaster DistanceFromOutlet = FilterFlowInfo.distance_from_outlet();
-    LSDIndexRaster ContributingPixels = FilterFlowInfo.write_NContributingNodes_to_LSDIndexRaster();
+    LSDIndexRaster FilterContributingPixels = FilterFlowInfo.write_NContributingNodes_to_LSDIndexRaster();
 
     // get an initial sources network
     vector<int> sources;
     int pelletier_threshold = 250;
-    sources = FilterFlowInfo.get_sources_index_threshold(ContributingPixels, pelletier_threshold);
+    sources = FilterFlowInfo.get_sources_index_threshold(FilterContributingPixels, pelletier_threshold);
 
     // now get an initial junction network. This will be refined in later steps.
-    LSDJunctionNetwork ChanNetwork(sources, FilterFlowInfo);
+    LSDJunctionNetwork ChanNetwork(sources, FilterFlowInfo, this_bool_map["sparse_junction_network"]);
 
     float surface_fitting_window_radius = this_float_map["surface_fitting_radius"];
     float surface_fitting_window_radius_LW = 25;
@@ -568,13 +710,13 @@ int main (int nNumberofArgs,char *argv[])
     // Now filter out false positives along channel according to a threshold
     // catchment area
     cout << "\tFiltering out false positives..." << endl;
-    LSDJunctionNetwork ChanNetworkNew(ChannelHeadNodes, FilterFlowInfo);
+    LSDJunctionNetwork NewChanNetwork(ChannelHeadNodes, FilterFlowInfo, this_bool_map["sparse_junction_network"]);
     vector<int> ChannelHeadNodesFilt;
     int count = 0;
     for(int i = 0; i<int(ChannelHeadNodes.size()); ++i)
     {
-      int upstream_junc = ChanNetworkNew.get_Junction_of_Node(ChannelHeadNodes[i], FilterFlowInfo);
-      int test_node = ChanNetworkNew.get_penultimate_node_from_stream_link(upstream_junc, FilterFlowInfo);
+      int upstream_junc = NewChanNetwork.get_Junction_of_Node(ChannelHeadNodes[i], FilterFlowInfo);
+      int test_node = NewChanNetwork.get_penultimate_node_from_stream_link(upstream_junc, FilterFlowInfo);
       float catchment_area = float(FilterFlowInfo.retrieve_contributing_pixels_of_node(test_node)) * FilterFlowInfo.get_DataResolution() * FilterFlowInfo.get_DataResolution();
       if (catchment_area >= this_float_map["minimum_drainage_area"])
       {
@@ -589,26 +731,25 @@ int main (int nNumberofArgs,char *argv[])
 
     vector<int> FinalSources = ChannelHeadNodesFilt;
 
-    //create a channel network based on these channel heads
+    //create a channel network based on these channel heads, removing the
+    // false positives from the network used to find them
     cout << "Making a channel network from the filtered channel heads." << endl;
-    LSDJunctionNetwork NewChanNetwork(ChannelHeadNodesFilt, FilterFlowInfo);
+    NewChanNetwork.update_sources(ChannelHeadNodesFilt, FilterFlowInfo);
     cout << "Got the network!" << endl;
 
     // Print sources
     if( this_bool_map["print_sources_to_csv"])
     {
       string sources_csv_name = OUT_DIR+OUT_ID+"_Psources.csv";
-
-      //write channel_heads to a csv file
-      FilterFlowInfo.print_vector_of_nodeindices_to_csv_file_with_latlong(FinalSources, sources_csv_name);
-
+      string gjson_name = "NULL";
       if ( this_bool_map["convert_csv_to_geojson"])
       {
-        string gjson_name = OUT_DIR+OUT_ID+"_Psources.geojson";
-        LSDSpatialCSVReader thiscsv(OUT_DIR+OUT_ID+"_Psources.csv");
-        thiscsv.print_data_to_geojson(gjson_name);
+        gjson_name = OUT_DIR+OUT_ID+"_Psources.geojson";
       }
 
+      //write channel_heads to a csv file
+      Writer.write_nodeindices_csv(FilterFlowInfo, FinalSources, sources_csv_name, gjson_name);
+
     }
 
     if( this_bool_map["print_sources_to_raster"])
@@ -617,7 +758,7 @@ int main (int nNumberofArgs,char *argv[])
 
       //write channel heads to a raster
       LSDIndexRaster Channel_heads_raster = FilterFlowInfo.write_NodeIndexVector_to_LSDIndexRaster(FinalSources);
-      Channel_heads_raster.write_raster(sources_raster_name,raster_ext);
+      Writer.write_raster(Channel_heads_raster,sources_raster_name,raster_ext);
     }
 
     if( this_bool_map["print_stream_order_raster"])
@@ -626,23 +767,20 @@ int main (int nNumberofArgs,char *argv[])
 
       //write stream order array to a raster
       LSDIndexRaster SOArray = NewChanNetwork.StreamOrderArray_to_LSDIndexRaster();
-      SOArray.write_raster(SO_raster_name,raster_ext);
+      Writer.write_raster(SOArray,SO_raster_name,raster_ext);
     }
 
     if( this_bool_map["print_channels_to_csv"])
     {
       string channel_csv_name = OUT_DIR+OUT_ID+"_P_CN";
-      NewChanNetwork.PrintChannelNetworkToCSV(FilterFlowInfo, channel_csv_name);
-
-      if ( this_bool_map["convert_csv_to_geojson"])
-      {
-        string gjson_name = OUT_DIR+OUT_ID+"_P_CN.geojson";
-        LSDSpatialCSVReader thiscsv(OUT_DIR+OUT_ID+"_P_CN.csv");
-        thiscsv.print_data_to_geojson(gjson_name);
-      }
+      Writer.write_channel_network_csv(NewChanNetwork, FilterFlowInfo, channel_csv_name,
+                                       this_bool_map["convert_csv_to_geojson"]);
 
     }
 
+    // the queued csv files use FilterFlowInfo, so they need to be written
+    // before it goes out of scope
+    Writer.flush();
   }
 
   //===============================================================
@@ -656,16 +794,31 @@ int main (int nNumberofArgs,char *argv[])
     cout << "and combines elements of the Pelletier and Passalacqua et al  methods: " << endl;
     cout << " doi:10.1029/2012WR012452 and doi:10.1029/2009JF001254" << endl;
 
-    // initiate the spectral raster
-    LSDRasterSpectral Spec_raster(topography_raster);
-
     string QQ_fname = OUT_DIR+OUT_ID+"__qq.txt";
 
     cout << "I am am getting the connected components using a weiner QQ filter." << endl;
     cout << "Area threshold is: " << this_float_map["pruning_drainage_area"] << " window is: " <<  this_float_map["surface_fitting_radius"] << endl;
 
-    LSDIndexRaster connected_components = Spec_raster.IsolateChannelsWienerQQ(this_float_map["pruning_drainage_area"],
+    LSDIndexRaster connected_components;
+    if (this_bool_map["tiled_wiener_filter"])
+    {
+      // the DEM is streamed from disk tile by tile
+      LSDRasterSpectral topo_wiener;
+      topo_wiener.read_raster_and_fftw2D_wiener_tiled((DATA_DIR+DEM_ID), raster_ext,
+                                     this_int_map["wiener_tile_size"],
+                                     this_int_map["wiener_tile_overlap"],
+                                     this_bool_map["global_wiener_noise_model"],
+                                     this_int_map["wiener_noise_window"]);
+      connected_components = topo_wiener.IsolateChannelsWienerQQ(topo_wiener, this_float_map["pruning_drainage_area"],
+                                                       this_float_map["surface_fitting_radius"], QQ_fname);
+    }
+    else
+    {
+      // initiate the spectral raster
+      LSDRasterSpectral Spec_raster(topography_raster);
+      connected_components = Spec_raster.IsolateChannelsWienerQQ(this_float_map["pruning_drainage_area"],
                                                        this_float_map["surface_fitting_radius"], QQ_fname);
+    }
 
     cout << "I am filtering by connected components" << endl;
     LSDIndexRaster connected_components_filtered = connected_components.filter_by_connected_components(this_int_map["connected_components_threshold"]);
@@ -676,37 +829,36 @@ int main (int nNumberofArgs,char *argv[])
 
     cout << "I am finding the finding end points" << endl;
     LSDIndexRaster Ends = skeleton_raster.find_end_points();
-    Ends.remove_downstream_endpoints(CC_raster, Spec_raster);
+    Ends.remove_downstream_endpoints(CC_raster, topography_raster);
 
     //this processes the end points to only keep the upper extent of the channel network
     cout << "getting channel heads" << endl;
     vector<int> tmpsources = FlowInfo.ProcessEndPointsToChannelHeads(Ends);
 
     // we need a temp junction network to search for single pixel channels
-    LSDJunctionNetwork tmpJunctionNetwork(tmpsources, FlowInfo);
-    LSDIndexRaster tmpStreamNetwork = tmpJunctionNetwork.StreamOrderArray_to_LSDIndexRaster();
+    LSDJunctionNetwork ChanNetwork(tmpsources, FlowInfo, this_bool_map["sparse_junction_network"]);
+    LSDIndexRaster tmpStreamNetwork = ChanNetwork.StreamOrderArray_to_LSDIndexRaster();
 
     cout << "removing single px channels" << endl;
     vector<int> FinalSources = FlowInfo.RemoveSinglePxChannels(tmpStreamNetwork, tmpsources);
 
-    //Now we have the final channel heads, so we can generate a channel network from them
-    LSDJunctionNetwork ChanNetwork(FinalSources, FlowInfo);
+    //Now we have the final channel heads, so we can generate a channel network
+    // from them by updating the temp network
+    ChanNetwork.update_sources(FinalSources, FlowInfo);
 
     // Print sources
     if( this_bool_map["print_sources_to_csv"])
     {
       string sources_csv_name = OUT_DIR+OUT_ID+"_Wsources.csv";
-
-      //write channel_heads to a csv file
-      FlowInfo.print_vector_of_nodeindices_to_csv_file_with_latlong(FinalSources, sources_csv_name);
-
+      string gjson_name = "NULL";
       if ( this_bool_map["convert_csv_to_geojson"])
       {
-        string gjson_name = OUT_DIR+OUT_ID+"_Wsources.geojson";
-        LSDSpatialCSVReader thiscsv(OUT_DIR+OUT_ID+"_Wsources.csv");
-        thiscsv.print_data_to_geojson(gjson_name);
+        gjson_name = OUT_DIR+OUT_ID+"_Wsources.geojson";
       }
 
+      //write channel_heads to a csv file
+      Writer.write_nodeindices_csv(FlowInfo, FinalSources, sources_csv_name, gjson_name);
+
     }
 
     if( this_bool_map["print_sources_to_raster"])
@@ -715,7 +867,7 @@ int main (int nNumberofArgs,char *argv[])
 
       //write channel heads to a raster
       LSDIndexRaster Channel_heads_raster = FlowInfo.write_NodeIndexVector_to_LSDIndexRaster(FinalSources);
-      Channel_heads_raster.write_raster(sources_raster_name,raster_ext);
+      Writer.write_raster(Channel_heads_raster,sources_raster_name,raster_ext);
     }
 
     if( this_bool_map["print_stream_order_raster"])
@@ -724,20 +876,14 @@ int main (int nNumberofArgs,char *argv[])
 
       //write stream order array to a raster
       LSDIndexRaster SOArray = ChanNetwork.StreamOrderArray_to_LSDIndexRaster();
-      SOArray.write_raster(SO_raster_name,raster_ext);
+      Writer.write_raster(SOArray,SO_raster_name,raster_ext);
     }
 
     if( this_bool_map["print_channels_to_csv"])
     {
       string channel_csv_name = OUT_DIR+OUT_ID+"_W_CN";
-      ChanNetwork.PrintChannelNetworkToCSV(FlowInfo, channel_csv_name);
-
-      if ( this_bool_map["convert_csv_to_geojson"])
-      {
-        string gjson_name = OUT_DIR+OUT_ID+"_W_CN.geojson";
-        LSDSpatialCSVReader thiscsv(OUT_DIR+OUT_ID+"_W_CN.csv");
-        thiscsv.print_data_to_geojson(gjson_name);
-      }
+      Writer.write_channel_network_csv(ChanNetwork, FlowInfo, channel_csv_name,
+                                       this_bool_map["convert_csv_to_geojson"]);
     }
 
   }
@@ -753,11 +899,26 @@ int main (int nNumberofArgs,char *argv[])
   {
 
     cout << "I am running a filter to print to raster" << endl;
-    LSDRasterSpectral SpectralRaster(topography_raster);
-    LSDRaster topo_test_wiener = SpectralRaster.fftw2D_wiener();
+    LSDRaster topo_test_wiener;
+    if (this_bool_map["tiled_wiener_filter"])
+    {
+      // the DEM is streamed from disk tile by tile
+      LSDRasterSpectral SpectralRaster;
+      SpectralRaster.read_raster_and_fftw2D_wiener_tiled((DATA_DIR+DEM_ID), raster_ext,
+                                     this_int_map["wiener_tile_size"],
+                                     this_int_map["wiener_tile_overlap"],
+                                     this_bool_map["global_wiener_noise_model"],
+                                     this_int_map["wiener_noise_window"]);
+      topo_test_wiener = SpectralRaster;
+    }
+    else
+    {
+      LSDRasterSpectral SpectralRaster(topography_raster);
+      topo_test_wiener = SpectralRaster.fftw2D_wiener();
+    }
 
     string wiener_name = OUT_DIR+OUT_ID+"_Wfilt";
-    topo_test_wiener.write_raster(wiener_name,raster_ext);
+    Writer.write_raster(topo_test_wiener,wiener_name,raster_ext);
   }
 
   // Prints the curvature raster if you want it
@@ -779,14 +940,22 @@ int main (int nNumberofArgs,char *argv[])
     string curv_name = OUT_DIR+OUT_ID+"_tan_curv";
     string curv_name_LW = OUT_DIR+OUT_ID+"_tan_curv_LW";
 
-    surface_fitting[6].write_raster(curv_name,raster_ext);
-    surface_fitting_LW[6].write_raster(curv_name_LW,raster_ext);
+    Writer.write_raster(surface_fitting[6],curv_name,raster_ext);
+    Writer.write_raster(surface_fitting_LW[6],curv_name_LW,raster_ext);
   }
 
 
 
 
 
+  if (this_bool_map["cache_fftw_wisdom"])
+  {
+    LSDRasterSpectral::export_fftw_wisdom(fftw_wisdom_name);
+  }
+
+  // wait for the writer threads to finish
+  Writer.flush();
+
   // Done, check how long it took
   clock_t end = clock();
   float elapsed_secs = float(end - begin) / CLOCKS_PER_SEC;
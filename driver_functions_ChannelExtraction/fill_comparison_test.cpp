@@ -0,0 +1,134 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// fill_comparison_test.cpp
+// A test program for use with the Land Surace Dynamics Topo Toolbox
+// This program checks that the improved priority flood fill gives exactly the
+// same filled DEM as the standard fill. It fills random DEMs, rounded so that
+// they are full of exact ties, flats and pits, both with and without a minimum
+// slope, and exits with a failure if any cell differs.
+//
+// Developed by:
+//  Simon M. Mudd
+//  Martin D. Hurst
+//  David T. Milodowski
+//  Stuart W.D. Grieve
+//  Declan A. Valters
+//  Fiona Clubb
+//
+// Copyright (C) 2013 Simon M. Mudd 2013
+//
+// Developer can be contacted by simon.m.mudd _at_ ed.ac.uk
+//
+//    Simon Mudd
+//    University of Edinburgh
+//    School of GeoSciences
+//    Drummond Street
+//    Edinburgh, EH8 9XP
+//    Scotland
+//    United Kingdom
+//
+// This program is free software;
+// you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation;
+// either version 2 of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY;
+// without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU General Public License for more details.
+//
+// You should have received a copy of the
+// GNU General Public License along with this program;
+// if not, write to:
+// Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301
+// USA
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// Usage: fill_comparison_test.exe [number of DEMs]
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+#include "../LSDRaster.hpp"
+using namespace std;
+
+int main (int nNumberofArgs,char *argv[])
+{
+  int NDEMs = 200;
+  if (nNumberofArgs > 1)
+  {
+    NDEMs = atoi(argv[1]);
+  }
+
+  float NoDataValue = -9999;
+  vector<float> MinSlopes;
+  MinSlopes.push_back(0);
+  MinSlopes.push_back(0.0001);
+  MinSlopes.push_back(0.01);
+
+  srand(1);
+  int NFailures = 0;
+  for (int dem = 0; dem<NDEMs; dem++)
+  {
+    // a tilted, bumpy surface rounded to a coarse step so that many cells tie,
+    // with some nodata holes so there are internal edges as well
+    int NRows = 20+rand()%80;
+    int NCols = 20+rand()%80;
+    float DataResolution = (dem%2 == 0) ? 1.0 : 2.5;
+    float step = 0.5*float(1+rand()%4);
+    Array2D<float> Zeta(NRows,NCols);
+    for (int row = 0; row<NRows; row++)
+    {
+      for (int col = 0; col<NCols; col++)
+      {
+        float z = 0.05*row + 2*sin(0.3*col)*cos(0.2*row) + float(rand()%100)/25.0;
+        Zeta[row][col] = step*floor(z/step);
+        if (rand()%200 == 0)
+        {
+          Zeta[row][col] = NoDataValue;
+        }
+      }
+    }
+    LSDRaster DEM(NRows,NCols,0,0,DataResolution,NoDataValue,Zeta);
+
+    for (int s = 0; s<int(MinSlopes.size()); s++)
+    {
+      float MinSlope = MinSlopes[s];
+      LSDRaster Filled = DEM.fill(MinSlope);
+      LSDRaster ImprovedFilled = DEM.fill(MinSlope,true);
+
+      int NDifferent = 0;
+      for (int row = 0; row<NRows; row++)
+      {
+        for (int col = 0; col<NCols; col++)
+        {
+          if (Filled.get_data_element(row,col) != ImprovedFilled.get_data_element(row,col))
+          {
+            NDifferent++;
+          }
+        }
+      }
+      if (NDifferent > 0)
+      {
+        cout << "DEM " << dem << " with a MinSlope of " << MinSlope << ": "
+             << NDifferent << " cells differ" << endl;
+        NFailures++;
+      }
+    }
+  }
+
+  if (NFailures > 0)
+  {
+    cout << "FAILED: " << NFailures << " fills differ" << endl;
+    exit(EXIT_FAILURE);
+  }
+  cout << "The improved fill matches the standard fill on " << NDEMs << " DEMs" << endl;
+  return 0;
+}